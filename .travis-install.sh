@@ -1,10 +1,20 @@
 #!/bin/sh
 set -ev
 
-if [ -n "$VALGRIND_TEST" ]; then
+if [ -n "$VALGRIND_TEST" ] || [ -n "$DECODE_TEST" ]; then
   wget http://ultravideo.cs.tut.fi/ffmpeg-release-32bit-static.tar.xz
   7z x ffmpeg-release-32bit-static.tar.xz
   7z x ffmpeg-release-32bit-static.tar
   chmod +x ./ffmpeg-2.6.3-32bit-static/ffmpeg
   ./ffmpeg-2.6.3-32bit-static/ffmpeg -f lavfi -i "mandelbrot=size=${TEST_DIM}:end_pts=10" -vframes $TEST_FRAMES -pix_fmt yuv420p mandelbrot_${TEST_DIM}.yuv
+
+  if [ -n "$DUPLICATE_FRAMES" ]; then
+    # Repeat every frame to get static content.
+    FRAME_SIZE=$(( ${TEST_DIM%x*} * ${TEST_DIM#*x} * 3 / 2 ))
+    for i in $(seq 0 $((TEST_FRAMES - 1))); do
+      dd if=mandelbrot_${TEST_DIM}.yuv bs=$FRAME_SIZE skip=$i count=1 2>/dev/null
+      dd if=mandelbrot_${TEST_DIM}.yuv bs=$FRAME_SIZE skip=$i count=1 2>/dev/null
+    done > duplicated.yuv
+    mv duplicated.yuv mandelbrot_${TEST_DIM}.yuv
+  fi
 fi
@@ -5,6 +5,12 @@ if [ -n "$VALGRIND_TEST" ]; then
   cd src
   make debug
   valgrind --leak-check=full --error-exitcode=1 ./kvazaar_debug -i ../mandelbrot_${TEST_DIM}.yuv --input-res=${TEST_DIM} -o /dev/null $VALGRIND_TEST
+elif [ -n "$DECODE_TEST" ]; then
+  cd src
+  make cli
+  ./kvazaar -i ../mandelbrot_${TEST_DIM}.yuv --input-res=${TEST_DIM} -o test.hevc --debug=recon.yuv $DECODE_TEST
+  ../ffmpeg-2.6.3-32bit-static/ffmpeg -i test.hevc -f rawvideo -pix_fmt yuv420p decoded.yuv
+  cmp recon.yuv decoded.yuv
 elif [ -n "$EXPECTED_STATUS" ]; then
   cd src
   make cli
@@ -0,0 +1,250 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "analysis.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "encoderstate.h"
+
+/*
+ * The analysis file starts with a header:
+ *   "KVZA", version, width in LCUs, height in LCUs
+ * followed by a record for every picture in coding order:
+ *   frame number, POC, CU_RECORD_SIZE bytes for every SCU in raster scan
+ *
+ * Header fields, picture numbers and motion vectors are little endian.
+ */
+static const char ANALYSIS_MAGIC[4] = { 'K', 'V', 'Z', 'A' };
+#define ANALYSIS_VERSION 1
+#define CU_RECORD_SIZE 24
+
+
+static void put_u32(FILE *file, uint32_t value)
+{
+  const uint8_t bytes[4] = {
+    value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24
+  };
+  fwrite(bytes, 1, 4, file);
+}
+
+static int get_u32(FILE *file, uint32_t *value)
+{
+  uint8_t bytes[4];
+  if (fread(bytes, 1, 4, file) != 4) return 0;
+  *value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+  return 1;
+}
+
+/**
+ * \brief Pack the mode decision of a CU into CU_RECORD_SIZE bytes.
+ */
+static void pack_cu(const cu_info_t *cu, uint8_t *buf)
+{
+  buf[0] = cu->type;
+  buf[1] = cu->depth;
+  buf[2] = cu->part_size;
+  buf[3] = cu->tr_depth;
+  buf[4] = cu->skipped;
+  buf[5] = cu->merged;
+  buf[6] = cu->merge_idx;
+  for (int i = 0; i < 4; ++i) {
+    buf[7 + i] = cu->intra[i].mode;
+  }
+  buf[11] = cu->intra[0].mode_chroma;
+  buf[12] = cu->inter.mv_dir;
+  buf[13] = cu->inter.mv_ref[0];
+  buf[14] = cu->inter.mv_ref[1];
+  buf[15] = 0;
+  for (int i = 0; i < 4; ++i) {
+    const uint16_t mv = cu->inter.mv[i / 2][i % 2];
+    buf[16 + 2 * i] = mv & 0xff;
+    buf[17 + 2 * i] = mv >> 8;
+  }
+}
+
+/**
+ * \brief Unpack the mode decision of a CU from CU_RECORD_SIZE bytes.
+ */
+static void unpack_cu(const uint8_t *buf, cu_info_t *cu)
+{
+  memset(cu, 0, sizeof(*cu));
+  cu->type = buf[0];
+  cu->depth = buf[1];
+  cu->part_size = buf[2];
+  cu->tr_depth = buf[3];
+  cu->skipped = buf[4];
+  cu->merged = buf[5];
+  cu->merge_idx = buf[6];
+  for (int i = 0; i < 4; ++i) {
+    cu->intra[i].mode = buf[7 + i];
+  }
+  cu->intra[0].mode_chroma = buf[11];
+  cu->inter.mv_dir = buf[12];
+  cu->inter.mv_ref[0] = buf[13];
+  cu->inter.mv_ref[1] = buf[14];
+  for (int i = 0; i < 4; ++i) {
+    cu->inter.mv[i / 2][i % 2] = (int16_t)(buf[16 + 2 * i] | (buf[17 + 2 * i] << 8));
+  }
+}
+
+
+/**
+ * \brief Open the analysis files.
+ * \param encoder encoder control
+ * \return 1 on success, 0 on failure
+ */
+int kvz_analysis_init(encoder_control_t * const encoder)
+{
+  const kvz_config * const cfg = encoder->cfg;
+
+  if (cfg->analysis_save) {
+    encoder->analysis_save = fopen(cfg->analysis_save, "wb");
+    if (!encoder->analysis_save) {
+      fprintf(stderr, "Could not open analysis file for writing: %s\n", cfg->analysis_save);
+      return 0;
+    }
+    fwrite(ANALYSIS_MAGIC, 1, 4, encoder->analysis_save);
+    put_u32(encoder->analysis_save, ANALYSIS_VERSION);
+    put_u32(encoder->analysis_save, encoder->in.width_in_lcu);
+    put_u32(encoder->analysis_save, encoder->in.height_in_lcu);
+  }
+
+  if (cfg->analysis_load) {
+    encoder->analysis_load = fopen(cfg->analysis_load, "rb");
+    if (!encoder->analysis_load) {
+      fprintf(stderr, "Could not open analysis file for reading: %s\n", cfg->analysis_load);
+      return 0;
+    }
+    char magic[4];
+    uint32_t version, width_in_lcu, height_in_lcu;
+    if (fread(magic, 1, 4, encoder->analysis_load) != 4 ||
+        memcmp(magic, ANALYSIS_MAGIC, 4) ||
+        !get_u32(encoder->analysis_load, &version) || version != ANALYSIS_VERSION ||
+        !get_u32(encoder->analysis_load, &width_in_lcu) ||
+        !get_u32(encoder->analysis_load, &height_in_lcu))
+    {
+      fprintf(stderr, "Invalid analysis file header.\n");
+      return 0;
+    }
+    if (width_in_lcu != encoder->in.width_in_lcu ||
+        height_in_lcu != encoder->in.height_in_lcu)
+    {
+      fprintf(stderr, "The analysis file is for a different resolution.\n");
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * \brief Close the analysis files.
+ */
+void kvz_analysis_free(encoder_control_t * const encoder)
+{
+  if (encoder->analysis_save) {
+    fclose(encoder->analysis_save);
+    encoder->analysis_save = NULL;
+  }
+  if (encoder->analysis_load) {
+    fclose(encoder->analysis_load);
+    encoder->analysis_load = NULL;
+  }
+}
+
+/**
+ * \brief Write the mode decisions of a picture.
+ * \param state the main encoder state
+ *
+ * Must be called in coding order after the picture has been encoded.
+ */
+void kvz_analysis_save_frame(const encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const videoframe_t * const frame = state->tile->frame;
+  const int width_in_scu = encoder->in.width_in_lcu << MAX_DEPTH;
+  const int height_in_scu = encoder->in.height_in_lcu << MAX_DEPTH;
+  FILE * const file = encoder->analysis_save;
+
+  put_u32(file, state->global->frame);
+  put_u32(file, (uint32_t)state->global->poc);
+
+  for (int y = 0; y < height_in_scu; ++y) {
+    for (int x = 0; x < width_in_scu; ++x) {
+      uint8_t buf[CU_RECORD_SIZE];
+      pack_cu(kvz_videoframe_get_cu_const(frame, x, y), buf);
+      fwrite(buf, 1, CU_RECORD_SIZE, file);
+    }
+  }
+}
+
+/**
+ * \brief Read the mode decisions of the next picture.
+ * \param state the main encoder state
+ *
+ * Must be called in coding order before the picture is searched. The
+ * decisions are used only if the picture matches the one in the file.
+ */
+void kvz_analysis_load_frame(encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const int num_scu = (encoder->in.width_in_lcu << MAX_DEPTH) *
+                      (encoder->in.height_in_lcu << MAX_DEPTH);
+  FILE * const file = encoder->analysis_load;
+
+  state->global->analysis_loaded = false;
+
+  uint32_t frame, poc;
+  if (!get_u32(file, &frame) || !get_u32(file, &poc)) {
+    return;
+  }
+
+  for (int i = 0; i < num_scu; ++i) {
+    uint8_t buf[CU_RECORD_SIZE];
+    if (fread(buf, 1, CU_RECORD_SIZE, file) != CU_RECORD_SIZE) {
+      return;
+    }
+    unpack_cu(buf, &state->global->analysis[i]);
+  }
+
+  state->global->analysis_loaded =
+    frame == state->global->frame && (int32_t)poc == state->global->poc;
+}
+
+/**
+ * \brief Get the loaded mode decision of a CU.
+ * \param state encoder state
+ * \param x_px  x-coordinate of the CU in the tile
+ * \param y_px  y-coordinate of the CU in the tile
+ * \return loaded CU or NULL if there is no analysis for the picture
+ */
+const cu_info_t * kvz_analysis_get_cu(const encoder_state_t * const state,
+                                      int x_px, int y_px)
+{
+  if (!state->global->analysis_loaded) return NULL;
+
+  const int x_scu = (state->tile->lcu_offset_x * LCU_WIDTH + x_px) >> MIN_SIZE;
+  const int y_scu = (state->tile->lcu_offset_y * LCU_WIDTH + y_px) >> MIN_SIZE;
+  const int width_in_scu = state->encoder_control->in.width_in_lcu << MAX_DEPTH;
+  return &state->global->analysis[x_scu + y_scu * width_in_scu];
+}
@@ -0,0 +1,48 @@
+#ifndef ANALYSIS_H_
+#define ANALYSIS_H_
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/*
+ * \file
+ * \brief Saving and loading the mode decisions of the search.
+ */
+
+#include "global.h"
+
+#include "cu.h"
+
+
+// Forward declare because including the header would lead  to a cyclic
+// dependency.
+struct encoder_control_t;
+struct encoder_state_t;
+
+
+int kvz_analysis_init(struct encoder_control_t *encoder);
+void kvz_analysis_free(struct encoder_control_t *encoder);
+
+void kvz_analysis_save_frame(const struct encoder_state_t *state);
+void kvz_analysis_load_frame(struct encoder_state_t *state);
+
+const cu_info_t * kvz_analysis_get_cu(const struct encoder_state_t *state,
+                                      int x_px, int y_px);
+
+#endif // ANALYSIS_H_
@@ -268,6 +268,33 @@ void kvz_bitstream_put(bitstream_t *const stream, const uint32_t data, uint8_t b
   }
 }
 
+/**
+ * \brief Write a byte to bitstream with emulation prevention.
+ *
+ * Same as kvz_bitstream_put(stream, byte, 8) but faster when the stream is
+ * byte-aligned, as it is when writing CABAC data.
+ */
+void kvz_bitstream_put_byte(bitstream_t *const stream, const uint32_t byte)
+{
+  if (stream->cur_bit != 0) {
+    kvz_bitstream_put(stream, byte, 8);
+    return;
+  }
+
+  const uint8_t emulation_prevention_three_byte = 0x03;
+  const uint8_t data = byte & 0xff;
+  if ((stream->zerocount == 2) && (data < 4)) {
+    kvz_bitstream_writebyte(stream, emulation_prevention_three_byte);
+    stream->zerocount = 0;
+  }
+  if (data == 0) {
+    stream->zerocount++;
+  } else {
+    stream->zerocount = 0;
+  }
+  kvz_bitstream_writebyte(stream, data);
+}
+
 /**
  * \brief Add rbsp_trailing_bits syntax element, which aligns the bitstream.
  */
@@ -0,0 +1,228 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "blockhash.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "threads.h"
+
+
+static INLINE uint32_t hash_row(const kvz_pixel *data)
+{
+  uint32_t hash = 0;
+  for (int i = 0; i < BLOCKHASH_SIZE; ++i) {
+    hash = (hash + data[i] + 1) * 0x9E3779B1u;
+  }
+  return hash;
+}
+
+/**
+ * \brief Combine the hashes of the rows of a block.
+ *
+ * \param rows    hash of the first row
+ * \param stride  distance between the hashes of consecutive rows
+ */
+static INLINE uint32_t hash_rows(const uint32_t *rows, int stride)
+{
+  uint32_t hash = 0x811C9DC5u;
+  for (int i = 0; i < BLOCKHASH_SIZE; ++i) {
+    hash ^= rows[i * stride];
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+  }
+  return hash;
+}
+
+static INLINE unsigned bucket_index(uint32_t hash)
+{
+  return (hash * 0x9E3779B1u) >> (32 - BLOCKHASH_BUCKET_BITS);
+}
+
+
+/**
+ * \brief Build the hash table of a picture.
+ *
+ * \param pic  picture to hash, usually the source picture of a reference
+ *
+ * \return The hash table, or NULL on failure.
+ */
+kvz_blockhash_t * kvz_blockhash_alloc(const kvz_picture *pic)
+{
+  const int width = pic->width;
+  const int height = pic->height;
+  if (width < BLOCKHASH_SIZE || height < BLOCKHASH_SIZE) return NULL;
+
+  kvz_blockhash_t *table = MALLOC(kvz_blockhash_t, 1);
+  if (!table) return NULL;
+
+  table->width = width - BLOCKHASH_SIZE + 1;
+  table->height = height - BLOCKHASH_SIZE + 1;
+  const int num_positions = table->width * table->height;
+  table->hashes = MALLOC(uint32_t, num_positions);
+  table->next = MALLOC(int32_t, num_positions);
+  table->buckets = MALLOC(int32_t, 1 << BLOCKHASH_BUCKET_BITS);
+  table->refcount = 1;
+
+  // Hashes of the rows starting at each position and the number of equal
+  // pixels starting from each pixel to the right and downwards, up to
+  // BLOCKHASH_SIZE.
+  uint32_t *row_hashes = MALLOC(uint32_t, table->width * height);
+  uint8_t *hor_runs = MALLOC(uint8_t, width * height);
+  uint8_t *ver_runs = MALLOC(uint8_t, width * height);
+
+  if (!table->hashes || !table->next || !table->buckets ||
+      !row_hashes || !hor_runs || !ver_runs) {
+    FREE_POINTER(row_hashes);
+    FREE_POINTER(hor_runs);
+    FREE_POINTER(ver_runs);
+    kvz_blockhash_free(table);
+    return NULL;
+  }
+
+  for (int y = height - 1; y >= 0; --y) {
+    const kvz_pixel *row = &pic->y[y * pic->stride];
+    for (int x = 0; x < table->width; ++x) {
+      row_hashes[y * table->width + x] = hash_row(&row[x]);
+    }
+    for (int x = width - 1; x >= 0; --x) {
+      const int i = y * width + x;
+      hor_runs[i] = 1;
+      if (x + 1 < width && row[x + 1] == row[x]) {
+        hor_runs[i] = MIN(hor_runs[i + 1] + 1, BLOCKHASH_SIZE);
+      }
+      ver_runs[i] = 1;
+      if (y + 1 < height && row[pic->stride + x] == row[x]) {
+        ver_runs[i] = MIN(ver_runs[i + width] + 1, BLOCKHASH_SIZE);
+      }
+    }
+  }
+
+  for (int i = 0; i < 1 << BLOCKHASH_BUCKET_BITS; ++i) {
+    table->buckets[i] = -1;
+  }
+
+  // Add the positions in reverse raster scan so that the buckets list them
+  // in raster scan.
+  for (int y = table->height - 1; y >= 0; --y) {
+    for (int x = table->width - 1; x >= 0; --x) {
+      const int pos = y * table->width + x;
+      const uint32_t hash = hash_rows(&row_hashes[pos], table->width);
+      table->hashes[pos] = hash;
+      table->next[pos] = -1;
+
+      bool hor_flat = true;
+      bool ver_flat = true;
+      for (int i = 0; i < BLOCKHASH_SIZE; ++i) {
+        hor_flat &= hor_runs[(y + i) * width + x] == BLOCKHASH_SIZE;
+        ver_flat &= ver_runs[y * width + x + i] == BLOCKHASH_SIZE;
+      }
+      if (hor_flat || ver_flat) continue;
+
+      const unsigned bucket = bucket_index(hash);
+      table->next[pos] = table->buckets[bucket];
+      table->buckets[bucket] = pos;
+    }
+  }
+
+  free(row_hashes);
+  free(hor_runs);
+  free(ver_runs);
+
+  return table;
+}
+
+kvz_blockhash_t * kvz_blockhash_copy_ref(kvz_blockhash_t *table)
+{
+  // The caller should have had another reference.
+  assert(table->refcount > 0);
+  ATOMIC_INC(&(table->refcount));
+
+  return table;
+}
+
+void kvz_blockhash_free(kvz_blockhash_t *table)
+{
+  if (!table) return;
+
+  if (ATOMIC_DEC(&(table->refcount)) > 0) return;
+
+  FREE_POINTER(table->hashes);
+  FREE_POINTER(table->next);
+  FREE_POINTER(table->buckets);
+  free(table);
+}
+
+
+/**
+ * \brief Calculate the hash of a block.
+ *
+ * The hash is the same as the one stored in the table for an equal block.
+ *
+ * \param data      top-left pixel of the block
+ * \param stride    stride of data
+ * \param flat_out  returns whether the block is flat horizontally or
+ *                  vertically, in which case it is not found in the buckets
+ */
+uint32_t kvz_blockhash_calc(const kvz_pixel *data, int stride, bool *flat_out)
+{
+  uint32_t rows[BLOCKHASH_SIZE];
+  bool hor_flat = true;
+  bool ver_flat = true;
+
+  for (int y = 0; y < BLOCKHASH_SIZE; ++y) {
+    const kvz_pixel *row = &data[y * stride];
+    rows[y] = hash_row(row);
+    for (int x = 1; x < BLOCKHASH_SIZE; ++x) {
+      hor_flat &= row[x] == row[0];
+    }
+    if (y > 0) {
+      for (int x = 0; x < BLOCKHASH_SIZE; ++x) {
+        ver_flat &= row[x] == data[x];
+      }
+    }
+  }
+
+  *flat_out = hor_flat || ver_flat;
+  return hash_rows(rows, 1);
+}
+
+/**
+ * \brief Find the positions of blocks with the given hash.
+ *
+ * \param positions_out  returns the positions in raster scan
+ * \param max_positions  maximum number of positions to return
+ *
+ * \return Number of positions found.
+ */
+int kvz_blockhash_find(const kvz_blockhash_t *table, uint32_t hash,
+                       int32_t *positions_out, int max_positions)
+{
+  int count = 0;
+  for (int32_t pos = table->buckets[bucket_index(hash)];
+       pos >= 0 && count < max_positions;
+       pos = table->next[pos]) {
+    if (table->hashes[pos] == hash) {
+      positions_out[count++] = pos;
+    }
+  }
+  return count;
+}
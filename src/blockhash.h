@@ -0,0 +1,67 @@
+#ifndef BLOCKHASH_H_
+#define BLOCKHASH_H_
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/*
+ * \file
+ * \brief Hash tables of the blocks of a picture for finding exact matches.
+ */
+
+#include "global.h"
+
+#include "image.h"
+
+
+//! Width and height of the hashed blocks.
+#define BLOCKHASH_SIZE 8
+
+//! Base 2 logarithm of the number of buckets.
+#define BLOCKHASH_BUCKET_BITS 16
+
+
+/**
+ * \brief Hashes of the BLOCKHASH_SIZE x BLOCKHASH_SIZE blocks at every
+ * position of a picture.
+ *
+ * Positions are indexed in raster scan, pos = y * width + x. Blocks which
+ * are flat horizontally or vertically match too many positions to be
+ * useful, so they are not added to the buckets, but their hashes are
+ * still stored.
+ */
+typedef struct {
+  int32_t width;      //!< \brief Number of block positions in a row.
+  int32_t height;     //!< \brief Number of block positions in a column.
+  uint32_t *hashes;   //!< \brief Hash of the block at each position.
+  int32_t *next;      //!< \brief Next position in the same bucket, or -1.
+  int32_t *buckets;   //!< \brief First position in each bucket, or -1.
+  int32_t refcount;
+} kvz_blockhash_t;
+
+
+kvz_blockhash_t * kvz_blockhash_alloc(const kvz_picture *pic);
+kvz_blockhash_t * kvz_blockhash_copy_ref(kvz_blockhash_t *table);
+void kvz_blockhash_free(kvz_blockhash_t *table);
+
+uint32_t kvz_blockhash_calc(const kvz_pixel *data, int stride, bool *flat_out);
+int kvz_blockhash_find(const kvz_blockhash_t *table, uint32_t hash,
+                       int32_t *positions_out, int max_positions);
+
+#endif // BLOCKHASH_H_
@@ -84,7 +84,7 @@ void kvz_cabac_start(cabac_data_t * const data)
 {
   data->low = 0;
   data->range = 510;
-  data->bits_left = 23;
+  data->bits_left = CABAC_BITS_LEFT_START;
   data->num_buffered_bytes = 0;
   data->buffered_byte = 0xff;
   data->only_count = 0; // By default, write bits out
@@ -125,37 +125,53 @@ void kvz_cabac_encode_bin(cabac_data_t * const data, const uint32_t bin_value)
 }
 
 /**
- * \brief
+ * \brief Get the number of bits written so far.
+ *
+ * Includes the bits which are still buffered in the CABAC encoder.
  */
-void kvz_cabac_write(cabac_data_t * const data)
+uint64_t kvz_cabac_bits_written(const cabac_data_t * const data)
 {
-  uint32_t lead_byte = data->low >> (24 - data->bits_left);
-  data->bits_left += 8;
-  data->low &= 0xffffffffu >> data->bits_left;
+  return kvz_bitstream_tell(data->stream) +
+    8 * data->num_buffered_bytes + (CABAC_BITS_LEFT_START - data->bits_left);
+}
 
-  // Binary counter mode
-  if(data->only_count) {
-    data->num_buffered_bytes++;
-    return;
-  }
+/**
+ * \brief Output the complete bytes of the low register.
+ *
+ * Writes bytes until less than 12 bits are pending, which leaves room for
+ * about 40 bits before the next call is needed.
+ */
+void kvz_cabac_write(cabac_data_t * const data)
+{
+  while (data->bits_left < CABAC_BITS_LEFT_START - 11) {
+    uint32_t lead_byte = (uint32_t)(data->low >> (CABAC_BITS_LEFT_START + 1 - data->bits_left));
+    data->bits_left += 8;
+    data->low &= UINT64_MAX >> data->bits_left;
+
+    // Binary counter mode
+    if(data->only_count) {
+      data->num_buffered_bytes++;
+      continue;
+    }
 
-  if (lead_byte == 0xff) {
-    data->num_buffered_bytes++;
-  } else {
-    if (data->num_buffered_bytes > 0) {
-      uint32_t carry = lead_byte >> 8;
-      uint32_t byte = data->buffered_byte + carry;
-      data->buffered_byte = lead_byte & 0xff;
-      kvz_bitstream_put(data->stream, byte, 8);
-
-      byte = (0xff + carry) & 0xff;
-      while (data->num_buffered_bytes > 1) {
-        kvz_bitstream_put(data->stream, byte, 8);
-        data->num_buffered_bytes--;
-      }
+    if (lead_byte == 0xff) {
+      data->num_buffered_bytes++;
     } else {
-      data->num_buffered_bytes = 1;
-      data->buffered_byte = lead_byte;
+      if (data->num_buffered_bytes > 0) {
+        uint32_t carry = lead_byte >> 8;
+        uint32_t byte = data->buffered_byte + carry;
+        data->buffered_byte = lead_byte & 0xff;
+        kvz_bitstream_put_byte(data->stream, byte);
+
+        byte = (0xff + carry) & 0xff;
+        while (data->num_buffered_bytes > 1) {
+          kvz_bitstream_put_byte(data->stream, byte);
+          data->num_buffered_bytes--;
+        }
+      } else {
+        data->num_buffered_bytes = 1;
+        data->buffered_byte = lead_byte;
+      }
     }
   }
 }
@@ -165,15 +181,15 @@ void kvz_cabac_write(cabac_data_t * const data)
  */
 void kvz_cabac_finish(cabac_data_t * const data)
 {
-  assert(data->bits_left <= 32);
+  kvz_cabac_write(data);
 
-  if (data->low >> (32 - data->bits_left)) {
+  if (data->low >> (64 - data->bits_left)) {
     kvz_bitstream_put(data->stream,data->buffered_byte + 1, 8);
     while (data->num_buffered_bytes > 1) {
       kvz_bitstream_put(data->stream, 0, 8);
       data->num_buffered_bytes--;
     }
-    data->low -= 1 << (32 - data->bits_left);
+    data->low -= (uint64_t)1 << (64 - data->bits_left);
   } else {
     if (data->num_buffered_bytes > 0) {
       kvz_bitstream_put(data->stream,data->buffered_byte, 8);
@@ -185,8 +201,8 @@ void kvz_cabac_finish(cabac_data_t * const data)
   }
 
   {
-    uint8_t bits = (uint8_t)(24 - data->bits_left);
-    kvz_bitstream_put(data->stream, data->low >> 8, bits);
+    uint8_t bits = (uint8_t)(CABAC_BITS_LEFT_START + 1 - data->bits_left);
+    kvz_bitstream_put(data->stream, (uint32_t)(data->low >> 8), bits);
   }
 }
 
@@ -243,27 +259,19 @@ void kvz_cabac_encode_bin_ep(cabac_data_t * const data, const uint32_t bin_value
 }
 
 /**
- * \brief
+ * \brief Encode up to 32 bypass bins at once.
  */
 void kvz_cabac_encode_bins_ep(cabac_data_t * const data, uint32_t bin_values, int num_bins)
 {
-  uint32_t pattern;
-
-  while (num_bins > 8) {
-    num_bins -= 8;
-    pattern = bin_values >> num_bins;
-    data->low <<= 8;
-    data->low += data->range * pattern;
-    bin_values -= pattern << num_bins;
-    data->bits_left -= 8;
-
-    if(data->bits_left < 12) {
-      kvz_cabac_write(data);
-    }
+  assert(num_bins <= 32);
+
+  // Make room for the bins in the low register.
+  if (data->bits_left - num_bins < 4) {
+    kvz_cabac_write(data);
   }
 
   data->low <<= num_bins;
-  data->low += data->range * bin_values;
+  data->low += (uint64_t)data->range * bin_values;
   data->bits_left -= num_bins;
 
   if (data->bits_left < 12) {
@@ -281,9 +289,11 @@ void kvz_cabac_write_coeff_remain(cabac_data_t * const cabac, const uint32_t sym
   int32_t code_number = symbol;
   uint32_t length;
   if (code_number < (3 << r_param)) {
+    // The prefix and the suffix fit in 8 bins.
     length = code_number >> r_param;
-    CABAC_BINS_EP(cabac, (1 << (length + 1)) - 2 , length + 1, "coeff_abs_level_remaining");
-    CABAC_BINS_EP(cabac, (code_number % (1 << r_param)), r_param, "coeff_abs_level_remaining");
+    const uint32_t prefix = (1 << (length + 1)) - 2;
+    const uint32_t suffix = code_number % (1 << r_param);
+    CABAC_BINS_EP(cabac, (prefix << r_param) | suffix, length + 1 + r_param, "coeff_abs_level_remaining");
   } else {
     length = r_param;
     code_number = code_number - (3 << r_param);
@@ -291,8 +301,14 @@ void kvz_cabac_write_coeff_remain(cabac_data_t * const cabac, const uint32_t sym
       code_number -= 1 << length;
       ++length;
     }
-    CABAC_BINS_EP(cabac, (1 << (3 + length + 1 - r_param)) - 2, 3 + length + 1 - r_param, "coeff_abs_level_remaining");
-    CABAC_BINS_EP(cabac, code_number, length, "coeff_abs_level_remaining");
+    const uint32_t prefix_length = 3 + length + 1 - r_param;
+    const uint32_t prefix = (1 << prefix_length) - 2;
+    if (prefix_length + length <= 32) {
+      CABAC_BINS_EP(cabac, (prefix << length) | code_number, prefix_length + length, "coeff_abs_level_remaining");
+    } else {
+      CABAC_BINS_EP(cabac, prefix, prefix_length, "coeff_abs_level_remaining");
+      CABAC_BINS_EP(cabac, code_number, length, "coeff_abs_level_remaining");
+    }
   }
 }
 
@@ -39,7 +39,7 @@ typedef struct
 typedef struct
 {
   cabac_ctx_t *cur_ctx;
-  uint32_t   low;
+  uint64_t   low;
   uint32_t   range;
   uint32_t   buffered_byte;
   int32_t    num_buffered_bytes;
@@ -80,10 +80,15 @@ typedef struct
     cabac_ctx_t cu_qt_root_cbf_model;
     cabac_ctx_t transform_skip_model_luma;
     cabac_ctx_t transform_skip_model_chroma;
+    cabac_ctx_t cu_qp_delta_abs[2];
   } ctx;
 } cabac_data_t;
 
 
+//! Initial value of cabac_data_t::bits_left. The low register can hold
+//! this many bits in addition to the 9 bits of range and the carry.
+#define CABAC_BITS_LEFT_START 55
+
 // Globals
 extern const uint8_t kvz_g_auc_next_state_mps[128];
 extern const uint8_t kvz_g_auc_next_state_lps[128];
@@ -99,6 +104,7 @@ void kvz_cabac_encode_bins_ep(cabac_data_t *data, uint32_t bin_values, int num_b
 void kvz_cabac_encode_bin_trm(cabac_data_t *data, uint8_t bin_value);
 void kvz_cabac_write(cabac_data_t *data);
 void kvz_cabac_finish(cabac_data_t *data);
+uint64_t kvz_cabac_bits_written(const cabac_data_t *data);
 void kvz_cabac_flush(cabac_data_t *data);
 void kvz_cabac_write_coeff_remain(cabac_data_t *cabac, uint32_t symbol,
                               uint32_t r_param);
@@ -81,6 +81,24 @@ static const struct option long_options[] = {
   { "gop",                required_argument, NULL, 0 },
   { "bipred",                   no_argument, NULL, 0 },
   { "bitrate",            required_argument, NULL, 0 },
+  { "vbv-maxrate",        required_argument, NULL, 0 },
+  { "vbv-bufsize",        required_argument, NULL, 0 },
+  { "lcu-rc",                   no_argument, NULL, 0 },
+  { "pass",               required_argument, NULL, 0 },
+  { "stats",              required_argument, NULL, 0 },
+  { "analysis-save",      required_argument, NULL, 0 },
+  { "analysis-load",      required_argument, NULL, 0 },
+  { "aq",                 required_argument, NULL, 0 },
+  { "aq-strength",        required_argument, NULL, 0 },
+  { "cu-split-termination", required_argument, NULL, 0 },
+  { "early-skip",               no_argument, NULL, 0 },
+  { "adaptive-cu-depth",        no_argument, NULL, 0 },
+  { "me-pyramid",               no_argument, NULL, 0 },
+  { "me-parent-seed",           no_argument, NULL, 0 },
+  { "subpel-planes",            no_argument, NULL, 0 },
+  { "hash-me",                  no_argument, NULL, 0 },
+  { "static-skip",              no_argument, NULL, 0 },
+  { "gradient-intra",           no_argument, NULL, 0 },
   {0, 0, 0, 0}
 };
 
@@ -301,12 +319,71 @@ void print_help(void)
     "                                     0: 64x64, 1: 32x32, 2: 16x16, 3: 8x8\n"
     "          --pu-depth-intra <int>-<int> : Range for sizes of intra prediction units to try.\n"
     "                                     0: 64x64, 1: 32x32, 2: 16x16, 3: 8x8, 4: 4x4\n"
+    "          --cu-split-termination <string> : Early termination of the CU\n"
+    "                                   split search. [\"zero\"]\n"
+    "                                     \"zero\": stop when there are no\n"
+    "                                       coefficients\n"
+    "                                     \"adaptive\": also stop when the CU\n"
+    "                                       costs much less than the unsplit\n"
+    "                                       CUs of the same size so far\n"
+    "          --early-skip           : Code the CU as skip without motion\n"
+    "                                   estimation if the best merge\n"
+    "                                   candidate leaves no residual.\n"
+    "          --adaptive-cu-depth    : Limit the CU depths searched in each\n"
+    "                                   LCU to those used in the LCUs to the\n"
+    "                                   left and above and the co-located\n"
+    "                                   LCU of a reference picture.\n"
+    "          --me-pyramid           : Start motion estimation from vectors\n"
+    "                                   found on 4x and 2x downscaled pictures.\n"
+    "          --me-parent-seed       : Start motion estimation of sub-CUs from\n"
+    "                                   the vectors of the parent CU. The best\n"
+    "                                   vector is only refined with the small\n"
+    "                                   hexagon, which needs fewer SADs.\n"
+    "          --subpel-planes        : Interpolate the fractional luma samples\n"
+    "                                   of each reference picture once, instead\n"
+    "                                   of for each block. Uses 15 times the\n"
+    "                                   luma size of memory per reference.\n"
+    "          --hash-me              : Look up exact matches of the blocks\n"
+    "                                   from hash tables of the reference\n"
+    "                                   pictures in motion estimation. Finds\n"
+    "                                   long motions of screen content.\n"
+    "          --static-skip          : Code LCUs whose source pixels are\n"
+    "                                   identical to those of a reference\n"
+    "                                   picture as skip without search.\n"
+    "          --gradient-intra       : Limit the rough intra search to planar,\n"
+    "                                   DC, the predicted modes and the\n"
+    "                                   strongest edge directions of the\n"
+    "                                   source block.\n"
     "          --no-info              : Don't add information about the encoder to settings.\n"
     "          --gop <int>           : Length of Group of Pictures, must be 8 or 0 [0]\n"
     "          --bipred               : Enable bi-prediction search\n"
     "          --bitrate <integer>    : Target bitrate. [0]\n"
     "                                     0: disable rate-control\n"
     "                                     N: target N bits per second\n"
+    "          --vbv-maxrate <integer> : Maximum VBV buffer fill rate in bits\n"
+    "                                    per second. Requires --bitrate. [0]\n"
+    "                                     Equal to --bitrate: CBR\n"
+    "          --vbv-bufsize <integer> : VBV buffer size in bits. [0]\n"
+    "          --lcu-rc               : Adapt QP and lambda for each LCU to\n"
+    "                                   follow the bit budget within a\n"
+    "                                   picture. Requires --bitrate.\n"
+    "          --aq <string>          : Adaptive quantization. [off]\n"
+    "                                     off: constant QP within LCUs\n"
+    "                                     variance: lower the QP of flat\n"
+    "                                       32x32 blocks and raise it for\n"
+    "                                       detailed ones\n"
+    "          --aq-strength <float>  : Strength of adaptive quantization.\n"
+    "                                   Range 0.0..3.0. [1.0]\n"
+    "          --pass <integer>       : Pass of two-pass encoding. [0]\n"
+    "                                     1: fast constant QP encode which\n"
+    "                                        writes the statistics file\n"
+    "                                     2: rate controlled encode which\n"
+    "                                        reads the statistics file\n"
+    "          --stats <string>       : Statistics file of two-pass encoding.\n"
+    "          --analysis-save <string> : Save the mode decisions to a file.\n"
+    "          --analysis-load <string> : Reuse the mode decisions saved from\n"
+    "                                     an encode of the same input with\n"
+    "                                     the same GOP and reference settings.\n"
     "\n"
     "  Video Usability Information:\n"
     "          --sar <width:height>   : Specify Sample Aspect Ratio\n"
@@ -77,6 +77,24 @@ int kvz_config_init(kvz_config *cfg)
   cfg->gop_len         = 0;
   cfg->bipred          = 0;
   cfg->target_bitrate  = 0;
+  cfg->vbv_maxrate     = 0;
+  cfg->vbv_bufsize     = 0;
+  cfg->lcu_rc          = 0;
+  cfg->pass            = 0;
+  cfg->stats_file      = NULL;
+  cfg->analysis_save   = NULL;
+  cfg->analysis_load   = NULL;
+  cfg->aq              = KVZ_AQ_OFF;
+  cfg->aq_strength     = 1.0;
+  cfg->cu_split_termination = KVZ_CU_SPLIT_TERMINATION_ZERO;
+  cfg->early_skip      = 0;
+  cfg->adaptive_cu_depth = 0;
+  cfg->me_pyramid      = 0;
+  cfg->me_parent_seed  = 0;
+  cfg->subpel_planes   = 0;
+  cfg->hash_me         = 0;
+  cfg->static_skip     = 0;
+  cfg->gradient_intra  = 0;
 
   cfg->tiles_width_count         = 0;
   cfg->tiles_height_count         = 0;
@@ -107,6 +125,9 @@ int kvz_config_destroy(kvz_config *cfg)
 {
   if (cfg) {
     FREE_POINTER(cfg->cqmfile);
+    FREE_POINTER(cfg->stats_file);
+    FREE_POINTER(cfg->analysis_save);
+    FREE_POINTER(cfg->analysis_load);
     FREE_POINTER(cfg->tiles_width_split);
     FREE_POINTER(cfg->tiles_height_split);
     FREE_POINTER(cfg->slice_addresses_in_ts);
@@ -265,6 +286,8 @@ static int parse_slice_specification(const char* const arg, int32_t * const nsli
 int kvz_config_parse(kvz_config *cfg, const char *name, const char *value)
 {
   static const char * const me_names[]          = { "hexbs", "tz", NULL };
+  static const char * const aq_names[]          = { "off", "variance", NULL };
+  static const char * const cu_split_termination_names[] = { "zero", "adaptive", NULL };
   static const char * const source_scan_type_names[] = { "progressive", "tff", "bff", NULL };
 
   static const char * const overscan_names[]    = { "undef", "show", "crop", NULL };
@@ -438,6 +461,48 @@ int kvz_config_parse(kvz_config *cfg, const char *name, const char *value)
     cfg->bipred = atobool(value);
   else if OPT("bitrate")
     cfg->target_bitrate = atoi(value);
+  else if OPT("vbv-maxrate")
+    cfg->vbv_maxrate = atoi(value);
+  else if OPT("vbv-bufsize")
+    cfg->vbv_bufsize = atoi(value);
+  else if OPT("lcu-rc")
+    cfg->lcu_rc = atobool(value);
+  else if OPT("pass")
+    cfg->pass = atoi(value);
+  else if OPT("stats") {
+    FREE_POINTER(cfg->stats_file);
+    cfg->stats_file = strdup(value);
+  }
+  else if OPT("analysis-save") {
+    FREE_POINTER(cfg->analysis_save);
+    cfg->analysis_save = strdup(value);
+  }
+  else if OPT("analysis-load") {
+    FREE_POINTER(cfg->analysis_load);
+    cfg->analysis_load = strdup(value);
+  }
+  else if OPT("aq")
+    return parse_enum(value, aq_names, &cfg->aq);
+  else if OPT("aq-strength")
+    cfg->aq_strength = atof(value);
+  else if OPT("cu-split-termination")
+    return parse_enum(value, cu_split_termination_names, &cfg->cu_split_termination);
+  else if OPT("early-skip")
+    cfg->early_skip = atobool(value);
+  else if OPT("adaptive-cu-depth")
+    cfg->adaptive_cu_depth = atobool(value);
+  else if OPT("me-pyramid")
+    cfg->me_pyramid = atobool(value);
+  else if OPT("me-parent-seed")
+    cfg->me_parent_seed = atobool(value);
+  else if OPT("subpel-planes")
+    cfg->subpel_planes = atobool(value);
+  else if OPT("hash-me")
+    cfg->hash_me = atobool(value);
+  else if OPT("static-skip")
+    cfg->static_skip = atobool(value);
+  else if OPT("gradient-intra")
+    cfg->gradient_intra = atobool(value);
   else
     return 0;
 #undef OPT
@@ -535,6 +600,54 @@ int kvz_config_validate(const kvz_config *const cfg)
       error = 1;
   }
 
+  if (cfg->vbv_maxrate < 0 || cfg->vbv_bufsize < 0) {
+    fprintf(stderr, "Input error: --vbv-maxrate and --vbv-bufsize must be nonnegative\n");
+    error = 1;
+  } else if ((cfg->vbv_maxrate > 0) != (cfg->vbv_bufsize > 0)) {
+    fprintf(stderr, "Input error: --vbv-maxrate and --vbv-bufsize must be used together\n");
+    error = 1;
+  } else if (cfg->vbv_maxrate > 0) {
+    if (cfg->target_bitrate <= 0) {
+      fprintf(stderr, "Input error: VBV requires rate control (--bitrate)\n");
+      error = 1;
+    } else if (cfg->vbv_maxrate < cfg->target_bitrate) {
+      fprintf(stderr, "Input error: --vbv-maxrate must not be smaller than --bitrate\n");
+      error = 1;
+    }
+    if (cfg->vbv_bufsize < cfg->vbv_maxrate / cfg->framerate) {
+      fprintf(stderr, "Input error: --vbv-bufsize must hold at least one frame at --vbv-maxrate\n");
+      error = 1;
+    }
+  }
+
+  if (cfg->lcu_rc && cfg->target_bitrate <= 0) {
+    fprintf(stderr, "Input error: --lcu-rc requires rate control (--bitrate)\n");
+    error = 1;
+  }
+
+  if (cfg->pass < 0 || cfg->pass > 2) {
+    fprintf(stderr, "Input error: --pass must be 1 or 2\n");
+    error = 1;
+  } else if (cfg->pass > 0) {
+    if (!cfg->stats_file) {
+      fprintf(stderr, "Input error: --pass requires --stats\n");
+      error = 1;
+    }
+    if (cfg->pass == 1 && cfg->target_bitrate > 0) {
+      fprintf(stderr, "Input error: the first pass uses constant QP, --bitrate is not allowed\n");
+      error = 1;
+    }
+    if (cfg->pass == 2 && cfg->target_bitrate <= 0) {
+      fprintf(stderr, "Input error: the second pass requires rate control (--bitrate)\n");
+      error = 1;
+    }
+  }
+
+  if (cfg->aq_strength < 0.0 || cfg->aq_strength > 3.0) {
+    fprintf(stderr, "Input error: --aq-strength must be in range 0.0..3.0\n");
+    error = 1;
+  }
+
   if (!WITHIN(cfg->pu_depth_inter.min, PU_DEPTH_INTER_MIN, PU_DEPTH_INTER_MAX) ||
       !WITHIN(cfg->pu_depth_inter.max, PU_DEPTH_INTER_MIN, PU_DEPTH_INTER_MAX)) 
   {
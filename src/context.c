@@ -180,6 +180,12 @@ static const uint8_t INIT_TRANSFORMSKIP_FLAG[3][2] =
   { 139,  139},
 };
 
+static const uint8_t INIT_CU_QP_DELTA_ABS[3][2] = {
+  { 154, 154 },
+  { 154, 154 },
+  { 154, 154 },
+};
+
 
 
 
@@ -213,6 +219,8 @@ void kvz_init_contexts(encoder_state_t *state, int8_t QP, int8_t slice)
   // Initialize contexts
   kvz_ctx_init(&cabac->ctx.transform_skip_model_luma, QP, INIT_TRANSFORMSKIP_FLAG[slice][0]);
   kvz_ctx_init(&cabac->ctx.transform_skip_model_chroma, QP, INIT_TRANSFORMSKIP_FLAG[slice][1]);
+  kvz_ctx_init(&cabac->ctx.cu_qp_delta_abs[0], QP, INIT_CU_QP_DELTA_ABS[slice][0]);
+  kvz_ctx_init(&cabac->ctx.cu_qp_delta_abs[1], QP, INIT_CU_QP_DELTA_ABS[slice][1]);
 
   kvz_ctx_init(&cabac->ctx.sao_merge_flag_model, QP, kvz_INIT_SAO_MERGE_FLAG[slice]);
   kvz_ctx_init(&cabac->ctx.sao_type_idx_model, QP, kvz_INIT_SAO_TYPE_IDX[slice]);
@@ -62,6 +62,7 @@ typedef struct
   int8_t skipped;    //!< \brief flag to indicate this block is skipped
   int8_t merged;     //!< \brief flag to indicate this block is merged
   int8_t merge_idx;  //!< \brief merge index
+  int8_t qp;         //!< \brief luma QP (QpY) used for the block
 
   cu_cbf_t cbf;
   struct {
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include "tables.h"
 #include "config.h"
@@ -42,8 +43,10 @@
 #include "search.h"
 #include "sao.h"
 #include "rdo.h"
+#include "analysis.h"
 
 static int encoder_control_init_gop_layer_weights(encoder_control_t * const);
+static void encoder_control_init_vbv(encoder_control_t * const);
 
 static int size_of_wpp_ends(int threads)
 {
@@ -178,6 +181,27 @@ encoder_control_t* kvz_encoder_control_init(const kvz_config *const cfg) {
   if (!encoder_control_init_gop_layer_weights(encoder)) {
     goto init_failed;
   }
+
+  encoder_control_init_vbv(encoder);
+
+  // LCU level rate control signals one QP delta per LCU and adaptive
+  // quantization one per 32x32 block.
+  if (cfg->aq != KVZ_AQ_OFF) {
+    encoder->max_qp_delta_depth = 1;
+  } else {
+    encoder->max_qp_delta_depth = cfg->lcu_rc ? 0 : -1;
+  }
+
+  if (cfg->pass > 0) {
+    encoder->twopass = kvz_twopass_init(encoder);
+    if (!encoder->twopass) {
+      goto init_failed;
+    }
+  }
+
+  if (!kvz_analysis_init(encoder)) {
+    goto init_failed;
+  }
   
   //Tiles
   encoder->tiles_enable = encoder->cfg->tiles_width_count > 0 ||
@@ -420,6 +444,15 @@ encoder_control_t* kvz_encoder_control_init(const kvz_config *const cfg) {
   encoder->tr_depth_intra = (int8_t)encoder->cfg->tr_depth_intra;
   // MOTION ESTIMATION
   encoder->fme_level = (int8_t)encoder->cfg->fme_level;
+  encoder->ime_algorithm = encoder->cfg->ime_algorithm;
+
+  if (encoder->cfg->pass == 1) {
+    // The first pass only measures the complexity of the pictures so use
+    // the fastest search.
+    encoder->rdo = 0;
+    encoder->fme_level = 0;
+    encoder->ime_algorithm = KVZ_IME_HEXBS;
+  }
   // VUI
   encoder->vui.sar_width = (int16_t)encoder->cfg->vui.sar_width;
   encoder->vui.sar_height = (int16_t)encoder->cfg->vui.sar_height;
@@ -469,6 +502,9 @@ void kvz_encoder_control_free(encoder_control_t *const encoder) {
 
   kvz_scalinglist_destroy(&encoder->scaling_list);
 
+  kvz_twopass_free(encoder->twopass);
+  kvz_analysis_free(encoder);
+
   if (encoder->threadqueue) {
     kvz_threadqueue_finalize(encoder->threadqueue);
   }
@@ -589,6 +625,60 @@ static int encoder_control_init_gop_layer_weights(encoder_control_t * const enco
   return 1;
 }
 
+/**
+ * \brief Initialize the VBV buffer model and the HRD parameters.
+ * \param encoder   encoder control
+ *
+ * The rates are rounded down to the units used by the HRD parameters so that
+ * the buffer model of the rate control matches the signalled one.
+ */
+static void encoder_control_init_vbv(encoder_control_t * const encoder)
+{
+  const kvz_config * const cfg = encoder->cfg;
+
+  if (cfg->vbv_maxrate <= 0) {
+    encoder->vbv.maxrate = 0;
+    return;
+  }
+
+  // The values are written with the exp-golomb table, so keep them in range.
+  uint8_t rate_scale = 0;
+  while (rate_scale < 15 && (cfg->vbv_maxrate >> (6 + rate_scale)) > EXP_GOLOMB_TABLE_SIZE) {
+    rate_scale++;
+  }
+  uint8_t size_scale = 0;
+  while (size_scale < 15 && (cfg->vbv_bufsize >> (4 + size_scale)) > EXP_GOLOMB_TABLE_SIZE) {
+    size_scale++;
+  }
+  encoder->vbv.bit_rate_scale = rate_scale;
+  encoder->vbv.cpb_size_scale = size_scale;
+  encoder->vbv.maxrate = MAX(1, cfg->vbv_maxrate >> (6 + rate_scale)) << (6 + rate_scale);
+  encoder->vbv.bufsize = MAX(1, cfg->vbv_bufsize >> (4 + size_scale)) << (4 + size_scale);
+  encoder->vbv.initial_fullness = 0.9 * encoder->vbv.bufsize;
+
+  // Use 1001 as the tick for NTSC-style rates such as 29.97.
+  const double ntsc_time_scale = cfg->framerate * 1001;
+  if (cfg->framerate != (uint32_t)cfg->framerate &&
+      fabs(ntsc_time_scale - (uint32_t)(ntsc_time_scale + 0.5)) < 0.01) {
+    encoder->vbv.num_units_in_tick = 1001;
+    encoder->vbv.time_scale = (uint32_t)(ntsc_time_scale + 0.5);
+  } else if (cfg->framerate == (uint32_t)cfg->framerate) {
+    encoder->vbv.num_units_in_tick = 1;
+    encoder->vbv.time_scale = (uint32_t)cfg->framerate;
+  } else {
+    encoder->vbv.num_units_in_tick = 1000;
+    encoder->vbv.time_scale = (uint32_t)(cfg->framerate * 1000 + 0.5);
+  }
+
+  // A picture can be output once every picture preceding it in output order
+  // has been decoded.
+  int32_t reorder_delay = 0;
+  for (int i = 0; i < cfg->gop_len; ++i) {
+    reorder_delay = MAX(reorder_delay, i + 1 - cfg->gop[i].poc_offset);
+  }
+  encoder->vbv.dpb_output_delay = reorder_delay;
+}
+
 unsigned kvz_get_padding(unsigned width_or_height){
   if (width_or_height % CU_MIN_SIZE_PIXELS){
     return CU_MIN_SIZE_PIXELS - (width_or_height % CU_MIN_SIZE_PIXELS);
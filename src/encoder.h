@@ -34,6 +34,7 @@
 #include "tables.h"
 #include "scalinglist.h"
 #include "threadqueue.h"
+#include "twopass.h"
 
 
 enum { FORMAT_400 = 0, FORMAT_420, FORMAT_422, FORMAT_444 };
@@ -69,6 +70,7 @@ typedef struct encoder_control_t
   int8_t tr_depth_intra;
 
   int8_t fme_level;
+  enum kvz_ime_algorithm ime_algorithm;
 
   /* Filtering */
   int8_t deblock_enable; // \brief Flag to enable deblocking filter
@@ -153,6 +155,29 @@ typedef struct encoder_control_t
   //! Picture weights when GOP is used.
   double gop_layer_weights[MAX_GOP_LAYERS];
 
+  //! VBV buffer model and the matching HRD parameters.
+  struct {
+    int32_t maxrate; //!< \brief Buffer fill rate in bits per second, 0 if VBV is disabled
+    int32_t bufsize; //!< \brief Buffer size in bits
+    double initial_fullness; //!< \brief Buffer fullness before the first picture is removed
+
+    uint8_t bit_rate_scale;  //!< \brief spec: bit_rate_scale
+    uint8_t cpb_size_scale;  //!< \brief spec: cpb_size_scale
+    uint32_t num_units_in_tick; //!< \brief spec: vui_num_units_in_tick
+    uint32_t time_scale;        //!< \brief spec: vui_time_scale
+    int32_t dpb_output_delay;   //!< \brief Output delay of a picture without reordering, in ticks
+  } vbv;
+
+  //! Depth of the quantization groups, -1 if cu_qp_delta is not used.
+  int8_t max_qp_delta_depth;
+
+  //! Statistics of two-pass encoding, NULL if not used.
+  twopass_stats_t *twopass;
+
+  //! Files for saving and loading the mode decisions, NULL if not used.
+  FILE *analysis_save;
+  FILE *analysis_load;
+
 } encoder_control_t;
 
 encoder_control_t* kvz_encoder_control_init(const kvz_config *cfg);
@@ -26,6 +26,11 @@
 #include "checkpoint.h"
 #include "encoderstate.h"
 #include "nal.h"
+#include "rate_control.h"
+#include "analysis.h"
+
+//! Length of the CPB and DPB delay fields in the HRD SEI messages.
+#define HRD_DELAY_LENGTH 24
 
 
 static void encoder_state_write_bitstream_aud(encoder_state_t * const state)
@@ -175,6 +180,45 @@ static void encoder_state_write_bitstream_scaling_list(bitstream_t *stream,
 }
 
 
+static void encoder_state_write_bitstream_sub_layer_hrd(bitstream_t *stream,
+                                                        encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+
+  //for each cpb
+  WRITE_UE(stream, (encoder->vbv.maxrate >> (6 + encoder->vbv.bit_rate_scale)) - 1,
+           "bit_rate_value_minus1");
+  WRITE_UE(stream, (encoder->vbv.bufsize >> (4 + encoder->vbv.cpb_size_scale)) - 1,
+           "cpb_size_value_minus1");
+  // Filler data is not written so the stream is never strictly CBR.
+  WRITE_U(stream, 0, 1, "cbr_flag");
+  //end for
+}
+
+static void encoder_state_write_bitstream_hrd(bitstream_t *stream,
+                                              encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+
+  WRITE_U(stream, 1, 1, "nal_hrd_parameters_present_flag");
+  WRITE_U(stream, 0, 1, "vcl_hrd_parameters_present_flag");
+
+  WRITE_U(stream, 0, 1, "sub_pic_hrd_params_present_flag");
+  WRITE_U(stream, encoder->vbv.bit_rate_scale, 4, "bit_rate_scale");
+  WRITE_U(stream, encoder->vbv.cpb_size_scale, 4, "cpb_size_scale");
+  WRITE_U(stream, HRD_DELAY_LENGTH - 1, 5, "initial_cpb_removal_delay_length_minus1");
+  WRITE_U(stream, HRD_DELAY_LENGTH - 1, 5, "au_cpb_removal_delay_length_minus1");
+  WRITE_U(stream, HRD_DELAY_LENGTH - 1, 5, "dpb_output_delay_length_minus1");
+
+  // for each sub-layer (sps_max_sub_layers_minus1 == 1)
+  for (int i = 0; i < 2; ++i) {
+    WRITE_U(stream, 1, 1, "fixed_pic_rate_general_flag");
+    WRITE_UE(stream, 0, "elemental_duration_in_tc_minus1");
+    WRITE_UE(stream, 0, "cpb_cnt_minus1");
+    encoder_state_write_bitstream_sub_layer_hrd(stream, state);
+  }
+}
+
 static void encoder_state_write_bitstream_VUI(bitstream_t *stream,
                                               encoder_state_t * const state)
 {
@@ -265,10 +309,15 @@ static void encoder_state_write_bitstream_VUI(bitstream_t *stream,
   //IF default display window
   //ENDIF
 
-  WRITE_U(stream, 0, 1, "vui_timing_info_present_flag");
-
-  //IF timing info
-  //ENDIF
+  if (encoder->vbv.maxrate > 0) {
+    WRITE_U(stream, 1, 1, "vui_timing_info_present_flag");
+    WRITE_U(stream, encoder->vbv.num_units_in_tick, 32, "vui_num_units_in_tick");
+    WRITE_U(stream, encoder->vbv.time_scale, 32, "vui_time_scale");
+    WRITE_U(stream, 0, 1, "vui_poc_proportional_to_timing_flag");
+    WRITE_U(stream, 1, 1, "vui_hrd_parameters_present_flag");
+    encoder_state_write_bitstream_hrd(stream, state);
+  } else
+    WRITE_U(stream, 0, 1, "vui_timing_info_present_flag");
 
   WRITE_U(stream, 0, 1, "bitstream_restriction_flag");
 
@@ -402,9 +451,12 @@ static void encoder_state_write_bitstream_pic_parameter_set(bitstream_t* stream,
   WRITE_SE(stream, ((int8_t)encoder->cfg->qp) - 26, "pic_init_qp_minus26");
   WRITE_U(stream, 0, 1, "constrained_intra_pred_flag");
   WRITE_U(stream, encoder->trskip_enable, 1, "transform_skip_enabled_flag");
-  WRITE_U(stream, 0, 1, "cu_qp_delta_enabled_flag");
-  //if cu_qp_delta_enabled_flag
-  //WRITE_UE(stream, 0, "diff_cu_qp_delta_depth");
+  if (encoder->max_qp_delta_depth >= 0) {
+    WRITE_U(stream, 1, 1, "cu_qp_delta_enabled_flag");
+    WRITE_UE(stream, encoder->max_qp_delta_depth, "diff_cu_qp_delta_depth");
+  } else {
+    WRITE_U(stream, 0, 1, "cu_qp_delta_enabled_flag");
+  }
 
   //TODO: add QP offsets
   WRITE_SE(stream, 0, "pps_cb_qp_offset");
@@ -550,11 +602,50 @@ static void encoder_state_write_active_parameter_sets_sei_message(encoder_state_
 }
 */
 
+static void encoder_state_write_buffering_period_sei_message(encoder_state_t * const state) {
+
+  const encoder_control_t * const encoder = state->encoder_control;
+  bitstream_t * const stream = &state->stream;
+
+  // The buffer fullness when this picture is removed determines how long
+  // the decoder must wait before removing it.
+  const double fullness = state->global->frame > 0 ?
+    state->previous_encoder_state->global->vbv_fullness :
+    encoder->vbv.initial_fullness;
+  const double max_delay = 90000.0 * encoder->vbv.bufsize / encoder->vbv.maxrate;
+  const uint32_t initial_delay =
+    (uint32_t)CLIP(1.0, max_delay, 90000.0 * fullness / encoder->vbv.maxrate);
+
+  // bp_seq_parameter_set_id (1 bit), two flags, and three delays
+  const int payload_bits = 3 + 3 * HRD_DELAY_LENGTH;
+
+  WRITE_U(stream, 0, 8, "last_payload_type_byte"); //buffering_period
+  WRITE_U(stream, CEILDIV(payload_bits, 8), 8, "last_payload_size_byte");
+  WRITE_UE(stream, 0, "bp_seq_parameter_set_id");
+  WRITE_U(stream, 0, 1, "irap_cpb_params_present_flag");
+  WRITE_U(stream, 0, 1, "concatenation_flag");
+  WRITE_U(stream, 0, HRD_DELAY_LENGTH, "au_cpb_removal_delay_delta_minus1");
+  //for each cpb
+  WRITE_U(stream, initial_delay, HRD_DELAY_LENGTH, "nal_initial_cpb_removal_delay");
+  WRITE_U(stream, 0, HRD_DELAY_LENGTH, "nal_initial_cpb_removal_offset");
+  //end for
+
+  kvz_bitstream_align(stream);
+}
+
 static void encoder_state_write_picture_timing_sei_message(encoder_state_t * const state) {
 
+  const encoder_control_t * const encoder = state->encoder_control;
   bitstream_t * const stream = &state->stream;
 
-  if (state->encoder_control->vui.frame_field_info_present_flag){
+  int payload_bits = 0;
+  if (encoder->vui.frame_field_info_present_flag) payload_bits += 7;
+  if (encoder->vbv.maxrate > 0) payload_bits += 2 * HRD_DELAY_LENGTH;
+
+  WRITE_U(stream, 1, 8, "last_payload_type_byte"); //pic_timing
+  WRITE_U(stream, CEILDIV(payload_bits, 8), 8, "last_payload_size_byte");
+
+  if (encoder->vui.frame_field_info_present_flag){
 
     int8_t odd_picture = state->global->frame % 2;
     int8_t pic_struct = 0; //0: progressive picture, 1: top field, 2: bottom field, 3...
@@ -578,14 +669,30 @@ static void encoder_state_write_picture_timing_sei_message(encoder_state_t * con
       break;
     }
 
-    WRITE_U(stream, 1, 8, "last_payload_type_byte"); //pic_timing
-    WRITE_U(stream, 1, 8, "last_payload_size_byte");
     WRITE_U(stream, pic_struct, 4, "pic_struct");
     WRITE_U(stream, source_scan_type, 2, "source_scan_type");
     WRITE_U(stream, 0, 1, "duplicate_flag");
+  }
 
-    kvz_bitstream_align(stream);
+  if (encoder->vbv.maxrate > 0) {
+    // Pictures are removed one tick apart, starting from the picture with
+    // the previous buffering period SEI.
+    const int32_t bp_frame = state->global->frame > 0 ?
+      state->previous_encoder_state->global->hrd_bp_frame : 0;
+    const uint32_t cpb_removal_delay = MAX(1, state->global->frame - bp_frame);
+
+    // Pictures are output one tick apart in POC order. Only the first
+    // picture is an IDR picture when GOP is used.
+    int32_t dpb_output_delay = encoder->vbv.dpb_output_delay;
+    if (encoder->cfg->gop_len > 0) {
+      dpb_output_delay += state->global->poc - state->global->frame;
+    }
+
+    WRITE_U(stream, cpb_removal_delay - 1, HRD_DELAY_LENGTH, "au_cpb_removal_delay_minus1");
+    WRITE_U(stream, dpb_output_delay, HRD_DELAY_LENGTH, "pic_dpb_output_delay");
   }
+
+  kvz_bitstream_align(stream);
 }
 
 
@@ -853,8 +960,8 @@ static void encoder_state_write_bitstream_main(encoder_state_t * const state)
     kvz_bitstream_add_rbsp_trailing_bits(stream);
   }
 
-  //SEI messages for interlacing
-  if (encoder->vui.frame_field_info_present_flag){
+  //SEI messages for interlacing and HRD
+  if (encoder->vui.frame_field_info_present_flag || encoder->vbv.maxrate > 0){
     // These should be optional, needed for earlier versions
     // of HM decoder to accept bitstream
     //kvz_nal_write(stream, KVZ_NAL_PREFIX_SEI_NUT, 0, 0);
@@ -862,6 +969,9 @@ static void encoder_state_write_bitstream_main(encoder_state_t * const state)
     //kvz_bitstream_rbsp_trailing_bits(stream);
 
     kvz_nal_write(stream, KVZ_NAL_PREFIX_SEI_NUT, 0, first_nal_in_au);
+    if (encoder->vbv.maxrate > 0 && state->global->is_idr_frame) {
+      encoder_state_write_buffering_period_sei_message(state);
+    }
     encoder_state_write_picture_timing_sei_message(state);
 
     // spec:sei_rbsp() rbsp_trailing_bits
@@ -901,6 +1011,24 @@ static void encoder_state_write_bitstream_main(encoder_state_t * const state)
     state->global->cur_gop_bits_coded = 0;
   }
   state->global->cur_gop_bits_coded += newpos - curpos;
+
+  if (encoder->cfg->pass == 1) {
+    kvz_twopass_write_frame(state, newpos - curpos);
+  }
+
+  if (encoder->analysis_save) {
+    kvz_analysis_save_frame(state);
+  }
+
+  if (encoder->vbv.maxrate > 0) {
+    kvz_vbv_update(state, newpos - curpos);
+
+    if (state->global->is_idr_frame) {
+      state->global->hrd_bp_frame = state->global->frame;
+    } else {
+      state->global->hrd_bp_frame = state->previous_encoder_state->global->hrd_bp_frame;
+    }
+  }
 }
 
 void kvz_encoder_state_write_bitstream_leaf(encoder_state_t * const state)
@@ -38,11 +38,70 @@ static int encoder_state_config_global_init(encoder_state_t * const state) {
   state->global->cur_gop_bits_coded = 0;
   state->global->rc_alpha = 3.2003;
   state->global->rc_beta = -1.367;
+
+  state->global->lcu_weights = NULL;
+  if (state->encoder_control->cfg->lcu_rc) {
+    const encoder_control_t * const encoder = state->encoder_control;
+    state->global->lcu_weights = MALLOC(double, encoder->in.width_in_lcu * encoder->in.height_in_lcu);
+    if (!state->global->lcu_weights) {
+      fprintf(stderr, "Failed to allocate the LCU weights!\n");
+      return 0;
+    }
+  }
+
+  state->global->lcu_bits = NULL;
+  if (state->encoder_control->cfg->pass == 1) {
+    const encoder_control_t * const encoder = state->encoder_control;
+    state->global->lcu_bits = MALLOC(uint32_t, encoder->in.width_in_lcu * encoder->in.height_in_lcu);
+    if (!state->global->lcu_bits) {
+      fprintf(stderr, "Failed to allocate the LCU statistics!\n");
+      return 0;
+    }
+  }
+
+  state->global->analysis = NULL;
+  state->global->analysis_loaded = false;
+  if (state->encoder_control->analysis_load) {
+    const encoder_control_t * const encoder = state->encoder_control;
+    const int num_scu = (encoder->in.width_in_lcu << MAX_DEPTH) *
+                        (encoder->in.height_in_lcu << MAX_DEPTH);
+    state->global->analysis = MALLOC(cu_info_t, num_scu);
+    if (!state->global->analysis) {
+      fprintf(stderr, "Failed to allocate the analysis!\n");
+      return 0;
+    }
+  }
+
+  state->global->aq_offsets = NULL;
+  if (state->encoder_control->cfg->aq != KVZ_AQ_OFF) {
+    const encoder_control_t * const encoder = state->encoder_control;
+    const int qg_depth = encoder->max_qp_delta_depth;
+    const int num_qgs = (encoder->in.width_in_lcu << qg_depth) *
+                        (encoder->in.height_in_lcu << qg_depth);
+    state->global->aq_offsets = MALLOC(double, num_qgs);
+    if (!state->global->aq_offsets) {
+      fprintf(stderr, "Failed to allocate the AQ offsets!\n");
+      return 0;
+    }
+  }
+
+  FILL(state->global->pyramid, 0);
+  state->global->subpel_planes = NULL;
+  state->global->block_hash = NULL;
   return 1;
 }
 
 static void encoder_state_config_global_finalize(encoder_state_t * const state) {
   kvz_image_list_destroy(state->global->ref);
+  FREE_POINTER(state->global->lcu_weights);
+  FREE_POINTER(state->global->lcu_bits);
+  FREE_POINTER(state->global->analysis);
+  FREE_POINTER(state->global->aq_offsets);
+  for (int level = 0; level < ME_PYRAMID_LEVELS; ++level) {
+    kvz_image_free(state->global->pyramid[level]);
+  }
+  kvz_subpel_planes_free(state->global->subpel_planes);
+  kvz_blockhash_free(state->global->block_hash);
 }
 
 static int encoder_state_config_tile_init(encoder_state_t * const state, 
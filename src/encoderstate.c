@@ -43,6 +43,8 @@
 #include "sao.h"
 #include "rdo.h"
 #include "rate_control.h"
+#include "analysis.h"
+#include "strategies/strategies-quant.h"
 
 int kvz_encoder_state_match_children_of_previous_frame(encoder_state_t * const state) {
   int i;
@@ -182,6 +184,91 @@ static void encode_sao(encoder_state_t * const state,
 }
 
 
+/**
+ * \brief Get the predicted QP of a quantization group.
+ * \param state      encoder state
+ * \param x          x-coordinate of a CU in the quantization group in SCUs
+ * \param y          y-coordinate of a CU in the quantization group in SCUs
+ * \param last_qp    QP of the previous CU in decoding order
+ * \return           predicted QP (spec: qPY_PRED)
+ *
+ * The QPs of the CUs to the left and above are used only when they are
+ * in the same LCU.
+ */
+static int8_t get_cu_ref_qp(const encoder_state_t * const state,
+                            int x, int y, int8_t last_qp)
+{
+  const videoframe_t * const frame = state->tile->frame;
+  const int qg_width = LCU_CU_WIDTH >> MAX(0, state->encoder_control->max_qp_delta_depth);
+  const int x_qg = x & ~(qg_width - 1);
+  const int y_qg = y & ~(qg_width - 1);
+
+  int qp_a = last_qp;
+  int qp_b = last_qp;
+  if (x_qg % LCU_CU_WIDTH != 0) {
+    qp_a = kvz_videoframe_get_cu_const(frame, x_qg - 1, y_qg)->qp;
+  }
+  if (y_qg % LCU_CU_WIDTH != 0) {
+    qp_b = kvz_videoframe_get_cu_const(frame, x_qg, y_qg - 1)->qp;
+  }
+  return (qp_a + qp_b + 1) >> 1;
+}
+
+/**
+ * \brief Set the QP of the CUs to the value the decoder derives for them.
+ * \param state      encoder state
+ * \param x          x-coordinate of the CU in SCUs
+ * \param y          y-coordinate of the CU in SCUs
+ * \param depth      depth of the CU
+ * \param last_qp    QP of the previous CU in decoding order
+ * \param qp_pred    predicted QP of the current quantization group
+ * \param coded      set when cu_qp_delta has been coded in the current
+ *                   quantization group
+ *
+ * The CUs preceding the first CU with coefficients in a quantization group
+ * use the predicted QP, because cu_qp_delta has not been coded yet.
+ */
+static void set_cu_qps(encoder_state_t * const state, int x, int y, int depth,
+                       int8_t *last_qp, int8_t *qp_pred, bool *coded)
+{
+  videoframe_t * const frame = state->tile->frame;
+  if (x * (LCU_WIDTH >> MAX_DEPTH) >= frame->width ||
+      y * (LCU_WIDTH >> MAX_DEPTH) >= frame->height)
+  {
+    // Outside the picture.
+    return;
+  }
+
+  if (depth <= state->encoder_control->max_qp_delta_depth) {
+    *qp_pred = get_cu_ref_qp(state, x, y, *last_qp);
+    *coded = false;
+  }
+
+  cu_info_t *cu = kvz_videoframe_get_cu(frame, x, y);
+  const int width = LCU_CU_WIDTH >> depth;
+
+  if (cu->depth > depth) {
+    const int half = width / 2;
+    set_cu_qps(state, x,        y,        depth + 1, last_qp, qp_pred, coded);
+    set_cu_qps(state, x + half, y,        depth + 1, last_qp, qp_pred, coded);
+    set_cu_qps(state, x,        y + half, depth + 1, last_qp, qp_pred, coded);
+    set_cu_qps(state, x + half, y + half, depth + 1, last_qp, qp_pred, coded);
+    return;
+  }
+
+  if (cu->cbf.y || cu->cbf.u || cu->cbf.v) {
+    *coded = true;
+  }
+  const int8_t qp = *coded ? cu->qp : *qp_pred;
+  *last_qp = qp;
+
+  for (int y_scu = y; y_scu < y + width; ++y_scu) {
+    for (int x_scu = x; x_scu < x + width; ++x_scu) {
+      kvz_videoframe_get_cu(frame, x_scu, y_scu)->qp = qp;
+    }
+  }
+}
+
 static void encoder_state_worker_encode_lcu(void * opaque) {
   const lcu_order_element_t * const lcu = opaque;
   encoder_state_t *state = lcu->encoder_state;
@@ -190,7 +277,18 @@ static void encoder_state_worker_encode_lcu(void * opaque) {
   
   //This part doesn't write to bitstream, it's only search, deblock and sao
   
-  kvz_search_lcu(state, lcu->position_px.x, lcu->position_px.y, state->tile->hor_buf_search, state->tile->ver_buf_search);
+  kvz_set_lcu_lambda_and_qp(state, lcu);
+
+  const bool static_lcu = kvz_search_lcu(state, lcu->position_px.x, lcu->position_px.y,
+                                         state->tile->hor_buf_search, state->tile->ver_buf_search);
+
+  {
+    int8_t last_qp = state->last_qp;
+    int8_t qp_pred = state->qp_pred;
+    bool coded = false;
+    set_cu_qps(state, lcu->position.x << MAX_DEPTH, lcu->position.y << MAX_DEPTH, 0,
+               &last_qp, &qp_pred, &coded);
+  }
     
   encoder_state_recdata_to_bufs(state, lcu, state->tile->hor_buf_search, state->tile->ver_buf_search);
 
@@ -198,7 +296,13 @@ static void encoder_state_worker_encode_lcu(void * opaque) {
     kvz_filter_deblock_lcu(state, lcu->position_px.x, lcu->position_px.y);
   }
 
-  if (encoder->sao_enable) {
+  if (encoder->sao_enable && static_lcu) {
+    // The reconstruction is copied from a reference picture, which has
+    // already been filtered.
+    const int index = lcu->position.y * frame->width_in_lcu + lcu->position.x;
+    FILL(frame->sao_luma[index], 0);
+    FILL(frame->sao_chroma[index], 0);
+  } else if (encoder->sao_enable) {
     const int stride = frame->width_in_lcu;
     int32_t merge_cost_luma[3] = { INT32_MAX };
     int32_t merge_cost_chroma[3] = { INT32_MAX };
@@ -278,6 +382,8 @@ static void encoder_state_worker_encode_lcu(void * opaque) {
     kvz_bitstream_add_rbsp_trailing_bits(&state->stream); 
   }
   
+  const uint64_t lcu_start_bits = kvz_cabac_bits_written(&state->cabac);
+
   //Encode SAO
   if (encoder->sao_enable) {
     encode_sao(state, lcu->position.x, lcu->position.y, &frame->sao_luma[lcu->position.y * frame->width_in_lcu + lcu->position.x], &frame->sao_chroma[lcu->position.y * frame->width_in_lcu + lcu->position.x]);
@@ -286,6 +392,11 @@ static void encoder_state_worker_encode_lcu(void * opaque) {
   //Encode coding tree
   kvz_encode_coding_tree(state, lcu->position.x << MAX_DEPTH, lcu->position.y << MAX_DEPTH, 0);
 
+  if (state->global->lcu_bits) {
+    const int lcu_addr_in_rs = encoder->tiles_ctb_addr_ts_to_rs[lcu->id + state->tile->lcu_offset_in_ts];
+    state->global->lcu_bits[lcu_addr_in_rs] = kvz_cabac_bits_written(&state->cabac) - lcu_start_bits;
+  }
+
   //Terminator
   if (lcu->index < state->lcu_order_count - 1) {
     //Since we don't handle slice segments, end of slice segment == end of slice
@@ -451,17 +562,16 @@ static void encoder_state_worker_sao_reconstruct_lcu(void *opaque) {
   kvz_pixel *new_u_data = MALLOC(kvz_pixel, (frame->width * frame->height) >> 2);
   kvz_pixel *new_v_data = MALLOC(kvz_pixel, (frame->width * frame->height) >> 2);
   
-  const int offset = frame->width * (data->y*LCU_WIDTH);
-  const int offset_c = frame->width/2 * (data->y*LCU_WIDTH_C);
-  int num_pixels = frame->width * (LCU_WIDTH + 2);
-  
-  if (num_pixels + offset > frame->width * frame->height) {
-    num_pixels = frame->width * frame->height - offset;
-  }
-  
-  memcpy(&new_y_data[offset], &frame->rec->y[offset], sizeof(kvz_pixel) * num_pixels);
-  memcpy(&new_u_data[offset_c], &frame->rec->u[offset_c], sizeof(kvz_pixel) * num_pixels >> 2);
-  memcpy(&new_v_data[offset_c], &frame->rec->v[offset_c], sizeof(kvz_pixel) * num_pixels >> 2);
+  const int y_start = data->y * LCU_WIDTH;
+  const int num_rows = MIN(LCU_WIDTH + 2, frame->height - y_start);
+  const int rec_stride = frame->rec->stride;
+
+  kvz_pixels_blit(&frame->rec->y[y_start * rec_stride], &new_y_data[y_start * frame->width],
+                  frame->width, num_rows, rec_stride, frame->width);
+  kvz_pixels_blit(&frame->rec->u[y_start / 2 * rec_stride / 2], &new_u_data[y_start / 2 * frame->width / 2],
+                  frame->width / 2, num_rows / 2, rec_stride / 2, frame->width / 2);
+  kvz_pixels_blit(&frame->rec->v[y_start / 2 * rec_stride / 2], &new_v_data[y_start / 2 * frame->width / 2],
+                  frame->width / 2, num_rows / 2, rec_stride / 2, frame->width / 2);
   
   if (data->y>0) {
     //copy first row from buffer
@@ -487,6 +597,160 @@ static void encoder_state_worker_sao_reconstruct_lcu(void *opaque) {
 }
 
 
+typedef struct {
+  int y_start;
+  int y_end;
+  const encoder_state_t * encoder_state;
+} worker_finish_ref_data;
+
+static void encoder_state_worker_finish_ref(void *opaque) {
+  worker_finish_ref_data *data = opaque;
+  const encoder_state_t * const state = data->encoder_state;
+
+  kvz_picture * const rec = state->tile->frame->rec;
+
+  kvz_image_extend_borders(rec, FRAME_PADDING_LUMA, data->y_start, data->y_end);
+  if (state->global->subpel_planes) {
+    kvz_inter_interpolate_subpel_planes(rec, state->global->subpel_planes,
+                                        data->y_start, data->y_end);
+  }
+
+  free(opaque);
+}
+
+/**
+ * \brief Return whether any state in the tree has a reconstruction job.
+ */
+static bool encoder_state_recon_in_jobs(const encoder_state_t * const state)
+{
+  if (state->tqj_recon_done) return true;
+  for (int i = 0; state->children[i].encoder_control; ++i) {
+    if (encoder_state_recon_in_jobs(&state->children[i])) return true;
+  }
+  return false;
+}
+
+/**
+ * \brief Make a job depend on the reconstruction jobs of every state in
+ * the tree.
+ */
+static void encoder_state_add_recon_deps(const encoder_state_t * const state,
+                                         threadqueue_job_t * const job)
+{
+  for (int i = 0; state->children[i].encoder_control; ++i) {
+    encoder_state_add_recon_deps(&state->children[i], job);
+  }
+  if (state->tqj_recon_done) {
+    kvz_threadqueue_job_dep_add(job, state->tqj_recon_done);
+  }
+}
+
+/**
+ * \brief Replace the reconstruction jobs of every state in the tree.
+ *
+ * The following frames wait for tqj_recon_done of the states which have
+ * one, so those are replaced and the rest are left empty.
+ */
+static void encoder_state_replace_recon_done(encoder_state_t * const state,
+                                             threadqueue_job_t * const job)
+{
+  for (int i = 0; state->children[i].encoder_control; ++i) {
+    encoder_state_replace_recon_done(&state->children[i], job);
+  }
+  if (state->tqj_recon_done) {
+    state->tqj_recon_done = job;
+  }
+}
+
+/**
+ * \brief Add jobs for preparing the picture for use as a reference.
+ *
+ * The jobs fill the padding around the picture and interpolate the
+ * fractional sample planes, if there are any. With wavefronts, each LCU row
+ * is prepared once the row below it is reconstructed and the rows above it
+ * are prepared. Otherwise the whole picture is prepared once it is
+ * reconstructed. The jobs replace tqj_recon_done of the states, so the
+ * following frames wait for the preparation instead of the reconstruction.
+ */
+static void encoder_state_schedule_finish_ref(encoder_state_t * const main_state) {
+  const videoframe_t * const frame = main_state->tile->frame;
+
+  // Find the state whose children are the wavefront rows, if the tree is a
+  // chain down to them.
+  encoder_state_t *wf_parent = main_state;
+  while (wf_parent->children[0].encoder_control &&
+         !wf_parent->children[1].encoder_control &&
+         wf_parent->children[0].type != ENCODER_STATE_TYPE_WAVEFRONT_ROW) {
+    wf_parent = &wf_parent->children[0];
+  }
+
+  if (wf_parent->children[0].encoder_control &&
+      wf_parent->children[0].type == ENCODER_STATE_TYPE_WAVEFRONT_ROW) {
+    threadqueue_job_t *previous_job = NULL;
+    for (int i = 0; wf_parent->children[i].encoder_control; ++i) {
+      encoder_state_t * const row = &wf_parent->children[i];
+      const encoder_state_t * const below = wf_parent->children[i + 1].encoder_control ?
+                                            &wf_parent->children[i + 1] : NULL;
+      worker_finish_ref_data *data = MALLOC(worker_finish_ref_data, 1);
+      data->y_start = row->wfrow->lcu_offset_y * LCU_WIDTH;
+      data->y_end = MIN(data->y_start + LCU_WIDTH, frame->height);
+      data->encoder_state = main_state;
+#ifdef KVZ_DEBUG
+      char job_description[256];
+      sprintf(job_description, "type=finish_ref,frame=%d,px_y=%d-%d", main_state->global->frame, data->y_start, data->y_end - 1);
+#else
+      char* job_description = NULL;
+#endif
+      threadqueue_job_t *job = kvz_threadqueue_submit(main_state->encoder_control->threadqueue, encoder_state_worker_finish_ref, data, 1, job_description);
+      if (job) {
+        // Deblocking the LCU row below changes the bottom rows of this one,
+        // and the interpolation filter reaches 4 rows into it.
+        if (row->tqj_recon_done) {
+          kvz_threadqueue_job_dep_add(job, row->tqj_recon_done);
+        }
+        if (below && below->tqj_recon_done) {
+          kvz_threadqueue_job_dep_add(job, below->tqj_recon_done);
+        }
+        // Waiting for a row then means waiting for all rows above it.
+        if (previous_job) {
+          kvz_threadqueue_job_dep_add(job, previous_job);
+        }
+        kvz_threadqueue_job_unwait_job(main_state->encoder_control->threadqueue, job);
+      }
+      row->tqj_recon_done = job;
+      previous_job = job;
+    }
+    return;
+  }
+
+  worker_finish_ref_data *data = MALLOC(worker_finish_ref_data, 1);
+  data->y_start = 0;
+  data->y_end = frame->height;
+  data->encoder_state = main_state;
+
+  if (!encoder_state_recon_in_jobs(main_state)) {
+    // The picture was encoded in this thread and the next one will be too,
+    // so the reference must be ready before returning.
+    encoder_state_worker_finish_ref(data);
+    return;
+  }
+
+#ifdef KVZ_DEBUG
+  char job_description[256];
+  sprintf(job_description, "type=finish_ref,frame=%d,px_y=%d-%d", main_state->global->frame, data->y_start, data->y_end - 1);
+#else
+  char* job_description = NULL;
+#endif
+  threadqueue_job_t *job = kvz_threadqueue_submit(main_state->encoder_control->threadqueue, encoder_state_worker_finish_ref, data, 1, job_description);
+  if (job) {
+    // With tiles the reconstruction jobs belong to states deeper in the
+    // tree than the children of the main state.
+    encoder_state_add_recon_deps(main_state, job);
+    kvz_threadqueue_job_unwait_job(main_state->encoder_control->threadqueue, job);
+  }
+  encoder_state_replace_recon_done(main_state, job);
+}
+
 static int encoder_state_tree_is_a_chain(const encoder_state_t * const state) {
   if (!state->children[0].encoder_control) return 1;
   if (state->children[1].encoder_control) return 0;
@@ -758,6 +1022,44 @@ static void encoder_state_reset_poc(encoder_state_t *state) {
   }
 }
 
+/**
+ * \brief Build the downscaled pictures for pyramid motion estimation.
+ *
+ * The pyramid is built from the source picture once per frame and it is
+ * given to the following frames with the reference picture.
+ */
+static void encoder_state_build_pyramid(encoder_state_t * const state)
+{
+  const kvz_picture *src = state->tile->frame->source;
+  for (int level = 0; level < ME_PYRAMID_LEVELS; ++level) {
+    kvz_image_free(state->global->pyramid[level]);
+    state->global->pyramid[level] = kvz_image_downscale(src);
+    assert(state->global->pyramid[level]);
+    src = state->global->pyramid[level];
+  }
+}
+
+/**
+ * \brief Return whether the picture of the state is used as a reference.
+ */
+static bool encoder_state_is_ref(const encoder_state_t * const state)
+{
+  const kvz_config * const cfg = state->encoder_control->cfg;
+  return !cfg->gop_len ||
+         !state->global->poc ||
+         cfg->gop[state->global->gop_offset].is_ref;
+}
+
+/**
+ * \brief Return the source picture to keep in the reference list, or NULL
+ * if it is not needed.
+ */
+static kvz_picture * encoder_state_ref_source(const encoder_state_t * const state)
+{
+  if (!state->encoder_control->cfg->static_skip) return NULL;
+  return state->tile->frame->source;
+}
+
 static void encoder_state_new_frame(encoder_state_t * const state) {
   int i;
   //FIXME Move this somewhere else!
@@ -817,6 +1119,35 @@ static void encoder_state_new_frame(encoder_state_t * const state) {
     state->global->cur_lambda_cost = lambda;
     state->global->cur_lambda_cost_sqrt = sqrt(lambda);
 
+    if (encoder->cfg->lcu_rc) {
+      kvz_set_lcu_weights(state);
+    }
+
+    if (encoder->cfg->aq != KVZ_AQ_OFF) {
+      kvz_set_aq_offsets(state);
+    }
+
+    if (encoder->analysis_load) {
+      kvz_analysis_load_frame(state);
+    }
+
+    if (encoder->cfg->me_pyramid) {
+      encoder_state_build_pyramid(state);
+    }
+
+    kvz_subpel_planes_free(state->global->subpel_planes);
+    state->global->subpel_planes = NULL;
+    if (encoder->cfg->subpel_planes && encoder_state_is_ref(state)) {
+      state->global->subpel_planes = kvz_subpel_planes_alloc(state->tile->frame->width,
+                                                             state->tile->frame->height);
+      assert(state->global->subpel_planes);
+    }
+
+    kvz_blockhash_free(state->global->block_hash);
+    state->global->block_hash = NULL;
+    if (encoder->cfg->hash_me && encoder_state_is_ref(state)) {
+      state->global->block_hash = kvz_blockhash_alloc(state->tile->frame->source);
+    }
   }
   kvz_bitstream_clear(&state->stream);
   
@@ -824,6 +1155,22 @@ static void encoder_state_new_frame(encoder_state_t * const state) {
     //Leaf states have cabac and context
     kvz_cabac_start(&state->cabac);
     kvz_init_contexts(state, state->global->QP, state->global->slicetype);
+
+    // QP prediction starts from the slice QP at the start of each slice,
+    // tile and wavefront row.
+    state->qp = state->global->QP;
+    state->lambda = state->global->cur_lambda_cost;
+    state->lambda_sqrt = state->global->cur_lambda_cost_sqrt;
+    state->last_qp = state->global->QP;
+    state->qp_pred = state->global->QP;
+    state->must_code_qp_delta = false;
+
+    FILL(state->split_term_cost, 0);
+    FILL(state->split_term_count, 0);
+
+    if (state->encoder_control->cfg->lcu_rc) {
+      kvz_allocate_leaf_bits(state);
+    }
   }
   
   //Clear the jobs
@@ -863,6 +1210,9 @@ void kvz_encode_one_frame(encoder_state_t * const state)
     encoder_state_encode(state);
     PERFORMANCE_MEASURE_END(KVZ_PERF_FRAME, state->encoder_control->threadqueue, "type=encode,frame=%d", state->global->frame);
   }
+  if (encoder_state_is_ref(state)) {
+    encoder_state_schedule_finish_ref(state);
+  }
   //kvz_threadqueue_flush(main_state->encoder_control->threadqueue);
   {
     threadqueue_job_t *job;
@@ -891,8 +1241,6 @@ void kvz_encode_one_frame(encoder_state_t * const state)
 
 void kvz_encoder_next_frame(encoder_state_t *state)
 {
-  const encoder_control_t * const encoder = state->encoder_control;
-
   // The previous frame must be done before the next one is started.
   assert(state->frame_done);
 
@@ -902,7 +1250,7 @@ void kvz_encoder_next_frame(encoder_state_t *state)
     state->global->poc = 0;
     assert(!state->tile->frame->source);
     assert(!state->tile->frame->rec);
-    state->tile->frame->rec = kvz_image_alloc(state->tile->frame->width, state->tile->frame->height);
+    state->tile->frame->rec = kvz_image_alloc_padded(state->tile->frame->width, state->tile->frame->height, FRAME_PADDING_LUMA);
     assert(state->tile->frame->rec);
     state->prepared = 1;
     return;
@@ -919,7 +1267,7 @@ void kvz_encoder_next_frame(encoder_state_t *state)
     kvz_image_free(state->tile->frame->source);
     state->tile->frame->source = NULL;
     kvz_image_free(state->tile->frame->rec);
-    state->tile->frame->rec = kvz_image_alloc(state->tile->frame->width, state->tile->frame->height);
+    state->tile->frame->rec = kvz_image_alloc_padded(state->tile->frame->width, state->tile->frame->height, FRAME_PADDING_LUMA);
     assert(state->tile->frame->rec);
     {
       // Allocate height_in_scu x width_in_scu x sizeof(CU_info)
@@ -929,13 +1277,15 @@ void kvz_encoder_next_frame(encoder_state_t *state)
     }
     kvz_videoframe_set_poc(state->tile->frame, state->global->poc);
     kvz_image_list_copy_contents(state->global->ref, prev_state->global->ref);
-    if (!encoder->cfg->gop_len ||
-        !prev_state->global->poc ||
-        encoder->cfg->gop[prev_state->global->gop_offset].is_ref) {
+    if (encoder_state_is_ref(prev_state)) {
       kvz_image_list_add(state->global->ref,
                      prev_state->tile->frame->rec,
                      prev_state->tile->frame->cu_array,
-                     prev_state->global->poc);
+                     prev_state->global->poc,
+                     prev_state->global->pyramid,
+                     prev_state->global->subpel_planes,
+                     prev_state->global->block_hash,
+                     encoder_state_ref_source(prev_state));
     }
 
     state->prepared = 1;
@@ -943,14 +1293,16 @@ void kvz_encoder_next_frame(encoder_state_t *state)
   }
 
 
-  if (!encoder->cfg->gop_len ||
-      !state->global->poc ||
-      encoder->cfg->gop[state->global->gop_offset].is_ref) {
+  if (encoder_state_is_ref(state)) {
     // Add current reconstructed picture as reference
     kvz_image_list_add(state->global->ref,
                    state->tile->frame->rec,
                    state->tile->frame->cu_array,
-                   state->global->poc);
+                   state->global->poc,
+                   state->global->pyramid,
+                   state->global->subpel_planes,
+                   state->global->block_hash,
+                   encoder_state_ref_source(state));
   }
 
 
@@ -964,7 +1316,7 @@ void kvz_encoder_next_frame(encoder_state_t *state)
   // Remove current reconstructed picture, and alloc a new one
   kvz_image_free(state->tile->frame->rec);
 
-  state->tile->frame->rec = kvz_image_alloc(state->tile->frame->width, state->tile->frame->height);
+  state->tile->frame->rec = kvz_image_alloc_padded(state->tile->frame->width, state->tile->frame->height, FRAME_PADDING_LUMA);
   assert(state->tile->frame->rec);
   kvz_videoframe_set_poc(state->tile->frame, state->global->poc);
   state->prepared = 1;
@@ -991,6 +1343,11 @@ void kvz_encode_coding_tree(encoder_state_t * const state,
   uint8_t border_split_y = ((state->encoder_control->in.height) < ((abs_y_ctb + 1) * (LCU_WIDTH >> MAX_DEPTH) + (LCU_WIDTH >> (depth + 1)))) ? 0 : 1;
   uint8_t border = border_x | border_y; /*!< are we in any border CU */
 
+  if (depth <= state->encoder_control->max_qp_delta_depth) {
+    state->must_code_qp_delta = true;
+    state->qp_pred = get_cu_ref_qp(state, x_ctb, y_ctb, state->last_qp);
+  }
+
   // When not in MAX_DEPTH, insert split flag and split the blocks if needed
   if (depth != MAX_DEPTH) {
     // Implisit split flag when on border
@@ -1027,7 +1384,7 @@ void kvz_encode_coding_tree(encoder_state_t * const state,
     }
   }
 
-
+  state->last_qp = cur_cu->qp;
 
     // Encode skip flag
   if (state->global->slicetype != KVZ_SLICE_I) {
@@ -1429,6 +1786,34 @@ coeff_scan_order_t kvz_get_scan_order(int8_t cu_type, int intra_mode, int depth)
 }
 
 
+/**
+ * \brief Write cu_qp_delta_abs and cu_qp_delta_sign_flag.
+ * \param state      encoder state
+ * \param qp_delta   difference between the CU QP and the predicted QP
+ */
+static void encode_qp_delta(encoder_state_t * const state, int qp_delta)
+{
+  cabac_data_t * const cabac = &state->cabac;
+  const unsigned qp_delta_abs = abs(qp_delta);
+
+  // Prefix is truncated unary with cMax = 5, suffix is EG0.
+  const unsigned prefix = MIN(qp_delta_abs, 5);
+  for (unsigned i = 0; i < prefix; ++i) {
+    cabac->cur_ctx = &cabac->ctx.cu_qp_delta_abs[i > 0];
+    CABAC_BIN(cabac, 1, "cu_qp_delta_abs");
+  }
+  if (prefix < 5) {
+    cabac->cur_ctx = &cabac->ctx.cu_qp_delta_abs[prefix > 0];
+    CABAC_BIN(cabac, 0, "cu_qp_delta_abs");
+  } else {
+    kvz_cabac_write_ep_ex_golomb(cabac, qp_delta_abs - 5, 0);
+  }
+
+  if (qp_delta_abs > 0) {
+    CABAC_BIN_EP(cabac, qp_delta < 0, "cu_qp_delta_sign_flag");
+  }
+}
+
 static void encode_transform_unit(encoder_state_t * const state,
                                   int x_pu, int y_pu, int depth)
 {
@@ -1593,6 +1978,10 @@ void kvz_encode_transform_coeff(encoder_state_t * const state, int32_t x_pu,int3
   }
 
   if (cb_flag_y | cb_flag_u | cb_flag_v) {
+    if (state->must_code_qp_delta) {
+      encode_qp_delta(state, cur_cu->qp - state->qp_pred);
+      state->must_code_qp_delta = false;
+    }
     encode_transform_unit(state, x_pu, y_pu, depth);
   }
 }
@@ -1607,8 +1996,8 @@ void kvz_encode_coeff_nxn(encoder_state_t * const state, coeff_t *coeff, uint8_t
   uint8_t last_coeff_y = 0;
   int32_t i;
   uint32_t sig_coeffgroup_flag[64];
+  uint16_t sig_masks[64];
 
-  uint32_t num_nonzero = 0;
   int32_t scan_pos_last = -1;
   int32_t pos_last = 0;
   int32_t shift   = 4>>1;
@@ -1629,17 +2018,20 @@ void kvz_encode_coeff_nxn(encoder_state_t * const state, coeff_t *coeff, uint8_t
   cabac_ctx_t *base_coeff_group_ctx = &(cabac->ctx.cu_sig_coeff_group_model[type]);
   cabac_ctx_t *baseCtx           = (type == 0) ? &(cabac->ctx.cu_sig_model_luma[0]) :
                                  &(cabac->ctx.cu_sig_model_chroma[0]);
-  FILL(sig_coeffgroup_flag, 0);
 
-  // Count non-zero coeffs
-  for (i = 0; i < width * width; i++) {
-    if (coeff[i] != 0) {
-      num_nonzero++;
-    }
+  // Significance mapping
+  kvz_coeff_group_masks(coeff, width, scan_mode, sig_masks);
+  for (i = 0; i < num_blk_side * num_blk_side; i++) {
+    sig_coeffgroup_flag[i] = (sig_masks[i] != 0);
+  }
+
+  last_scan_set = num_blk_side * num_blk_side - 1;
+  while (last_scan_set >= 0 && sig_masks[scan_cg[last_scan_set]] == 0) {
+    last_scan_set--;
   }
 
   // Transforms with no non-zero coefficients are indicated with CBFs.
-  assert(num_nonzero != 0);
+  assert(last_scan_set >= 0);
 
   // transform skip flag
   if(width == 4 && encoder->trskip_enable) {
@@ -1647,22 +2039,11 @@ void kvz_encode_coeff_nxn(encoder_state_t * const state, coeff_t *coeff, uint8_t
     CABAC_BIN(cabac, tr_skip, "transform_skip_flag");
   }
 
-  scan_pos_last = -1;
-
-  // Significance mapping
-  while (num_nonzero > 0) {
-    pos_last = scan[++scan_pos_last];
-#define POSY (pos_last >> log2_block_size)
-#define POSX (pos_last - ( POSY << log2_block_size ))
-
-    if (coeff[pos_last] != 0) {
-      sig_coeffgroup_flag[(num_blk_side * (POSY >> shift) + (POSX >> shift))] = 1;
-    }
-
-    num_nonzero -= (coeff[pos_last] != 0) ? 1 : 0;
-    #undef POSY
-    #undef POSX
+  scan_pos_last = (last_scan_set << 4) + 15;
+  for (uint32_t mask = sig_masks[scan_cg[last_scan_set]]; !(mask & 0x8000); mask <<= 1) {
+    scan_pos_last--;
   }
+  pos_last = scan[scan_pos_last];
 
   last_coeff_x = pos_last & (width - 1);
   last_coeff_y = (uint8_t)(pos_last >> log2_block_size);
@@ -1672,7 +2053,6 @@ void kvz_encode_coeff_nxn(encoder_state_t * const state, coeff_t *coeff, uint8_t
                              type, scan_mode);
 
   scan_pos_sig  = scan_pos_last;
-  last_scan_set = (scan_pos_last >> 4);
 
   // significant_coeff_flag
   for (i = last_scan_set; i >= 0; i--) {
@@ -1681,6 +2061,7 @@ void kvz_encode_coeff_nxn(encoder_state_t * const state, coeff_t *coeff, uint8_t
     int32_t cg_blk_pos     = scan_cg[i];
     int32_t cg_pos_y       = cg_blk_pos / num_blk_side;
     int32_t cg_pos_x       = cg_blk_pos - (cg_pos_y * num_blk_side);
+    uint32_t sig_mask      = sig_masks[cg_blk_pos];
 
     uint32_t coeff_signs   = 0;
     int32_t last_nz_pos_in_cg = -1;
@@ -1715,7 +2096,7 @@ void kvz_encode_coeff_nxn(encoder_state_t * const state, coeff_t *coeff, uint8_t
         blk_pos = scan[scan_pos_sig];
         pos_y   = blk_pos >> log2_block_size;
         pos_x   = blk_pos - (pos_y << log2_block_size);
-        sig    = (coeff[blk_pos] != 0) ? 1 : 0;
+        sig    = (sig_mask >> (scan_pos_sig - sub_pos)) & 1;
 
         if (scan_pos_sig > sub_pos || i == 0 || num_non_zero) {
           ctx_sig  = kvz_context_get_sig_ctx_inc(pattern_sig_ctx, scan_mode, pos_x, pos_y,
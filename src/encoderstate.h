@@ -92,10 +92,47 @@ typedef struct {
   //! Number of bits targeted for the current GOP.
   double cur_gop_target_bits;
 
+  //! Number of bits targeted for the current picture.
+  double cur_pic_target_bits;
+
+  //! Share of the picture bits for each LCU in raster scan, if LCU level
+  //! rate control is enabled.
+  double *lcu_weights;
+
+  //! Number of bits of each LCU in raster scan, in the first pass of
+  //! two-pass encoding.
+  uint32_t *lcu_bits;
+
+  //! Mode decisions of the picture loaded from the analysis file, for
+  //! each SCU in raster scan.
+  cu_info_t *analysis;
+  bool analysis_loaded;
+
+  //! QP offsets of adaptive quantization for each quantization group in
+  //! raster scan.
+  double *aq_offsets;
+
+  //! Source picture downscaled by 2 and 4 for pyramid motion estimation.
+  kvz_picture *pyramid[ME_PYRAMID_LEVELS];
+
+  //! Fractional sample planes of the reconstruction, if the picture is used
+  //! as a reference.
+  kvz_subpel_planes_t *subpel_planes;
+
+  //! Hash table of the blocks of the source picture, if the picture is used
+  //! as a reference and hash motion estimation is enabled.
+  kvz_blockhash_t *block_hash;
+
   // Parameters used in rate control
   double rc_alpha;
   double rc_beta;
 
+  //! Number of bits in the VBV buffer when the next picture is removed.
+  double vbv_fullness;
+
+  //! Number of the last frame with a buffering period SEI.
+  int32_t hrd_bp_frame;
+
 } encoder_state_config_global_t;
 
 typedef struct {
@@ -198,6 +235,39 @@ typedef struct encoder_state_t {
   int frame_done;
 
   uint32_t stats_bitstream_length; //Bitstream length written in bytes
+
+  //! QP and lambdas used for the CU currently being encoded.
+  int8_t qp;
+  double lambda;      //!< \brief Lambda for SSE
+  double lambda_sqrt; //!< \brief Lambda for SAD and SATD
+
+  //! QP and lambda of the LCU before adaptive quantization.
+  int8_t lcu_qp;
+  double lcu_lambda;
+
+  //! QpY of the previous CU in decoding order (spec: qPY_PREV).
+  int8_t last_qp;
+  //! Predicted QP of the current quantization group (spec: qPY_PRED).
+  int8_t qp_pred;
+  //! Set when cu_qp_delta has not been coded in the current quantization group.
+  bool must_code_qp_delta;
+
+  //! Ranges of CU depths searched in the current LCU.
+  struct {
+    int8_t min;
+    int8_t max;
+  } pu_depth_inter, pu_depth_intra;
+
+  //! Sum of the costs per pixel and number of the CUs at each depth that
+  //! were not split in the current picture, for adaptive termination of
+  //! the split search.
+  double split_term_cost[MAX_PU_DEPTH + 1];
+  int32_t split_term_count[MAX_PU_DEPTH + 1];
+
+  //! Number of bits targeted for the LCUs of a leaf state.
+  double rc_target_bits;
+  //! Sum of the LCU weights of the LCUs not yet encoded in a leaf state.
+  double rc_remaining_weight;
   
   //Jobs to wait for
   threadqueue_job_t * tqj_recon_done; //Reconstruction is done
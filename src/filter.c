@@ -195,13 +195,10 @@ void kvz_filter_deblock_edge_luma(encoder_state_t * const state,
     int16_t x_cu = xpos>>MIN_SIZE,y_cu = ypos>>MIN_SIZE;
     int8_t strength = 0;
 
-    int32_t qp              = state->global->QP;
     int32_t bitdepth_scale  = 1 << (encoder->bitdepth - 8);
-    int32_t b_index         = CLIP(0, 51, qp + (beta_offset_div2 << 1));
-    int32_t beta            = kvz_g_beta_table_8x8[b_index] * bitdepth_scale;
-    int32_t side_threshold  = (beta + (beta >>1 )) >> 3;
     uint32_t blocks_in_part = (LCU_WIDTH >> depth) / 4;
     uint32_t block_idx;
+    int32_t qp, b_index, beta, side_threshold;
     int32_t tc_index,tc,thr_cut;
 
     if (dir == EDGE_VER) {
@@ -209,8 +206,6 @@ void kvz_filter_deblock_edge_luma(encoder_state_t * const state,
       step = stride;
     }
 
-    // TODO: add CU based QP calculation
-
     // For each 4-pixel part in the edge
     for (block_idx = 0; block_idx < blocks_in_part; ++block_idx) {
       int32_t dp0, dq0, dp3, dq3, d0, d3, dp, dq, d;
@@ -307,6 +302,10 @@ void kvz_filter_deblock_edge_luma(encoder_state_t * const state,
           }
         }
 
+        qp              = (cu_q->qp + cu_p->qp + 1) >> 1;
+        b_index         = CLIP(0, 51, qp + (beta_offset_div2 << 1));
+        beta            = kvz_g_beta_table_8x8[b_index] * bitdepth_scale;
+        side_threshold  = (beta + (beta >>1 )) >> 3;
         tc_index        = CLIP(0, 51 + 2, (int32_t)(qp + 2*(strength - 1) + (tc_offset_div2 << 1)));
         tc              = kvz_g_tc_table_8x8[tc_index] * bitdepth_scale;
         thr_cut         = tc * 10;
@@ -390,10 +389,8 @@ void kvz_filter_deblock_edge_chroma(encoder_state_t * const state,
     int16_t x_cu = x>>(MIN_SIZE-1),y_cu = y>>(MIN_SIZE-1);
     int8_t strength = 2;
 
-    int32_t QP             = kvz_g_chroma_scale[state->global->QP];
     int32_t bitdepth_scale = 1 << (encoder->bitdepth-8);
-    int32_t TC_index       = CLIP(0, 51+2, (int32_t)(QP + 2*(strength-1) + (tc_offset_div2 << 1)));
-    int32_t Tc             = kvz_g_tc_table_8x8[TC_index]*bitdepth_scale;
+    int32_t QP, TC_index, Tc;
 
     // Special handling for depth 4. It's meaning is that we want to bypass
     // last block in LCU check in order to deblock just that block.
@@ -421,6 +418,10 @@ void kvz_filter_deblock_edge_chroma(encoder_state_t * const state,
 
       // Only filter when strenght == 2 (one of the blocks is intra coded)
       if (cu_q->type == CU_INTRA || cu_p->type == CU_INTRA) {
+        QP       = kvz_g_chroma_scale[(cu_q->qp + cu_p->qp + 1) >> 1];
+        TC_index = CLIP(0, 51+2, (int32_t)(QP + 2*(strength-1) + (tc_offset_div2 << 1)));
+        Tc       = kvz_g_tc_table_8x8[TC_index]*bitdepth_scale;
+
         // Chroma U
         kvz_filter_deblock_chroma(encoder, src_u + step * (4*blk_idx + 0), offset, Tc, 0, 0);
         kvz_filter_deblock_chroma(encoder, src_u + step * (4*blk_idx + 1), offset, Tc, 0, 0);
@@ -40,15 +40,33 @@
  * \return image pointer or NULL on failure
  */
 kvz_picture *kvz_image_alloc(const int32_t width, const int32_t height)
+{
+  return kvz_image_alloc_padded(width, height, 0);
+}
+
+/**
+ * \brief Allocate a new image with a border around the pixel arrays.
+ *
+ * The luma has padding pixels of border on each side and the chroma half of
+ * that. The border is filled by kvz_image_extend_borders.
+ *
+ * \param width    width of the image
+ * \param height   height of the image
+ * \param padding  width of the luma border
+ * \return image pointer or NULL on failure
+ */
+kvz_picture *kvz_image_alloc_padded(const int32_t width, const int32_t height, const int32_t padding)
 {
   //Assert that we have a well defined image
   assert((width % 2) == 0);
   assert((height % 2) == 0);
+  assert((padding % 2) == 0);
 
   kvz_picture *im = MALLOC(kvz_picture, 1);
   if (!im) return NULL;
 
-  unsigned int luma_size = width * height;
+  const int32_t stride = width + 2 * padding;
+  unsigned int luma_size = stride * (height + 2 * padding);
   unsigned int chroma_size = luma_size / 4;
 
   //Allocate memory
@@ -62,11 +80,13 @@ kvz_picture *kvz_image_alloc(const int32_t width, const int32_t height)
   im->refcount = 1; //We give a reference to caller
   im->width = width;
   im->height = height;
-  im->stride = width;
+  im->stride = stride;
 
-  im->y = im->data[COLOR_Y] = &im->fulldata[0];
-  im->u = im->data[COLOR_U] = &im->fulldata[luma_size];
-  im->v = im->data[COLOR_V] = &im->fulldata[luma_size + chroma_size];
+  const int32_t luma_offset = padding * stride + padding;
+  const int32_t chroma_offset = (padding / 2) * (stride / 2) + padding / 2;
+  im->y = im->data[COLOR_Y] = &im->fulldata[luma_offset];
+  im->u = im->data[COLOR_U] = &im->fulldata[luma_size + chroma_offset];
+  im->v = im->data[COLOR_V] = &im->fulldata[luma_size + chroma_size + chroma_offset];
 
   im->pts = 0;
   im->dts = 0;
@@ -156,6 +176,98 @@ kvz_picture *kvz_image_make_subimage(kvz_picture *const orig_image,
   return im;
 }
 
+/**
+ * \brief Replicate the edge pixels of rows of a pixel array to its border.
+ *
+ * The rows above the array are filled when y_start is 0 and the rows below
+ * it when y_end is height.
+ */
+static void extend_plane(kvz_pixel *const data, const int32_t stride,
+                         const int32_t width, const int32_t height,
+                         const int32_t padding,
+                         const int32_t y_start, const int32_t y_end)
+{
+  for (int y = y_start; y < y_end; ++y) {
+    kvz_pixel *row = &data[y * stride];
+    for (int x = 1; x <= padding; ++x) {
+      row[-x] = row[0];
+      row[width - 1 + x] = row[width - 1];
+    }
+  }
+
+  const int32_t row_length = (width + 2 * padding) * sizeof(kvz_pixel);
+  if (y_start == 0) {
+    for (int y = 1; y <= padding; ++y) {
+      memcpy(&data[-y * stride - padding], &data[-padding], row_length);
+    }
+  }
+  if (y_end == height) {
+    const kvz_pixel *last_row = &data[(height - 1) * stride - padding];
+    for (int y = 1; y <= padding; ++y) {
+      memcpy(&data[(height - 1 + y) * stride - padding], last_row, row_length);
+    }
+  }
+}
+
+/**
+ * \brief Fill the border of an image allocated with kvz_image_alloc_padded.
+ *
+ * Only the part of the border next to luma rows y_start to y_end - 1 is
+ * filled, so that the border can be filled as the rows are finished.
+ *
+ * \param im       image to extend
+ * \param padding  width of the luma border
+ * \param y_start  first luma row, a multiple of two
+ * \param y_end    luma row after the last one, a multiple of two
+ */
+void kvz_image_extend_borders(kvz_picture *const im, const int32_t padding,
+                              const int32_t y_start, const int32_t y_end)
+{
+  extend_plane(im->y, im->stride, im->width, im->height,
+               padding, y_start, y_end);
+  extend_plane(im->u, im->stride / 2, im->width / 2, im->height / 2,
+               padding / 2, y_start / 2, y_end / 2);
+  extend_plane(im->v, im->stride / 2, im->width / 2, im->height / 2,
+               padding / 2, y_start / 2, y_end / 2);
+}
+
+/**
+ * \brief Make a copy of the luma of an image downscaled by two.
+ *
+ * Each pixel is the average of a 2x2 block of the original. The size is
+ * rounded up to an even number and the last row and column are
+ * replicated if necessary. The luma is padded like reconstructed pictures.
+ * Chroma planes are left uninitialized.
+ *
+ * \param orig_image  image to downscale
+ * \return new image, or NULL on failure
+ */
+kvz_picture *kvz_image_downscale(const kvz_picture *const orig_image)
+{
+  const int width = ((orig_image->width + 1) / 2 + 1) & ~1;
+  const int height = ((orig_image->height + 1) / 2 + 1) & ~1;
+
+  kvz_picture *im = kvz_image_alloc_padded(width, height, FRAME_PADDING_LUMA);
+  if (!im) return NULL;
+
+  for (int y = 0; y < height; ++y) {
+    const int y0 = MIN(2 * y, orig_image->height - 1);
+    const int y1 = MIN(2 * y + 1, orig_image->height - 1);
+    const kvz_pixel *row0 = &orig_image->y[y0 * orig_image->stride];
+    const kvz_pixel *row1 = &orig_image->y[y1 * orig_image->stride];
+    kvz_pixel *dst = &im->y[y * im->stride];
+
+    for (int x = 0; x < width; ++x) {
+      const int x0 = MIN(2 * x, orig_image->width - 1);
+      const int x1 = MIN(2 * x + 1, orig_image->width - 1);
+      dst[x] = (row0[x0] + row0[x1] + row1[x0] + row1[x1] + 2) >> 2;
+    }
+  }
+  extend_plane(im->y, im->stride, width, height, FRAME_PADDING_LUMA, 0, height);
+
+  return im;
+}
+
 yuv_t * kvz_yuv_t_alloc(int luma_size)
 {
   // Get buffers with separate mallocs in order to take advantage of
@@ -198,224 +310,50 @@ void kvz_hi_prec_buf_t_free(hi_prec_buf_t * yuv)
   free(yuv);
 }
 
-
 /**
- * \brief Diagonally interpolate SAD outside the frame.
+ * \brief Allocate the fractional sample planes of a picture.
  *
- * \param data1   Starting point of the first picture.
- * \param data2   Starting point of the second picture.
- * \param width   Width of the region for which SAD is calculated.
- * \param height  Height of the region for which SAD is calculated.
- * \param width  Width of the pixel array.
+ * The planes are filled by kvz_inter_interpolate_subpel_planes.
  *
- * \returns Sum of Absolute Differences
+ * \param width   width of the picture
+ * \param height  height of the picture
+ * \return planes or NULL on failure
  */
-static unsigned cor_sad(const kvz_pixel *pic_data, const kvz_pixel *ref_data,
-                        int block_width, int block_height, unsigned pic_stride)
+kvz_subpel_planes_t * kvz_subpel_planes_alloc(int32_t width, int32_t height)
 {
-  kvz_pixel ref = *ref_data;
-  int x, y;
-  unsigned sad = 0;
+  kvz_subpel_planes_t *planes = MALLOC(kvz_subpel_planes_t, 1);
+  if (!planes) return NULL;
 
-  for (y = 0; y < block_height; ++y) {
-    for (x = 0; x < block_width; ++x) {
-      sad += abs(pic_data[y * pic_stride + x] - ref);
-    }
+  planes->data = MALLOC(kvz_pixel, SUBPEL_PLANES * width * height);
+  if (!planes->data) {
+    free(planes);
+    return NULL;
   }
 
-  return sad;
-}
+  planes->stride = width;
+  planes->height = height;
+  planes->refcount = 1; // We give a reference to caller
 
-/**
- * \brief Vertically interpolate SAD outside the frame.
- *
- * \param data1   Starting point of the first picture.
- * \param data2   Starting point of the second picture.
- * \param width   Width of the region for which SAD is calculated.
- * \param height  Height of the region for which SAD is calculated.
- * \param width  Width of the pixel array.
- *
- * \returns Sum of Absolute Differences
- */
-static unsigned ver_sad(const kvz_pixel *pic_data, const kvz_pixel *ref_data,
-                        int block_width, int block_height, unsigned pic_stride)
-{
-  int x, y;
-  unsigned sad = 0;
-
-  for (y = 0; y < block_height; ++y) {
-    for (x = 0; x < block_width; ++x) {
-      sad += abs(pic_data[y * pic_stride + x] - ref_data[x]);
-    }
-  }
-
-  return sad;
+  return planes;
 }
 
-/**
- * \brief Horizontally interpolate SAD outside the frame.
- *
- * \param data1   Starting point of the first picture.
- * \param data2   Starting point of the second picture.
- * \param width   Width of the region for which SAD is calculated.
- * \param height  Height of the region for which SAD is calculated.
- * \param width   Width of the pixel array.
- *
- * \returns Sum of Absolute Differences
- */
-static unsigned hor_sad(const kvz_pixel *pic_data, const kvz_pixel *ref_data,
-                        int block_width, int block_height, unsigned pic_stride, unsigned ref_stride)
+kvz_subpel_planes_t * kvz_subpel_planes_copy_ref(kvz_subpel_planes_t *planes)
 {
-  int x, y;
-  unsigned sad = 0;
-
-  for (y = 0; y < block_height; ++y) {
-    for (x = 0; x < block_width; ++x) {
-      sad += abs(pic_data[y * pic_stride + x] - ref_data[y * ref_stride]);
-    }
-  }
+  // The caller should have had another reference.
+  assert(planes->refcount > 0);
+  ATOMIC_INC(&(planes->refcount));
 
-  return sad;
+  return planes;
 }
 
-
-/**
- * \brief  Handle special cases of comparing blocks that are not completely
- *         inside the frame.
- *
- * \param pic  First frame.
- * \param ref  Second frame.
- * \param pic_x  X coordinate of the first block.
- * \param pic_y  Y coordinate of the first block.
- * \param ref_x  X coordinate of the second block.
- * \param ref_y  Y coordinate of the second block.
- * \param block_width  Width of the blocks.
- * \param block_height  Height of the blocks.
- */
-static unsigned image_interpolated_sad(const kvz_picture *pic, const kvz_picture *ref,
-                                 int pic_x, int pic_y, int ref_x, int ref_y,
-                                 int block_width, int block_height)
+void kvz_subpel_planes_free(kvz_subpel_planes_t *planes)
 {
-  kvz_pixel *pic_data, *ref_data;
-
-  int left, right, top, bottom;
-  int result = 0;
-
-  // Change the movement vector to point right next to the frame. This doesn't
-  // affect the result but removes some special cases.
-  if (ref_x > ref->width)            ref_x = ref->width;
-  if (ref_y > ref->height)           ref_y = ref->height;
-  if (ref_x + block_width < 0)  ref_x = -block_width;
-  if (ref_y + block_height < 0) ref_y = -block_height;
-
-  // These are the number of pixels by how far the movement vector points
-  // outside the frame. They are always >= 0. If all of them are 0, the
-  // movement vector doesn't point outside the frame.
-  left   = (ref_x < 0) ? -ref_x : 0;
-  top    = (ref_y < 0) ? -ref_y : 0;
-  right  = (ref_x + block_width  > ref->width)  ? ref_x + block_width  - ref->width  : 0;
-  bottom = (ref_y + block_height > ref->height) ? ref_y + block_height - ref->height : 0;
-
-  // Center picture to the current block and reference to the point where
-  // movement vector is pointing to. That point might be outside the buffer,
-  // but that is ok because we project the movement vector to the buffer
-  // before dereferencing the pointer.
-  pic_data = &pic->y[pic_y * pic->stride + pic_x];
-  ref_data = &ref->y[ref_y * ref->stride + ref_x];
-
-  // The handling of movement vectors that point outside the picture is done
-  // in the following way.
-  // - Correct the index of ref_data so that it points to the top-left
-  //   of the area we want to compare against.
-  // - Correct the index of pic_data to point inside the current block, so
-  //   that we compare the right part of the block to the ref_data.
-  // - Reduce block_width and block_height so that the the size of the area
-  //   being compared is correct.
-  if (top && left) {
-    result += cor_sad(pic_data,
-                      &ref_data[top * ref->stride + left],
-                      left, top, pic->stride);
-    result += ver_sad(&pic_data[left],
-                      &ref_data[top * ref->stride + left],
-                      block_width - left, top, pic->stride);
-    result += hor_sad(&pic_data[top * pic->stride],
-                      &ref_data[top * ref->stride + left],
-                      left, block_height - top, pic->stride, ref->stride);
-    result += kvz_reg_sad(&pic_data[top * pic->stride + left],
-                      &ref_data[top * ref->stride + left],
-                      block_width - left, block_height - top, pic->stride, ref->stride);
-  } else if (top && right) {
-    result += ver_sad(pic_data,
-                      &ref_data[top * ref->stride],
-                      block_width - right, top, pic->stride);
-    result += cor_sad(&pic_data[block_width - right],
-                      &ref_data[top * ref->stride + (block_width - right - 1)],
-                      right, top, pic->stride);
-    result += kvz_reg_sad(&pic_data[top * pic->stride],
-                      &ref_data[top * ref->stride],
-                      block_width - right, block_height - top, pic->stride, ref->stride);
-    result += hor_sad(&pic_data[top * pic->stride + (block_width - right)],
-                      &ref_data[top * ref->stride + (block_width - right - 1)],
-                      right, block_height - top, pic->stride, ref->stride);
-  } else if (bottom && left) {
-    result += hor_sad(pic_data,
-                      &ref_data[left],
-                      left, block_height - bottom, pic->stride, ref->stride);
-    result += kvz_reg_sad(&pic_data[left],
-                      &ref_data[left],
-                      block_width - left, block_height - bottom, pic->stride, ref->stride);
-    result += cor_sad(&pic_data[(block_height - bottom) * pic->stride],
-                      &ref_data[(block_height - bottom - 1) * ref->stride + left],
-                      left, bottom, pic->stride);
-    result += ver_sad(&pic_data[(block_height - bottom) * pic->stride + left],
-                      &ref_data[(block_height - bottom - 1) * ref->stride + left],
-                      block_width - left, bottom, pic->stride);
-  } else if (bottom && right) {
-    result += kvz_reg_sad(pic_data,
-                      ref_data,
-                      block_width - right, block_height - bottom, pic->stride, ref->stride);
-    result += hor_sad(&pic_data[block_width - right],
-                      &ref_data[block_width - right - 1],
-                      right, block_height - bottom, pic->stride, ref->stride);
-    result += ver_sad(&pic_data[(block_height - bottom) * pic->stride],
-                      &ref_data[(block_height - bottom - 1) * ref->stride],
-                      block_width - right, bottom, pic->stride);
-    result += cor_sad(&pic_data[(block_height - bottom) * pic->stride + block_width - right],
-                      &ref_data[(block_height - bottom - 1) * ref->stride + block_width - right - 1],
-                      right, bottom, pic->stride);
-  } else if (top) {
-    result += ver_sad(pic_data,
-                      &ref_data[top * ref->stride],
-                      block_width, top, pic->stride);
-    result += kvz_reg_sad(&pic_data[top * pic->stride],
-                      &ref_data[top * ref->stride],
-                      block_width, block_height - top, pic->stride, ref->stride);
-  } else if (bottom) {
-    result += kvz_reg_sad(pic_data,
-                      ref_data,
-                      block_width, block_height - bottom, pic->stride, ref->stride);
-    result += ver_sad(&pic_data[(block_height - bottom) * pic->stride],
-                      &ref_data[(block_height - bottom - 1) * ref->stride],
-                      block_width, bottom, pic->stride);
-  } else if (left) {
-    result += hor_sad(pic_data,
-                      &ref_data[left],
-                      left, block_height, pic->stride, ref->stride);
-    result += kvz_reg_sad(&pic_data[left],
-                      &ref_data[left],
-                      block_width - left, block_height, pic->stride, ref->stride);
-  } else if (right) {
-    result += kvz_reg_sad(pic_data,
-                      ref_data,
-                      block_width - right, block_height, pic->stride, ref->stride);
-    result += hor_sad(&pic_data[block_width - right],
-                      &ref_data[block_width - right - 1],
-                      right, block_height, pic->stride, ref->stride);
-  } else {
-    result += kvz_reg_sad(pic_data, ref_data, block_width, block_height, pic->stride, ref->stride);
-  }
+  if (!planes) return;
+
+  if (ATOMIC_DEC(&(planes->refcount)) > 0) return;
 
-  return result;
+  free(planes->data);
+  free(planes);
 }
 
 
@@ -423,7 +361,8 @@ static unsigned image_interpolated_sad(const kvz_picture *pic, const kvz_picture
 * \brief Calculate interpolated SAD between two blocks.
 *
 * \param pic        Image for the block we are trying to find.
-* \param ref        Image where we are trying to find the block.
+* \param ref        Image where we are trying to find the block. It must
+*                   be padded by at least the size of the block.
 *
 * \returns  
 */
@@ -446,17 +385,84 @@ unsigned kvz_image_calc_sad(const kvz_picture *pic, const kvz_picture *ref, int
     }
   }
 
-  if (ref_x >= 0 && ref_x <= ref->width  - block_width &&
-      ref_y >= 0 && ref_y <= ref->height - block_height)
-  {
-    // Reference block is completely inside the frame, so just calculate the
-    // SAD directly. This is the most common case, which is why it's first.
-    const kvz_pixel *pic_data = &pic->y[pic_y * pic->stride + pic_x];
-    const kvz_pixel *ref_data = &ref->y[ref_y * ref->stride + ref_x];
-    return kvz_reg_sad(pic_data, ref_data, block_width, block_height, pic->stride, ref->stride)>>(KVZ_BIT_DEPTH-8);
+  // The reference is padded by at least the size of the block, so a block
+  // outside the frame can be moved right next to it without changing the
+  // result.
+  ref_x = CLIP(-block_width, ref->width, ref_x);
+  ref_y = CLIP(-block_height, ref->height, ref_y);
+
+  const kvz_pixel *pic_data = &pic->y[pic_y * pic->stride + pic_x];
+  const kvz_pixel *ref_data = &ref->y[ref_y * ref->stride + ref_x];
+  return kvz_reg_sad(pic_data, ref_data, block_width, block_height, pic->stride, ref->stride)>>(KVZ_BIT_DEPTH-8);
+}
+
+
+/**
+ * \brief Calculate SAD between a block and several blocks of a reference.
+ *
+ * Gives the same costs as calling kvz_image_calc_sad for each reference
+ * position, but compares up to four positions at once so that the block
+ * is only loaded once for them.
+ *
+ * \param pic        Image for the block we are trying to find.
+ * \param ref        Image where we are trying to find the block. It must
+ *                   be padded by at least the size of the block.
+ * \param ref_x      x coordinates of the blocks in ref
+ * \param ref_y      y coordinates of the blocks in ref
+ * \param count      number of positions
+ * \param costs_out  returns the costs of the positions
+ */
+void kvz_image_calc_sad_multi(const kvz_picture *pic, const kvz_picture *ref, int pic_x, int pic_y,
+                              const int *ref_x, const int *ref_y, int count,
+                              int block_width, int block_height, int max_lcu_below,
+                              unsigned *costs_out)
+{
+  assert(pic_x >= 0 && pic_x <= pic->width - block_width);
+  assert(pic_y >= 0 && pic_y <= pic->height - block_height);
+
+  const kvz_pixel *pic_data = &pic->y[pic_y * pic->stride + pic_x];
+  const kvz_pixel *ref_data[4];
+  unsigned *ref_costs[4];
+  int num_refs = 0;
+
+  for (int i = 0; i < count; ++i) {
+    if (max_lcu_below >= 0) {
+      // Same check as in kvz_image_calc_sad.
+      int mv_lcu_row_reach = (ref_y[i] + block_height - 1 + 2) / LCU_WIDTH;
+      int cur_lcu_row = pic_y / LCU_WIDTH;
+      if (mv_lcu_row_reach > cur_lcu_row + max_lcu_below) {
+        costs_out[i] = INT_MAX;
+        continue;
+      }
+    }
+
+    const int x = CLIP(-block_width, ref->width, ref_x[i]);
+    const int y = CLIP(-block_height, ref->height, ref_y[i]);
+    ref_data[num_refs] = &ref->y[y * ref->stride + x];
+    ref_costs[num_refs] = &costs_out[i];
+    ++num_refs;
+
+    if (num_refs == 4) {
+      unsigned sads[4];
+      kvz_reg_sad_x4(pic_data, ref_data, block_width, block_height, pic->stride, ref->stride, sads);
+      for (int j = 0; j < 4; ++j) {
+        *ref_costs[j] = sads[j] >> (KVZ_BIT_DEPTH - 8);
+      }
+      num_refs = 0;
+    }
+  }
+
+  // Positions left over from the groups of four.
+  unsigned sads[4];
+  if (num_refs == 3) {
+    kvz_reg_sad_x3(pic_data, ref_data, block_width, block_height, pic->stride, ref->stride, sads);
   } else {
-    // Call a routine that knows how to interpolate pixels outside the frame.
-    return image_interpolated_sad(pic, ref, pic_x, pic_y, ref_x, ref_y, block_width, block_height) >> (KVZ_BIT_DEPTH - 8);
+    for (int j = 0; j < num_refs; ++j) {
+      sads[j] = kvz_reg_sad(pic_data, ref_data[j], block_width, block_height, pic->stride, ref->stride);
+    }
+  }
+  for (int j = 0; j < num_refs; ++j) {
+    *ref_costs[j] = sads[j] >> (KVZ_BIT_DEPTH - 8);
   }
 }
 
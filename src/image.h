@@ -28,6 +28,19 @@
 #include "global.h"
 #include "kvazaar.h"
 
+//! Number of downscaled pictures used in pyramid motion estimation. Level n
+//! is downscaled by 2^(n+1).
+#define ME_PYRAMID_LEVELS 2
+
+//! Width of the border of replicated pixels around reconstructed pictures.
+//! It fits a 64x64 block with the reach of the 8-tap interpolation filter,
+//! so motion vectors can be clamped instead of checking every pixel.
+#define FRAME_PADDING_LUMA 80
+#define FRAME_PADDING_CHROMA (FRAME_PADDING_LUMA / 2)
+
+//! Number of fractional luma sample planes of a reference picture.
+#define SUBPEL_PLANES 15
+
 typedef struct {
   kvz_pixel y[LCU_LUMA_SIZE];
   kvz_pixel u[LCU_CHROMA_SIZE];
@@ -48,8 +61,22 @@ typedef struct {
   kvz_pixel *v;
 } yuv_t;
 
+/**
+ * \brief Fractional luma sample planes of a picture.
+ *
+ * The SUBPEL_PLANES planes are stored one after another. Each plane has
+ * height rows of stride pixels.
+ */
+typedef struct {
+  kvz_pixel *data;    //!< \brief Pixels of all the planes.
+  int32_t stride;     //!< \brief Distance between rows of a plane.
+  int32_t height;     //!< \brief Number of rows in a plane.
+  int32_t refcount;
+} kvz_subpel_planes_t;
+
 
 kvz_picture *kvz_image_alloc(const int32_t width, const int32_t height);
+kvz_picture *kvz_image_alloc_padded(const int32_t width, const int32_t height, const int32_t padding);
 
 void kvz_image_free(kvz_picture *im);
 
@@ -61,16 +88,29 @@ kvz_picture *kvz_image_make_subimage(kvz_picture *const orig_image,
                              const unsigned width,
                              const unsigned height);
 
+void kvz_image_extend_borders(kvz_picture *im, int32_t padding,
+                              int32_t y_start, int32_t y_end);
+
+kvz_picture *kvz_image_downscale(const kvz_picture *orig_image);
+
 yuv_t * kvz_yuv_t_alloc(int luma_size);
 void kvz_yuv_t_free(yuv_t * yuv);
 
 hi_prec_buf_t * kvz_hi_prec_buf_t_alloc(int luma_size);
 void kvz_hi_prec_buf_t_free(hi_prec_buf_t * yuv);
 
+kvz_subpel_planes_t * kvz_subpel_planes_alloc(int32_t width, int32_t height);
+kvz_subpel_planes_t * kvz_subpel_planes_copy_ref(kvz_subpel_planes_t *planes);
+void kvz_subpel_planes_free(kvz_subpel_planes_t *planes);
+
 
 //Algorithms
 unsigned kvz_image_calc_sad(const kvz_picture *pic, const kvz_picture *ref, int pic_x, int pic_y, int ref_x, int ref_y,
                         int block_width, int block_height, int max_lcu_below);
+void kvz_image_calc_sad_multi(const kvz_picture *pic, const kvz_picture *ref, int pic_x, int pic_y,
+                              const int *ref_x, const int *ref_y, int count,
+                              int block_width, int block_height, int max_lcu_below,
+                              unsigned *costs_out);
 
 
 unsigned kvz_pixels_calc_ssd(const kvz_pixel *const ref, const kvz_pixel *const rec,
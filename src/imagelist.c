@@ -44,6 +44,10 @@ image_list_t * kvz_image_list_alloc(int size)
   if (size > 0) {
     list->images = (kvz_picture**)malloc(sizeof(kvz_picture*) * size);
     list->cu_arrays = (cu_array_t**)malloc(sizeof(cu_array_t*) * size);
+    list->pyramids = malloc(sizeof(*list->pyramids) * size);
+    list->subpel_planes = (kvz_subpel_planes_t**)malloc(sizeof(kvz_subpel_planes_t*) * size);
+    list->block_hashes = (kvz_blockhash_t**)malloc(sizeof(kvz_blockhash_t*) * size);
+    list->sources = (kvz_picture**)malloc(sizeof(kvz_picture*) * size);
     list->pocs = malloc(sizeof(int32_t) * size);
   }
 
@@ -62,9 +66,15 @@ int kvz_image_list_resize(image_list_t *list, unsigned size)
 {
   list->images = (kvz_picture**)realloc(list->images, sizeof(kvz_picture*) * size);
   list->cu_arrays = (cu_array_t**)realloc(list->cu_arrays, sizeof(cu_array_t*) * size);
+  list->pyramids = realloc(list->pyramids, sizeof(*list->pyramids) * size);
+  list->subpel_planes = (kvz_subpel_planes_t**)realloc(list->subpel_planes, sizeof(kvz_subpel_planes_t*) * size);
+  list->block_hashes = (kvz_blockhash_t**)realloc(list->block_hashes, sizeof(kvz_blockhash_t*) * size);
+  list->sources = (kvz_picture**)realloc(list->sources, sizeof(kvz_picture*) * size);
   list->pocs = realloc(list->pocs, sizeof(int32_t) * size);
   list->size = size;
-  return size == 0 || (list->images && list->cu_arrays && list->pocs);
+  return size == 0 || (list->images && list->cu_arrays && list->pyramids &&
+                       list->subpel_planes && list->block_hashes && list->sources &&
+                       list->pocs);
 }
 
 /**
@@ -81,6 +91,16 @@ int kvz_image_list_destroy(image_list_t *list)
       list->images[i] = NULL;
       kvz_cu_array_free(list->cu_arrays[i]);
       list->cu_arrays[i] = NULL;
+      for (int level = 0; level < ME_PYRAMID_LEVELS; ++level) {
+        kvz_image_free(list->pyramids[i][level]);
+        list->pyramids[i][level] = NULL;
+      }
+      kvz_subpel_planes_free(list->subpel_planes[i]);
+      list->subpel_planes[i] = NULL;
+      kvz_blockhash_free(list->block_hashes[i]);
+      list->block_hashes[i] = NULL;
+      kvz_image_free(list->sources[i]);
+      list->sources[i] = NULL;
       list->pocs[i] = 0;
     }
   }
@@ -88,10 +108,18 @@ int kvz_image_list_destroy(image_list_t *list)
   if (list->size > 0) {
     free(list->images);
     free(list->cu_arrays);
+    free(list->pyramids);
+    free(list->subpel_planes);
+    free(list->block_hashes);
+    free(list->sources);
     free(list->pocs);
   }
   list->images = NULL;
   list->cu_arrays = NULL;
+  list->pyramids = NULL;
+  list->subpel_planes = NULL;
+  list->block_hashes = NULL;
+  list->sources = NULL;
   list->pocs = NULL;
   free(list);
   return 1;
@@ -101,9 +129,15 @@ int kvz_image_list_destroy(image_list_t *list)
  * \brief Add picture to the front of the picturelist
  * \param pic picture pointer to add
  * \param picture_list list to use
+ * \param pyramid ME_PYRAMID_LEVELS downscaled pictures, or NULL
+ * \param subpel_planes interpolated fractional sample planes, or NULL
+ * \param block_hash hash table of the source picture, or NULL
+ * \param source source picture, or NULL
  * \return 1 on success
  */
-int kvz_image_list_add(image_list_t *list, kvz_picture *im, cu_array_t *cua, int32_t poc)
+int kvz_image_list_add(image_list_t *list, kvz_picture *im, cu_array_t *cua, int32_t poc,
+                       kvz_picture *const *pyramid, kvz_subpel_planes_t *subpel_planes,
+                       kvz_blockhash_t *block_hash, kvz_picture *source)
 {
   int i = 0;
   if (ATOMIC_INC(&(im->refcount)) == 1) {
@@ -125,11 +159,24 @@ int kvz_image_list_add(image_list_t *list, kvz_picture *im, cu_array_t *cua, int
   for (i = list->used_size; i > 0; i--) {
     list->images[i] = list->images[i - 1];
     list->cu_arrays[i] = list->cu_arrays[i - 1];
+    memcpy(list->pyramids[i], list->pyramids[i - 1], sizeof(*list->pyramids));
+    list->subpel_planes[i] = list->subpel_planes[i - 1];
+    list->block_hashes[i] = list->block_hashes[i - 1];
+    list->sources[i] = list->sources[i - 1];
     list->pocs[i] = list->pocs[i - 1];
   }
 
   list->images[0] = im;
   list->cu_arrays[0] = cua;
+  for (int level = 0; level < ME_PYRAMID_LEVELS; ++level) {
+    list->pyramids[0][level] = NULL;
+    if (pyramid && pyramid[level]) {
+      list->pyramids[0][level] = kvz_image_copy_ref(pyramid[level]);
+    }
+  }
+  list->subpel_planes[0] = subpel_planes ? kvz_subpel_planes_copy_ref(subpel_planes) : NULL;
+  list->block_hashes[0] = block_hash ? kvz_blockhash_copy_ref(block_hash) : NULL;
+  list->sources[0] = source ? kvz_image_copy_ref(source) : NULL;
   list->pocs[0] = poc;
   
   list->used_size++;
@@ -151,6 +198,12 @@ int kvz_image_list_rem(image_list_t * const list, const unsigned n)
   }
 
   kvz_image_free(list->images[n]);
+  for (int level = 0; level < ME_PYRAMID_LEVELS; ++level) {
+    kvz_image_free(list->pyramids[n][level]);
+  }
+  kvz_subpel_planes_free(list->subpel_planes[n]);
+  kvz_blockhash_free(list->block_hashes[n]);
+  kvz_image_free(list->sources[n]);
 
   if (!kvz_cu_array_free(list->cu_arrays[n])) {
     fprintf(stderr, "Could not free cu_array!\n");
@@ -162,6 +215,10 @@ int kvz_image_list_rem(image_list_t * const list, const unsigned n)
   if (n == list->used_size - 1) {
     list->images[n] = NULL;
     list->cu_arrays[n] = NULL;
+    memset(list->pyramids[n], 0, sizeof(*list->pyramids));
+    list->subpel_planes[n] = NULL;
+    list->block_hashes[n] = NULL;
+    list->sources[n] = NULL;
     list->pocs[n] = 0;
     list->used_size--;
   } else {
@@ -170,10 +227,18 @@ int kvz_image_list_rem(image_list_t * const list, const unsigned n)
     for (i = n; i < list->used_size - 1; ++i) {
       list->images[i] = list->images[i + 1];
       list->cu_arrays[i] = list->cu_arrays[i + 1];
+      memcpy(list->pyramids[i], list->pyramids[i + 1], sizeof(*list->pyramids));
+      list->subpel_planes[i] = list->subpel_planes[i + 1];
+      list->block_hashes[i] = list->block_hashes[i + 1];
+      list->sources[i] = list->sources[i + 1];
       list->pocs[i] = list->pocs[i + 1];
     }
     list->images[list->used_size - 1] = NULL;
     list->cu_arrays[list->used_size - 1] = NULL;
+    memset(list->pyramids[list->used_size - 1], 0, sizeof(*list->pyramids));
+    list->subpel_planes[list->used_size - 1] = NULL;
+    list->block_hashes[list->used_size - 1] = NULL;
+    list->sources[list->used_size - 1] = NULL;
     list->pocs[list->used_size - 1] = 0;
     list->used_size--;
   }
@@ -188,7 +253,9 @@ int kvz_image_list_copy_contents(image_list_t *target, image_list_t *source) {
   }
   
   for (i = source->used_size - 1; i >= 0; --i) {
-    kvz_image_list_add(target, source->images[i], source->cu_arrays[i], source->pocs[i]);
+    kvz_image_list_add(target, source->images[i], source->cu_arrays[i], source->pocs[i],
+                       source->pyramids[i], source->subpel_planes[i],
+                       source->block_hashes[i], source->sources[i]);
   }
   return 1;
 }
@@ -27,6 +27,7 @@
 
 #include "image.h"
 #include "cu.h"
+#include "blockhash.h"
 
 /**
  * \brief Struct which contains array of picture structs
@@ -35,6 +36,14 @@ typedef struct
 {
   struct kvz_picture* *images;          //!< \brief Pointer to array of picture pointers.
   cu_array_t* *cu_arrays;
+  //! Downscaled pictures for pyramid motion estimation, or NULL.
+  struct kvz_picture* (*pyramids)[ME_PYRAMID_LEVELS];
+  //! Interpolated fractional sample planes, or NULL.
+  kvz_subpel_planes_t* *subpel_planes;
+  //! Hash tables of the blocks of the source pictures, or NULL.
+  kvz_blockhash_t* *block_hashes;
+  //! Source pictures, or NULL.
+  struct kvz_picture* *sources;
   int32_t *pocs;
   uint32_t size;       //!< \brief Array size.
   uint32_t used_size;
@@ -43,7 +52,9 @@ typedef struct
 image_list_t * kvz_image_list_alloc(int size);
 int kvz_image_list_resize(image_list_t *list, unsigned size);
 int kvz_image_list_destroy(image_list_t *list);
-int kvz_image_list_add(image_list_t *list, kvz_picture *im, cu_array_t* cua, int32_t poc);
+int kvz_image_list_add(image_list_t *list, kvz_picture *im, cu_array_t* cua, int32_t poc,
+                       kvz_picture *const *pyramid, kvz_subpel_planes_t *subpel_planes,
+                       kvz_blockhash_t *block_hash, kvz_picture *source);
 int kvz_image_list_rem(image_list_t *list, unsigned n);
 
 int kvz_image_list_copy_contents(image_list_t *target, image_list_t *source);
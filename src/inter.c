@@ -34,6 +34,8 @@
 #include "strategies/generic/ipol-generic.h"
 #include "strategies/generic/picture-generic.h"
 
+extern const int8_t kvz_g_luma_filter[4][8];
+
 /**
  * \brief Set block info to the CU structure
  * \param pic picture to use
@@ -64,23 +66,174 @@ void kvz_inter_set_block(videoframe_t* frame, uint32_t x_cu, uint32_t y_cu, uint
   }
 }
 
+/**
+ * \brief Get a fractional sample plane of a reference picture.
+ *
+ * Pixel (x, y) of the plane is the luma sample at position
+ * (x + frac_x / 4, y + frac_y / 4) of the reference picture.
+ *
+ * \param planes  fractional sample planes of the reference
+ * \param frac_x  horizontal quarter sample offset, 0..3
+ * \param frac_y  vertical quarter sample offset, 0..3
+ * \return pointer to the plane, which has the stride of planes
+ */
+const kvz_pixel *kvz_inter_get_subpel_plane(const kvz_subpel_planes_t *planes, int frac_x, int frac_y)
+{
+  assert(frac_x || frac_y);
+  const int index = ((frac_y << 2) | frac_x) - 1;
+  return planes->data + index * planes->stride * planes->height;
+}
+
+/**
+ * \brief Interpolate rows of the fractional sample planes.
+ *
+ * The filtering is the same as in kvz_inter_recon_lcu, so the planes can
+ * be used for reconstruction. Pixels outside the picture are replicated
+ * from the border. Rows up to y_end + 4 of the reference must be final.
+ *
+ * \param ref      reference picture
+ * \param planes   planes from kvz_subpel_planes_alloc
+ * \param y_start  first row to interpolate
+ * \param y_end    row after the last row to interpolate
+ */
+void kvz_inter_interpolate_subpel_planes(const kvz_picture *ref, kvz_subpel_planes_t *planes, int32_t y_start, int32_t y_end)
+{
+  #define FILTER_SIZE_Y 8
+  #define FILTER_OFFSET_Y 3
+  const int width = ref->width;
+  const int rows = y_end - y_start + FILTER_SIZE_Y - 1;
+  const int16_t shift1 = KVZ_BIT_DEPTH - 8;
+  const int32_t shift2 = 6;
+  const int32_t shift3 = 14 - KVZ_BIT_DEPTH;
+  const int32_t offset23 = 1 << (shift2 + shift3 - 1);
+
+  // Horizontally filtered rows for each horizontal offset.
+  int16_t *hor_filtered = MALLOC(int16_t, 4 * rows * width);
+  kvz_pixel *padded_row = MALLOC(kvz_pixel, width + FILTER_SIZE_Y - 1);
+  assert(hor_filtered && padded_row);
+
+  for (int row = 0; row < rows; ++row) {
+    const int y = CLIP(0, ref->height - 1, y_start + row - FILTER_OFFSET_Y);
+    const kvz_pixel *src = &ref->y[y * ref->stride];
+    for (int x = 0; x < width + FILTER_SIZE_Y - 1; ++x) {
+      padded_row[x] = src[CLIP(0, width - 1, x - FILTER_OFFSET_Y)];
+    }
+    for (int frac_x = 0; frac_x < 4; ++frac_x) {
+      const int8_t *filter = kvz_g_luma_filter[frac_x];
+      int16_t *dst = &hor_filtered[(frac_x * rows + row) * width];
+      for (int x = 0; x < width; ++x) {
+        int32_t sum = 0;
+        for (int i = 0; i < FILTER_SIZE_Y; ++i) {
+          sum += filter[i] * padded_row[x + i];
+        }
+        dst[x] = sum >> shift1;
+      }
+    }
+  }
+
+  for (int frac_y = 0; frac_y < 4; ++frac_y) {
+    const int8_t *filter = kvz_g_luma_filter[frac_y];
+    for (int frac_x = 0; frac_x < 4; ++frac_x) {
+      if (!frac_x && !frac_y) continue;
+
+      kvz_pixel *plane = (kvz_pixel *)kvz_inter_get_subpel_plane(planes, frac_x, frac_y);
+      const int16_t *src = &hor_filtered[frac_x * rows * width];
+      for (int y = y_start; y < y_end; ++y) {
+        const int16_t *r = &src[(y - y_start) * width];
+        kvz_pixel *dst = &plane[y * planes->stride];
+        if (!frac_y) {
+          // Only the center tap is non-zero.
+          const int16_t *center = &r[FILTER_OFFSET_Y * width];
+          for (int x = 0; x < width; ++x) {
+            int32_t sum = filter[FILTER_OFFSET_Y] * center[x];
+            dst[x] = CLIP_TO_PIXEL(((sum + offset23) >> shift2) >> shift3);
+          }
+          continue;
+        }
+        // Written out so that the compiler can vectorize the loop.
+        for (int x = 0; x < width; ++x) {
+          int32_t sum = filter[0] * r[x]             + filter[1] * r[x + width] +
+                        filter[2] * r[x + 2 * width] + filter[3] * r[x + 3 * width] +
+                        filter[4] * r[x + 4 * width] + filter[5] * r[x + 5 * width] +
+                        filter[6] * r[x + 6 * width] + filter[7] * r[x + 7 * width];
+          dst[x] = CLIP_TO_PIXEL(((sum + offset23) >> shift2) >> shift3);
+        }
+      }
+    }
+  }
+
+  free(hor_filtered);
+  free(padded_row);
+  #undef FILTER_SIZE_Y
+  #undef FILTER_OFFSET_Y
+}
+
+#define FILTER_SIZE_Y 8 //Luma filter size
+#define FILTER_SIZE_C 4 //Chroma filter size
+
+/**
+ * \brief Get a pointer to a block of a padded reference picture.
+ *
+ * Blocks so far outside the picture that reading them would go past the
+ * padding are moved next to the picture. All the pixels read are then
+ * still copies of the same edge pixels, so the result does not change.
+ *
+ * \param data         pixel array of the reference
+ * \param stride       stride of the pixel array
+ * \param width        width of the pixel array
+ * \param height       height of the pixel array
+ * \param x            x coordinate of the block
+ * \param y            y coordinate of the block
+ * \param block_width  width and height of the block
+ * \param margin       number of pixels read around the block
+ * \return pointer to the top-left pixel of the block
+ */
+kvz_pixel *kvz_inter_get_ref_block(kvz_pixel *data, int32_t stride, int32_t width, int32_t height,
+                                   int32_t x, int32_t y, int32_t block_width, int32_t margin)
+{
+  x = CLIP(-block_width - margin, width + margin, x);
+  y = CLIP(-block_width - margin, height + margin, y);
+  return &data[y * stride + x];
+}
+
+/**
+ * \brief Get the fractional sample planes of a reference picture.
+ * \return planes, or NULL if they are not available
+ */
+static const kvz_subpel_planes_t *get_subpel_planes(const encoder_state_t * const state, const kvz_picture * const ref)
+{
+  const image_list_t * const list = state->global->ref;
+  for (unsigned i = 0; i < list->used_size; ++i) {
+    if (list->images[i] == ref) return list->subpel_planes[i];
+  }
+  return NULL;
+}
+
 void kvz_inter_recon_frac_luma(const encoder_state_t * const state, const kvz_picture * const ref, int32_t xpos, int32_t ypos, int32_t block_width, const int16_t mv_param[2], lcu_t *lcu)
 {
   int mv_frac_x = (mv_param[0] & 3);
   int mv_frac_y = (mv_param[1] & 3);
-
- #define FILTER_SIZE_Y 8 //Luma filter size
+  kvz_pixel *dst = lcu->rec.y + (ypos%LCU_WIDTH)*LCU_WIDTH + (xpos%LCU_WIDTH);
+
+  // Copy the block from the interpolated planes, if it is inside them.
+  const kvz_subpel_planes_t * const planes = get_subpel_planes(state, ref);
+  const int ref_x = state->tile->lcu_offset_x * LCU_WIDTH + xpos + (mv_param[0] >> 2);
+  const int ref_y = state->tile->lcu_offset_y * LCU_WIDTH + ypos + (mv_param[1] >> 2);
+  if (planes &&
+      ref_x >= 0 && ref_x + block_width <= ref->width &&
+      ref_y >= 0 && ref_y + block_width <= ref->height)
+  {
+    const kvz_pixel *plane = kvz_inter_get_subpel_plane(planes, mv_frac_x, mv_frac_y);
+    kvz_pixels_blit(&plane[ref_y * planes->stride + ref_x], dst,
+                    block_width, block_width, planes->stride, LCU_WIDTH);
+    return;
+  }
 
   // Fractional luma 1/4-pel
-  kvz_extended_block src = {0, 0, 0};
-
-  // Fractional luma
-  kvz_get_extended_block(xpos, ypos, mv_param[0] >> 2, mv_param[1] >> 2, state->tile->lcu_offset_x * LCU_WIDTH, state->tile->lcu_offset_y * LCU_WIDTH,
-    ref->y, ref->width, ref->height, FILTER_SIZE_Y, block_width, block_width, &src);
-  kvz_sample_quarterpel_luma_generic(state->encoder_control, src.orig_topleft, src.stride, block_width,
-    block_width, lcu->rec.y + (ypos%LCU_WIDTH)*LCU_WIDTH + (xpos%LCU_WIDTH), LCU_WIDTH, mv_frac_x, mv_frac_y, mv_param);
-
-  if (src.malloc_used) free(src.buffer);
+  kvz_pixel *src = kvz_inter_get_ref_block(ref->y, ref->stride, ref->width, ref->height,
+                                           ref_x, ref_y, block_width, FILTER_SIZE_Y / 2);
+  kvz_sample_quarterpel_luma_generic(state->encoder_control, src, ref->stride, block_width,
+    block_width, dst, LCU_WIDTH, mv_frac_x, mv_frac_y, mv_param);
 }
 
 void kvz_inter_recon_14bit_frac_luma(const encoder_state_t * const state, const kvz_picture * const ref, int32_t xpos, int32_t ypos, int32_t block_width, const int16_t mv_param[2], hi_prec_buf_t *hi_prec_out)
@@ -88,18 +241,14 @@ void kvz_inter_recon_14bit_frac_luma(const encoder_state_t * const state, const
   int mv_frac_x = (mv_param[0] & 3);
   int mv_frac_y = (mv_param[1] & 3);
 
-#define FILTER_SIZE_Y 8 //Luma filter size
+  const int ref_x = state->tile->lcu_offset_x * LCU_WIDTH + xpos + (mv_param[0] >> 2);
+  const int ref_y = state->tile->lcu_offset_y * LCU_WIDTH + ypos + (mv_param[1] >> 2);
 
   // Fractional luma 1/4-pel
-  kvz_extended_block src = { 0, 0, 0 };
-
-  // Fractional luma
-  kvz_get_extended_block(xpos, ypos, mv_param[0] >> 2, mv_param[1] >> 2, state->tile->lcu_offset_x * LCU_WIDTH, state->tile->lcu_offset_y * LCU_WIDTH,
-    ref->y, ref->width, ref->height, FILTER_SIZE_Y, block_width, block_width, &src);
-  kvz_sample_14bit_quarterpel_luma_generic(state->encoder_control, src.orig_topleft, src.stride, block_width,
+  kvz_pixel *src = kvz_inter_get_ref_block(ref->y, ref->stride, ref->width, ref->height,
+                                           ref_x, ref_y, block_width, FILTER_SIZE_Y / 2);
+  kvz_sample_14bit_quarterpel_luma_generic(state->encoder_control, src, ref->stride, block_width,
     block_width, hi_prec_out->y + (ypos%LCU_WIDTH)*LCU_WIDTH + (xpos%LCU_WIDTH), LCU_WIDTH, mv_frac_x, mv_frac_y, mv_param);
-
-  if (src.malloc_used) free(src.buffer);
 }
 
 void kvz_inter_recon_frac_chroma(const encoder_state_t * const state, const kvz_picture * const ref, int32_t xpos, int32_t ypos, int32_t block_width, const int16_t mv_param[2], lcu_t *lcu)
@@ -112,26 +261,23 @@ void kvz_inter_recon_frac_chroma(const encoder_state_t * const state, const kvz_
   ypos >>= 1;
   block_width >>= 1;
 
-#define FILTER_SIZE_C 4 //Chroma filter size
+  const int ref_x = state->tile->lcu_offset_x * LCU_WIDTH_C + xpos + ((mv_param[0] >> 2) >> 1);
+  const int ref_y = state->tile->lcu_offset_y * LCU_WIDTH_C + ypos + ((mv_param[1] >> 2) >> 1);
+  const int stride_c = ref->stride >> 1;
 
   // Fractional chroma 1/8-pel
-  kvz_extended_block src_u = { 0, 0, 0 };
-  kvz_extended_block src_v = { 0, 0, 0 };
+  kvz_pixel *src_u = kvz_inter_get_ref_block(ref->u, stride_c, ref->width >> 1, ref->height >> 1,
+                                             ref_x, ref_y, block_width, FILTER_SIZE_C / 2);
+  kvz_pixel *src_v = kvz_inter_get_ref_block(ref->v, stride_c, ref->width >> 1, ref->height >> 1,
+                                             ref_x, ref_y, block_width, FILTER_SIZE_C / 2);
 
   //Fractional chroma U
-  kvz_get_extended_block(xpos, ypos, (mv_param[0] >> 2) >> 1, (mv_param[1] >> 2) >> 1, state->tile->lcu_offset_x * LCU_WIDTH_C, state->tile->lcu_offset_y * LCU_WIDTH_C,
-    ref->u, ref->width >> 1, ref->height >> 1, FILTER_SIZE_C, block_width, block_width, &src_u);
-  kvz_sample_octpel_chroma_generic(state->encoder_control, src_u.orig_topleft, src_u.stride, block_width,
+  kvz_sample_octpel_chroma_generic(state->encoder_control, src_u, stride_c, block_width,
     block_width, lcu->rec.u + (ypos % LCU_WIDTH_C)*LCU_WIDTH_C + (xpos % LCU_WIDTH_C), LCU_WIDTH_C, mv_frac_x, mv_frac_y, mv_param);
 
   //Fractional chroma V
-  kvz_get_extended_block(xpos, ypos, (mv_param[0] >> 2) >> 1, (mv_param[1] >> 2) >> 1, state->tile->lcu_offset_x * LCU_WIDTH_C, state->tile->lcu_offset_y * LCU_WIDTH_C,
-    ref->v, ref->width >> 1, ref->height >> 1, FILTER_SIZE_C, block_width, block_width, &src_v);
-  kvz_sample_octpel_chroma_generic(state->encoder_control, src_v.orig_topleft, src_v.stride, block_width,
+  kvz_sample_octpel_chroma_generic(state->encoder_control, src_v, stride_c, block_width,
     block_width, lcu->rec.v + (ypos  % LCU_WIDTH_C)*LCU_WIDTH_C + (xpos % LCU_WIDTH_C), LCU_WIDTH_C, mv_frac_x, mv_frac_y, mv_param);
-
-  if (src_u.malloc_used) free(src_u.buffer);
-  if (src_v.malloc_used) free(src_v.buffer);
 }
 
 void kvz_inter_recon_14bit_frac_chroma(const encoder_state_t * const state, const kvz_picture * const ref, int32_t xpos, int32_t ypos, int32_t block_width, const int16_t mv_param[2], hi_prec_buf_t *hi_prec_out)
@@ -144,26 +290,23 @@ void kvz_inter_recon_14bit_frac_chroma(const encoder_state_t * const state, cons
   ypos >>= 1;
   block_width >>= 1;
 
-#define FILTER_SIZE_C 4 //Chroma filter size
+  const int ref_x = state->tile->lcu_offset_x * LCU_WIDTH_C + xpos + ((mv_param[0] >> 2) >> 1);
+  const int ref_y = state->tile->lcu_offset_y * LCU_WIDTH_C + ypos + ((mv_param[1] >> 2) >> 1);
+  const int stride_c = ref->stride >> 1;
 
   // Fractional chroma 1/8-pel
-  kvz_extended_block src_u = { 0, 0, 0 };
-  kvz_extended_block src_v = { 0, 0, 0 };
+  kvz_pixel *src_u = kvz_inter_get_ref_block(ref->u, stride_c, ref->width >> 1, ref->height >> 1,
+                                             ref_x, ref_y, block_width, FILTER_SIZE_C / 2);
+  kvz_pixel *src_v = kvz_inter_get_ref_block(ref->v, stride_c, ref->width >> 1, ref->height >> 1,
+                                             ref_x, ref_y, block_width, FILTER_SIZE_C / 2);
 
   //Fractional chroma U
-  kvz_get_extended_block(xpos, ypos, (mv_param[0] >> 2) >> 1, (mv_param[1] >> 2) >> 1, state->tile->lcu_offset_x * LCU_WIDTH_C, state->tile->lcu_offset_y * LCU_WIDTH_C,
-    ref->u, ref->width >> 1, ref->height >> 1, FILTER_SIZE_C, block_width, block_width, &src_u);
-  kvz_sample_14bit_octpel_chroma_generic(state->encoder_control, src_u.orig_topleft, src_u.stride, block_width,
+  kvz_sample_14bit_octpel_chroma_generic(state->encoder_control, src_u, stride_c, block_width,
     block_width, hi_prec_out->u + (ypos % LCU_WIDTH_C)*LCU_WIDTH_C + (xpos % LCU_WIDTH_C), LCU_WIDTH_C, mv_frac_x, mv_frac_y, mv_param);
 
   //Fractional chroma V
-  kvz_get_extended_block(xpos, ypos, (mv_param[0] >> 2) >> 1, (mv_param[1] >> 2) >> 1, state->tile->lcu_offset_x * LCU_WIDTH_C, state->tile->lcu_offset_y * LCU_WIDTH_C,
-    ref->v, ref->width >> 1, ref->height >> 1, FILTER_SIZE_C, block_width, block_width, &src_v);
-  kvz_sample_14bit_octpel_chroma_generic(state->encoder_control, src_v.orig_topleft, src_v.stride, block_width,
+  kvz_sample_14bit_octpel_chroma_generic(state->encoder_control, src_v, stride_c, block_width,
     block_width, hi_prec_out->v + (ypos  % LCU_WIDTH_C)*LCU_WIDTH_C + (xpos % LCU_WIDTH_C), LCU_WIDTH_C, mv_frac_x, mv_frac_y, mv_param);
-
-  if (src_u.malloc_used) free(src_u.buffer);
-  if (src_v.malloc_used) free(src_v.buffer);
 }
 
 /**
@@ -179,20 +322,8 @@ void kvz_inter_recon_14bit_frac_chroma(const encoder_state_t * const state, cons
 */
 void kvz_inter_recon_lcu(const encoder_state_t * const state, const kvz_picture * const ref, int32_t xpos, int32_t ypos,int32_t width, const int16_t mv_param[2], lcu_t *lcu, hi_prec_buf_t *hi_prec_out)
 {
-  int x,y,coord_x,coord_y;
   int16_t mv[2] = { mv_param[0], mv_param[1] };
 
-  int32_t dst_width_c = LCU_WIDTH>>1; //!< Destination picture width in chroma pixels
-  int32_t ref_width_c = ref->width>>1; //!< Reference picture width in chroma pixels
-
-  // negative overflow flag
-  int8_t overflow_neg_x = (state->tile->lcu_offset_x * LCU_WIDTH + xpos + (mv[0]>>2) < 0)?1:0;
-  int8_t overflow_neg_y = (state->tile->lcu_offset_y * LCU_WIDTH + ypos + (mv[1]>>2) < 0)?1:0;
-
-  // positive overflow flag
-  int8_t overflow_pos_x = (state->tile->lcu_offset_x * LCU_WIDTH + xpos + (mv[0]>>2) + width > ref->width )?1:0;
-  int8_t overflow_pos_y = (state->tile->lcu_offset_y * LCU_WIDTH + ypos + (mv[1]>>2) + width > ref->height)?1:0;
-
   int8_t chroma_halfpel = ((mv[0]>>2)&1) || ((mv[1]>>2)&1); //!< (luma integer mv) lsb is set -> chroma is half-pel
   // Luma quarter-pel
   int8_t fractional_mv = (mv[0]&1) || (mv[1]&1) || (mv[0]&2) || (mv[1]&2); // either of 2 lowest bits of mv set -> mv is fractional
@@ -221,102 +352,28 @@ void kvz_inter_recon_lcu(const encoder_state_t * const state, const kvz_picture
       }
     }
 
-    // With overflow present, more checking
-    if (overflow_neg_x || overflow_neg_y || overflow_pos_x || overflow_pos_y) {
-      // Copy Luma with boundary checking
-      for (y = ypos; y < ypos + width; y++) {
-        for (x = xpos; x < xpos + width; x++) {
-          int x_in_lcu = (x & ((LCU_WIDTH)-1));
-          int y_in_lcu = (y & ((LCU_WIDTH)-1));
-
-          coord_x = (x + state->tile->lcu_offset_x * LCU_WIDTH) + mv[0];
-          coord_y = (y + state->tile->lcu_offset_y * LCU_WIDTH) + mv[1];
-          overflow_neg_x = (coord_x < 0)?1:0;
-          overflow_neg_y = (coord_y < 0)?1:0;
-
-          overflow_pos_x = (coord_x >= ref->width )?1:0;
-          overflow_pos_y = (coord_y >= ref->height)?1:0;
-
-          // On x-overflow set coord_x accordingly
-          if (overflow_neg_x) {
-            coord_x = 0;
-          } else if (overflow_pos_x) {
-            coord_x = ref->width - 1;
-          }
-
-          // On y-overflow set coord_y accordingly
-          if (overflow_neg_y) {
-            coord_y = 0;
-          } else if (overflow_pos_y) {
-            coord_y = ref->height - 1;
-          }
-
-          // set destination to (corrected) pixel value from the reference
-          lcu->rec.y[y_in_lcu * LCU_WIDTH + x_in_lcu] = ref->y[coord_y*ref->width + coord_x];
-        }
-      }
-
-      if(!chroma_halfpel) {
-        // Copy Chroma with boundary checking
-        for (y = ypos>>1; y < (ypos + width)>>1; y++) {
-          for (x = xpos>>1; x < (xpos + width)>>1; x++) {
-            int x_in_lcu = (x & ((LCU_WIDTH>>1)-1));
-            int y_in_lcu = (y & ((LCU_WIDTH>>1)-1));
-
-            coord_x = (x + state->tile->lcu_offset_x * (LCU_WIDTH >> 1)) + (mv[0]>>1);
-            coord_y = (y + state->tile->lcu_offset_y * (LCU_WIDTH >> 1)) + (mv[1]>>1);
-
-            overflow_neg_x = (coord_x < 0)?1:0;
-            overflow_neg_y = (y + (mv[1]>>1) < 0)?1:0;
-
-            overflow_pos_x = (coord_x >= ref->width>>1 )?1:0;
-            overflow_pos_y = (coord_y >= ref->height>>1)?1:0;
-
-            // On x-overflow set coord_x accordingly
-            if(overflow_neg_x) {
-              coord_x = 0;
-            } else if(overflow_pos_x) {
-              coord_x = (ref->width>>1) - 1;
-            }
-
-            // On y-overflow set coord_y accordingly
-            if(overflow_neg_y) {
-              coord_y = 0;
-            } else if(overflow_pos_y) {
-              coord_y = (ref->height>>1) - 1;
-            }
-
-            // set destinations to (corrected) pixel value from the reference
-            lcu->rec.u[y_in_lcu*dst_width_c + x_in_lcu] = ref->u[coord_y * ref_width_c + coord_x];
-            lcu->rec.v[y_in_lcu*dst_width_c + x_in_lcu] = ref->v[coord_y * ref_width_c + coord_x];
-          }
-        }
-      }
-    } else { //If no overflow, we can copy without checking boundaries
-      // Copy Luma
-      for (y = ypos; y < ypos + width; y++) {
-        int y_in_lcu = (y & ((LCU_WIDTH)-1));
-        coord_y = ((y + state->tile->lcu_offset_y * LCU_WIDTH) + mv[1]) * ref->width; // pre-calculate
-        for (x = xpos; x < xpos + width; x++) {
-          int x_in_lcu = (x & ((LCU_WIDTH)-1));
-
-          lcu->rec.y[y_in_lcu * LCU_WIDTH + x_in_lcu] = ref->y[coord_y + (x + state->tile->lcu_offset_x * LCU_WIDTH) + mv[0]];
-        }
-      }
-
-      if(!chroma_halfpel) {
-        // Copy Chroma
-        // TODO: chroma fractional pixel interpolation
-        for (y = ypos>>1; y < (ypos + width)>>1; y++) {
-          int y_in_lcu = (y & ((LCU_WIDTH>>1)-1));
-          coord_y = ((y + state->tile->lcu_offset_y * (LCU_WIDTH>>1)) + (mv[1]>>1)) * ref_width_c; // pre-calculate
-          for (x = xpos>>1; x < (xpos + width)>>1; x++) {
-            int x_in_lcu = (x & ((LCU_WIDTH>>1)-1));
-            lcu->rec.u[y_in_lcu*dst_width_c + x_in_lcu] = ref->u[coord_y + (x + state->tile->lcu_offset_x * (LCU_WIDTH>>1)) + (mv[0]>>1)];
-            lcu->rec.v[y_in_lcu*dst_width_c + x_in_lcu] = ref->v[coord_y + (x + state->tile->lcu_offset_x * (LCU_WIDTH>>1)) + (mv[0]>>1)];
-          }
-        }
-      }
+    // The reference is padded, so the block can be copied without checking
+    // the boundaries.
+    // Copy Luma
+    const kvz_pixel *src = kvz_inter_get_ref_block(ref->y, ref->stride, ref->width, ref->height,
+                                                   state->tile->lcu_offset_x * LCU_WIDTH + xpos + mv[0],
+                                                   state->tile->lcu_offset_y * LCU_WIDTH + ypos + mv[1],
+                                                   width, 0);
+    kvz_pixels_blit(src, &lcu->rec.y[(ypos % LCU_WIDTH) * LCU_WIDTH + (xpos % LCU_WIDTH)],
+                    width, width, ref->stride, LCU_WIDTH);
+
+    if(!chroma_halfpel) {
+      // Copy Chroma
+      const int32_t stride_c = ref->stride >> 1;
+      const int32_t x_c = state->tile->lcu_offset_x * LCU_WIDTH_C + (xpos >> 1) + (mv[0] >> 1);
+      const int32_t y_c = state->tile->lcu_offset_y * LCU_WIDTH_C + (ypos >> 1) + (mv[1] >> 1);
+      const int32_t offset_c = ((ypos >> 1) % LCU_WIDTH_C) * LCU_WIDTH_C + ((xpos >> 1) % LCU_WIDTH_C);
+      const kvz_pixel *src_u = kvz_inter_get_ref_block(ref->u, stride_c, ref->width >> 1, ref->height >> 1,
+                                                       x_c, y_c, width >> 1, 0);
+      const kvz_pixel *src_v = kvz_inter_get_ref_block(ref->v, stride_c, ref->width >> 1, ref->height >> 1,
+                                                       x_c, y_c, width >> 1, 0);
+      kvz_pixels_blit(src_u, &lcu->rec.u[offset_c], width >> 1, width >> 1, stride_c, LCU_WIDTH_C);
+      kvz_pixels_blit(src_v, &lcu->rec.v[offset_c], width >> 1, width >> 1, stride_c, LCU_WIDTH_C);
     }
   }
 }
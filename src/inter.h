@@ -46,5 +46,11 @@ void kvz_inter_recon_lcu_bipred(const encoder_state_t * const state, const kvz_p
 void kvz_inter_get_spatial_merge_candidates(int32_t x, int32_t y, int8_t depth, cu_info_t **b0, cu_info_t **b1,
                                         cu_info_t **b2, cu_info_t **a0, cu_info_t **a1, lcu_t *lcu);
 void kvz_inter_get_mv_cand(const encoder_state_t *state, int32_t x, int32_t y, int8_t depth, int16_t mv_cand[2][2], cu_info_t* cur_cu, lcu_t *lcu, int8_t reflist);
+const kvz_pixel *kvz_inter_get_subpel_plane(const kvz_subpel_planes_t *planes, int frac_x, int frac_y);
+void kvz_inter_interpolate_subpel_planes(const kvz_picture *ref, kvz_subpel_planes_t *planes, int32_t y_start, int32_t y_end);
+
+kvz_pixel *kvz_inter_get_ref_block(kvz_pixel *data, int32_t stride, int32_t width, int32_t height,
+                                   int32_t x, int32_t y, int32_t block_width, int32_t margin);
+
 uint8_t kvz_inter_get_merge_cand(const encoder_state_t *state, int32_t x, int32_t y, int8_t depth, inter_merge_cand_t mv_cand[MRG_MAX_NUM_CANDS], lcu_t *lcu);
 #endif
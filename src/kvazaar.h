@@ -82,6 +82,22 @@ enum kvz_ime_algorithm {
   KVZ_IME_TZ = 1,
 };
 
+/**
+ * \brief Early termination of the CU split search.
+ */
+enum kvz_cu_split_termination {
+  KVZ_CU_SPLIT_TERMINATION_ZERO = 0,
+  KVZ_CU_SPLIT_TERMINATION_ADAPTIVE = 1,
+};
+
+/**
+ * \brief Adaptive quantization mode.
+ */
+enum kvz_aq_mode {
+  KVZ_AQ_OFF = 0,
+  KVZ_AQ_VARIANCE = 1,
+};
+
 /**
  * \brief GoP picture configuration.
  */
@@ -175,6 +191,28 @@ typedef struct kvz_config
   kvz_gop_config gop[KVZ_MAX_GOP_LENGTH];  /*!< \brief Array of GOP settings */
 
   int32_t target_bitrate;
+  int32_t vbv_maxrate;  /*!< \brief Maximum rate at which the VBV buffer is filled (bits per second) */
+  int32_t vbv_bufsize;  /*!< \brief Size of the VBV buffer (bits) */
+  int32_t lcu_rc;       /*!< \brief Flag to enable LCU level rate control */
+
+  int32_t pass;         /*!< \brief Pass of two-pass encoding (1 or 2), 0 for single pass */
+  char *stats_file;     /*!< \brief Statistics file of two-pass encoding */
+
+  char *analysis_save;  /*!< \brief File to save the mode decisions to */
+  char *analysis_load;  /*!< \brief File to load the mode decisions from */
+
+  int8_t aq;            /*!< \brief Adaptive quantization mode */
+  double aq_strength;   /*!< \brief Strength of adaptive quantization */
+
+  int8_t cu_split_termination; /*!< \brief Early termination of the CU split search */
+  int32_t early_skip;   /*!< \brief Flag to try skip before motion estimation */
+  int32_t adaptive_cu_depth; /*!< \brief Flag to limit CU depths from neighbouring LCUs */
+  int32_t me_pyramid;   /*!< \brief Flag to seed motion estimation from downscaled pictures */
+  int32_t me_parent_seed; /*!< \brief Flag to refine the motion vectors of the parent CU in sub-CUs */
+  int32_t subpel_planes; /*!< \brief Flag to interpolate reference pictures once */
+  int32_t hash_me;      /*!< \brief Flag to look up exact block matches from hash tables */
+  int32_t static_skip;  /*!< \brief Flag to code LCUs identical to a reference as skip */
+  int32_t gradient_intra; /*!< \brief Flag to limit rough intra search to source gradient directions */
 } kvz_config;
 
 /**
@@ -21,6 +21,7 @@
 #include "rate_control.h"
 
 #include <math.h>
+#include <stdlib.h>
 
 static const int SMOOTHING_WINDOW = 40;
 
@@ -104,6 +105,99 @@ static double pic_allocate_bits(const encoder_state_t * const state)
   return MAX(100, pic_target_bits);
 }
 
+/**
+ * \brief Check whether first pass statistics exist for the current picture.
+ * \param state the main encoder state
+ * \return 1 if the statistics can be used, 0 otherwise
+ */
+static int twopass_stats_available(const encoder_state_t * const state)
+{
+  const twopass_stats_t * const stats = state->encoder_control->twopass;
+  const int frame = state->global->frame;
+  return stats && stats->file == NULL && frame < stats->num_frames &&
+         stats->poc[frame] == state->global->poc;
+}
+
+/**
+ * \brief Allocate bits for the current picture from the first pass statistics.
+ * \param state the main encoder state
+ * \return target number of bits
+ *
+ * The bits left for the sequence are shared between the remaining pictures
+ * in proportion to their size in the constant QP first pass. This keeps the
+ * quality roughly constant while the total size follows the target.
+ */
+static double twopass_allocate_bits(const encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const twopass_stats_t * const stats = encoder->twopass;
+
+  // At this point, total_bits_coded of the current state contains the
+  // number of bits written encoder->owf frames before the current frame.
+  const int pictures_coded = MAX(0, state->global->frame - encoder->owf);
+  const double bits_coded = pictures_coded > 0 ? state->global->total_bits_coded : 0;
+
+  const double bits_left = encoder->target_avg_bppic * stats->num_frames - bits_coded;
+  const double share = (double)stats->frame_bits[state->global->frame] /
+                       MAX(1, stats->remaining_bits[pictures_coded]);
+  return MAX(100, bits_left * share);
+}
+
+/**
+ * \brief Limit the bits allocated for the current picture by the VBV buffer.
+ * \param state the main encoder state
+ * \param target_bits number of bits allocated for the picture
+ * \return target number of bits
+ *
+ * The picture must fit in the buffer when it is removed. In CBR mode, i.e.
+ * when the buffer is filled at the target bitrate, the picture must also
+ * remove enough bits that the buffer does not overflow.
+ */
+static double vbv_limit_bits(const encoder_state_t * const state,
+                             double target_bits)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+
+  const double bits_per_picture = encoder->vbv.maxrate / encoder->cfg->framerate;
+
+  // At this point, vbv_fullness of the current state is the buffer fullness
+  // encoder->owf frames before the current frame. Assume that the frames
+  // still being encoded hit the average target.
+  const int frames_in_flight = MIN(state->global->frame, encoder->owf);
+  double fullness = state->global->frame > encoder->owf ?
+    state->global->vbv_fullness : encoder->vbv.initial_fullness;
+  fullness += frames_in_flight * (bits_per_picture - encoder->target_avg_bppic);
+  fullness = CLIP(0, encoder->vbv.bufsize, fullness);
+
+  if (encoder->vbv.maxrate == encoder->cfg->target_bitrate) {
+    const double min_bits = fullness + bits_per_picture - encoder->vbv.bufsize;
+    target_bits = MAX(min_bits, target_bits);
+  }
+
+  // Leave a margin since the lambda model does not hit the target exactly.
+  const double max_bits = 0.8 * fullness;
+  return MAX(100, MIN(max_bits, target_bits));
+}
+
+/**
+ * \brief Update the VBV buffer fullness after a picture has been written.
+ * \param state the main encoder state
+ * \param bits number of bits in the picture
+ */
+void kvz_vbv_update(encoder_state_t * const state, uint64_t bits)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+
+  double fullness = state->global->frame > 0 ?
+    state->previous_encoder_state->global->vbv_fullness :
+    encoder->vbv.initial_fullness;
+
+  // Remove the picture and fill the buffer until the next picture is removed.
+  fullness -= bits;
+  fullness += encoder->vbv.maxrate / encoder->cfg->framerate;
+  state->global->vbv_fullness = MIN(encoder->vbv.bufsize, fullness);
+}
+
 /**
  * \brief Select a lambda value for encoding the next picture
  * \param state the main encoder state
@@ -132,7 +226,12 @@ double kvz_select_picture_lambda(encoder_state_t * const state)
   }
 
   // TODO: take the picture headers into account
-  const double target_bits_current_picture = pic_allocate_bits(state);
+  double target_bits_current_picture = twopass_stats_available(state) ?
+    twopass_allocate_bits(state) : pic_allocate_bits(state);
+  if (encoder->vbv.maxrate > 0) {
+    target_bits_current_picture = vbv_limit_bits(state, target_bits_current_picture);
+  }
+  state->global->cur_pic_target_bits = target_bits_current_picture;
   const double target_bits_per_pixel =
     target_bits_current_picture / encoder->in.pixels_per_pic;
   const double lambda =
@@ -140,6 +239,245 @@ double kvz_select_picture_lambda(encoder_state_t * const state)
   return CLIP(0.1, 10000, lambda);
 }
 
+/**
+ * \brief Compute the weights used for distributing bits between LCUs.
+ * \param state the main encoder state
+ *
+ * The weight of an LCU is the number of pixels plus the sum of absolute
+ * horizontal and vertical luma gradients in the source picture, so that
+ * detailed areas get a larger share of the bits than flat ones. In the
+ * second pass the number of bits of the LCU in the first pass is used
+ * instead.
+ */
+void kvz_set_lcu_weights(encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const kvz_picture * const src = state->tile->frame->source;
+
+  if (twopass_stats_available(state)) {
+    const twopass_stats_t * const stats = encoder->twopass;
+    const uint32_t *lcu_bits = &stats->lcu_bits[state->global->frame * stats->num_lcus];
+    for (int i = 0; i < stats->num_lcus; ++i) {
+      state->global->lcu_weights[i] = 1.0 + lcu_bits[i];
+    }
+    return;
+  }
+
+  for (int lcu_y = 0; lcu_y < encoder->in.height_in_lcu; ++lcu_y) {
+    for (int lcu_x = 0; lcu_x < encoder->in.width_in_lcu; ++lcu_x) {
+      const int x_start = lcu_x * LCU_WIDTH;
+      const int y_start = lcu_y * LCU_WIDTH;
+      const int x_end = MIN(x_start + LCU_WIDTH, encoder->in.width);
+      const int y_end = MIN(y_start + LCU_WIDTH, encoder->in.height);
+
+      uint64_t activity = 0;
+      for (int y = y_start; y < y_end; ++y) {
+        const kvz_pixel *row = &src->y[y * src->stride];
+        for (int x = x_start; x < x_end; ++x) {
+          if (x + 1 < encoder->in.width) {
+            activity += abs(row[x + 1] - row[x]);
+          }
+          if (y + 1 < encoder->in.height) {
+            activity += abs(row[x + src->stride] - row[x]);
+          }
+        }
+      }
+
+      const int pixels = (x_end - x_start) * (y_end - y_start);
+      state->global->lcu_weights[lcu_x + lcu_y * encoder->in.width_in_lcu] =
+        pixels + (double)activity;
+    }
+  }
+}
+
+/**
+ * \brief Get the index of an LCU in the picture.
+ * \param state the leaf encoder state
+ * \param lcu the LCU
+ * \return raster scan index of the LCU in the whole picture
+ */
+static int lcu_index_in_picture(const encoder_state_t * const state,
+                                const lcu_order_element_t * const lcu)
+{
+  const int lcu_addr_in_ts = lcu->id + state->tile->lcu_offset_in_ts;
+  return state->encoder_control->tiles_ctb_addr_ts_to_rs[lcu_addr_in_ts];
+}
+
+/**
+ * \brief Allocate bits for the LCUs of a leaf encoder state.
+ * \param state the leaf encoder state
+ *
+ * Rate control must be enabled and kvz_set_lcu_weights must have been called
+ * for the current picture.
+ */
+void kvz_allocate_leaf_bits(encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+
+  double total_weight = 0;
+  for (int i = 0; i < encoder->in.width_in_lcu * encoder->in.height_in_lcu; ++i) {
+    total_weight += state->global->lcu_weights[i];
+  }
+
+  double leaf_weight = 0;
+  for (int i = 0; i < state->lcu_order_count; ++i) {
+    leaf_weight += state->global->lcu_weights[lcu_index_in_picture(state, &state->lcu_order[i])];
+  }
+
+  state->rc_target_bits = state->global->cur_pic_target_bits * leaf_weight / total_weight;
+  state->rc_remaining_weight = leaf_weight;
+}
+
+/**
+ * \brief Select QP and lambda for the next LCU.
+ * \param state the leaf encoder state
+ * \param lcu the LCU to encode next
+ *
+ * Without LCU level rate control the picture QP and lambda are used.
+ * Otherwise the bits left for the leaf are divided between the remaining
+ * LCUs according to their weights and the lambda is chosen with the same
+ * R-lambda model as for the picture, but limited to a range around the
+ * picture lambda.
+ */
+void kvz_set_lcu_lambda_and_qp(encoder_state_t * const state,
+                               const lcu_order_element_t * const lcu)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+
+  if (!encoder->cfg->lcu_rc) {
+    state->qp = state->global->QP;
+    state->lambda = state->global->cur_lambda_cost;
+    state->lambda_sqrt = state->global->cur_lambda_cost_sqrt;
+    state->lcu_qp = state->qp;
+    state->lcu_lambda = state->lambda;
+    return;
+  }
+
+  const double weight = state->global->lcu_weights[lcu_index_in_picture(state, lcu)];
+
+  const double bits_coded = kvz_cabac_bits_written(&state->cabac);
+  const double bits_left = MAX(1, state->rc_target_bits - bits_coded);
+  const double lcu_target_bits = bits_left * weight / MAX(weight, state->rc_remaining_weight);
+  state->rc_remaining_weight -= weight;
+
+  const double bpp = lcu_target_bits / (lcu->size.x * lcu->size.y);
+  const double pic_lambda = state->global->cur_lambda_cost;
+  double lambda = state->global->rc_alpha * pow(bpp, state->global->rc_beta);
+  lambda = CLIP(0.5 * pic_lambda, 2.0 * pic_lambda, lambda);
+
+  const int8_t pic_qp = state->global->QP;
+  state->qp = CLIP(pic_qp - 3, pic_qp + 3, kvz_lambda_to_QP(lambda));
+  state->lambda = lambda;
+  state->lambda_sqrt = sqrt(lambda);
+  state->lcu_qp = state->qp;
+  state->lcu_lambda = state->lambda;
+}
+
+/**
+ * \brief Compute the QP offsets of adaptive quantization.
+ * \param state the main encoder state
+ *
+ * The offset of a quantization group is the log2 of the luma variance of
+ * the block minus the average of that over the picture, scaled by the AQ
+ * strength. Flat blocks get a lower QP and detailed blocks a higher one,
+ * while the average QP of the picture stays about the same.
+ */
+void kvz_set_aq_offsets(encoder_state_t * const state)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const kvz_picture * const src = state->tile->frame->source;
+  const int qg_depth = encoder->max_qp_delta_depth;
+  const int qg_size = LCU_WIDTH >> qg_depth;
+  const int width_in_qg = encoder->in.width_in_lcu << qg_depth;
+  const int height_in_qg = encoder->in.height_in_lcu << qg_depth;
+  double * const offsets = state->global->aq_offsets;
+
+  double sum_log_var = 0.0;
+  int num_qgs = 0;
+  for (int qg_y = 0; qg_y < height_in_qg; ++qg_y) {
+    for (int qg_x = 0; qg_x < width_in_qg; ++qg_x) {
+      const int x_start = qg_x * qg_size;
+      const int y_start = qg_y * qg_size;
+      double *offset = &offsets[qg_x + qg_y * width_in_qg];
+      if (x_start >= encoder->in.width || y_start >= encoder->in.height) {
+        *offset = 0.0;
+        continue;
+      }
+      const int x_end = MIN(x_start + qg_size, encoder->in.width);
+      const int y_end = MIN(y_start + qg_size, encoder->in.height);
+
+      uint64_t sum = 0;
+      uint64_t sum_sq = 0;
+      for (int y = y_start; y < y_end; ++y) {
+        const kvz_pixel *row = &src->y[y * src->stride];
+        for (int x = x_start; x < x_end; ++x) {
+          sum += row[x];
+          sum_sq += row[x] * row[x];
+        }
+      }
+
+      const double pixels = (x_end - x_start) * (y_end - y_start);
+      const double variance = (sum_sq - (double)sum * sum / pixels) / pixels;
+      *offset = log2(variance + 1.0);
+      sum_log_var += *offset;
+      ++num_qgs;
+    }
+  }
+
+  const double avg_log_var = sum_log_var / num_qgs;
+  for (int qg_y = 0; qg_y < height_in_qg; ++qg_y) {
+    for (int qg_x = 0; qg_x < width_in_qg; ++qg_x) {
+      if (qg_x * qg_size < encoder->in.width && qg_y * qg_size < encoder->in.height) {
+        double *offset = &offsets[qg_x + qg_y * width_in_qg];
+        *offset = encoder->cfg->aq_strength * (*offset - avg_log_var);
+      }
+    }
+  }
+}
+
+/**
+ * \brief Select QP and lambda for a CU with adaptive quantization.
+ * \param state the leaf encoder state
+ * \param x x-coordinate of the CU in the tile in pixels
+ * \param y y-coordinate of the CU in the tile in pixels
+ * \param depth depth of the CU, at most max_qp_delta_depth
+ *
+ * The offset of a CU larger than a quantization group is the average of
+ * the offsets of the quantization groups it covers. The QP is limited so
+ * that cu_qp_delta stays within its range together with LCU level rate
+ * control.
+ */
+void kvz_set_cu_lambda_and_qp(encoder_state_t * const state,
+                              int x, int y, int depth)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const int qg_depth = encoder->max_qp_delta_depth;
+  const int qg_size = LCU_WIDTH >> qg_depth;
+  const int width_in_qg = encoder->in.width_in_lcu << qg_depth;
+  const int qg_x = (state->tile->lcu_offset_x * LCU_WIDTH + x) / qg_size;
+  const int qg_y = (state->tile->lcu_offset_y * LCU_WIDTH + y) / qg_size;
+  const int cu_width_in_qg = 1 << (qg_depth - depth);
+
+  double offset = 0.0;
+  int num_qgs = 0;
+  for (int j = 0; j < cu_width_in_qg; ++j) {
+    for (int i = 0; i < cu_width_in_qg; ++i) {
+      if ((qg_x + i) * qg_size < encoder->in.width &&
+          (qg_y + j) * qg_size < encoder->in.height)
+      {
+        offset += state->global->aq_offsets[qg_x + i + (qg_y + j) * width_in_qg];
+        ++num_qgs;
+      }
+    }
+  }
+  offset /= MAX(1, num_qgs);
+
+  const int qp_offset = CLIP(-8, 8, (int)floor(offset + 0.5));
+  state->qp = CLIP(0, 51, state->lcu_qp + qp_offset);
+  state->lambda = state->lcu_lambda * pow(2.0, (state->qp - state->lcu_qp) / 3.0);
+  state->lambda_sqrt = sqrt(state->lambda);
+}
+
 int8_t kvz_lambda_to_QP(const double lambda)
 {
   const int8_t qp = 4.2005 * log(lambda) + 13.7223 + 0.5;
@@ -29,6 +29,17 @@
 
 double kvz_select_picture_lambda(encoder_state_t * const state);
 
+void kvz_vbv_update(encoder_state_t * const state, uint64_t bits);
+
+void kvz_set_lcu_weights(encoder_state_t * const state);
+void kvz_allocate_leaf_bits(encoder_state_t * const state);
+void kvz_set_lcu_lambda_and_qp(encoder_state_t * const state,
+                               const lcu_order_element_t * const lcu);
+
+void kvz_set_aq_offsets(encoder_state_t * const state);
+void kvz_set_cu_lambda_and_qp(encoder_state_t * const state,
+                              int x, int y, int depth);
+
 int8_t kvz_lambda_to_QP(const double lambda);
 
 double kvz_select_picture_lambda_from_qp(encoder_state_t const * const state);
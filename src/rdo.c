@@ -43,7 +43,7 @@ const uint32_t kvz_g_go_rice_range[5] = { 7, 14, 26, 46, 78 };
 const uint32_t kvz_g_go_rice_prefix_len[5] = { 8, 7, 6, 5, 4 };
 
 
-#define CTX_ENTROPY_BITS(ctx,val) kvz_entropy_bits[(ctx)->uc_state ^ val]
+#define CTX_ENTROPY_BITS(ctx,val) kvz_entropy_bits[(ctx)->uc_state ^ (val)]
 /**
  * Entropy bits to estimate coded bits in RDO / RDOQ (From HM 12.0)
  */
@@ -216,11 +216,81 @@ uint32_t kvz_rdo_cost_intra(encoder_state_t * const state, kvz_pixel *pred, kvz_
 
     double coeff_bits = kvz_get_coeff_cost(state, temp_coeff, width, 0, luma_scan_mode);
 
-    return (uint32_t)(0.5 + ssd + coeff_bits * state->global->cur_lambda_cost);
+    return (uint32_t)(0.5 + ssd + coeff_bits * state->lambda);
 }
 
 
-/** Calculate actual (or really close to actual) bitcost for coding coefficients
+/**
+ * \brief Estimate the bits of the last significant coefficient position.
+ *
+ * Mirrors kvz_encode_last_significant_xy.
+ *
+ * \param ctx_bits     accumulates the cost of context coded bins in 1/32768 bits
+ * \param bypass_bits  accumulates the number of bypass bins
+ */
+static void last_xy_bits(const cabac_data_t * const cabac,
+                         uint8_t lastpos_x, uint8_t lastpos_y,
+                         uint8_t width, uint8_t type, int8_t scan_mode,
+                         uint32_t *ctx_bits, uint32_t *bypass_bits)
+{
+  const uint8_t offset = type ? 0 : ((TOBITS(width) * 3) + ((TOBITS(width) + 1) >> 2));
+  const uint8_t shift  = type ? TOBITS(width) : ((TOBITS(width) + 3) >> 2);
+  const cabac_ctx_t *base_ctx_x = (type ? cabac->ctx.cu_ctx_last_x_chroma : cabac->ctx.cu_ctx_last_x_luma);
+  const cabac_ctx_t *base_ctx_y = (type ? cabac->ctx.cu_ctx_last_y_chroma : cabac->ctx.cu_ctx_last_y_luma);
+
+  if (scan_mode == SCAN_VER) {
+    SWAP(lastpos_x, lastpos_y, uint8_t);
+  }
+
+  const int group_idx_x = g_group_idx[lastpos_x];
+  const int group_idx_y = g_group_idx[lastpos_y];
+  int i;
+
+  for (i = 0; i < group_idx_x; i++) {
+    *ctx_bits += CTX_ENTROPY_BITS(&base_ctx_x[offset + (i >> shift)], 1);
+  }
+  if (group_idx_x < g_group_idx[width - 1]) {
+    *ctx_bits += CTX_ENTROPY_BITS(&base_ctx_x[offset + (i >> shift)], 0);
+  }
+
+  for (i = 0; i < group_idx_y; i++) {
+    *ctx_bits += CTX_ENTROPY_BITS(&base_ctx_y[offset + (i >> shift)], 1);
+  }
+  if (group_idx_y < g_group_idx[width - 1]) {
+    *ctx_bits += CTX_ENTROPY_BITS(&base_ctx_y[offset + (i >> shift)], 0);
+  }
+
+  if (group_idx_x > 3) *bypass_bits += (group_idx_x - 2) >> 1;
+  if (group_idx_y > 3) *bypass_bits += (group_idx_y - 2) >> 1;
+}
+
+/**
+ * \brief Number of bins of coeff_abs_level_remaining.
+ *
+ * Mirrors kvz_cabac_write_coeff_remain.
+ */
+static uint32_t coeff_remain_bits(uint32_t symbol, uint32_t r_param)
+{
+  if (symbol < (3u << r_param)) {
+    return (symbol >> r_param) + 1 + r_param;
+  } else {
+    uint32_t length = r_param;
+    symbol -= 3 << r_param;
+    while (symbol >= (1u << length)) {
+      symbol -= 1 << length;
+      ++length;
+    }
+    return 3 + length + 1 - r_param + length;
+  }
+}
+
+/** Estimate the bitcost for coding coefficients
+ *
+ * Walks the same syntax elements as kvz_encode_coeff_nxn, but instead of
+ * running the CABAC engine on a copy of the state, looks up the cost of each
+ * context coded bin from the current context states. The contexts are not
+ * updated between bins, as in the estBits tables of HM.
+ *
  * \param coeff coefficient array
  * \param width coeff block width
  * \param type data type (0 == luma)
@@ -228,36 +298,161 @@ uint32_t kvz_rdo_cost_intra(encoder_state_t * const state, kvz_pixel *pred, kvz_
  */
 int32_t kvz_get_coeff_cost(const encoder_state_t * const state, coeff_t *coeff, int32_t width, int32_t type, int8_t scan_mode)
 {
-  int32_t cost = 0;
-  int i;
-  int found = 0;
-  encoder_state_t state_copy;
+  const encoder_control_t * const encoder = state->encoder_control;
+  const cabac_data_t * const cabac = &state->cabac;
 
-  // Make sure there are coeffs present
-  for(i = 0; i < width*width; i++) {
-    if (coeff[i] != 0) {
-      found = 1;
-      break;
-    }
+  const uint32_t log2_block_size = kvz_g_convert_to_bit[width] + 2;
+  const uint32_t num_blk_side = width >> 2;
+  const uint32_t *scan = kvz_g_sig_last_scan[scan_mode][log2_block_size - 1];
+  const uint32_t *scan_cg = g_sig_last_scan_cg[log2_block_size - 2][scan_mode];
+
+  const cabac_ctx_t *base_coeff_group_ctx = &(cabac->ctx.cu_sig_coeff_group_model[type]);
+  const cabac_ctx_t *base_sig_ctx = (type == 0) ? cabac->ctx.cu_sig_model_luma :
+                                                  cabac->ctx.cu_sig_model_chroma;
+
+  uint32_t ctx_bits = 0;
+  uint32_t bypass_bits = 0;
+  uint32_t sig_coeffgroup_flag[64];
+  uint16_t sig_masks[64];
+  int32_t i;
+
+  kvz_coeff_group_masks(coeff, width, scan_mode, sig_masks);
+  for (i = 0; i < num_blk_side * num_blk_side; i++) {
+    sig_coeffgroup_flag[i] = (sig_masks[i] != 0);
   }
 
-  if(!found) return 0;
+  int32_t last_scan_set = num_blk_side * num_blk_side - 1;
+  while (last_scan_set >= 0 && sig_masks[scan_cg[last_scan_set]] == 0) {
+    last_scan_set--;
+  }
+  if (last_scan_set < 0) return 0;
 
-  // Store cabac state and contexts
-  memcpy(&state_copy,state,sizeof(encoder_state_t));
+  int32_t scan_pos_last = (last_scan_set << LOG2_SCAN_SET_SIZE) + 15;
+  for (uint32_t mask = sig_masks[scan_cg[last_scan_set]]; !(mask & 0x8000); mask <<= 1) {
+    scan_pos_last--;
+  }
+
+  if (width == 4 && encoder->trskip_enable) {
+    const cabac_ctx_t *ctx = (type == 0) ? &(cabac->ctx.transform_skip_model_luma) :
+                                           &(cabac->ctx.transform_skip_model_chroma);
+    ctx_bits += CTX_ENTROPY_BITS(ctx, 0);
+  }
+
+  {
+    const uint32_t pos_last = scan[scan_pos_last];
+    last_xy_bits(cabac, pos_last & (width - 1), (uint8_t)(pos_last >> log2_block_size),
+                 width, type, scan_mode, &ctx_bits, &bypass_bits);
+  }
 
-  // Clear bytes and bits and set mode to "count"
-  state_copy.cabac.only_count = 1;
-  state_copy.cabac.num_buffered_bytes = 0;
-  state_copy.cabac.bits_left = 23;
+  int32_t scan_pos_sig = scan_pos_last;
+  int c1 = 1;
+
+  for (i = last_scan_set; i >= 0; i--) {
+    const int32_t sub_pos = i << LOG2_SCAN_SET_SIZE;
+    const int32_t cg_blk_pos = scan_cg[i];
+    const int32_t cg_pos_y = cg_blk_pos / num_blk_side;
+    const int32_t cg_pos_x = cg_blk_pos - (cg_pos_y * num_blk_side);
+    const uint32_t sig_mask = sig_masks[cg_blk_pos];
+    int32_t abs_coeff[16];
+    int32_t last_nz_pos_in_cg = -1;
+    int32_t first_nz_pos_in_cg = 16;
+    int32_t num_non_zero = 0;
+
+    if (scan_pos_sig == scan_pos_last) {
+      abs_coeff[0] = abs(coeff[scan[scan_pos_sig]]);
+      num_non_zero = 1;
+      last_nz_pos_in_cg = scan_pos_sig;
+      first_nz_pos_in_cg = scan_pos_sig;
+      scan_pos_sig--;
+    }
 
-  // Execute the coding function
-  kvz_encode_coeff_nxn(&state_copy, coeff, width, type, scan_mode, 0);
+    if (i == last_scan_set || i == 0) {
+      sig_coeffgroup_flag[cg_blk_pos] = 1;
+    } else {
+      const uint32_t ctx_sig = kvz_context_get_sig_coeff_group(sig_coeffgroup_flag, cg_pos_x,
+                                                               cg_pos_y, width);
+      ctx_bits += CTX_ENTROPY_BITS(&base_coeff_group_ctx[ctx_sig],
+                                   sig_coeffgroup_flag[cg_blk_pos] != 0);
+    }
 
-  // Store bitcost before restoring cabac
-  cost = (23-state_copy.cabac.bits_left) + (state_copy.cabac.num_buffered_bytes << 3);
+    if (sig_coeffgroup_flag[cg_blk_pos]) {
+      const int32_t pattern_sig_ctx = kvz_context_calc_pattern_sig_ctx(sig_coeffgroup_flag,
+                                                                       cg_pos_x, cg_pos_y, width);
+      for (; scan_pos_sig >= sub_pos; scan_pos_sig--) {
+        const uint32_t blk_pos = scan[scan_pos_sig];
+        const uint32_t sig = (sig_mask >> (scan_pos_sig - sub_pos)) & 1;
+
+        if (scan_pos_sig > sub_pos || i == 0 || num_non_zero) {
+          const uint32_t pos_y = blk_pos >> log2_block_size;
+          const uint32_t pos_x = blk_pos - (pos_y << log2_block_size);
+          const uint32_t ctx_sig = kvz_context_get_sig_ctx_inc(pattern_sig_ctx, scan_mode,
+                                                               pos_x, pos_y,
+                                                               log2_block_size, type);
+          ctx_bits += CTX_ENTROPY_BITS(&base_sig_ctx[ctx_sig], sig);
+        }
 
-  return cost;
+        if (sig) {
+          abs_coeff[num_non_zero++] = abs(coeff[blk_pos]);
+          if (last_nz_pos_in_cg == -1) {
+            last_nz_pos_in_cg = scan_pos_sig;
+          }
+          first_nz_pos_in_cg = scan_pos_sig;
+        }
+      }
+    } else {
+      scan_pos_sig = sub_pos - 1;
+    }
+
+    if (num_non_zero == 0) continue;
+
+    const bool sign_hidden = encoder->sign_hiding &&
+                             last_nz_pos_in_cg - first_nz_pos_in_cg >= SBH_THRESHOLD;
+    uint32_t ctx_set = (i > 0 && type == 0) ? 2 : 0;
+    if (c1 == 0) ctx_set++;
+    c1 = 1;
+
+    const cabac_ctx_t *base_one_ctx = (type == 0) ? &(cabac->ctx.cu_one_model_luma[4 * ctx_set]) :
+                                                    &(cabac->ctx.cu_one_model_chroma[4 * ctx_set]);
+    const int32_t num_c1_flag = MIN(num_non_zero, C1FLAG_NUMBER);
+    int32_t first_c2_flag_idx = -1;
+    int32_t idx;
+
+    for (idx = 0; idx < num_c1_flag; idx++) {
+      const uint32_t symbol = abs_coeff[idx] > 1;
+      ctx_bits += CTX_ENTROPY_BITS(&base_one_ctx[c1], symbol);
+      if (symbol) {
+        c1 = 0;
+        if (first_c2_flag_idx == -1) first_c2_flag_idx = idx;
+      } else if (c1 < 3 && c1 > 0) {
+        c1++;
+      }
+    }
+
+    if (c1 == 0 && first_c2_flag_idx != -1) {
+      const cabac_ctx_t *abs_ctx = (type == 0) ? &(cabac->ctx.cu_abs_model_luma[ctx_set]) :
+                                                 &(cabac->ctx.cu_abs_model_chroma[ctx_set]);
+      ctx_bits += CTX_ENTROPY_BITS(abs_ctx, abs_coeff[first_c2_flag_idx] > 2);
+    }
+
+    bypass_bits += sign_hidden ? num_non_zero - 1 : num_non_zero;
+
+    if (c1 == 0 || num_non_zero > C1FLAG_NUMBER) {
+      uint32_t go_rice_param = 0;
+      int32_t first_coeff2 = 1;
+      for (idx = 0; idx < num_non_zero; idx++) {
+        const int32_t base_level = (idx < C1FLAG_NUMBER) ? (2 + first_coeff2) : 1;
+        if (abs_coeff[idx] >= base_level) {
+          bypass_bits += coeff_remain_bits(abs_coeff[idx] - base_level, go_rice_param);
+          if (abs_coeff[idx] > 3 * (1 << go_rice_param)) {
+            go_rice_param = MIN(go_rice_param + 1, 4);
+          }
+        }
+        if (abs_coeff[idx] >= 2) first_coeff2 = 0;
+      }
+    }
+  }
+
+  return bypass_bits + ((ctx_bits + (1 << 14)) >> 15);
 }
 
 
@@ -350,7 +545,7 @@ uint32_t kvz_get_coded_level ( encoder_state_t * const state, double *coded_cost
   cabac_ctx_t* base_sig_model = type?(cabac->ctx.cu_sig_model_chroma):(cabac->ctx.cu_sig_model_luma);
 
   if( !last && max_abs_level < 3 ) {
-    *coded_cost_sig = state->global->cur_lambda_cost * CTX_ENTROPY_BITS(&base_sig_model[ctx_num_sig], 0);
+    *coded_cost_sig = state->lambda * CTX_ENTROPY_BITS(&base_sig_model[ctx_num_sig], 0);
     *coded_cost     = *coded_cost0 + *coded_cost_sig;
     if (max_abs_level == 0) return best_abs_level;
   } else {
@@ -358,13 +553,13 @@ uint32_t kvz_get_coded_level ( encoder_state_t * const state, double *coded_cost
   }
 
   if( !last ) {
-    cur_cost_sig = state->global->cur_lambda_cost * CTX_ENTROPY_BITS(&base_sig_model[ctx_num_sig], 1);
+    cur_cost_sig = state->lambda * CTX_ENTROPY_BITS(&base_sig_model[ctx_num_sig], 1);
   }
 
   min_abs_level    = ( max_abs_level > 1 ? max_abs_level - 1 : 1 );
   for (abs_level = max_abs_level; abs_level >= min_abs_level ; abs_level-- ) {
     double err       = (double)(level_double - ( abs_level << q_bits ) );
-    double cur_cost  = err * err * temp + state->global->cur_lambda_cost *
+    double cur_cost  = err * err * temp + state->lambda *
                        kvz_get_ic_rate( state, abs_level, ctx_num_one, ctx_num_abs,
                                     abs_go_rice, c1_idx, c2_idx, type);
     cur_cost        += cur_cost_sig;
@@ -401,7 +596,7 @@ static double get_rate_last(const encoder_state_t * const state,
   if( ctx_y > 3 ) {
     uiCost += 32768.0 * ((ctx_y-2)>>1);
   }
-  return state->global->cur_lambda_cost*uiCost;
+  return state->lambda*uiCost;
 }
 
 static void calc_last_bits(encoder_state_t * const state, int32_t width, int32_t height, int8_t type,
@@ -451,7 +646,7 @@ void kvz_rdoq_sign_hiding(const encoder_state_t *const state,
   
   int64_t rd_factor = (int64_t)(
     kvz_g_inv_quant_scales[qp_scaled % 6] * kvz_g_inv_quant_scales[qp_scaled % 6] * (1 << (2 * (qp_scaled / 6)))
-    / state->global->cur_lambda_cost / 16 / (1 << (2 * (encoder->bitdepth - 8)))
+    / state->lambda / 16 / (1 << (2 * (encoder->bitdepth - 8)))
     + 0.5);
   int32_t lastCG = -1;
   int32_t absSum = 0;
@@ -560,7 +755,7 @@ void  kvz_rdoq(encoder_state_t * const state, coeff_t *coef, coeff_t *dest_coeff
   uint32_t max_num_coeff   = width * height;
   int32_t  scalinglist_type= (block_type == CU_INTRA ? 0 : 3) + (int8_t)("\0\3\1\2"[type]);
 
-  int32_t qp_scaled = kvz_get_scaled_qp(type, state->global->QP, (encoder->bitdepth-8)*6);
+  int32_t qp_scaled = kvz_get_scaled_qp(type, state->qp, (encoder->bitdepth-8)*6);
   uint32_t abs_sum = 0;
 
   
@@ -624,6 +819,23 @@ void  kvz_rdoq(encoder_state_t * const state, coeff_t *coef, coeff_t *dest_coeff
     int32_t nnz_before_pos0;
   } rd_stats;
 
+  // Scale the coefficients in raster order in one pass the compiler can
+  // vectorize. A coefficient can only be coded if it rounds to a non-zero
+  // level, so if none of them does, the result is all zeros and the rate
+  // estimation below can be skipped.
+  int32_t level_doubles[32 * 32];
+  int32_t max_level_double = 0;
+  const int32_t max_level_limit = MAX_INT - (1 << (q_bits - 1));
+  for (uint32_t i = 0; i < max_num_coeff; i++) {
+    int32_t level_double = MIN(abs(coef[i]) * quant_coeff[i], max_level_limit);
+    level_doubles[i] = level_double;
+    max_level_double = MAX(max_level_double, level_double);
+  }
+  if (max_level_double < (1 << (q_bits - 1))) {
+    FILL_ARRAY(dest_coeff, 0, max_num_coeff);
+    return;
+  }
+
   int32_t last_x_bits[32],last_y_bits[32];
   calc_last_bits(state, width, height, type,last_x_bits, last_y_bits);
 
@@ -653,17 +865,14 @@ void  kvz_rdoq(encoder_state_t * const state, coeff_t *coef, coeff_t *dest_coeff
     FILL(rd_stats, 0);
     for (scanpos_in_cg = cg_size-1; scanpos_in_cg >= 0; scanpos_in_cg--)  {
       uint32_t blkpos;
-      int32_t q;
       double temp, err;
       int32_t level_double;
       uint32_t max_abs_level;
 
       scanpos = cg_scanpos*cg_size + scanpos_in_cg;
       blkpos          = scan[scanpos];
-      q  = quant_coeff[blkpos];
       temp = err_scale[blkpos];
-      level_double        = coef[blkpos];
-      level_double        = MIN(abs(level_double) * q , MAX_INT - (1 << (q_bits - 1)));
+      level_double        = level_doubles[blkpos];
       max_abs_level       = (level_double + (1 << (q_bits - 1))) >> q_bits;
 
       err               = (double)level_double;
@@ -766,7 +975,7 @@ void  kvz_rdoq(encoder_state_t * const state, coeff_t *coef, coeff_t *dest_coeff
         if (sig_coeffgroup_flag[ cg_blkpos ] == 0) {
           uint32_t ctx_sig  = kvz_context_get_sig_coeff_group(sig_coeffgroup_flag, cg_pos_x,
                                                           cg_pos_y, width);
-          cost_coeffgroup_sig[ cg_scanpos ] = state->global->cur_lambda_cost*CTX_ENTROPY_BITS(&base_coeff_group_ctx[ctx_sig],0);
+          cost_coeffgroup_sig[ cg_scanpos ] = state->lambda*CTX_ENTROPY_BITS(&base_coeff_group_ctx[ctx_sig],0);
           base_cost += cost_coeffgroup_sig[ cg_scanpos ]  - rd_stats.sig_cost;
         } else {
           if (cg_scanpos < cg_last_scanpos) {//skip the last coefficient group, which will be handled together with last position below.
@@ -783,9 +992,9 @@ void  kvz_rdoq(encoder_state_t * const state, coeff_t *coef, coeff_t *dest_coeff
             ctx_sig  = kvz_context_get_sig_coeff_group(sig_coeffgroup_flag, cg_pos_x,
                                                             cg_pos_y, width);
             if (cg_scanpos < cg_last_scanpos) {
-              cost_coeffgroup_sig[cg_scanpos] = state->global->cur_lambda_cost*CTX_ENTROPY_BITS(&base_coeff_group_ctx[ctx_sig],1);
+              cost_coeffgroup_sig[cg_scanpos] = state->lambda*CTX_ENTROPY_BITS(&base_coeff_group_ctx[ctx_sig],1);
               base_cost    += cost_coeffgroup_sig[cg_scanpos];
-              cost_zero_cg += state->global->cur_lambda_cost*CTX_ENTROPY_BITS(&base_coeff_group_ctx[ctx_sig],0);
+              cost_zero_cg += state->lambda*CTX_ENTROPY_BITS(&base_coeff_group_ctx[ctx_sig],0);
             }
 
             // try to convert the current coeff group from non-zero to all-zero
@@ -799,7 +1008,7 @@ void  kvz_rdoq(encoder_state_t * const state, coeff_t *coef, coeff_t *dest_coeff
               sig_coeffgroup_flag[ cg_blkpos ] = 0;
               base_cost = cost_zero_cg;
               if (cg_scanpos < cg_last_scanpos) {
-                cost_coeffgroup_sig[ cg_scanpos ] = state->global->cur_lambda_cost*CTX_ENTROPY_BITS(&base_coeff_group_ctx[ctx_sig],0);
+                cost_coeffgroup_sig[ cg_scanpos ] = state->lambda*CTX_ENTROPY_BITS(&base_coeff_group_ctx[ctx_sig],0);
               }
               // reset coeffs to 0 in this block
               for (scanpos_in_cg = cg_size-1; scanpos_in_cg >= 0; scanpos_in_cg--) {
@@ -827,13 +1036,13 @@ void  kvz_rdoq(encoder_state_t * const state, coeff_t *coef, coeff_t *dest_coeff
 
 
   if( block_type != CU_INTRA && !type/* && pcCU->getTransformIdx( uiAbsPartIdx ) == 0*/ ) {
-    best_cost  = block_uncoded_cost +   state->global->cur_lambda_cost*CTX_ENTROPY_BITS(&(cabac->ctx.cu_qt_root_cbf_model),0);
-    base_cost +=   state->global->cur_lambda_cost*CTX_ENTROPY_BITS(&(cabac->ctx.cu_qt_root_cbf_model),1);
+    best_cost  = block_uncoded_cost +   state->lambda*CTX_ENTROPY_BITS(&(cabac->ctx.cu_qt_root_cbf_model),0);
+    base_cost +=   state->lambda*CTX_ENTROPY_BITS(&(cabac->ctx.cu_qt_root_cbf_model),1);
   } else {
     cabac_ctx_t* base_cbf_model = type?(cabac->ctx.qt_cbf_model_chroma):(cabac->ctx.qt_cbf_model_luma);
     ctx_cbf   = ( type ? tr_depth : !tr_depth);
-    best_cost  = block_uncoded_cost +  state->global->cur_lambda_cost*CTX_ENTROPY_BITS(&base_cbf_model[ctx_cbf],0);
-    base_cost +=   state->global->cur_lambda_cost*CTX_ENTROPY_BITS(&base_cbf_model[ctx_cbf],1);
+    best_cost  = block_uncoded_cost +  state->lambda*CTX_ENTROPY_BITS(&base_cbf_model[ctx_cbf],0);
+    base_cost +=   state->lambda*CTX_ENTROPY_BITS(&base_cbf_model[ctx_cbf],1);
   }
 
   for (cg_scanpos = cg_last_scanpos; cg_scanpos >= 0; cg_scanpos--) {
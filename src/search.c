@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include "intra.h"
 #include "inter.h"
@@ -35,6 +36,9 @@
 #include "transform.h"
 #include "search_inter.h"
 #include "search_intra.h"
+#include "analysis.h"
+#include "rate_control.h"
+#include "strategies/strategies-picture.h"
 
 #define IN_FRAME(x, y, width, height, block_width, block_height) \
   ((x) >= 0 && (y) >= 0 \
@@ -56,6 +60,22 @@
 #ifndef FULL_CU_SPLIT_SEARCH
 #  define FULL_CU_SPLIT_SEARCH false
 #endif
+// Adaptive cu-split termination skips the split when the cost per pixel
+// of the CU is below this fraction of the average of the CUs at the same
+// depth that were not split.
+#ifndef SPLIT_TERM_FACTOR
+#  define SPLIT_TERM_FACTOR 0.95
+#endif
+// Number of unsplit CUs needed before adaptive cu-split termination is used.
+#ifndef SPLIT_TERM_MIN_CUS
+#  define SPLIT_TERM_MIN_CUS 8
+#endif
+// The skip check before motion estimation is done only if the luma SATD
+// per pixel of the best merge candidate is below this fraction of the
+// quantization step.
+#ifndef EARLY_SKIP_SATD_FACTOR
+#  define EARLY_SKIP_SATD_FACTOR 0.5
+#endif
 // Modify weight of luma SSD.
 #ifndef LUMA_MULT
 # define LUMA_MULT 0.8
@@ -324,7 +344,7 @@ double kvz_cu_rd_cost_luma(const encoder_state_t *const state,
     sum += kvz_cu_rd_cost_luma(state, x_px, y_px + offset, depth + 1, pred_cu, lcu);
     sum += kvz_cu_rd_cost_luma(state, x_px + offset, y_px + offset, depth + 1, pred_cu, lcu);
 
-    return sum + tr_tree_bits * state->global->cur_lambda_cost;
+    return sum + tr_tree_bits * state->lambda;
   }
 
   // Add transform_tree cbf_luma bit cost.
@@ -356,7 +376,7 @@ double kvz_cu_rd_cost_luma(const encoder_state_t *const state,
   }
 
   double bits = tr_tree_bits + coeff_bits;
-  return (double)ssd * LUMA_MULT + bits * state->global->cur_lambda_cost;
+  return (double)ssd * LUMA_MULT + bits * state->lambda;
 }
 
 
@@ -401,7 +421,7 @@ double kvz_cu_rd_cost_chroma(const encoder_state_t *const state,
     sum += kvz_cu_rd_cost_chroma(state, x_px, y_px + offset, depth + 1, pred_cu, lcu);
     sum += kvz_cu_rd_cost_chroma(state, x_px + offset, y_px + offset, depth + 1, pred_cu, lcu);
 
-    return sum + tr_tree_bits * state->global->cur_lambda_cost;
+    return sum + tr_tree_bits * state->lambda;
   }
 
   // Chroma SSD
@@ -433,7 +453,7 @@ double kvz_cu_rd_cost_chroma(const encoder_state_t *const state,
   }
 
   double bits = tr_tree_bits + coeff_bits;
-  return (double)ssd * CHROMA_MULT + bits * state->global->cur_lambda_cost;
+  return (double)ssd * CHROMA_MULT + bits * state->lambda;
 }
 
 
@@ -473,6 +493,86 @@ static uint8_t get_ctx_cu_split_model(const lcu_t *lcu, int x, int y, int depth)
   return condA + condL;
 }
 
+/**
+ * \brief Check whether a loaded mode decision can be used at this depth.
+ *
+ * The decision can be used if it is within the allowed search depths and
+ * the references it uses exist in the current picture.
+ *
+ * \param state     encoder state
+ * \param analysis  loaded mode decision
+ * \param depth     search depth of the CU
+ * \param can_split whether the CU may be split further
+ */
+static bool analysis_usable(const encoder_state_t * const state,
+                            const cu_info_t * const analysis,
+                            int depth, bool can_split)
+{
+  const int analysis_depth = analysis->depth + (analysis->part_size == SIZE_NxN);
+
+  if (analysis_depth > depth) return can_split;
+  if (analysis_depth < depth) return false;
+
+  if (analysis->type == CU_INTRA) {
+    return WITHIN(depth, state->pu_depth_intra.min, state->pu_depth_intra.max);
+  }
+
+  if (analysis->type != CU_INTER ||
+      state->global->slicetype == KVZ_SLICE_I ||
+      !WITHIN(depth, state->pu_depth_inter.min, state->pu_depth_inter.max))
+  {
+    return false;
+  }
+  for (int list = 0; list < 2; ++list) {
+    if (!(analysis->inter.mv_dir & (1 << list))) continue;
+    const int ref_idx = analysis->inter.mv_ref[list];
+    if (ref_idx >= state->global->ref->used_size ||
+        state->global->refmap[ref_idx].list - 1 != list)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * \brief Reconstruct an inter CU and quantize its residual.
+ *
+ * A merged CU without coefficients is turned into a skipped CU.
+ */
+static void inter_recon_cu(encoder_state_t * const state, int x, int y, int depth, lcu_t *lcu)
+{
+  const int x_local = x & 0x3f, y_local = y & 0x3f;
+  cu_info_t *cur_cu = &lcu->cu[LCU_CU_OFFSET + (x_local >> 3) + (y_local >> 3) * LCU_T_CU_WIDTH];
+
+  // Reset transform depth because intra messes with them.
+  // This will no longer be necessary if the transform depths are not shared.
+  int tr_depth = depth > 0 ? depth : 1;
+  kvz_lcu_set_trdepth(lcu, x, y, depth, tr_depth);
+
+  if (cur_cu->inter.mv_dir == 3) {
+    kvz_inter_recon_lcu_bipred(state, state->global->ref->images[cur_cu->inter.mv_ref[0]], state->global->ref->images[cur_cu->inter.mv_ref[1]], x, y, LCU_WIDTH >> depth, cur_cu->inter.mv, lcu);
+  } else {
+    kvz_inter_recon_lcu(state, state->global->ref->images[cur_cu->inter.mv_ref[cur_cu->inter.mv_dir - 1]], x, y, LCU_WIDTH >> depth, cur_cu->inter.mv[cur_cu->inter.mv_dir - 1], lcu, 0);
+  }
+
+  kvz_quantize_lcu_luma_residual(state, x, y, depth, NULL, lcu);
+  kvz_quantize_lcu_chroma_residual(state, x, y, depth, NULL, lcu);
+
+  int cbf = cbf_is_set(cur_cu->cbf.y, depth) || cbf_is_set(cur_cu->cbf.u, depth) || cbf_is_set(cur_cu->cbf.v, depth);
+
+  if(cur_cu->merged && !cbf) {
+    cur_cu->merged = 0;
+    cur_cu->skipped = 1;
+    // Selecting skip reduces bits needed to code the CU
+    if (cur_cu->inter.bitcost > 1) {
+      cur_cu->inter.bitcost -= 1;
+    }
+  }
+  lcu_set_inter(lcu, x, y, depth, cur_cu);
+  lcu_set_coeff(lcu, x, y, depth, cur_cu);
+}
+
 /**
  * Search every mode from 0 to MAX_PU_DEPTH and return cost of best mode.
  * - The recursion is started at depth 0 and goes in Z-order to MAX_PU_DEPTH.
@@ -483,7 +583,9 @@ static uint8_t get_ctx_cu_split_model(const lcu_t *lcu, int x, int y, int depth)
  * - All the final data for the LCU gets eventually copied to depth 0, which
  *   will be the final output of the recursion.
  */
-static double search_cu(encoder_state_t * const state, int x, int y, int depth, lcu_t work_tree[MAX_PU_DEPTH + 1])
+static double search_cu(encoder_state_t * const state, int x, int y, int depth, lcu_t work_tree[MAX_PU_DEPTH + 1],
+                        const inter_mv_seeds_t *parent_mv_seeds,
+                        const intra_gradients_t *gradients)
 {
   const encoder_control_t* ctrl = state->encoder_control;
   const videoframe_t * const frame = state->tile->frame;
@@ -499,6 +601,10 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
 #endif
   PERFORMANCE_MEASURE_START(KVZ_PERF_SEARCHCU);
 
+  // Motion vectors of this CU, or of the closest ancestor for references
+  // not searched at this depth, are the starting points for the sub-CUs.
+  inter_mv_seeds_t mv_seeds = *parent_mv_seeds;
+
   // Stop recursion if the CU is completely outside the frame.
   if (x >= frame->width || y >= frame->height) {
     // Return zero cost because this CU does not have to be coded.
@@ -511,16 +617,69 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
   cur_cu->tr_depth = depth > 0 ? depth : 1;
   cur_cu->type = CU_NOTSET;
   cur_cu->part_size = depth > MAX_DEPTH ? SIZE_NxN : SIZE_2Nx2N;
+
+  // With adaptive quantization each quantization group has its own QP.
+  // The QP of the parent is restored before returning.
+  const int8_t parent_qp = state->qp;
+  const double parent_lambda = state->lambda;
+  const double parent_lambda_sqrt = state->lambda_sqrt;
+  if (ctrl->cfg->aq != KVZ_AQ_OFF && depth <= ctrl->max_qp_delta_depth) {
+    kvz_set_cu_lambda_and_qp(state, x, y, depth);
+  }
+  cur_cu->qp = state->qp;
+
+  const bool can_split =
+    depth < state->pu_depth_intra.max ||
+    (depth < state->pu_depth_inter.max && state->global->slicetype != KVZ_SLICE_I);
+
+  // Reuse the mode decision loaded from the analysis file, if any. When the
+  // loaded CU is deeper, only the split is searched at this depth.
+  const cu_info_t *analysis = kvz_analysis_get_cu(state, x, y);
+  if (analysis && !analysis_usable(state, analysis, depth, can_split)) {
+    analysis = NULL;
+  }
+  const bool analysis_split = analysis &&
+    analysis->depth + (analysis->part_size == SIZE_NxN) > depth;
+
   // If the CU is completely inside the frame at this depth, search for
   // prediction modes at this depth.
   if (x + cu_width <= frame->width &&
-      y + cu_width <= frame->height)
+      y + cu_width <= frame->height &&
+      !analysis_split)
   {
 
+    if (analysis && analysis->type == CU_INTRA) {
+      // Take the loaded intra mode as is.
+      kvz_lcu_set_trdepth(&work_tree[depth], x, y, depth, depth);
+      cur_cu->intra[PU_INDEX(x >> 2, y >> 2)].mode =
+        analysis->intra[PU_INDEX(x >> 2, y >> 2)].mode;
+      cur_cu->type = CU_INTRA;
+    }
+
+    // Try the best merge candidate before motion estimation. If it leaves
+    // no residual, the CU is coded as skip without further search.
+    bool early_skip = false;
+    if (ctrl->cfg->early_skip && !analysis &&
+        state->global->slicetype != KVZ_SLICE_I &&
+        WITHIN(depth, state->pu_depth_inter.min, state->pu_depth_inter.max) &&
+        kvz_search_cu_merge(state, x, y, depth, &work_tree[depth]) <
+          EARLY_SKIP_SATD_FACTOR * pow(2.0, (state->qp - 4) / 6.0) * cu_width * cu_width)
+    {
+      cur_cu->skipped = 0;
+      inter_recon_cu(state, x, y, depth, &work_tree[depth]);
+      if (cur_cu->skipped) {
+        early_skip = true;
+        cur_cu->type = CU_INTER;
+        cost = 0;
+      }
+    }
+
     if (state->global->slicetype != KVZ_SLICE_I &&
-        WITHIN(depth, ctrl->pu_depth_inter.min, ctrl->pu_depth_inter.max))
+        WITHIN(depth, state->pu_depth_inter.min, state->pu_depth_inter.max) &&
+        (!analysis || analysis->type == CU_INTER) &&
+        !early_skip)
     {
-      int mode_cost = kvz_search_cu_inter(state, x, y, depth, &work_tree[depth]);
+      int mode_cost = kvz_search_cu_inter(state, x, y, depth, &work_tree[depth], analysis, &mv_seeds);
       if (mode_cost < cost) {
         cost = mode_cost;
         cur_cu->type = CU_INTER;
@@ -530,13 +689,15 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
     // Try to skip intra search in rd==0 mode.
     // This can be quite severe on bdrate. It might be better to do this
     // decision after reconstructing the inter frame.
-    bool skip_intra = state->encoder_control->rdo == 0
-                      && cur_cu->type != CU_NOTSET
-                      && cost / (cu_width * cu_width) < INTRA_TRESHOLD;
+    bool skip_intra = early_skip ||
+                      (state->encoder_control->rdo == 0
+                       && cur_cu->type != CU_NOTSET
+                       && cost / (cu_width * cu_width) < INTRA_TRESHOLD);
     if (!skip_intra 
-        && WITHIN(depth, ctrl->pu_depth_intra.min, ctrl->pu_depth_intra.max))
+        && !analysis
+        && WITHIN(depth, state->pu_depth_intra.min, state->pu_depth_intra.max))
     {
-      double mode_cost = kvz_search_cu_intra(state, x, y, depth, &work_tree[depth]);
+      double mode_cost = kvz_search_cu_intra(state, x, y, depth, &work_tree[depth], gradients);
       if (mode_cost < cost) {
         cost = mode_cost;
         cur_cu->type = CU_INTRA;
@@ -560,7 +721,12 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
         // rd2. Possibly because the luma mode search already takes chroma
         // into account, so there is less of a chanse of luma mode being
         // really bad for chroma.
-        if (state->encoder_control->rdo == 3) {
+        if (analysis) {
+          intra_mode_chroma = analysis->intra[0].mode_chroma;
+          lcu_set_intra_mode(&work_tree[depth], x, y, depth,
+                             intra_mode, intra_mode_chroma,
+                             cur_cu->part_size);
+        } else if (state->encoder_control->rdo == 3) {
           intra_mode_chroma = kvz_search_cu_intra_chroma(state, x, y, depth, &work_tree[depth]);
           lcu_set_intra_mode(&work_tree[depth], x, y, depth,
                              intra_mode, intra_mode_chroma,
@@ -569,47 +735,22 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
 
         kvz_intra_recon_lcu_chroma(state, x, y, depth, intra_mode_chroma, NULL, &work_tree[depth]);
       }
-    } else if (cur_cu->type == CU_INTER) {
-      // Reset transform depth because intra messes with them.
-      // This will no longer be necessary if the transform depths are not shared.
-      int tr_depth = depth > 0 ? depth : 1;
-      kvz_lcu_set_trdepth(&work_tree[depth], x, y, depth, tr_depth);
-
-      if (cur_cu->inter.mv_dir == 3) {
-        kvz_inter_recon_lcu_bipred(state, state->global->ref->images[cur_cu->inter.mv_ref[0]], state->global->ref->images[cur_cu->inter.mv_ref[1]], x, y, LCU_WIDTH >> depth, cur_cu->inter.mv, &work_tree[depth]);
-      } else {
-        kvz_inter_recon_lcu(state, state->global->ref->images[cur_cu->inter.mv_ref[cur_cu->inter.mv_dir - 1]], x, y, LCU_WIDTH >> depth, cur_cu->inter.mv[cur_cu->inter.mv_dir - 1], &work_tree[depth], 0);
-      }
-
-      kvz_quantize_lcu_luma_residual(state, x, y, depth, NULL, &work_tree[depth]);
-      kvz_quantize_lcu_chroma_residual(state, x, y, depth, NULL, &work_tree[depth]);
-
-      int cbf = cbf_is_set(cur_cu->cbf.y, depth) || cbf_is_set(cur_cu->cbf.u, depth) || cbf_is_set(cur_cu->cbf.v, depth);
-
-      if(cur_cu->merged && !cbf) {
-        cur_cu->merged = 0;
-        cur_cu->skipped = 1;
-        // Selecting skip reduces bits needed to code the CU
-        if (cur_cu->inter.bitcost > 1) {
-          cur_cu->inter.bitcost -= 1;
-        }
-      }
-      lcu_set_inter(&work_tree[depth], x, y, depth, cur_cu);
-      lcu_set_coeff(&work_tree[depth], x, y, depth, cur_cu);
+    } else if (cur_cu->type == CU_INTER && !early_skip) {
+      inter_recon_cu(state, x, y, depth, &work_tree[depth]);
     }
   }
   if (cur_cu->type == CU_INTRA || cur_cu->type == CU_INTER) {
     cost = kvz_cu_rd_cost_luma(state, x_local, y_local, depth, cur_cu, &work_tree[depth]);
     cost += kvz_cu_rd_cost_chroma(state, x_local, y_local, depth, cur_cu, &work_tree[depth]);
     double mode_bits = calc_mode_bits(state, cur_cu, x, y);
-    cost += mode_bits * state->global->cur_lambda_cost;
+    cost += mode_bits * state->lambda;
   }
   
   // Recursively split all the way to max search depth.
-  if (depth < ctrl->pu_depth_intra.max || (depth < ctrl->pu_depth_inter.max && state->global->slicetype != KVZ_SLICE_I)) {
+  if (can_split) {
     int half_cu = cu_width / 2;
     // Using Cost = lambda * 9 to compensate on the price of the split
-    double split_cost = state->global->cur_lambda_cost * CU_COST;
+    double split_cost = state->lambda * CU_COST;
     int cbf = cbf_is_set(cur_cu->cbf.y, depth) || cbf_is_set(cur_cu->cbf.u, depth) || cbf_is_set(cur_cu->cbf.v, depth);
         
     if (depth < MAX_DEPTH) {
@@ -626,14 +767,36 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
       split_cost += CTX_ENTROPY_FBITS(ctx, 0);  // NxN
     }
 
+    // With adaptive termination, a CU much cheaper than the unsplit CUs
+    // at this depth so far is unlikely to gain from splitting.
+    const bool mode_searched = cur_cu->type != CU_NOTSET;
+    const double cost_per_pixel = cost / (cu_width * cu_width);
+    const bool cheap_cu =
+      ctrl->cfg->cu_split_termination == KVZ_CU_SPLIT_TERMINATION_ADAPTIVE &&
+      mode_searched &&
+      state->split_term_count[depth] >= SPLIT_TERM_MIN_CUS &&
+      cost_per_pixel < SPLIT_TERM_FACTOR *
+                       state->split_term_cost[depth] / state->split_term_count[depth];
+
     // If skip mode was selected for the block, skip further search.
     // Skip mode means there's no coefficients in the block, so splitting
     // might not give any better results but takes more time to do.
-    if (cur_cu->type == CU_NOTSET || cbf || FULL_CU_SPLIT_SEARCH) {
-      split_cost += search_cu(state, x,           y,           depth + 1, work_tree);
-      split_cost += search_cu(state, x + half_cu, y,           depth + 1, work_tree);
-      split_cost += search_cu(state, x,           y + half_cu, depth + 1, work_tree);
-      split_cost += search_cu(state, x + half_cu, y + half_cu, depth + 1, work_tree);
+    bool split_searched = false;
+    if (analysis && !analysis_split) {
+      // The loaded mode decision was not split.
+      split_cost = INT_MAX;
+    } else if (((cur_cu->type == CU_NOTSET || cbf) && !cheap_cu) ||
+               FULL_CU_SPLIT_SEARCH)
+    {
+      const vector2d_t sub_cu[4] = {
+        { x,           y           }, { x + half_cu, y           },
+        { x,           y + half_cu }, { x + half_cu, y + half_cu },
+      };
+      // Stop as soon as the split is known to cost more than this CU.
+      for (int i = 0; i < 4 && split_cost < cost; ++i) {
+        split_cost += search_cu(state, sub_cu[i].x, sub_cu[i].y, depth + 1, work_tree, &mv_seeds, gradients);
+      }
+      split_searched = true;
     } else {
       split_cost = INT_MAX;
     }
@@ -642,7 +805,7 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
     // of the top left CU from the next depth. This should ensure that 64x64
     // gets used, at least in the most obvious cases, while avoiding any
     // searching.
-    if (cur_cu->type == CU_NOTSET && depth < MAX_PU_DEPTH
+    if (cur_cu->type == CU_NOTSET && depth < MAX_PU_DEPTH && !analysis
         && x + cu_width <= frame->width && y + cu_width <= frame->height)
     {
       vector2d_t lcu_cu = { x_local / 8, y_local / 8 };
@@ -670,7 +833,7 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
         cost += CTX_ENTROPY_FBITS(ctx, 0);
 
         double mode_bits = calc_mode_bits(state, cur_cu, x, y);
-        cost += mode_bits * state->global->cur_lambda_cost;
+        cost += mode_bits * state->lambda;
       }
     }
 
@@ -686,8 +849,17 @@ static double search_cu(encoder_state_t * const state, int x, int y, int depth,
       // search.
       work_tree_copy_down(x, y, depth, work_tree);
     }
+
+    if (split_searched && mode_searched && split_cost >= cost) {
+      state->split_term_cost[depth] += cost_per_pixel;
+      state->split_term_count[depth] += 1;
+    }
   }
   
+  state->qp = parent_qp;
+  state->lambda = parent_lambda;
+  state->lambda_sqrt = parent_lambda_sqrt;
+
   PERFORMANCE_MEASURE_END(KVZ_PERF_SEARCHCU, state->encoder_control->threadqueue, "type=search_cu,frame=%d,tile=%d,slice=%d,px_x=%d-%d,px_y=%d-%d,depth=%d,split=%d,cur_cu_is_intra=%d", state->global->frame, state->tile->id, state->slice->id,
                           (state->tile->lcu_offset_x * LCU_WIDTH) + x,
                           (state->tile->lcu_offset_x * LCU_WIDTH) + x + (LCU_WIDTH >> depth), 
@@ -845,22 +1017,263 @@ static void copy_lcu_to_cu_data(const encoder_state_t * const state, int x_px, i
 }
 
 
+/**
+ * \brief Update a range with the depths of the CUs in an LCU.
+ * \param cu       top-left CU of the LCU
+ * \param stride   distance between rows of CUs
+ * \param width    width of the LCU inside the picture in SCUs
+ * \param height   height of the LCU inside the picture in SCUs
+ * \param min      minimum depth to update
+ * \param max      maximum depth to update
+ *
+ * Intra CUs with NxN partitions are counted as depth MAX_PU_DEPTH.
+ */
+static void update_depth_range(const cu_info_t *cu, int stride,
+                               int width, int height,
+                               int *min, int *max)
+{
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const cu_info_t *cur = &cu[x + y * stride];
+      const int depth = cur->depth + (cur->part_size == SIZE_NxN);
+      *min = MIN(*min, depth);
+      *max = MAX(*max, depth);
+    }
+  }
+}
+
+/**
+ * \brief Select the range of CU depths to search in an LCU.
+ * \param state  encoder state
+ * \param x      x-coordinate of the LCU in the tile in pixels
+ * \param y      y-coordinate of the LCU in the tile in pixels
+ *
+ * With adaptive CU depth the range is limited to the depths used in the
+ * LCUs to the left and above and in the co-located LCU of the first
+ * reference picture. At least two of them must be available. LCUs on the
+ * picture boundary are always searched with the full range.
+ */
+static void set_lcu_depth_range(encoder_state_t * const state, int x, int y)
+{
+  const encoder_control_t * const ctrl = state->encoder_control;
+  const videoframe_t * const frame = state->tile->frame;
+
+  state->pu_depth_inter.min = ctrl->pu_depth_inter.min;
+  state->pu_depth_inter.max = ctrl->pu_depth_inter.max;
+  state->pu_depth_intra.min = ctrl->pu_depth_intra.min;
+  state->pu_depth_intra.max = ctrl->pu_depth_intra.max;
+
+  if (!ctrl->cfg->adaptive_cu_depth ||
+      x + LCU_WIDTH > frame->width || y + LCU_WIDTH > frame->height)
+  {
+    return;
+  }
+
+  int min_depth = MAX_PU_DEPTH;
+  int max_depth = 0;
+  int num_lcus = 0;
+
+  const int stride = frame->width_in_lcu << MAX_DEPTH;
+  const cu_info_t *cu = &frame->cu_array->data[(x >> MIN_SIZE) + (y >> MIN_SIZE) * stride];
+  if (x > 0) {
+    update_depth_range(cu - LCU_CU_WIDTH, stride, LCU_CU_WIDTH, LCU_CU_WIDTH,
+                       &min_depth, &max_depth);
+    ++num_lcus;
+  }
+  if (y > 0) {
+    update_depth_range(cu - LCU_CU_WIDTH * stride, stride, LCU_CU_WIDTH, LCU_CU_WIDTH,
+                       &min_depth, &max_depth);
+    ++num_lcus;
+  }
+  if (state->global->ref->used_size > 0) {
+    const int col_stride = ctrl->in.width_in_lcu << MAX_DEPTH;
+    const int x_col = (state->tile->lcu_offset_x * LCU_WIDTH + x) >> MIN_SIZE;
+    const int y_col = (state->tile->lcu_offset_y * LCU_WIDTH + y) >> MIN_SIZE;
+    const cu_array_t * const col = state->global->ref->cu_arrays[0];
+    update_depth_range(&col->data[x_col + y_col * col_stride], col_stride,
+                       LCU_CU_WIDTH, LCU_CU_WIDTH, &min_depth, &max_depth);
+    ++num_lcus;
+  }
+
+  if (num_lcus < 2) {
+    return;
+  }
+
+  // Keep the configured range if the ranges do not overlap.
+  if (min_depth <= state->pu_depth_inter.max && max_depth >= state->pu_depth_inter.min) {
+    state->pu_depth_inter.min = MAX(state->pu_depth_inter.min, min_depth);
+    state->pu_depth_inter.max = MIN(state->pu_depth_inter.max, max_depth);
+  }
+  if (min_depth <= state->pu_depth_intra.max && max_depth >= state->pu_depth_intra.min) {
+    state->pu_depth_intra.min = MAX(state->pu_depth_intra.min, min_depth);
+    state->pu_depth_intra.max = MIN(state->pu_depth_intra.max, max_depth);
+  }
+}
+
+/**
+ * \brief Check whether the source pixels of an LCU are identical to the
+ * co-located pixels of the source of a reference picture.
+ */
+static bool lcu_source_identical(const encoder_state_t * const state,
+                                 const kvz_picture *ref_source, int x, int y)
+{
+  const kvz_picture *source = state->tile->frame->source;
+  const int x_ref = state->tile->lcu_offset_x * LCU_WIDTH + x;
+  const int y_ref = state->tile->lcu_offset_y * LCU_WIDTH + y;
+
+  if (kvz_reg_sad(&source->y[y * source->stride + x],
+                  &ref_source->y[y_ref * ref_source->stride + x_ref],
+                  LCU_WIDTH, LCU_WIDTH, source->stride, ref_source->stride) != 0)
+  {
+    return false;
+  }
+
+  const int stride_c = source->stride / 2;
+  const int ref_stride_c = ref_source->stride / 2;
+  const int offset_c = y / 2 * stride_c + x / 2;
+  const int ref_offset_c = y_ref / 2 * ref_stride_c + x_ref / 2;
+  return
+    kvz_reg_sad(&source->u[offset_c], &ref_source->u[ref_offset_c],
+                LCU_WIDTH_C, LCU_WIDTH_C, stride_c, ref_stride_c) == 0 &&
+    kvz_reg_sad(&source->v[offset_c], &ref_source->v[ref_offset_c],
+                LCU_WIDTH_C, LCU_WIDTH_C, stride_c, ref_stride_c) == 0;
+}
+
+/**
+ * \brief Code a static LCU as a skipped CU without search.
+ *
+ * If the source pixels of the LCU are identical to those of the reference
+ * of a uni-predictive merge candidate with a zero motion vector, the LCU
+ * is coded as a skipped 64x64 CU using that candidate. The reconstruction
+ * of the reference is copied as is, without transform or RDO.
+ *
+ * \return true if the LCU was coded as skip.
+ */
+static bool search_static_lcu(encoder_state_t * const state, int x, int y, lcu_t *lcu)
+{
+  const encoder_control_t * const ctrl = state->encoder_control;
+  const videoframe_t * const frame = state->tile->frame;
+  const image_list_t * const ref = state->global->ref;
+
+  if (!ctrl->cfg->static_skip ||
+      state->global->slicetype == KVZ_SLICE_I ||
+      ctrl->pu_depth_inter.min > 0 ||
+      x + LCU_WIDTH > frame->width || y + LCU_WIDTH > frame->height)
+  {
+    return false;
+  }
+
+  inter_merge_cand_t merge_cand[MRG_MAX_NUM_CANDS];
+  const int num_cand = kvz_inter_get_merge_cand(state, x, y, 0, merge_cand, lcu);
+
+  // Whether the source of each reference is identical, or -1 if it has not
+  // been checked yet.
+  int8_t identical[MAX_REF_PIC_COUNT];
+  FILL(identical, -1);
+
+  int merge_idx;
+  for (merge_idx = 0; merge_idx < num_cand; ++merge_idx) {
+    const inter_merge_cand_t *cand = &merge_cand[merge_idx];
+    if (cand->dir == 3) continue;
+    bool usable = true;
+    for (int list = 0; list < 2 && usable; ++list) {
+      if (!(cand->dir & (1 << list))) continue;
+
+      const int ref_idx = cand->ref[list];
+      if (cand->mv[list][0] != 0 || cand->mv[list][1] != 0 ||
+          ref_idx >= MAX_REF_PIC_COUNT)
+      {
+        usable = false;
+        break;
+      }
+      if (identical[ref_idx] < 0) {
+        identical[ref_idx] = ref->sources[ref_idx] &&
+                             lcu_source_identical(state, ref->sources[ref_idx], x, y);
+      }
+      usable = identical[ref_idx];
+    }
+    if (usable) break;
+  }
+  if (merge_idx == num_cand) return false;
+
+  const inter_merge_cand_t *cand = &merge_cand[merge_idx];
+  cu_info_t *cur_cu = &lcu->cu[LCU_CU_OFFSET];
+  cur_cu->depth = 0;
+  cur_cu->tr_depth = 1;
+  cur_cu->type = CU_INTER;
+  cur_cu->part_size = SIZE_2Nx2N;
+  cur_cu->qp = state->qp;
+  cur_cu->merged = 0;
+  cur_cu->skipped = 1;
+  cur_cu->merge_idx = merge_idx;
+  cur_cu->inter.mv_dir = cand->dir;
+  for (int list = 0; list < 2; ++list) {
+    cur_cu->inter.mv_ref[list] = cand->ref[list];
+    cur_cu->inter.mv[list][0] = cand->mv[list][0];
+    cur_cu->inter.mv[list][1] = cand->mv[list][1];
+    if (cand->dir & (1 << list)) {
+      cur_cu->inter.mv_ref_coded[list] = state->global->refmap[cand->ref[list]].idx;
+    }
+  }
+  cur_cu->cbf.y = 0;
+  cur_cu->cbf.u = 0;
+  cur_cu->cbf.v = 0;
+
+  kvz_lcu_set_trdepth(lcu, x, y, 0, cur_cu->tr_depth);
+  kvz_inter_recon_lcu(state, ref->images[cur_cu->inter.mv_ref[cur_cu->inter.mv_dir - 1]],
+                      x, y, LCU_WIDTH, cur_cu->inter.mv[cur_cu->inter.mv_dir - 1], lcu, NULL);
+  lcu_set_inter(lcu, x, y, 0, cur_cu);
+  lcu_set_coeff(lcu, x, y, 0, cur_cu);
+
+  return true;
+}
+
 /**
  * Search LCU for modes.
  * - Best mode gets copied to current picture.
+ *
+ * \return true if the LCU was coded as a static skip.
  */
-void kvz_search_lcu(encoder_state_t * const state, const int x, const int y, const yuv_t * const hor_buf, const yuv_t * const ver_buf)
+bool kvz_search_lcu(encoder_state_t * const state, const int x, const int y, const yuv_t * const hor_buf, const yuv_t * const ver_buf)
 {
   lcu_t work_tree[MAX_PU_DEPTH + 1];
   int depth;
+
+  FILL(work_tree[0], 0);
+  init_lcu_t(state, x, y, &work_tree[0], hor_buf, ver_buf);
+
+  // Static LCUs are coded without initializing the rest of the work tree.
+  if (search_static_lcu(state, x, y, &work_tree[0])) {
+    copy_lcu_to_cu_data(state, x, y, &work_tree[0]);
+    return true;
+  }
+
   // Initialize work tree.
-  for (depth = 0; depth <= MAX_PU_DEPTH; ++depth) {
+  for (depth = 1; depth <= MAX_PU_DEPTH; ++depth) {
     FILL(work_tree[depth], 0);
     init_lcu_t(state, x, y, &work_tree[depth], hor_buf, ver_buf);
   }
 
+  set_lcu_depth_range(state, x, y);
+
+  inter_mv_seeds_t mv_seeds;
+  FILL(mv_seeds, 0);
+  mv_seeds.best_ref = -1;
+
+  // Gradients of the source pixels for limiting the intra mode search.
+  intra_gradients_t gradients;
+  if (state->encoder_control->cfg->gradient_intra) {
+    const videoframe_t * const frame = state->tile->frame;
+    kvz_search_intra_calc_gradients(&work_tree[0],
+                                    MIN(LCU_WIDTH, frame->width - x),
+                                    MIN(LCU_WIDTH, frame->height - y),
+                                    &gradients);
+  }
+
   // Start search from depth 0.
-  search_cu(state, x, y, 0, work_tree);
+  search_cu(state, x, y, 0, work_tree, &mv_seeds,
+            state->encoder_control->cfg->gradient_intra ? &gradients : NULL);
 
   copy_lcu_to_cu_data(state, x, y, &work_tree[0]);
+  return false;
 }
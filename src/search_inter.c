@@ -27,6 +27,8 @@
 #include <stdlib.h>
 
 #include "inter.h"
+#include "analysis.h"
+#include "blockhash.h"
 #include "strategies/strategies-picture.h"
 #include "strategies/strategies-ipol.h"
 
@@ -34,6 +36,22 @@
 // Temporarily for debugging.
 #define SEARCH_MV_FULL_RADIUS 0
 
+// Maximum number of small pattern steps when refining a motion vector
+// found in a larger CU.
+#define SMALL_HEXBS_MAX_STEPS 8
+
+// Search range of the full search on the smallest pyramid level, in pixels
+// of that level.
+#define PYRAMID_SEARCH_RANGE 8
+
+// Smallest CU for which pyramid motion estimation is used. Smaller blocks
+// become too small to match reliably on the downscaled pictures.
+#define PYRAMID_MIN_CU_WIDTH 16
+
+// Maximum number of exact matches looked up from the hash table of a
+// reference picture for each block.
+#define HASH_ME_MAX_CANDIDATES 16
+
 
 static uint32_t get_ep_ex_golomb_bitcost(uint32_t symbol, uint32_t count)
 {
@@ -125,7 +143,47 @@ static int calc_mvd_cost(const encoder_state_t * const state, int x, int y, int
     temp_bitcost += cur_mv_cand ? cand2_cost : cand1_cost;
   }
   *bitcost = temp_bitcost;
-  return temp_bitcost*(int32_t)(state->global->cur_lambda_cost_sqrt+0.5);
+  return temp_bitcost*(int32_t)(state->lambda_sqrt+0.5);
+}
+
+
+/**
+ * \brief Calculate the SADs of several integer motion vectors.
+ *
+ * \param mv         motion vector the offsets are relative to
+ * \param offsets    offsets of the motion vectors to check
+ * \param count      number of offsets
+ * \param costs_out  returns the SAD of each motion vector
+ */
+static void calc_sad_offsets(const encoder_state_t * const state,
+                             const kvz_picture *pic, const kvz_picture *ref,
+                             const vector2d_t *orig, vector2d_t mv,
+                             const vector2d_t *offsets, int count,
+                             int block_width, int max_lcu_below,
+                             unsigned *costs_out)
+{
+  const int base_x = (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x;
+  const int base_y = (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y;
+
+  while (count > 0) {
+    int ref_x[8];
+    int ref_y[8];
+    const int n = MIN(count, 8);
+
+    for (int i = 0; i < n; ++i) {
+      ref_x[i] = base_x + offsets[i].x;
+      ref_y[i] = base_y + offsets[i].y;
+    }
+
+    PERFORMANCE_MEASURE_START(KVZ_PERF_SEARCHPX);
+    kvz_image_calc_sad_multi(pic, ref, orig->x, orig->y, ref_x, ref_y, n,
+                             block_width, block_width, max_lcu_below, costs_out);
+    PERFORMANCE_MEASURE_END(KVZ_PERF_SEARCHPX, state->encoder_control->threadqueue, "type=sad_multi,frame=%d,tile=%d,px_x=%d-%d,px_y=%d-%d,points=%d", state->global->frame, state->tile->id, orig->x, orig->x + block_width, orig->y, orig->y + block_width, n);
+
+    offsets += n;
+    costs_out += n;
+    count -= n;
+  }
 }
 
 
@@ -239,26 +297,17 @@ unsigned kvz_tz_pattern_search(const encoder_state_t * const state, const kvz_pi
   }
 
   //compute SAD values for all chosen points
+  unsigned costs[8];
+  calc_sad_offsets(state, pic, ref, orig, *mv, pattern[pattern_type], n_points,
+                   block_width, max_lcu_below, costs);
+
   for (i = 0; i < n_points; i++)
   {
     vector2d_t *current = &pattern[pattern_type][i];
-    unsigned cost;
+    unsigned cost = costs[i];
     uint32_t bitcost;
 
-    {
-      PERFORMANCE_MEASURE_START(KVZ_PERF_SEARCHPX);
-      cost = kvz_image_calc_sad(pic, ref, orig->x, orig->y,
-                            (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv->x + current->x,
-                            (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv->y + current->y,
-                            block_width, block_width, max_lcu_below);
-      cost += calc_mvd_cost(state, mv->x + current->x, mv->y + current->y, 2, mv_cand, merge_cand, num_cand, ref_idx, &bitcost);
-
-      PERFORMANCE_MEASURE_END(KVZ_PERF_SEARCHPX, state->encoder_control->threadqueue, "type=sad,step=large_hexbs,frame=%d,tile=%d,px_x=%d-%d,px_y=%d-%d,ref_px_x=%d-%d,ref_px_y=%d-%d", state->global->frame, state->tile->id, orig->x, orig->x + block_width, orig->y, orig->y + block_width,
-        (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv->x + current->x,
-        (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv->x + current->x + block_width,
-        (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv->y + current->y,
-        (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv->y + current->y + block_width);
-    }
+    cost += calc_mvd_cost(state, mv->x + current->x, mv->y + current->y, 2, mv_cand, merge_cand, num_cand, ref_idx, &bitcost);
 
     if (cost < best_cost)
     {
@@ -296,26 +345,29 @@ unsigned kvz_tz_raster_search(const encoder_state_t * const state, const kvz_pic
   //compute SAD values for every point in the iRaster downsampled version of the current search area
   for (i = iSearchRange; i >= -iSearchRange; i -= iRaster)
   {
+    // Compute the SADs of the whole row at once.
+    vector2d_t row[2 * 96 + 1];
+    unsigned costs[2 * 96 + 1];
+    int num_points = 0;
+
+    assert(iSearchRange <= 96);
+
     for (k = -iSearchRange; k <= iSearchRange; k += iRaster)
     {
-      vector2d_t current = { k, i };
-      unsigned cost;
+      row[num_points].x = k;
+      row[num_points].y = i;
+      ++num_points;
+    }
+    calc_sad_offsets(state, pic, ref, orig, *mv, row, num_points,
+                     block_width, max_lcu_below, costs);
+
+    for (int p = 0; p < num_points; ++p)
+    {
+      vector2d_t current = row[p];
+      unsigned cost = costs[p];
       uint32_t bitcost;
 
-      {
-        PERFORMANCE_MEASURE_START(KVZ_PERF_SEARCHPX);
-        cost = kvz_image_calc_sad(pic, ref, orig->x, orig->y,
-          (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv->x + k,
-          (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv->y + i,
-          block_width, block_width, max_lcu_below);
-        cost += calc_mvd_cost(state, mv->x + k, mv->y + i, 2, mv_cand, merge_cand, num_cand, ref_idx, &bitcost);
-
-        PERFORMANCE_MEASURE_END(KVZ_PERF_SEARCHPX, state->encoder_control->threadqueue, "type=sad,step=large_hexbs,frame=%d,tile=%d,px_x=%d-%d,px_y=%d-%d,ref_px_x=%d-%d,ref_px_y=%d-%d", state->global->frame, state->tile->id, orig->x, orig->x + block_width, orig->y, orig->y + block_width,
-          (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv->x + k,
-          (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv->x + k + block_width,
-          (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv->y + i,
-          (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv->y + i + block_width);
-      }
+      cost += calc_mvd_cost(state, mv->x + current.x, mv->y + current.y, 2, mv_cand, merge_cand, num_cand, ref_idx, &bitcost);
 
       if (cost < best_cost)
       {
@@ -499,7 +551,8 @@ static unsigned hexagon_search(const encoder_state_t * const state, unsigned dep
                                const kvz_picture *pic, const kvz_picture *ref,
                                const vector2d_t *orig, vector2d_t *mv_in_out,
                                int16_t mv_cand[2][2], inter_merge_cand_t merge_cand[MRG_MAX_NUM_CANDS],
-                               int16_t num_cand, int32_t ref_idx, uint32_t *bitcost_out)
+                               int16_t num_cand, int32_t ref_idx, uint32_t *bitcost_out,
+                               bool refine_only)
 {
   // The start of the hexagonal pattern has been repeated at the end so that
   // the indices between 1-6 can be used as the start of a 3-point list of new
@@ -599,30 +652,24 @@ static unsigned hexagon_search(const encoder_state_t * const state, unsigned dep
     mv.y = mv_in_out->y >> 2;
   }
   
-  // Search the initial 7 points of the hexagon.
+  // Search the initial 7 points of the hexagon. A starting point found in
+  // a larger CU is only refined with the small pattern.
   best_index = 0;
-  for (i = 0; i < 7; ++i) {
-    const vector2d_t *pattern = &large_hexbs[i];
-    unsigned cost;
-    {
-      PERFORMANCE_MEASURE_START(KVZ_PERF_SEARCHPX);
-      cost = kvz_image_calc_sad(pic, ref, orig->x, orig->y,
-                             (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x + pattern->x, 
-                             (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y + pattern->y,
-                             block_width, block_width, max_lcu_below);
+  if (!refine_only) {
+    unsigned costs[7];
+    calc_sad_offsets(state, pic, ref, orig, mv, large_hexbs, 7,
+                     block_width, max_lcu_below, costs);
+
+    for (i = 0; i < 7; ++i) {
+      const vector2d_t *pattern = &large_hexbs[i];
+      unsigned cost = costs[i];
       cost += calc_mvd_cost(state, mv.x + pattern->x, mv.y + pattern->y, 2, mv_cand,merge_cand,num_cand,ref_idx, &bitcost);
 
-      PERFORMANCE_MEASURE_END(KVZ_PERF_SEARCHPX, state->encoder_control->threadqueue, "type=sad,step=large_hexbs,frame=%d,tile=%d,px_x=%d-%d,px_y=%d-%d,ref_px_x=%d-%d,ref_px_y=%d-%d", state->global->frame, state->tile->id, orig->x, orig->x + block_width, orig->y, orig->y + block_width,
-                              (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x + pattern->x, 
-                              (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x + pattern->x + block_width, 
-                              (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y + pattern->y, 
-                              (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y + pattern->y + block_width);
-    }
-
-    if (cost < best_cost) {
-      best_cost    = cost;
-      best_index   = i;
-      best_bitcost = bitcost;
+      if (cost < best_cost) {
+        best_cost    = cost;
+        best_index   = i;
+        best_bitcost = bitcost;
+      }
     }
   }
 
@@ -644,65 +691,53 @@ static unsigned hexagon_search(const encoder_state_t * const state, unsigned dep
     best_index = 0;
 
     // Iterate through the next 3 points.
+    unsigned costs[3];
+    calc_sad_offsets(state, pic, ref, orig, mv, &large_hexbs[start], 3,
+                     block_width, max_lcu_below, costs);
+
     for (i = 0; i < 3; ++i) {
       const vector2d_t *offset = &large_hexbs[start + i];
-      unsigned cost;
-      {
-        PERFORMANCE_MEASURE_START(KVZ_PERF_SEARCHPX);
-        cost = kvz_image_calc_sad(pic, ref, orig->x, orig->y,
-                               (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x + offset->x,
-                               (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y + offset->y,
-                               block_width, block_width, max_lcu_below);
-        cost += calc_mvd_cost(state, mv.x + offset->x, mv.y + offset->y, 2, mv_cand,merge_cand,num_cand,ref_idx, &bitcost);
-        PERFORMANCE_MEASURE_END(KVZ_PERF_SEARCHPX, state->encoder_control->threadqueue, "type=sad,step=large_hexbs_iterative,frame=%d,tile=%d,px_x=%d-%d,px_y=%d-%d,ref_px_x=%d-%d,ref_px_y=%d-%d", state->global->frame, state->tile->id, orig->x, orig->x + block_width, orig->y, orig->y + block_width,
-              (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x + offset->x, 
-              (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x + offset->x + block_width, 
-              (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y + offset->y, 
-              (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y + offset->y + block_width);
-      }
+      unsigned cost = costs[i];
+      cost += calc_mvd_cost(state, mv.x + offset->x, mv.y + offset->y, 2, mv_cand,merge_cand,num_cand,ref_idx, &bitcost);
 
       if (cost < best_cost) {
         best_cost    = cost;
         best_index   = start + i;
         best_bitcost = bitcost;
       }
-      ++offset;
     }
   }
 
   // Move the center to the best match.
   mv.x += large_hexbs[best_index].x;
   mv.y += large_hexbs[best_index].y;
-  best_index = 0;
 
-  // Do the final step of the search with a small pattern.
-  for (i = 1; i < 5; ++i) {
-    const vector2d_t *offset = &small_hexbs[i];
-    unsigned cost;
-    {
-      PERFORMANCE_MEASURE_START(KVZ_PERF_SEARCHPX);
-      cost = kvz_image_calc_sad(pic, ref, orig->x, orig->y,
-                             (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x + offset->x,
-                             (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y + offset->y,
-                             block_width, block_width, max_lcu_below);
+  // Do the final step of the search with a small pattern. When only
+  // refining, repeat it until the center is the best match.
+  unsigned small_steps = 0;
+  do {
+    best_index = 0;
+    unsigned costs[4];
+    calc_sad_offsets(state, pic, ref, orig, mv, &small_hexbs[1], 4,
+                     block_width, max_lcu_below, costs);
+
+    for (i = 1; i < 5; ++i) {
+      const vector2d_t *offset = &small_hexbs[i];
+      unsigned cost = costs[i - 1];
       cost += calc_mvd_cost(state, mv.x + offset->x, mv.y + offset->y, 2, mv_cand,merge_cand,num_cand,ref_idx, &bitcost);
-      PERFORMANCE_MEASURE_END(KVZ_PERF_SEARCHPX, state->encoder_control->threadqueue, "type=sad,step=small_hexbs,frame=%d,tile=%d,px_x=%d-%d,px_y=%d-%d,ref_px_x=%d-%d,ref_px_y=%d-%d", state->global->frame, state->tile->id, orig->x, orig->x + block_width, orig->y, orig->y + block_width,
-            (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x + offset->x, 
-            (state->tile->lcu_offset_x * LCU_WIDTH) + orig->x + mv.x + offset->x + block_width, 
-            (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y + offset->y, 
-            (state->tile->lcu_offset_y * LCU_WIDTH) + orig->y + mv.y + offset->y + block_width);
-    }
 
-    if (cost > 0 && cost < best_cost) {
-      best_cost    = cost;
-      best_index   = i;
-      best_bitcost = bitcost;
+      if (cost > 0 && cost < best_cost) {
+        best_cost    = cost;
+        best_index   = i;
+        best_bitcost = bitcost;
+      }
     }
-  }
 
-  // Adjust the movement vector according to the final best match.
-  mv.x += small_hexbs[best_index].x;
-  mv.y += small_hexbs[best_index].y;
+    // Adjust the movement vector according to the final best match.
+    mv.x += small_hexbs[best_index].x;
+    mv.y += small_hexbs[best_index].y;
+    ++small_steps;
+  } while (refine_only && best_index != 0 && small_steps < SMALL_HEXBS_MAX_STEPS);
 
   // Return final movement vector in quarter-pixel precision.
   mv_in_out->x = mv.x << 2;
@@ -714,6 +749,179 @@ static unsigned hexagon_search(const encoder_state_t * const state, unsigned dep
 }
 
 
+/**
+ * \brief Find a starting point for motion estimation on the downscaled
+ * pictures.
+ *
+ * Does a full search on the smallest level of the pyramid and refines the
+ * result on each larger level. The pyramids are built from source pictures
+ * so the search does not depend on the reconstruction of the reference.
+ *
+ * \param pic_pyramid  pyramid of the current picture
+ * \param ref_pyramid  pyramid of the reference picture
+ * \param x            absolute x coordinate of the block in luma pixels
+ * \param y            absolute y coordinate of the block in luma pixels
+ * \param block_width  width of the block in luma pixels
+ *
+ * \return Motion vector in quarter pixel precision.
+ */
+static vector2d_t pyramid_search(kvz_picture *const *pic_pyramid,
+                                 kvz_picture *const *ref_pyramid,
+                                 int x, int y, int block_width)
+{
+  vector2d_t mv = { 0, 0 };
+  unsigned best_cost = UINT32_MAX;
+
+  // Full search on the smallest level.
+  {
+    const int level = ME_PYRAMID_LEVELS - 1;
+    const int shift = level + 1;
+    const kvz_picture *pic = pic_pyramid[level];
+    const kvz_picture *ref = ref_pyramid[level];
+    const int width = block_width >> shift;
+    const int pic_x = x >> shift;
+    const int pic_y = y >> shift;
+
+    for (int mv_y = -PYRAMID_SEARCH_RANGE; mv_y <= PYRAMID_SEARCH_RANGE; ++mv_y) {
+      for (int mv_x = -PYRAMID_SEARCH_RANGE; mv_x <= PYRAMID_SEARCH_RANGE; ++mv_x) {
+        unsigned cost = kvz_image_calc_sad(pic, ref, pic_x, pic_y,
+                                           pic_x + mv_x, pic_y + mv_y,
+                                           width, width, -1);
+        // Prefer short vectors when the costs are equal.
+        if (cost < best_cost ||
+            (cost == best_cost && abs(mv_x) + abs(mv_y) < abs(mv.x) + abs(mv.y))) {
+          best_cost = cost;
+          mv.x = mv_x;
+          mv.y = mv_y;
+        }
+      }
+    }
+  }
+
+  // Refine the vector on each larger level.
+  for (int level = ME_PYRAMID_LEVELS - 2; level >= 0; --level) {
+    const int shift = level + 1;
+    const kvz_picture *pic = pic_pyramid[level];
+    const kvz_picture *ref = ref_pyramid[level];
+    const int width = block_width >> shift;
+    const int pic_x = x >> shift;
+    const int pic_y = y >> shift;
+    const vector2d_t center = { mv.x * 2, mv.y * 2 };
+
+    best_cost = UINT32_MAX;
+    for (int i = 0; i < 9; ++i) {
+      const int mv_x = center.x + i % 3 - 1;
+      const int mv_y = center.y + i / 3 - 1;
+      unsigned cost = kvz_image_calc_sad(pic, ref, pic_x, pic_y,
+                                         pic_x + mv_x, pic_y + mv_y,
+                                         width, width, -1);
+      if (cost < best_cost) {
+        best_cost = cost;
+        mv.x = mv_x;
+        mv.y = mv_y;
+      }
+    }
+  }
+
+  // Scale from the largest level to quarter pixels of the full picture.
+  mv.x <<= 3;
+  mv.y <<= 3;
+  return mv;
+}
+
+
+/**
+ * \brief Look up exact matches of the block from the hash table of the
+ * reference picture.
+ *
+ * A position matches if the hashes of all the BLOCKHASH_SIZE x
+ * BLOCKHASH_SIZE blocks of the CU match. If the best match costs less than
+ * the starting point, it replaces the starting point. This finds long
+ * motions, such as scrolling, which the pattern searches would miss.
+ *
+ * \param ref_hash   hash table of the source of the reference picture
+ * \param mv_in_out  starting point in quarter pixel precision
+ */
+static void hash_search(const encoder_state_t * const state, unsigned depth,
+                        const kvz_picture *pic, const kvz_picture *ref,
+                        const kvz_blockhash_t *ref_hash,
+                        const vector2d_t *orig, vector2d_t *mv_in_out,
+                        int16_t mv_cand[2][2], inter_merge_cand_t merge_cand[MRG_MAX_NUM_CANDS],
+                        int16_t num_cand, int32_t ref_idx)
+{
+  const int block_width = CU_WIDTH_FROM_DEPTH(depth);
+  const int num_blocks = block_width / BLOCKHASH_SIZE;
+  const int x = state->tile->lcu_offset_x * LCU_WIDTH + orig->x;
+  const int y = state->tile->lcu_offset_y * LCU_WIDTH + orig->y;
+
+  // Hash the blocks of the CU and look up the first one that is not flat.
+  uint32_t hashes[(LCU_WIDTH / BLOCKHASH_SIZE) * (LCU_WIDTH / BLOCKHASH_SIZE)];
+  int anchor = -1;
+  for (int i = 0; i < num_blocks * num_blocks; ++i) {
+    const int block_x = orig->x + i % num_blocks * BLOCKHASH_SIZE;
+    const int block_y = orig->y + i / num_blocks * BLOCKHASH_SIZE;
+    bool flat;
+    hashes[i] = kvz_blockhash_calc(&pic->y[block_y * pic->stride + block_x], pic->stride, &flat);
+    if (!flat && anchor < 0) {
+      anchor = i;
+    }
+  }
+  if (anchor < 0) return;
+
+  int32_t positions[HASH_ME_MAX_CANDIDATES];
+  const int num_positions = kvz_blockhash_find(ref_hash, hashes[anchor],
+                                               positions, HASH_ME_MAX_CANDIDATES);
+  if (num_positions == 0) return;
+
+  int max_lcu_below = -1;
+  if (state->encoder_control->owf) {
+    max_lcu_below = 1;
+  }
+
+  vector2d_t best_mv = { mv_in_out->x >> 2, mv_in_out->y >> 2 };
+  uint32_t bitcost;
+  unsigned best_cost = kvz_image_calc_sad(pic, ref, orig->x, orig->y,
+                                          x + best_mv.x, y + best_mv.y,
+                                          block_width, block_width, max_lcu_below);
+  best_cost += calc_mvd_cost(state, best_mv.x, best_mv.y, 2, mv_cand, merge_cand, num_cand, ref_idx, &bitcost);
+  bool found = false;
+
+  const int anchor_x = anchor % num_blocks * BLOCKHASH_SIZE;
+  const int anchor_y = anchor / num_blocks * BLOCKHASH_SIZE;
+  for (int p = 0; p < num_positions; ++p) {
+    const int ref_x = positions[p] % ref_hash->width - anchor_x;
+    const int ref_y = positions[p] / ref_hash->width - anchor_y;
+    if (ref_x < 0 || ref_y < 0 ||
+        ref_x + block_width > ref->width || ref_y + block_width > ref->height) {
+      continue;
+    }
+
+    bool match = true;
+    for (int i = 0; i < num_blocks * num_blocks && match; ++i) {
+      const int block_x = ref_x + i % num_blocks * BLOCKHASH_SIZE;
+      const int block_y = ref_y + i / num_blocks * BLOCKHASH_SIZE;
+      match = ref_hash->hashes[block_y * ref_hash->width + block_x] == hashes[i];
+    }
+    if (!match) continue;
+
+    const vector2d_t mv = { ref_x - x, ref_y - y };
+    unsigned cost = kvz_image_calc_sad(pic, ref, orig->x, orig->y, ref_x, ref_y,
+                                       block_width, block_width, max_lcu_below);
+    cost += calc_mvd_cost(state, mv.x, mv.y, 2, mv_cand, merge_cand, num_cand, ref_idx, &bitcost);
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_mv = mv;
+      found = true;
+    }
+  }
+
+  if (found) {
+    mv_in_out->x = best_mv.x << 2;
+    mv_in_out->y = best_mv.y << 2;
+  }
+}
+
+
 #if SEARCH_MV_FULL_RADIUS
 static unsigned search_mv_full(unsigned depth,
                                const picture *pic, const picture *ref,
@@ -767,6 +975,30 @@ static unsigned search_mv_full(unsigned depth,
 #endif
 
 
+/**
+ * \brief Copy a block at a fractional position from interpolated planes.
+ *
+ * \param planes  fractional sample planes of ref
+ * \param ref     reference picture
+ * \param x       x coordinate of the block in the reference in quarter pixels
+ * \param y       y coordinate of the block in the reference in quarter pixels
+ * \param width   width and height of the block
+ * \param dst     destination with a stride of width
+ */
+static void get_subpel_block(const kvz_subpel_planes_t *planes, const kvz_picture *ref,
+                             int x, int y, int width, kvz_pixel *dst)
+{
+  const int frac_x = x & 3;
+  const int frac_y = y & 3;
+  if (frac_x || frac_y) {
+    const kvz_pixel *plane = kvz_inter_get_subpel_plane(planes, frac_x, frac_y);
+    kvz_pixels_blit(&plane[(y >> 2) * planes->stride + (x >> 2)], dst, width, width, planes->stride, width);
+  } else {
+    kvz_pixels_blit(&ref->y[(y >> 2) * ref->stride + (x >> 2)], dst, width, width, ref->stride, width);
+  }
+}
+
+
 /**
  * \brief Do fractional motion estimation
  *
@@ -780,6 +1012,9 @@ static unsigned search_mv_full(unsigned depth,
  *
  * Algoritm first searches 1/2-pel positions around integer mv and after best match is found,
  * refines the search by searching best 1/4-pel postion around best 1/2-pel position.
+ *
+ * If the reference has interpolated fractional sample planes, the blocks
+ * are copied from them instead of interpolating the block.
  */
 static unsigned search_frac(const encoder_state_t * const state,
                             unsigned depth,
@@ -815,22 +1050,30 @@ static unsigned search_frac(const encoder_state_t * const state,
   #define FILTER_SIZE 8
   #define HALF_FILTER (FILTER_SIZE>>1)
 
-  kvz_extended_block src = { 0, 0, 0 };
-
   //destination buffer for interpolation
   int dst_stride = (block_width+1)*4;
   kvz_pixel dst[(LCU_WIDTH+1) * (LCU_WIDTH+1) * 16];
   kvz_pixel* dst_off = &dst[dst_stride*4+4];
 
-  kvz_get_extended_block(orig->x, orig->y, mv.x-1, mv.y-1,
-                state->tile->lcu_offset_x * LCU_WIDTH,
-                state->tile->lcu_offset_y * LCU_WIDTH,
-                ref->y, ref->width, ref->height, FILTER_SIZE, block_width+1, block_width+1, &src);
+  // Position of the integer mv in the reference in quarter pixels.
+  const int ref_x = (state->tile->lcu_offset_x * LCU_WIDTH + orig->x + mv.x) << 2;
+  const int ref_y = (state->tile->lcu_offset_y * LCU_WIDTH + orig->y + mv.y) << 2;
 
-  kvz_filter_inter_quarterpel_luma(state->encoder_control, src.orig_topleft, src.stride, block_width+1,
-      block_width+1, dst, dst_stride, 1, 1);
+  // The planes can be used if the searched positions are inside them.
+  const kvz_subpel_planes_t *planes = state->global->ref->subpel_planes[ref_idx];
+  const bool use_planes = planes &&
+                          ref_x >= 4 && (ref_x >> 2) + block_width <= ref->width &&
+                          ref_y >= 4 && (ref_y >> 2) + block_width <= ref->height;
 
-  if (src.malloc_used) free(src.buffer);
+  if (!use_planes) {
+    // Interpolate the block extended by one pixel to each direction.
+    kvz_pixel *src = kvz_inter_get_ref_block(ref->y, ref->stride, ref->width, ref->height,
+                                             (ref_x >> 2) - 1, (ref_y >> 2) - 1,
+                                             block_width + 1, HALF_FILTER);
+
+    kvz_filter_inter_quarterpel_luma(state->encoder_control, src, ref->stride, block_width+1,
+        block_width+1, dst, dst_stride, 1, 1);
+  }
 
   //Set mv to half-pixel precision
   mv.x <<= 1;
@@ -844,12 +1087,16 @@ static unsigned search_frac(const encoder_state_t * const state,
   for (i = 0; i < 9; ++i) {
     const vector2d_t *pattern = &square[i];
 
-    int y,x;
-    for(y = 0; y < block_width; ++y) {
-      int dst_y = y*4+pattern->y*2;
-      for(x = 0; x < block_width; ++x) {
-        int dst_x = x*4+pattern->x*2;
-        tmp_filtered[y*block_width+x] = dst_off[dst_y*dst_stride+dst_x];
+    if (use_planes) {
+      get_subpel_block(planes, ref, ref_x + pattern->x*2, ref_y + pattern->y*2, block_width, tmp_filtered);
+    } else {
+      int y,x;
+      for(y = 0; y < block_width; ++y) {
+        int dst_y = y*4+pattern->y*2;
+        for(x = 0; x < block_width; ++x) {
+          int dst_x = x*4+pattern->x*2;
+          tmp_filtered[y*block_width+x] = dst_off[dst_y*dst_stride+dst_x];
+        }
       }
     }
 
@@ -880,12 +1127,19 @@ static unsigned search_frac(const encoder_state_t * const state,
   for (i = 0; i < 9; ++i) {
     const vector2d_t *pattern = &square[i];
 
-    int y,x;
-    for(y = 0; y < block_width; ++y) {
-      int dst_y = y*4+halfpel_offset.y+pattern->y;
-      for(x = 0; x < block_width; ++x) {
-        int dst_x = x*4+halfpel_offset.x+pattern->x;
-        tmp_filtered[y*block_width+x] = dst_off[dst_y*dst_stride+dst_x];
+    if (use_planes) {
+      get_subpel_block(planes, ref,
+                       ref_x + halfpel_offset.x + pattern->x,
+                       ref_y + halfpel_offset.y + pattern->y,
+                       block_width, tmp_filtered);
+    } else {
+      int y,x;
+      for(y = 0; y < block_width; ++y) {
+        int dst_y = y*4+halfpel_offset.y+pattern->y;
+        for(x = 0; x < block_width; ++x) {
+          int dst_x = x*4+halfpel_offset.x+pattern->x;
+          tmp_filtered[y*block_width+x] = dst_off[dst_y*dst_stride+dst_x];
+        }
       }
     }
 
@@ -913,12 +1167,125 @@ static unsigned search_frac(const encoder_state_t * const state,
 }
 
 
+/**
+ * \brief Select the merge candidate with the lowest prediction cost.
+ *
+ * The cost is the luma SATD of the prediction plus the merge index bits.
+ * The best candidate is set as the merged inter mode of the CU.
+ *
+ * \return Cost of the best candidate, or UINT_MAX if there are none.
+ */
+uint32_t kvz_search_cu_merge(const encoder_state_t * const state, int x, int y, int depth, lcu_t *lcu)
+{
+  const videoframe_t * const frame = state->tile->frame;
+  const int width = LCU_WIDTH >> depth;
+  const int x_local = x & (LCU_WIDTH - 1);
+  const int y_local = y & (LCU_WIDTH - 1);
+  cu_info_t *cur_cu = &lcu->cu[LCU_CU_OFFSET + (x_local >> 3) + (y_local >> 3) * LCU_T_CU_WIDTH];
+  cost_pixel_nxn_func *satd = kvz_pixels_get_satd_func(width);
+
+  inter_merge_cand_t merge_cand[MRG_MAX_NUM_CANDS];
+  const int num_cand = kvz_inter_get_merge_cand(state, x, y, depth, merge_cand, lcu);
+
+  int max_lcu_below = -1;
+  if (state->encoder_control->owf) {
+    max_lcu_below = 1;
+  }
+
+  kvz_pixel tmp_block[64 * 64];
+  kvz_pixel tmp_pic[64 * 64];
+  for (int ypos = 0; ypos < width; ++ypos) {
+    for (int xpos = 0; xpos < width; ++xpos) {
+      tmp_pic[ypos * width + xpos] = frame->source->y[x + xpos + (y + ypos) * frame->source->stride];
+    }
+  }
+
+  uint32_t best_cost = UINT_MAX;
+  int best_idx = -1;
+  for (int merge_idx = 0; merge_idx < num_cand; ++merge_idx) {
+    const inter_merge_cand_t *cand = &merge_cand[merge_idx];
+    // The zero and combined bi-predictive candidates are not mapped
+    // correctly to the reference lists, so they are never chosen, as in
+    // the other merge searches.
+    if (cand->dir == 3) continue;
+
+    int16_t mv[2][2] = {
+      { cand->mv[0][0], cand->mv[0][1] },
+      { cand->mv[1][0], cand->mv[1][1] },
+    };
+
+    // Check boundaries when using owf to process multiple frames at the same time
+    if (max_lcu_below >= 0) {
+      bool out_of_reach = false;
+      for (int list = 0; list < 2; ++list) {
+        if (cand->dir & (1 << list)) {
+          int mv_lcu_row_reach = ((y + (mv[list][1] >> 2)) + width - 1 + 2) / LCU_WIDTH;
+          out_of_reach |= mv_lcu_row_reach > y / LCU_WIDTH + max_lcu_below;
+        }
+      }
+      if (out_of_reach) continue;
+    }
+
+    kvz_inter_recon_lcu(state, state->global->ref->images[cand->ref[cand->dir - 1]],
+                        x, y, width, mv[cand->dir - 1], lcu, NULL);
+
+    for (int ypos = 0; ypos < width; ++ypos) {
+      for (int xpos = 0; xpos < width; ++xpos) {
+        tmp_block[ypos * width + xpos] = lcu->rec.y[(y_local + ypos) * LCU_WIDTH + x_local + xpos];
+      }
+    }
+
+    const uint32_t cost = satd(tmp_pic, tmp_block) +
+                          merge_idx * (int32_t)(state->lambda_sqrt + 0.5);
+    if (cost < best_cost) {
+      best_cost = cost;
+      best_idx = merge_idx;
+    }
+  }
+
+  if (best_idx < 0) {
+    return UINT_MAX;
+  }
+
+  const inter_merge_cand_t *best = &merge_cand[best_idx];
+  cur_cu->merged = 1;
+  cur_cu->merge_idx = best_idx;
+  cur_cu->inter.mv_dir = best->dir;
+  for (int list = 0; list < 2; ++list) {
+    cur_cu->inter.mv_ref[list] = best->ref[list];
+    cur_cu->inter.mv[list][0] = best->mv[list][0];
+    cur_cu->inter.mv[list][1] = best->mv[list][1];
+    if (best->dir & (1 << list)) {
+      cur_cu->inter.mv_ref_coded[list] = state->global->refmap[best->ref[list]].idx;
+    }
+  }
+  cur_cu->inter.cost = best_cost;
+  cur_cu->inter.bitcost = best_idx;
+
+  return best_cost;
+}
+
+
 /**
  * Update lcu to have best modes at this depth.
+ *
+ * If analysis is not NULL, only the references it uses are searched and
+ * the search starts from its motion vectors.
+ *
+ * With --me-parent-seed, the search starts from the motion vectors in
+ * seeds, which are found for the parent CU, and the motion vectors found
+ * for this CU are written to seeds for the sub-CUs. The best reference of
+ * the parent CU is only refined with the small hexagon. If there are no
+ * seeds and pyramid motion estimation is enabled, the search starts from
+ * a vector found on the downscaled pictures. With hash motion estimation, an exact match of the
+ * block in the reference replaces the starting point if it costs less.
+ *
  * \return Cost of best mode.
  */
-int kvz_search_cu_inter(const encoder_state_t * const state, int x, int y, int depth, lcu_t *lcu)
+int kvz_search_cu_inter(const encoder_state_t * const state, int x, int y, int depth, lcu_t *lcu,
+                        const cu_info_t *analysis, inter_mv_seeds_t *seeds)
 {
+  const inter_mv_seeds_t parent_seeds = *seeds;
   const videoframe_t * const frame = state->tile->frame;
   uint32_t ref_idx = 0;
   int x_local = (x&0x3f), y_local = (y&0x3f);
@@ -955,6 +1322,10 @@ int kvz_search_cu_inter(const encoder_state_t * const state, int x, int y, int d
     uint8_t cu_mv_cand = 0;
     int8_t merge_idx = 0;
     int8_t ref_list = state->global->refmap[ref_idx].list-1;
+    if (analysis && (!(analysis->inter.mv_dir & (1 << ref_list)) ||
+                     analysis->inter.mv_ref[ref_list] != ref_idx)) {
+      continue;
+    }
     int8_t temp_ref_idx = cur_cu->inter.mv_ref[ref_list];
     orig.x = x_cu * CU_MIN_SIZE_PIXELS;
     orig.y = y_cu * CU_MIN_SIZE_PIXELS;
@@ -964,7 +1335,24 @@ int kvz_search_cu_inter(const encoder_state_t * const state, int x, int y, int d
     cur_cu->inter.mv_ref[ref_list] = temp_ref_idx;
 
     vector2d_t mv = { 0, 0 };
-    {
+    bool seeded = false;
+    if (analysis) {
+      // Refine the motion vector of the loaded mode decision.
+      mv.x = analysis->inter.mv[ref_list][0];
+      mv.y = analysis->inter.mv[ref_list][1];
+    } else if (parent_seeds.valid[ref_idx]) {
+      // Start from the motion vector found for the parent CU.
+      mv = parent_seeds.mv[ref_idx];
+      seeded = true;
+    } else if (state->encoder_control->cfg->me_pyramid &&
+               state->global->ref->pyramids[ref_idx][0] &&
+               LCU_WIDTH >> depth >= PYRAMID_MIN_CU_WIDTH) {
+      mv = pyramid_search(state->global->pyramid,
+                          state->global->ref->pyramids[ref_idx],
+                          state->tile->lcu_offset_x * LCU_WIDTH + x,
+                          state->tile->lcu_offset_y * LCU_WIDTH + y,
+                          LCU_WIDTH >> depth);
+    } else {
       // Take starting point for MV search from previous frame.
       // When temporal motion vector candidates are added, there is probably
       // no point to this anymore, but for now it helps.
@@ -982,23 +1370,35 @@ int kvz_search_cu_inter(const encoder_state_t * const state, int x, int y, int d
       }
     }
 
+    if (!analysis && state->global->ref->block_hashes[ref_idx]) {
+      hash_search(state, depth, frame->source, ref_image,
+                  state->global->ref->block_hashes[ref_idx],
+                  &orig, &mv, mv_cand, merge_cand, num_cand, ref_idx);
+    }
+
 #if SEARCH_MV_FULL_RADIUS
     temp_cost += search_mv_full(depth, frame, ref_pic, &orig, &mv, mv_cand, merge_cand, num_cand, ref_idx, &temp_bitcost);
 #else
-    switch (state->encoder_control->cfg->ime_algorithm) {
+    switch (state->encoder_control->ime_algorithm) {
       case KVZ_IME_TZ:
         temp_cost += tz_search(state, depth, frame->source, ref_image, &orig, &mv, mv_cand, merge_cand, num_cand, ref_idx, &temp_bitcost);
         break;
 
       default:
-        temp_cost += hexagon_search(state, depth, frame->source, ref_image, &orig, &mv, mv_cand, merge_cand, num_cand, ref_idx, &temp_bitcost);
+        temp_cost += hexagon_search(state, depth, frame->source, ref_image, &orig, &mv, mv_cand, merge_cand, num_cand, ref_idx, &temp_bitcost,
+                                    seeded && (int)ref_idx == parent_seeds.best_ref);
         break;
       }
 #endif
-    if (state->encoder_control->cfg->fme_level > 0) {
+    if (state->encoder_control->fme_level > 0) {
       temp_cost = search_frac(state, depth, frame->source, ref_image, &orig, &mv, mv_cand, merge_cand, num_cand, ref_idx, &temp_bitcost);
     }
 
+    if (state->encoder_control->cfg->me_parent_seed) {
+      seeds->valid[ref_idx] = true;
+      seeds->mv[ref_idx] = mv;
+    }
+
     merged = 0;
     // Check every candidate to find a match
     for(merge_idx = 0; merge_idx < num_cand; merge_idx++) {
@@ -1048,6 +1448,7 @@ int kvz_search_cu_inter(const encoder_state_t * const state, int x, int y, int d
       cur_cu->inter.cost    = temp_cost;
       cur_cu->inter.bitcost = temp_bitcost + cur_cu->inter.mv_dir - 1 + cur_cu->inter.mv_ref_coded[ref_list];
       cur_cu->inter.mv_cand[ref_list] = cu_mv_cand;
+      seeds->best_ref = ref_idx;
     }
   }
 
@@ -29,6 +29,20 @@
 
 #include "encoderstate.h"
 
-int kvz_search_cu_inter(const encoder_state_t * const state, int x, int y, int depth, lcu_t *lcu);
+/**
+ * \brief Motion vectors found for a CU for each reference picture.
+ *
+ * They are used as starting points in the motion search of the sub-CUs.
+ */
+typedef struct {
+  bool valid[MAX_REF_PIC_COUNT];
+  vector2d_t mv[MAX_REF_PIC_COUNT];
+  //! Reference with the lowest uni-prediction cost, if any is valid.
+  int8_t best_ref;
+} inter_mv_seeds_t;
+
+uint32_t kvz_search_cu_merge(const encoder_state_t * const state, int x, int y, int depth, lcu_t *lcu);
+int kvz_search_cu_inter(const encoder_state_t * const state, int x, int y, int depth, lcu_t *lcu,
+                        const cu_info_t *analysis, inter_mv_seeds_t *seeds);
 
 #endif // SEARCH_INTER_H_
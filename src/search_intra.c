@@ -38,6 +38,15 @@
 # define TRSKIP_RATIO 1.7
 #endif
 
+// Number of intra modes predicted before calculating their costs in the
+// rough search.
+#define INTRA_ROUGH_BATCH 4
+
+// Number of edge directions tried in the rough search with gradient-intra.
+// The neighbouring modes of the strongest direction are also tried.
+#define INTRA_GRADIENT_DIRECTIONS 3
+#define INTRA_GRADIENT_MAX_MODES (INTRA_GRADIENT_DIRECTIONS + 3)
+
 
 /**
  * \brief Sort modes and costs to ascending order according to costs.
@@ -82,25 +91,35 @@ static INLINE uint8_t select_best_mode_index(const int8_t *modes, const double *
 
 
 /**
- * \brief Calculate quality of the reconstruction.
+ * \brief Calculate quality of the reconstruction of several intra modes.
  *
- * \param pred  Predicted pixels in continous memory.
- * \param orig_block  Orignal (target) pixels in continous memory.
- * \param satd_func  SATD function for this block size.
- * \param sad_func  SAD function this block size.
- * \param width  Pixel width of the block.
+ * The modes are predicted in batches of INTRA_ROUGH_BATCH and the SATD of
+ * each batch is calculated with a single call.
  *
- * \return  Estimated RD cost of the reconstruction and signaling the
- *     coefficients of the residual.
+ * \param refs  Reference pixels of the block.
+ * \param log2_width  Log2 of the width of the block.
+ * \param modes  Intra modes to evaluate.
+ * \param num_modes  Number of modes in param modes.
+ * \param orig_block  Orignal (target) pixels in continous memory.
+ * \param[out] costs_out  Estimated RD costs of the reconstruction and
+ *     signaling the coefficients of the residual for each mode.
  */
-static double get_cost(encoder_state_t * const state, 
-                       kvz_pixel *pred, kvz_pixel *orig_block,
-                       cost_pixel_nxn_func *satd_func,
-                       cost_pixel_nxn_func *sad_func,
-                       int width)
+static void get_costs(encoder_state_t * const state,
+                      kvz_intra_references *refs, int log2_width,
+                      const int8_t *modes, int num_modes,
+                      kvz_pixel *orig_block, double *costs_out)
 {
-  double satd_cost = satd_func(pred, orig_block);
-  if (TRSKIP_RATIO != 0 && width == 4 && state->encoder_control->trskip_enable) {
+  const int width = 1 << log2_width;
+  cost_pixel_nxn_multi_func *satd_multi_func = kvz_pixels_get_satd_multi_func(width);
+  cost_pixel_nxn_func *sad_func = kvz_pixels_get_sad_func(width);
+
+  // Temporary block arrays
+  kvz_pixel _preds[INTRA_ROUGH_BATCH * 32 * 32 + SIMD_ALIGNMENT];
+  pred_buffer preds = ALIGNED_POINTER(_preds, SIMD_ALIGNMENT);
+
+  double trskip_bits = 0.0;
+  const bool try_trskip = TRSKIP_RATIO != 0 && width == 4 && state->encoder_control->trskip_enable;
+  if (try_trskip) {
     // If the mode looks better with SAD than SATD it might be a good
     // candidate for transform skip. How much better SAD has to be is
     // controlled by TRSKIP_RATIO.
@@ -108,16 +127,31 @@ static double get_cost(encoder_state_t * const state,
     // Add the offset bit costs of signaling 'luma and chroma use trskip',
     // versus signaling 'luma and chroma don't use trskip' to the SAD cost.
     const cabac_ctx_t *ctx = &state->cabac.ctx.transform_skip_model_luma;
-    double trskip_bits = CTX_ENTROPY_FBITS(ctx, 1) - CTX_ENTROPY_FBITS(ctx, 0);
+    trskip_bits = CTX_ENTROPY_FBITS(ctx, 1) - CTX_ENTROPY_FBITS(ctx, 0);
     ctx = &state->cabac.ctx.transform_skip_model_chroma;
     trskip_bits += 2.0 * (CTX_ENTROPY_FBITS(ctx, 1) - CTX_ENTROPY_FBITS(ctx, 0));
+  }
 
-    double sad_cost = TRSKIP_RATIO * sad_func(pred, orig_block) + state->global->cur_lambda_cost_sqrt * trskip_bits;
-    if (sad_cost < satd_cost) {
-      return sad_cost;
+  for (int first = 0; first < num_modes; first += INTRA_ROUGH_BATCH) {
+    const int batch_size = MIN(num_modes - first, INTRA_ROUGH_BATCH);
+    unsigned satd_costs[INTRA_ROUGH_BATCH];
+
+    for (int i = 0; i < batch_size; ++i) {
+      kvz_intra_predict(refs, log2_width, modes[first + i], COLOR_Y, preds[i]);
+    }
+    satd_multi_func(preds, orig_block, batch_size, satd_costs);
+
+    for (int i = 0; i < batch_size; ++i) {
+      double cost = satd_costs[i];
+      if (try_trskip) {
+        double sad_cost = TRSKIP_RATIO * sad_func(preds[i], orig_block) + state->lambda_sqrt * trskip_bits;
+        if (sad_cost < cost) {
+          cost = sad_cost;
+        }
+      }
+      costs_out[first + i] = cost;
     }
   }
-  return satd_cost;
 }
 
 
@@ -201,7 +235,7 @@ static double search_intra_trdepth(encoder_state_t * const state,
   //     max_depth.
   // - Min transform size hasn't been reached (MAX_PU_DEPTH).
   if (depth < max_depth && depth < MAX_PU_DEPTH) {
-    split_cost = 3 * state->global->cur_lambda_cost;
+    split_cost = 3 * state->lambda;
 
     split_cost += search_intra_trdepth(state, x_px, y_px, depth + 1, max_depth, intra_mode, nosplit_cost, pred_cu, lcu);
     if (split_cost < nosplit_cost) {
@@ -243,7 +277,7 @@ static double search_intra_trdepth(encoder_state_t * const state,
     }
 
     double bits = tr_split_bit + cbf_bits;
-    split_cost += bits * state->global->cur_lambda_cost;
+    split_cost += bits * state->lambda;
   } else {
     assert(width <= TR_MAX_WIDTH);
   }
@@ -333,6 +367,9 @@ static void search_intra_chroma_rough(encoder_state_t * const state,
  * \param rec_stride  Stride of param rec.
  * \param width  Width of the prediction block.
  * \param intra_preds  Array of the 3 predicted intra modes.
+ * \param gradient_modes  Angular modes to search instead of the halving
+ *     search, or NULL.
+ * \param num_gradient_modes  Number of modes in param gradient_modes.
  *
  * \param[out] modes  The modes ordered according to their RD costs, from best
  *     to worst. The number of modes and costs output is given by parameter
@@ -345,17 +382,14 @@ static int8_t search_intra_rough(encoder_state_t * const state,
                                  kvz_pixel *orig, int32_t origstride,
                                  kvz_intra_references *refs,
                                  int log2_width, int8_t *intra_preds,
+                                 const int8_t *gradient_modes,
+                                 int num_gradient_modes,
                                  int8_t modes[35], double costs[35])
 {
   assert(log2_width >= 2 && log2_width <= 5);
   int_fast8_t width = 1 << log2_width;
-  cost_pixel_nxn_func *satd_func = kvz_pixels_get_satd_func(width);
-  cost_pixel_nxn_func *sad_func = kvz_pixels_get_sad_func(width);
 
   // Temporary block arrays
-  kvz_pixel _pred[32 * 32 + SIMD_ALIGNMENT];
-  kvz_pixel *pred = ALIGNED_POINTER(_pred, SIMD_ALIGNMENT);
-  
   kvz_pixel _orig_block[32 * 32 + SIMD_ALIGNMENT];
   kvz_pixel *orig_block = ALIGNED_POINTER(_orig_block, SIMD_ALIGNMENT);
 
@@ -363,65 +397,65 @@ static int8_t search_intra_rough(encoder_state_t * const state,
   kvz_pixels_blit(orig, orig_block, width, width, origstride, width);
 
   int8_t modes_selected = 0;
-  unsigned min_cost = UINT_MAX;
-  unsigned max_cost = 0;
-  
-  // Initial offset decides how many modes are tried before moving on to the
-  // recursive search.
-  int offset;
-  if (state->encoder_control->full_intra_search) {
-    offset = 1;
+  if (gradient_modes) {
+    // Only try the edge directions found in the source block. Planar, DC and
+    // the predicted modes are added below.
+    for (int i = 0; i < num_gradient_modes; ++i) {
+      modes[modes_selected++] = gradient_modes[i];
+    }
+    get_costs(state, refs, log2_width, modes, modes_selected, orig_block, costs);
   } else {
-    static const int8_t offsets[4] = { 2, 4, 8, 8 };
-    offset = offsets[log2_width - 2];
-  }
-
-  // Calculate SAD for evenly spaced modes to select the starting point for 
-  // the recursive search.
-  for (int mode = 2; mode <= 34; mode += offset) {
-    kvz_intra_predict(refs, log2_width, mode, COLOR_Y, pred);
-    costs[modes_selected] = get_cost(state, pred, orig_block, satd_func, sad_func, width);
-    modes[modes_selected] = mode;
-
-    min_cost = MIN(min_cost, costs[modes_selected]);
-    max_cost = MAX(max_cost, costs[modes_selected]);
+    unsigned min_cost = UINT_MAX;
+    unsigned max_cost = 0;
+  
+    // Initial offset decides how many modes are tried before moving on to the
+    // recursive search.
+    int offset;
+    if (state->encoder_control->full_intra_search) {
+      offset = 1;
+    } else {
+      static const int8_t offsets[4] = { 2, 4, 8, 8 };
+      offset = offsets[log2_width - 2];
+    }
 
-    ++modes_selected;
-  }
+    // Calculate SAD for evenly spaced modes to select the starting point for 
+    // the recursive search.
+    for (int mode = 2; mode <= 34; mode += offset) {
+      modes[modes_selected++] = mode;
+    }
+    get_costs(state, refs, log2_width, modes, modes_selected, orig_block, costs);
+    for (int mode_i = 0; mode_i < modes_selected; ++mode_i) {
+      min_cost = MIN(min_cost, costs[mode_i]);
+      max_cost = MAX(max_cost, costs[mode_i]);
+    }
 
-  int8_t best_mode = modes[select_best_mode_index(modes, costs, modes_selected)];
-  double best_cost = min_cost;
+    int8_t best_mode = modes[select_best_mode_index(modes, costs, modes_selected)];
+    double best_cost = min_cost;
   
-  // Skip recursive search if all modes have the same cost.
-  if (min_cost != max_cost) {
-    // Do a recursive search to find the best mode, always centering on the
-    // current best mode.
-    while (offset > 1) {
-      offset >>= 1;
-
-      int8_t center_node = best_mode;
-      int8_t mode = center_node - offset;
-      if (mode >= 2) {
-        kvz_intra_predict(refs, log2_width, mode, COLOR_Y, pred);
-        costs[modes_selected] = get_cost(state, pred, orig_block, satd_func, sad_func, width);
-        modes[modes_selected] = mode;
-        if (costs[modes_selected] < best_cost) {
-          best_cost = costs[modes_selected];
-          best_mode = modes[modes_selected];
+    // Skip recursive search if all modes have the same cost.
+    if (min_cost != max_cost) {
+      // Do a recursive search to find the best mode, always centering on the
+      // current best mode.
+      while (offset > 1) {
+        offset >>= 1;
+
+        const int8_t first = modes_selected;
+        int8_t center_node = best_mode;
+        if (center_node - offset >= 2) {
+          modes[modes_selected++] = center_node - offset;
         }
-        ++modes_selected;
-      }
-
-      mode = center_node + offset;
-      if (mode <= 34) {
-        kvz_intra_predict(refs, log2_width, mode, COLOR_Y, pred);
-        costs[modes_selected] = get_cost(state, pred, orig_block, satd_func, sad_func, width);
-        modes[modes_selected] = mode;
-        if (costs[modes_selected] < best_cost) {
-          best_cost = costs[modes_selected];
-          best_mode = modes[modes_selected];
+        if (center_node + offset <= 34) {
+          modes[modes_selected++] = center_node + offset;
+        }
+        get_costs(state, refs, log2_width, &modes[first], modes_selected - first,
+                  orig_block, &costs[first]);
+
+        for (int mode_i = first; mode_i < modes_selected; ++mode_i) {
+          if (costs[mode_i] < best_cost) {
+            best_cost = costs[mode_i];
+            best_mode = modes[mode_i];
+          }
         }
-        ++modes_selected;
       }
     }
   }
@@ -429,6 +463,7 @@ static int8_t search_intra_rough(encoder_state_t * const state,
   int8_t add_modes[5] = {intra_preds[0], intra_preds[1], intra_preds[2], 0, 1};
 
   // Add DC, planar and missing predicted modes.
+  const int8_t first_added = modes_selected;
   for (int8_t pred_i = 0; pred_i < 5; ++pred_i) {
     bool has_mode = false;
     int8_t mode = add_modes[pred_i];
@@ -441,16 +476,15 @@ static int8_t search_intra_rough(encoder_state_t * const state,
     }
 
     if (!has_mode) {
-      kvz_intra_predict(refs, log2_width, mode, COLOR_Y, pred);
-      costs[modes_selected] = get_cost(state, pred, orig_block, satd_func, sad_func, width);
-      modes[modes_selected] = mode;
-      ++modes_selected;
+      modes[modes_selected++] = mode;
     }
   }
+  get_costs(state, refs, log2_width, &modes[first_added], modes_selected - first_added,
+            orig_block, &costs[first_added]);
 
   // Add prediction mode coding cost as the last thing. We don't want this
   // affecting the halving search.
-  int lambda_cost = (int)(state->global->cur_lambda_cost_sqrt + 0.5);
+  int lambda_cost = (int)(state->lambda_sqrt + 0.5);
   for (int mode_i = 0; mode_i < modes_selected; ++mode_i) {
     costs[mode_i] += lambda_cost * kvz_luma_mode_bits(state, modes[mode_i], intra_preds);
   }
@@ -520,7 +554,7 @@ static int8_t search_intra_rdo(encoder_state_t * const state,
 
   for(int rdo_mode = 0; rdo_mode < modes_to_check; rdo_mode ++) {
     int rdo_bitcost = kvz_luma_mode_bits(state, modes[rdo_mode], intra_preds);
-    costs[rdo_mode] = rdo_bitcost * (int)(state->global->cur_lambda_cost + 0.5);
+    costs[rdo_mode] = rdo_bitcost * (int)(state->lambda + 0.5);
 
     // Perform transform split search and save mode RD cost for the best one.
     cu_info_t pred_cu;
@@ -627,7 +661,7 @@ int8_t kvz_search_intra_chroma_rdo(encoder_state_t * const state,
       chroma.cost = kvz_cu_rd_cost_chroma(state, lcu_px.x, lcu_px.y, depth, tr_cu, lcu);
 
       double mode_bits = kvz_chroma_mode_bits(state, chroma.mode, intra_mode);
-      chroma.cost += mode_bits * state->global->cur_lambda_cost;
+      chroma.cost += mode_bits * state->lambda;
 
       if (chroma.cost < best_chroma.cost) {
         best_chroma = chroma;
@@ -702,13 +736,156 @@ int8_t kvz_search_cu_intra_chroma(encoder_state_t * const state,
 }
 
 
+/**
+ * \brief Select the angular modes of the strongest edge directions.
+ *
+ * The gradient histograms of the 4x4 blocks of the prediction block are
+ * summed and smoothed, and the peaks are taken in order of strength,
+ * together with the neighbours of the strongest one.
+ *
+ * \param gradients  Gradient histograms of the LCU.
+ * \param lcu_px  Position of the block in the LCU.
+ * \param log2_width  Log2 of the width of the block.
+ * \param[out] modes_out  The selected modes.
+ *
+ * \return  Number of modes in param modes_out.
+ */
+static int select_gradient_modes(const intra_gradients_t *gradients,
+                                 vector2d_t lcu_px, int log2_width,
+                                 int8_t modes_out[INTRA_GRADIENT_MAX_MODES])
+{
+  const int blocks = 1 << (log2_width - 2);
+  uint32_t hist[35] = { 0 };
+  for (int y = 0; y < blocks; ++y) {
+    for (int x = 0; x < blocks; ++x) {
+      const int block = ((lcu_px.y >> 2) + y) * INTRA_GRADIENT_BLOCKS + (lcu_px.x >> 2) + x;
+      for (int mode = 2; mode <= 34; ++mode) {
+        hist[mode] += gradients->bins[block][mode];
+      }
+    }
+  }
+
+  // Modes 2 and 34 have the same direction, so the angular modes 3 to 34
+  // form a circle of directions. Smooth it with [1 2 1].
+  uint32_t smoothed[35] = { 0 };
+  hist[34] += hist[2];
+  for (int mode = 3; mode <= 34; ++mode) {
+    const int prev = mode == 3 ? 34 : mode - 1;
+    const int next = mode == 34 ? 3 : mode + 1;
+    smoothed[mode] = hist[prev] + 2 * hist[mode] + hist[next];
+  }
+
+  int num_modes = 0;
+  for (int i = 0; i < INTRA_GRADIENT_DIRECTIONS; ++i) {
+    int best_mode = 0;
+    for (int mode = 3; mode <= 34; ++mode) {
+      if (smoothed[mode] > smoothed[best_mode]) {
+        best_mode = mode;
+      }
+    }
+    if (best_mode == 0) break;
+
+    const int prev = best_mode == 3 ? 34 : best_mode - 1;
+    const int next = best_mode == 34 ? 3 : best_mode + 1;
+
+    modes_out[num_modes++] = best_mode;
+    if (i == 0) {
+      // The histogram is too coarse to tell the strongest direction from
+      // its neighbours.
+      modes_out[num_modes++] = prev;
+      modes_out[num_modes++] = next;
+    }
+
+    // Suppress the neighbouring directions of the peak.
+    smoothed[best_mode] = 0;
+    smoothed[prev] = 0;
+    smoothed[next] = 0;
+  }
+
+  // The diagonal mode 34 can also be predicted from the left side.
+  for (int i = 0; i < num_modes; ++i) {
+    if (modes_out[i] == 34) {
+      modes_out[num_modes++] = 2;
+      break;
+    }
+  }
+
+  return num_modes;
+}
+
+
+/**
+ * \brief Calculate the gradient orientation histograms of an LCU.
+ *
+ * Source pixels vote with the magnitude of their Sobel gradient for the
+ * angular mode whose prediction direction is closest to the direction of
+ * the edge, which is perpendicular to the gradient. The histograms are
+ * calculated once per LCU and used for the blocks of every depth.
+ *
+ * \param lcu  LCU containing the source pixels.
+ * \param width  Width of the part of the LCU inside the picture.
+ * \param height  Height of the part of the LCU inside the picture.
+ * \param[out] gradients  The histograms of the 4x4 blocks.
+ */
+void kvz_search_intra_calc_gradients(const lcu_t *lcu, int width, int height,
+                                     intra_gradients_t *gradients)
+{
+  // Twice the sample displacements half way between those of consecutive
+  // angular modes. The mode offset from the vertical or horizontal mode is
+  // the number of these that the displacement of the edge exceeds.
+  static const int16_t mode_disp_limits[8] = { 2, 7, 14, 22, 30, 38, 47, 58 };
+
+  FILL(*gradients, 0);
+
+  // Only every other pixel in both directions is sampled, which still gives
+  // four samples for each 4x4 block.
+  const kvz_pixel *src = lcu->ref.y;
+  for (int y = 1; y < height; y += 2) {
+    const kvz_pixel *above = &src[(y - 1) * LCU_WIDTH];
+    const kvz_pixel *row = &src[y * LCU_WIDTH];
+    const kvz_pixel *below = &src[MIN(y + 1, height - 1) * LCU_WIDTH];
+
+    for (int x = 1; x < width; x += 2) {
+      const int left = x - 1;
+      const int right = MIN(x + 1, width - 1);
+
+      const int gx = (above[right] + 2 * row[right] + below[right]) -
+                     (above[left] + 2 * row[left] + below[left]);
+      const int gy = (below[left] + 2 * below[x] + below[right]) -
+                     (above[left] + 2 * above[x] + above[right]);
+      const int abs_gx = abs(gx);
+      const int abs_gy = abs(gy);
+      if (abs_gx + abs_gy == 0) continue;
+
+      // The edge direction is (gy, -gx). Mirror it to point up for
+      // vertical edges or left for horizontal edges, and find the angular
+      // mode with the closest sample displacement per row or column.
+      const bool vertical = abs_gx >= abs_gy;
+      const int across = vertical ? abs_gx : abs_gy;
+      const int along = vertical ? (gx > 0 ? gy : -gy) : (gy > 0 ? gx : -gx);
+      const int scaled_along = 64 * abs(along);
+      int offset = 0;
+      for (int i = 0; i < 8; ++i) {
+        offset += scaled_along > mode_disp_limits[i] * across;
+      }
+      if (along < 0) offset = -offset;
+      const int mode = vertical ? 26 + offset : 10 - offset;
+
+      const int block = (y >> 2) * INTRA_GRADIENT_BLOCKS + (x >> 2);
+      gradients->bins[block][mode] += abs_gx + abs_gy;
+    }
+  }
+}
+
+
 /**
  * Update lcu to have best modes at this depth.
  * \return Cost of best mode.
  */
 double kvz_search_cu_intra(encoder_state_t * const state,
                            const int x_px, const int y_px,
-                           const int depth, lcu_t *lcu)
+                           const int depth, lcu_t *lcu,
+                           const intra_gradients_t *gradients)
 {
   const vector2d_t lcu_px = { x_px & 0x3f, y_px & 0x3f };
   const vector2d_t lcu_cu = { lcu_px.x >> 3, lcu_px.y >> 3 };
@@ -751,10 +928,18 @@ double kvz_search_cu_intra(encoder_state_t * const state,
   int8_t number_of_modes;
   bool skip_rough_search = (depth == 0 || state->encoder_control->rdo >= 3);
   if (!skip_rough_search) {
+    int8_t gradient_modes[INTRA_GRADIENT_MAX_MODES];
+    int num_gradient_modes = 0;
+    const bool use_gradients = gradients && !state->encoder_control->full_intra_search;
+    if (use_gradients) {
+      num_gradient_modes = select_gradient_modes(gradients, lcu_px, log2_width, gradient_modes);
+    }
     number_of_modes = search_intra_rough(state,
                                          ref_pixels, LCU_WIDTH,
                                          &refs,
                                          log2_width, candidate_modes,
+                                         use_gradients ? gradient_modes : NULL,
+                                         num_gradient_modes,
                                          modes, costs);
   } else {
     number_of_modes = 35;
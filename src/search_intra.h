@@ -30,6 +30,22 @@
 #include "encoderstate.h"
 
 
+//! Number of 4x4 blocks in a row of an LCU.
+#define INTRA_GRADIENT_BLOCKS (LCU_WIDTH / 4)
+
+/**
+ * \brief Gradient orientation histograms of the source pixels of an LCU.
+ *
+ * There is a histogram for each 4x4 block in raster scan. Each bin is the
+ * sum of the gradient magnitudes of the pixels whose edge direction is
+ * closest to the direction of the angular intra mode of the same index.
+ * Bins 0 and 1 are unused.
+ */
+typedef struct {
+  uint16_t bins[INTRA_GRADIENT_BLOCKS * INTRA_GRADIENT_BLOCKS][35];
+} intra_gradients_t;
+
+
 double kvz_luma_mode_bits(const encoder_state_t *state, 
                       int8_t luma_mode, const int8_t *intra_preds);
                        
@@ -42,7 +58,11 @@ int8_t kvz_search_cu_intra_chroma(encoder_state_t * const state,
                                   
 double kvz_search_cu_intra(encoder_state_t * const state,
                        const int x_px, const int y_px,
-                       const int depth, lcu_t *lcu);
+                       const int depth, lcu_t *lcu,
+                       const intra_gradients_t *gradients);
+
+void kvz_search_intra_calc_gradients(const lcu_t *lcu, int width, int height,
+                                     intra_gradients_t *gradients);
 
 
 #endif // SEARCH_INTRA_H_
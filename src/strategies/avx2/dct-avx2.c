@@ -307,6 +307,97 @@ static void mul_clip_matrix_32x32_avx2(const int16_t *left, const int16_t *right
   }
 }
 
+// 32x32 matrix multiplication with value clipping, where only the first
+// num_rows columns of left and rows of right may be non-zero.
+// Parameters: Two 32x32 matrices containing 16-bit values in consecutive addresses,
+//             destination for the result, the shift value for clipping and
+//             the number of non-zero rows in right.
+static INLINE void mul_clip_matrix_32x32_pruned_avx2(const int16_t *left, const int16_t *right, int16_t *dst, const int32_t shift, const int num_rows)
+{
+  int i, j;
+  __m256i row[4], tmp[2], accu[32][4], even, odd;
+
+  const int32_t stride = 16;
+
+  const int32_t add = 1 << (shift - 1);
+
+  row[0] = _mm256_loadu_si256((__m256i*) right);
+  row[1] = _mm256_loadu_si256((__m256i*) right + 2);
+  tmp[0] = _mm256_unpacklo_epi16(row[0], row[1]);
+  tmp[1] = _mm256_unpackhi_epi16(row[0], row[1]);
+  row[0] = _mm256_permute2x128_si256(tmp[0], tmp[1], 0 + 32);
+  row[1] = _mm256_permute2x128_si256(tmp[0], tmp[1], 1 + 48);
+
+  row[2] = _mm256_loadu_si256((__m256i*) right + 1);
+  row[3] = _mm256_loadu_si256((__m256i*) right + 3);
+  tmp[0] = _mm256_unpacklo_epi16(row[2], row[3]);
+  tmp[1] = _mm256_unpackhi_epi16(row[2], row[3]);
+  row[2] = _mm256_permute2x128_si256(tmp[0], tmp[1], 0 + 32);
+  row[3] = _mm256_permute2x128_si256(tmp[0], tmp[1], 1 + 48);
+
+  for (i = 0; i < 32; i += 2) {
+
+    even = _mm256_set1_epi32(((int32_t*)left)[stride * i]);
+    accu[i][0] = _mm256_madd_epi16(even, row[0]);
+    accu[i][1] = _mm256_madd_epi16(even, row[1]);
+    accu[i][2] = _mm256_madd_epi16(even, row[2]);
+    accu[i][3] = _mm256_madd_epi16(even, row[3]);
+
+    odd = _mm256_set1_epi32(((int32_t*)left)[stride * (i + 1)]);
+    accu[i + 1][0] = _mm256_madd_epi16(odd, row[0]);
+    accu[i + 1][1] = _mm256_madd_epi16(odd, row[1]);
+    accu[i + 1][2] = _mm256_madd_epi16(odd, row[2]);
+    accu[i + 1][3] = _mm256_madd_epi16(odd, row[3]);
+  }
+
+  for (j = 4; j < 2 * num_rows; j += 4) {
+
+    row[0] = _mm256_loadu_si256((__m256i*)right + j);
+    row[1] = _mm256_loadu_si256((__m256i*)right + j + 2);
+    tmp[0] = _mm256_unpacklo_epi16(row[0], row[1]);
+    tmp[1] = _mm256_unpackhi_epi16(row[0], row[1]);
+    row[0] = _mm256_permute2x128_si256(tmp[0], tmp[1], 0 + 32);
+    row[1] = _mm256_permute2x128_si256(tmp[0], tmp[1], 1 + 48);
+
+    row[2] = _mm256_loadu_si256((__m256i*) right + j + 1);
+    row[3] = _mm256_loadu_si256((__m256i*) right + j + 3);
+    tmp[0] = _mm256_unpacklo_epi16(row[2], row[3]);
+    tmp[1] = _mm256_unpackhi_epi16(row[2], row[3]);
+    row[2] = _mm256_permute2x128_si256(tmp[0], tmp[1], 0 + 32);
+    row[3] = _mm256_permute2x128_si256(tmp[0], tmp[1], 1 + 48);
+
+    for (i = 0; i < 32; i += 2) {
+
+      even = _mm256_set1_epi32(((int32_t*)left)[stride * i + j / 4]);
+      accu[i][0] = _mm256_add_epi32(accu[i][0], _mm256_madd_epi16(even, row[0]));
+      accu[i][1] = _mm256_add_epi32(accu[i][1], _mm256_madd_epi16(even, row[1]));
+      accu[i][2] = _mm256_add_epi32(accu[i][2], _mm256_madd_epi16(even, row[2]));
+      accu[i][3] = _mm256_add_epi32(accu[i][3], _mm256_madd_epi16(even, row[3]));
+
+      odd = _mm256_set1_epi32(((int32_t*)left)[stride * (i + 1) + j / 4]);
+      accu[i + 1][0] = _mm256_add_epi32(accu[i + 1][0], _mm256_madd_epi16(odd, row[0]));
+      accu[i + 1][1] = _mm256_add_epi32(accu[i + 1][1], _mm256_madd_epi16(odd, row[1]));
+      accu[i + 1][2] = _mm256_add_epi32(accu[i + 1][2], _mm256_madd_epi16(odd, row[2]));
+      accu[i + 1][3] = _mm256_add_epi32(accu[i + 1][3], _mm256_madd_epi16(odd, row[3]));
+
+    }
+  }
+
+  for (i = 0; i < 32; ++i) {
+    __m256i result, first_quarter, second_quarter, third_quarter, fourth_quarter;
+
+    first_quarter = _mm256_srai_epi32(_mm256_add_epi32(accu[i][0], _mm256_set1_epi32(add)), shift);
+    second_quarter = _mm256_srai_epi32(_mm256_add_epi32(accu[i][1], _mm256_set1_epi32(add)), shift);
+    third_quarter = _mm256_srai_epi32(_mm256_add_epi32(accu[i][2], _mm256_set1_epi32(add)), shift);
+    fourth_quarter = _mm256_srai_epi32(_mm256_add_epi32(accu[i][3], _mm256_set1_epi32(add)), shift);
+    result = _mm256_permute4x64_epi64(_mm256_packs_epi32(first_quarter, second_quarter), 0 + 8 + 16 + 192);
+    _mm256_storeu_si256((__m256i*)dst + 2 * i, result);
+    result = _mm256_permute4x64_epi64(_mm256_packs_epi32(third_quarter, fourth_quarter), 0 + 8 + 16 + 192);
+    _mm256_storeu_si256((__m256i*)dst + 2 * i + 1, result);
+
+  }
+}
+
 // Macro that generates 2D transform functions with clipping values.
 // Sets correct shift values and matrices according to transform type and
 // block size. Performs matrix multiplication horizontally and vertically.
@@ -338,6 +429,22 @@ static void matrix_i ## type ## _## n ## x ## n ## _avx2(int8_t bitdepth, const
   mul_clip_matrix_ ## n ## x ## n ## _avx2(tmp, dct, output, shift_2nd);\
 }\
 
+// Inverse 32x32 transform of a block with non-zero coefficients only in the
+// top-left n x n corner. Only the first n rows of input and the first n
+// columns of the intermediate result contribute to the products.
+#define PARTIAL_ITRANSFORM_32(n) \
+static void matrix_partial_idct_32x32_ ## n ## _avx2(int8_t bitdepth, const int16_t *input, int16_t *output)\
+{\
+  int32_t shift_1st = 7; \
+  int32_t shift_2nd = 12 - (bitdepth - 8); \
+  int16_t tmp[32 * 32];\
+  const int16_t *tdct = &kvz_g_dct_32_t[0][0];\
+  const int16_t *dct = &kvz_g_dct_32[0][0];\
+\
+  mul_clip_matrix_32x32_pruned_avx2(tdct, input, tmp, shift_1st, n);\
+  mul_clip_matrix_32x32_pruned_avx2(tmp, dct, output, shift_2nd, n);\
+}\
+
 // Generate all the transform functions
 TRANSFORM(dst, 4);
 TRANSFORM(dct, 4);
@@ -351,6 +458,9 @@ ITRANSFORM(dct, 8);
 ITRANSFORM(dct, 16);
 ITRANSFORM(dct, 32);
 
+PARTIAL_ITRANSFORM_32(8);
+PARTIAL_ITRANSFORM_32(16);
+
 #endif //COMPILE_INTEL_AVX2
 
 int kvz_strategy_register_dct_avx2(void* opaque, uint8_t bitdepth)
@@ -371,6 +481,9 @@ int kvz_strategy_register_dct_avx2(void* opaque, uint8_t bitdepth)
     success &= kvz_strategyselector_register(opaque, "idct_8x8", "avx2", 40, &matrix_idct_8x8_avx2);
     success &= kvz_strategyselector_register(opaque, "idct_16x16", "avx2", 40, &matrix_idct_16x16_avx2);
     success &= kvz_strategyselector_register(opaque, "idct_32x32", "avx2", 40, &matrix_idct_32x32_avx2);
+
+    success &= kvz_strategyselector_register(opaque, "partial_idct_32x32_8", "avx2", 40, &matrix_partial_idct_32x32_8_avx2);
+    success &= kvz_strategyselector_register(opaque, "partial_idct_32x32_16", "avx2", 40, &matrix_partial_idct_32x32_16_avx2);
   }
 #endif //COMPILE_INTEL_AVX2  
   return success;
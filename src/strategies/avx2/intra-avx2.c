@@ -30,6 +30,8 @@
 #if COMPILE_INTEL_AVX2
 #include <immintrin.h>
 
+#include "strategies/strategies-common.h"
+
  /**
  * \brief Generage angular predictions.
  * \param log2_width    Log2 of width, range 2..5.
@@ -162,6 +164,284 @@ static void kvz_angular_pred_avx2(
   }
 }
 
+/**
+ * \brief Generate planar prediction.
+ * \param log2_width    Log2 of width, range 2..5.
+ * \param ref_top       Pointer to -1 index of above reference, length=width*2+1.
+ * \param ref_left      Pointer to -1 index of left reference, length=width*2+1.
+ * \param dst           Buffer of size width*width.
+ */
+static void kvz_intra_pred_planar_avx2(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const dst)
+{
+  assert(log2_width >= 2 && log2_width <= 5);
+
+  const int_fast8_t width = 1 << log2_width;
+  // A vector of 16 pixels covers several rows of 4x4 and 8x8 blocks and
+  // half a row of 32x32 blocks.
+  const int_fast8_t rows_per_vec = width < 16 ? 16 >> log2_width : 1;
+  const int_fast8_t vecs_per_row = width > 16 ? width >> 4 : 1;
+  const int_fast8_t vec_width = MIN(width, 16);
+  const int top_right = ref_top[width + 1];
+  const int bottom_left = ref_left[width + 1];
+  const __m128i shift = _mm_cvtsi32_si128(log2_width + 1);
+
+  // Shuffle which copies the left reference pixel of each row to the lanes
+  // of that row.
+  uint8_t row_of_lane[16];
+  for (int i = 0; i < 16; ++i) {
+    row_of_lane[i] = i >> MIN(log2_width, 4);
+  }
+  const __m128i left_shuffle = _mm_loadu_si128((__m128i*)row_of_lane);
+
+  for (int_fast8_t v = 0; v < vecs_per_row; ++v) {
+    // The value of each lane is
+    //   (width - 1 - x) * left[y] + (x + 1) * top_right +
+    //   (width - 1 - y) * top[x] + (y + 1) * bottom_left + width,
+    // of which everything except the left part is accumulated with a step
+    // of rows_per_vec rows.
+    int16_t acc_init[16];
+    int16_t acc_step[16];
+    int16_t left_weight[16];
+    for (int i = 0; i < 16; ++i) {
+      const int x = v * 16 + (i & (vec_width - 1));
+      const int y = i / vec_width;
+      const int top = ref_top[x + 1];
+      acc_init[i] = (x + 1) * top_right + (width - 1 - y) * top +
+                    (y + 1) * bottom_left + width;
+      acc_step[i] = rows_per_vec * (bottom_left - top);
+      left_weight[i] = width - 1 - x;
+    }
+    __m256i acc = _mm256_loadu_si256((__m256i*)acc_init);
+    const __m256i step = _mm256_loadu_si256((__m256i*)acc_step);
+    const __m256i weight = _mm256_loadu_si256((__m256i*)left_weight);
+
+    for (int_fast8_t y = 0; y < width; y += rows_per_vec) {
+      __m128i left = _mm_loadl_epi64((__m128i*)&ref_left[y + 1]);
+      left = _mm_shuffle_epi8(left, left_shuffle);
+      __m256i pred = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(left), weight);
+      pred = _mm256_add_epi16(pred, acc);
+      pred = _mm256_srl_epi16(pred, shift);
+      pred = _mm256_packus_epi16(pred, pred);
+      pred = _mm256_permute4x64_epi64(pred, KVZ_PERMUTE(0, 2, 1, 3));
+      _mm_storeu_si128((__m128i*)&dst[y * width + v * 16], _mm256_castsi256_si128(pred));
+
+      acc = _mm256_add_epi16(acc, step);
+    }
+  }
+}
+
+
+/**
+ * \brief Calculate the DC value of the references.
+ */
+static INLINE kvz_pixel dc_value_avx2(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left)
+{
+  const int_fast8_t width = 1 << log2_width;
+  __m128i sum;
+
+  if (width == 32) {
+    __m256i top = _mm256_loadu_si256((__m256i*)&ref_top[1]);
+    __m256i left = _mm256_loadu_si256((__m256i*)&ref_left[1]);
+    __m256i sad = _mm256_add_epi64(_mm256_sad_epu8(top, _mm256_setzero_si256()),
+                                   _mm256_sad_epu8(left, _mm256_setzero_si256()));
+    sum = _mm_add_epi64(_mm256_castsi256_si128(sad), _mm256_extracti128_si256(sad, 1));
+  } else {
+    __m128i top, left;
+    if (width == 16) {
+      top = _mm_loadu_si128((__m128i*)&ref_top[1]);
+      left = _mm_loadu_si128((__m128i*)&ref_left[1]);
+    } else if (width == 8) {
+      top = _mm_loadl_epi64((__m128i*)&ref_top[1]);
+      left = _mm_loadl_epi64((__m128i*)&ref_left[1]);
+    } else {
+      top = _mm_cvtsi32_si128(*(int32_t*)&ref_top[1]);
+      left = _mm_cvtsi32_si128(*(int32_t*)&ref_left[1]);
+    }
+    sum = _mm_add_epi64(_mm_sad_epu8(top, _mm_setzero_si128()),
+                        _mm_sad_epu8(left, _mm_setzero_si128()));
+  }
+  sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+
+  return (_mm_cvtsi128_si32(sum) + width) >> (log2_width + 1);
+}
+
+
+/**
+ * \brief Generate intra DC prediction.
+ * \param log2_width    Log2 of width, range 2..5.
+ * \param ref_top       Pointer to -1 index of above reference, length=width*2+1.
+ * \param ref_left      Pointer to -1 index of left reference, length=width*2+1.
+ * \param out_block     Buffer of size width*width.
+ */
+static void kvz_intra_pred_dc_avx2(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const out_block)
+{
+  assert(log2_width >= 2 && log2_width <= 5);
+
+  const int_fast16_t block_size = 1 << (log2_width * 2);
+  const __m256i dc_val = _mm256_set1_epi8(dc_value_avx2(log2_width, ref_top, ref_left));
+
+  if (block_size == 16) {
+    _mm_storeu_si128((__m128i*)out_block, _mm256_castsi256_si128(dc_val));
+  } else {
+    for (int_fast16_t i = 0; i < block_size; i += 32) {
+      _mm256_storeu_si256((__m256i*)&out_block[i], dc_val);
+    }
+  }
+}
+
+
+/**
+ * \brief Generate intra DC prediction with post filtering applied.
+ * \param log2_width    Log2 of width, range 2..5.
+ * \param ref_top       Pointer to -1 index of above reference, length=width*2+1.
+ * \param ref_left      Pointer to -1 index of left reference, length=width*2+1.
+ * \param out_block     Buffer of size width*width.
+ */
+static void kvz_intra_pred_filtered_dc_avx2(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const out_block)
+{
+  assert(log2_width >= 2 && log2_width <= 5);
+
+  const int_fast8_t width = 1 << log2_width;
+  const kvz_pixel dc_val = dc_value_avx2(log2_width, ref_top, ref_left);
+
+  kvz_intra_pred_dc_avx2(log2_width, ref_top, ref_left, out_block);
+
+  // Filter the top row with ([1 3] / 4) in chunks of 16 pixels.
+  const __m256i dc_x3 = _mm256_set1_epi16(3 * dc_val + 2);
+  for (int_fast8_t x = 0; x < width; x += 16) {
+    __m128i top;
+    if (width >= 16) {
+      top = _mm_loadu_si128((__m128i*)&ref_top[x + 1]);
+    } else {
+      top = _mm_loadl_epi64((__m128i*)&ref_top[1]);
+    }
+    __m256i row = _mm256_add_epi16(_mm256_cvtepu8_epi16(top), dc_x3);
+    row = _mm256_srli_epi16(row, 2);
+    row = _mm256_packus_epi16(row, row);
+    row = _mm256_permute4x64_epi64(row, KVZ_PERMUTE(0, 2, 1, 3));
+    if (width >= 16) {
+      _mm_storeu_si128((__m128i*)&out_block[x], _mm256_castsi256_si128(row));
+    } else if (width == 8) {
+      _mm_storel_epi64((__m128i*)out_block, _mm256_castsi256_si128(row));
+    } else {
+      *(int32_t*)out_block = _mm_cvtsi128_si32(_mm256_castsi256_si128(row));
+    }
+  }
+
+  // Filter top-left with ([1 2 1] / 4) and the left column with ([1 3] / 4).
+  out_block[0] = (ref_left[1] + 2 * dc_val + ref_top[1] + 2) / 4;
+  for (int_fast8_t y = 1; y < width; ++y) {
+    out_block[y * width] = (ref_left[y + 1] + 3 * dc_val + 2) / 4;
+  }
+}
+
+
+/**
+ * \brief Filter 16 reference pixels with [1 2 1] / 4.
+ */
+static INLINE void filter_ref_16_avx2(const kvz_pixel *src, kvz_pixel *dst)
+{
+  __m256i left = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)&src[-1]));
+  __m256i center = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)&src[0]));
+  __m256i right = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)&src[1]));
+
+  __m256i sum = _mm256_add_epi16(_mm256_add_epi16(left, right), _mm256_set1_epi16(2));
+  sum = _mm256_add_epi16(sum, _mm256_slli_epi16(center, 1));
+  sum = _mm256_srli_epi16(sum, 2);
+  sum = _mm256_packus_epi16(sum, sum);
+  sum = _mm256_permute4x64_epi64(sum, KVZ_PERMUTE(0, 2, 1, 3));
+  _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(sum));
+}
+
+
+/**
+ * \brief Filter 8 reference pixels with [1 2 1] / 4.
+ */
+static INLINE void filter_ref_8_avx2(const kvz_pixel *src, kvz_pixel *dst)
+{
+  __m128i left = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*)&src[-1]));
+  __m128i center = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*)&src[0]));
+  __m128i right = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*)&src[1]));
+
+  __m128i sum = _mm_add_epi16(_mm_add_epi16(left, right), _mm_set1_epi16(2));
+  sum = _mm_add_epi16(sum, _mm_slli_epi16(center, 1));
+  sum = _mm_srli_epi16(sum, 2);
+  _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(sum, sum));
+}
+
+
+/**
+ * \brief Filter the pixels between the first and the last reference pixel.
+ *
+ * The last chunk is moved back to end at the last filtered pixel, so nothing
+ * is read beyond the reference.
+ */
+static INLINE void filter_ref_line_avx2(
+  const int_fast8_t ref_width,
+  const kvz_pixel *const ref,
+  kvz_pixel *const filtered)
+{
+  const int_fast8_t last = ref_width - 2;
+
+  if (ref_width > 17) {
+    for (int_fast8_t i = 1; i <= last; i += 16) {
+      const int_fast8_t start = MIN(i, last - 15);
+      filter_ref_16_avx2(&ref[start], &filtered[start]);
+    }
+  } else if (ref_width > 9) {
+    for (int_fast8_t i = 1; i <= last; i += 8) {
+      const int_fast8_t start = MIN(i, last - 7);
+      filter_ref_8_avx2(&ref[start], &filtered[start]);
+    }
+  } else {
+    for (int_fast8_t i = 1; i <= last; ++i) {
+      filtered[i] = (ref[i - 1] + 2 * ref[i] + ref[i + 1] + 2) / 4;
+    }
+  }
+}
+
+
+/**
+ * \brief Filter the reference pixels with [1 2 1] / 4.
+ * \param log2_width     Log2 of width, range 2..5.
+ * \param ref_top        Pointer to -1 index of above reference, length=width*2+1.
+ * \param ref_left       Pointer to -1 index of left reference, length=width*2+1.
+ * \param filtered_top   Buffer of length width*2+1 for the filtered above reference.
+ * \param filtered_left  Buffer of length width*2+1 for the filtered left reference.
+ */
+static void kvz_intra_filter_ref_avx2(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const filtered_top,
+  kvz_pixel *const filtered_left)
+{
+  const int_fast8_t ref_width = 2 * (1 << log2_width) + 1;
+
+  filter_ref_line_avx2(ref_width, ref_left, filtered_left);
+  filter_ref_line_avx2(ref_width, ref_top, filtered_top);
+
+  filtered_left[0] = (ref_left[1] + 2 * ref_left[0] + ref_top[1] + 2) / 4;
+  filtered_top[0] = filtered_left[0];
+  filtered_left[ref_width - 1] = ref_left[ref_width - 1];
+  filtered_top[ref_width - 1] = ref_top[ref_width - 1];
+}
+
 #endif //COMPILE_INTEL_AVX2
 
 int kvz_strategy_register_intra_avx2(void* opaque, uint8_t bitdepth)
@@ -170,6 +450,10 @@ int kvz_strategy_register_intra_avx2(void* opaque, uint8_t bitdepth)
 #if COMPILE_INTEL_AVX2
   if (bitdepth == 8) {
     success &= kvz_strategyselector_register(opaque, "angular_pred", "avx2", 40, &kvz_angular_pred_avx2);
+    success &= kvz_strategyselector_register(opaque, "intra_pred_planar", "avx2", 40, &kvz_intra_pred_planar_avx2);
+    success &= kvz_strategyselector_register(opaque, "intra_pred_dc", "avx2", 40, &kvz_intra_pred_dc_avx2);
+    success &= kvz_strategyselector_register(opaque, "intra_pred_filtered_dc", "avx2", 40, &kvz_intra_pred_filtered_dc_avx2);
+    success &= kvz_strategyselector_register(opaque, "intra_filter_ref", "avx2", 40, &kvz_intra_filter_ref_avx2);
   }
 #endif //COMPILE_INTEL_AVX2
   return success;
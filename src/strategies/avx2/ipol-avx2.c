@@ -481,61 +481,6 @@ void kvz_filter_inter_octpel_chroma_avx2(const encoder_control_t * const encoder
   }
 }
 
-void kvz_get_extended_block_avx2(int xpos, int ypos, int mv_x, int mv_y, int off_x, int off_y, kvz_pixel *ref, int ref_width, int ref_height,
-  int filter_size, int width, int height, kvz_extended_block *out) {
-
-  int half_filter_size = filter_size >> 1;
-
-  out->buffer = ref + (ypos - half_filter_size + off_y + mv_y) * ref_width + (xpos - half_filter_size + off_x + mv_x);
-  out->stride = ref_width;
-  out->orig_topleft = out->buffer + out->stride * half_filter_size + half_filter_size;
-  out->malloc_used = 0;
-
-  int min_y = ypos - half_filter_size + off_y + mv_y;
-  int max_y = min_y + height + filter_size;
-  int out_of_bounds_y = (min_y < 0) || (max_y >= ref_height);
-
-  int min_x = xpos - half_filter_size + off_x + mv_x;
-  int max_x = min_x + width + filter_size;
-  int out_of_bounds_x = (min_x < 0) || (max_x >= ref_width);
-
-  int sample_out_of_bounds = out_of_bounds_y || out_of_bounds_x;
-
-  if (sample_out_of_bounds){
-    out->buffer = MALLOC(kvz_pixel, (width + filter_size) * (width + filter_size));
-    if (!out->buffer){
-      fprintf(stderr, "Memory allocation failed!\n");
-      assert(0);
-    }
-    out->stride = width + filter_size;
-    out->orig_topleft = out->buffer + out->stride * half_filter_size + half_filter_size;
-    out->malloc_used = 1;
-
-    int dst_y; int y; int dst_x; int x; int coord_x; int coord_y;
-
-    for (dst_y = 0, y = ypos - half_filter_size; y < ((ypos + height)) + half_filter_size; dst_y++, y++) {
-
-      // calculate y-pixel offset
-      coord_y = y + off_y + mv_y;
-      coord_y = CLIP(0, (ref_height)-1, coord_y);
-      coord_y *= ref_width;
-
-      if (!out_of_bounds_x){
-        memcpy(&out->buffer[dst_y*(width + filter_size) + 0], &ref[coord_y + min_x], (width + filter_size) * sizeof(kvz_pixel));
-      } else {
-        for (dst_x = 0, x = (xpos)-half_filter_size; x < ((xpos + width)) + half_filter_size; dst_x++, x++) {
-
-          coord_x = x + off_x + mv_x;
-          coord_x = CLIP(0, (ref_width)-1, coord_x);
-
-          // Store source block data (with extended borders)
-          out->buffer[dst_y*(width + filter_size) + dst_x] = ref[coord_y + coord_x];
-        }
-      }
-    }
-  }
-}
-
 #endif //COMPILE_INTEL_AVX2
 
 int kvz_strategy_register_ipol_avx2(void* opaque, uint8_t bitdepth)
@@ -547,7 +492,6 @@ int kvz_strategy_register_ipol_avx2(void* opaque, uint8_t bitdepth)
     success &= kvz_strategyselector_register(opaque, "filter_inter_halfpel_chroma", "avx2", 40, &kvz_filter_inter_halfpel_chroma_avx2);
     success &= kvz_strategyselector_register(opaque, "filter_inter_octpel_chroma", "avx2", 40, &kvz_filter_inter_octpel_chroma_avx2);
   }
-  success &= kvz_strategyselector_register(opaque, "get_extended_block", "avx2", 40, &kvz_get_extended_block_avx2);
 #endif //COMPILE_INTEL_AVX2
   return success;
 }
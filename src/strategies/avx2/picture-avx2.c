@@ -28,6 +28,7 @@
 #  include "image.h"
 #  include "strategies/strategies-common.h"
 #  include <immintrin.h>
+#  include <stdlib.h>
 
 
 /**
@@ -318,6 +319,258 @@ SATD_NXN_AVX2(16)
 SATD_NXN_AVX2(32)
 SATD_NXN_AVX2(64)
 
+/**
+ * \brief Calculate SATD of two 4x4 predictions against the same block.
+ *
+ * Each 128-bit lane does the same calculation as satd_8bit_4x4_avx2 for one
+ * of the predictions.
+ */
+static void satd_8bit_4x4_dual_avx2(const kvz_pixel *pred0, const kvz_pixel *pred1,
+                                    const kvz_pixel *org, unsigned *sum0, unsigned *sum1)
+{
+  __m128i org_lo = _mm_loadl_epi64((__m128i*)org);
+  __m128i org_hi = _mm_loadl_epi64((__m128i*)(org + 8));
+
+  __m256i original = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(org_lo, org_lo));
+  __m256i current = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)pred0),
+                                                             _mm_loadl_epi64((__m128i*)pred1)));
+  __m256i diff_lo = _mm256_sub_epi16(current, original);
+
+  original = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(org_hi, org_hi));
+  current = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)(pred0 + 8)),
+                                                    _mm_loadl_epi64((__m128i*)(pred1 + 8))));
+  __m256i diff_hi = _mm256_sub_epi16(current, original);
+
+  //Hor
+  __m256i row0 = _mm256_hadd_epi16(diff_lo, diff_hi);
+  __m256i row1 = _mm256_hsub_epi16(diff_lo, diff_hi);
+
+  __m256i row2 = _mm256_hadd_epi16(row0, row1);
+  __m256i row3 = _mm256_hsub_epi16(row0, row1);
+
+  //Ver
+  row0 = _mm256_hadd_epi16(row2, row3);
+  row1 = _mm256_hsub_epi16(row2, row3);
+
+  row2 = _mm256_hadd_epi16(row0, row1);
+  row3 = _mm256_hsub_epi16(row0, row1);
+
+  //Abs and sum
+  row2 = _mm256_abs_epi16(row2);
+  row3 = _mm256_abs_epi16(row3);
+
+  row3 = _mm256_add_epi16(row2, row3);
+
+  row3 = _mm256_add_epi16(row3, _mm256_shuffle_epi32(row3, KVZ_PERMUTE(2, 3, 0, 1) ));
+  row3 = _mm256_add_epi16(row3, _mm256_shuffle_epi32(row3, KVZ_PERMUTE(1, 0, 1, 0) ));
+  row3 = _mm256_add_epi16(row3, _mm256_shufflelo_epi16(row3, KVZ_PERMUTE(1, 0, 1, 0) ));
+
+  *sum0 = (_mm_extract_epi16(_mm256_castsi256_si128(row3), 0) + 1) >> 1;
+  *sum1 = (_mm_extract_epi16(_mm256_extracti128_si256(row3, 1), 0) + 1) >> 1;
+}
+
+static void hor_add_sub_dual_avx2(__m256i *row0, __m256i *row1){
+
+  __m256i a = _mm256_hadd_epi16(*row0, *row1);
+  __m256i b = _mm256_hsub_epi16(*row0, *row1);
+
+  __m256i c = _mm256_hadd_epi16(a, b);
+  __m256i d = _mm256_hsub_epi16(a, b);
+
+  *row0 = _mm256_hadd_epi16(c, d);
+  *row1 = _mm256_hsub_epi16(c, d);
+}
+
+static INLINE void ver_add_sub_dual_avx2(__m256i temp_hor[8], __m256i temp_ver[8]){
+
+  // First stage
+  for (int i = 0; i < 8; i += 2){
+    temp_ver[i+0] = _mm256_hadd_epi16(temp_hor[i + 0], temp_hor[i + 1]);
+    temp_ver[i+1] = _mm256_hsub_epi16(temp_hor[i + 0], temp_hor[i + 1]);
+  }
+
+  // Second stage
+  for (int i = 0; i < 8; i += 4){
+    temp_hor[i + 0] = _mm256_add_epi16(temp_ver[i + 0], temp_ver[i + 2]);
+    temp_hor[i + 1] = _mm256_add_epi16(temp_ver[i + 1], temp_ver[i + 3]);
+    temp_hor[i + 2] = _mm256_sub_epi16(temp_ver[i + 0], temp_ver[i + 2]);
+    temp_hor[i + 3] = _mm256_sub_epi16(temp_ver[i + 1], temp_ver[i + 3]);
+  }
+
+  // Third stage
+  for (int i = 0; i < 4; ++i){
+    temp_ver[i + 0] = _mm256_add_epi16(temp_hor[0 + i], temp_hor[4 + i]);
+    temp_ver[i + 4] = _mm256_sub_epi16(temp_hor[0 + i], temp_hor[4 + i]);
+  }
+}
+
+INLINE static __m256i diff_row_dual_avx2(const kvz_pixel *pred0, const kvz_pixel *pred1,
+                                         const kvz_pixel *orig)
+{
+  __m128i orig_row = _mm_loadl_epi64((__m128i*)orig);
+  __m256i preds_row = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)pred0),
+                                                               _mm_loadl_epi64((__m128i*)pred1)));
+  __m256i origs_row = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(orig_row, orig_row));
+  return _mm256_sub_epi16(preds_row, origs_row);
+}
+
+/**
+ * \brief Calculate SATD of two 8x8 predictions against the same block.
+ *
+ * Each 128-bit lane does the same calculation as
+ * kvz_satd_8bit_8x8_general_avx2 for one of the predictions, so the rows of
+ * the original block are loaded only once for both.
+ */
+static void satd_8bit_8x8_general_dual_avx2(const kvz_pixel *pred0, const kvz_pixel *pred1,
+                                            unsigned pred_stride,
+                                            const kvz_pixel *orig, unsigned orig_stride,
+                                            unsigned *sum0, unsigned *sum1)
+{
+  __m256i temp_hor[8];
+  __m256i temp_ver[8];
+
+  for (int i = 0; i < 8; i += 2) {
+    temp_hor[i + 0] = diff_row_dual_avx2(pred0 + (i + 0) * pred_stride,
+                                         pred1 + (i + 0) * pred_stride,
+                                         orig + (i + 0) * orig_stride);
+    temp_hor[i + 1] = diff_row_dual_avx2(pred0 + (i + 1) * pred_stride,
+                                         pred1 + (i + 1) * pred_stride,
+                                         orig + (i + 1) * orig_stride);
+    hor_add_sub_dual_avx2(temp_hor + i, temp_hor + i + 1);
+  }
+
+  ver_add_sub_dual_avx2(temp_hor, temp_ver);
+
+  __m256i sad = _mm256_setzero_si256();
+  for (int i = 0; i < 8; ++i) {
+    __m256i abs_value = _mm256_abs_epi16(temp_ver[i]);
+    sad = _mm256_add_epi32(sad, _mm256_madd_epi16(abs_value, _mm256_set1_epi16(1)));
+  }
+  sad = _mm256_add_epi32(sad, _mm256_shuffle_epi32(sad, KVZ_PERMUTE(2, 3, 0, 1)));
+  sad = _mm256_add_epi32(sad, _mm256_shuffle_epi32(sad, KVZ_PERMUTE(1, 0, 1, 0)));
+
+  *sum0 += (_mm_cvtsi128_si32(_mm256_castsi256_si128(sad)) + 2) >> 2;
+  *sum1 += (_mm_cvtsi128_si32(_mm256_extracti128_si256(sad, 1)) + 2) >> 2;
+}
+
+static void satd_8bit_4x4_multi_avx2(const pred_buffer preds, const kvz_pixel *orig,
+                                     unsigned num_modes, unsigned *costs_out)
+{
+  for (unsigned i = 0; i < num_modes; i += 2) {
+    // With an odd number of modes, the last one is paired with itself.
+    const unsigned next = MIN(i + 1, num_modes - 1);
+    unsigned sum0, sum1;
+    satd_8bit_4x4_dual_avx2(preds[i], preds[next], orig, &sum0, &sum1);
+    costs_out[i] = sum0;
+    costs_out[next] = sum1;
+  }
+}
+
+// Function macro for defining functions which calculate the hadamard
+// of several predictions of integer multiples of 8x8, two at a time.
+#define SATD_NXN_MULTI_AVX2(n) \
+static void satd_8bit_ ## n ## x ## n ## _multi_avx2( \
+  const pred_buffer preds, const kvz_pixel *orig, \
+  unsigned num_modes, unsigned *costs_out) \
+{ \
+  for (unsigned i = 0; i < num_modes; i += 2) { \
+    const unsigned next = MIN(i + 1, num_modes - 1); \
+    unsigned sum0 = 0; \
+    unsigned sum1 = 0; \
+    for (unsigned y = 0; y < (n); y += 8) { \
+      unsigned row = y * (n); \
+      for (unsigned x = 0; x < (n); x += 8) { \
+        satd_8bit_8x8_general_dual_avx2(&preds[i][row + x], &preds[next][row + x], (n), \
+                                        &orig[row + x], (n), &sum0, &sum1); \
+      } \
+    } \
+    costs_out[i] = sum0; \
+    costs_out[next] = sum1; \
+  } \
+}
+
+SATD_NXN_MULTI_AVX2(8)
+SATD_NXN_MULTI_AVX2(16)
+SATD_NXN_MULTI_AVX2(32)
+
+
+/**
+ * \brief Calculate SAD of one block against count blocks.
+ *
+ * Each row of the first block is loaded once for all the blocks.
+ */
+static INLINE void reg_sad_multi_8bit_avx2(const kvz_pixel * const data1, const kvz_pixel * const * const data2,
+                                           const int count, const int width, const int height,
+                                           const unsigned stride1, const unsigned stride2,
+                                           unsigned * const sad_out)
+{
+  __m256i sums[4];
+  __m128i sums_128[4];
+  unsigned tails[4];
+  for (int i = 0; i < count; ++i) {
+    sums[i] = _mm256_setzero_si256();
+    sums_128[i] = _mm_setzero_si128();
+    tails[i] = 0;
+  }
+
+  for (int y = 0; y < height; ++y) {
+    const kvz_pixel *row1 = &data1[y * stride1];
+    const unsigned offset2 = y * stride2;
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+      const __m256i a = _mm256_loadu_si256((__m256i const*) &row1[x]);
+      for (int i = 0; i < count; ++i) {
+        const __m256i b = _mm256_loadu_si256((__m256i const*) &data2[i][offset2 + x]);
+        sums[i] = _mm256_add_epi64(sums[i], _mm256_sad_epu8(a, b));
+      }
+    }
+    if (x + 16 <= width) {
+      const __m128i a = _mm_loadu_si128((__m128i const*) &row1[x]);
+      for (int i = 0; i < count; ++i) {
+        const __m128i b = _mm_loadu_si128((__m128i const*) &data2[i][offset2 + x]);
+        sums_128[i] = _mm_add_epi64(sums_128[i], _mm_sad_epu8(a, b));
+      }
+      x += 16;
+    }
+    if (x + 8 <= width) {
+      const __m128i a = _mm_loadl_epi64((__m128i const*) &row1[x]);
+      for (int i = 0; i < count; ++i) {
+        const __m128i b = _mm_loadl_epi64((__m128i const*) &data2[i][offset2 + x]);
+        sums_128[i] = _mm_add_epi64(sums_128[i], _mm_sad_epu8(a, b));
+      }
+      x += 8;
+    }
+    for (; x < width; ++x) {
+      for (int i = 0; i < count; ++i) {
+        tails[i] += abs(row1[x] - data2[i][offset2 + x]);
+      }
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    const __m128i sum = _mm_add_epi64(sums_128[i],
+                                      _mm_add_epi64(_mm256_castsi256_si128(sums[i]),
+                                                    _mm256_extracti128_si256(sums[i], 1)));
+    sad_out[i] = _mm_cvtsi128_si32(sum) + _mm_extract_epi32(sum, 2) + tails[i];
+  }
+}
+
+static void reg_sad_x3_8bit_avx2(const kvz_pixel * const data1, const kvz_pixel * const * const data2,
+                                 const int width, const int height,
+                                 const unsigned stride1, const unsigned stride2,
+                                 unsigned * const sad_out)
+{
+  reg_sad_multi_8bit_avx2(data1, data2, 3, width, height, stride1, stride2, sad_out);
+}
+
+static void reg_sad_x4_8bit_avx2(const kvz_pixel * const data1, const kvz_pixel * const * const data2,
+                                 const int width, const int height,
+                                 const unsigned stride1, const unsigned stride2,
+                                 unsigned * const sad_out)
+{
+  reg_sad_multi_8bit_avx2(data1, data2, 4, width, height, stride1, stride2, sad_out);
+}
+
 #endif //COMPILE_INTEL_AVX2
 
 
@@ -340,6 +593,14 @@ int kvz_strategy_register_picture_avx2(void* opaque, uint8_t bitdepth)
     success &= kvz_strategyselector_register(opaque, "satd_16x16", "avx2", 40, &satd_8bit_16x16_avx2);
     success &= kvz_strategyselector_register(opaque, "satd_32x32", "avx2", 40, &satd_8bit_32x32_avx2);
     success &= kvz_strategyselector_register(opaque, "satd_64x64", "avx2", 40, &satd_8bit_64x64_avx2);
+
+    success &= kvz_strategyselector_register(opaque, "satd_4x4_multi", "avx2", 40, &satd_8bit_4x4_multi_avx2);
+    success &= kvz_strategyselector_register(opaque, "satd_8x8_multi", "avx2", 40, &satd_8bit_8x8_multi_avx2);
+    success &= kvz_strategyselector_register(opaque, "satd_16x16_multi", "avx2", 40, &satd_8bit_16x16_multi_avx2);
+    success &= kvz_strategyselector_register(opaque, "satd_32x32_multi", "avx2", 40, &satd_8bit_32x32_multi_avx2);
+
+    success &= kvz_strategyselector_register(opaque, "reg_sad_x3", "avx2", 40, &reg_sad_x3_8bit_avx2);
+    success &= kvz_strategyselector_register(opaque, "reg_sad_x4", "avx2", 40, &reg_sad_x4_8bit_avx2);
   }
 #endif
   return success;
@@ -46,7 +46,7 @@ void kvz_quant_flat_avx2(const encoder_state_t * const state, coeff_t *coef, coe
   const uint32_t log2_block_size = kvz_g_convert_to_bit[width] + 2;
   const uint32_t * const scan = kvz_g_sig_last_scan[scan_idx][log2_block_size - 1];
 
-  int32_t qp_scaled = kvz_get_scaled_qp(type, state->global->QP, (encoder->bitdepth - 8) * 6);
+  int32_t qp_scaled = kvz_get_scaled_qp(type, state->qp, (encoder->bitdepth - 8) * 6);
   const uint32_t log2_tr_size = kvz_g_convert_to_bit[width] + 2;
   const int32_t scalinglist_type = (block_type == CU_INTRA ? 0 : 3) + (int8_t)("\0\3\1\2"[type]);
   const int32_t *quant_coeff = encoder->scaling_list.quant_coeff[log2_tr_size - 2][scalinglist_type][qp_scaled % 6];
@@ -205,6 +205,108 @@ void kvz_quant_avx2(const encoder_state_t * const state, coeff_t *coef, coeff_t
   }
 }
 
+/**
+ * \brief Scale 16 coefficients, round and clip them to 16 bits.
+ *
+ * Computes (q_coef * scale + add) >> shift for each coefficient when shift
+ * is positive and clip(q_coef * scale) << -shift otherwise.
+ */
+static INLINE void dequant_16_avx2(const coeff_t *q_coef, coeff_t *coef,
+                                   __m256i v_scale_lo, __m256i v_scale_hi,
+                                   __m256i v_add, int32_t shift)
+{
+  __m256i v_q = _mm256_loadu_si256((const __m256i*)q_coef);
+  __m256i v_lo = _mm256_mullo_epi32(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v_q)), v_scale_lo);
+  __m256i v_hi = _mm256_mullo_epi32(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v_q, 1)), v_scale_hi);
+
+  if (shift > 0) {
+    v_lo = _mm256_srai_epi32(_mm256_add_epi32(v_lo, v_add), shift);
+    v_hi = _mm256_srai_epi32(_mm256_add_epi32(v_hi, v_add), shift);
+  } else {
+    // Clip to avoid possible overflow in following shift left operation
+    const __m256i v_min = _mm256_set1_epi32(-32768);
+    const __m256i v_max = _mm256_set1_epi32(32767);
+    v_lo = _mm256_slli_epi32(_mm256_min_epi32(_mm256_max_epi32(v_lo, v_min), v_max), -shift);
+    v_hi = _mm256_slli_epi32(_mm256_min_epi32(_mm256_max_epi32(v_hi, v_min), v_max), -shift);
+  }
+
+  // Saturating pack clips to the range of coeff_t. It packs within 128-bit
+  // lanes, so the middle quarters need to be swapped.
+  __m256i v_result = _mm256_permute4x64_epi64(_mm256_packs_epi32(v_lo, v_hi), KVZ_PERMUTE(0, 2, 1, 3));
+  _mm256_storeu_si256((__m256i*)coef, v_result);
+}
+
+/**
+ * \brief inverse quantize transformed and quantized coefficents
+ *
+ */
+static void dequant_avx2(const encoder_state_t * const state, coeff_t *q_coef, coeff_t *coef, int32_t width, int32_t height, int8_t type, int8_t block_type)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const int32_t transform_shift = 15 - encoder->bitdepth - (kvz_g_convert_to_bit[width] + 2);
+  const int32_t qp_scaled = kvz_get_scaled_qp(type, state->qp, (encoder->bitdepth - 8) * 6);
+  int32_t shift = 20 - QUANT_SHIFT - transform_shift;
+
+  if (encoder->scaling_list.enable) {
+    const uint32_t log2_tr_size = kvz_g_convert_to_bit[width] + 2;
+    const int32_t scalinglist_type = (block_type == CU_INTRA ? 0 : 3) + (int8_t)("\0\3\1\2"[type]);
+    const int32_t *dequant_coef = encoder->scaling_list.de_quant_coeff[log2_tr_size - 2][scalinglist_type][qp_scaled % 6];
+
+    shift += 4 - qp_scaled / 6;
+    const __m256i v_add = _mm256_set1_epi32(shift > 0 ? 1 << (shift - 1) : 0);
+
+    for (int32_t n = 0; n < width * height; n += 16) {
+      __m256i v_scale_lo = _mm256_loadu_si256((const __m256i*)&dequant_coef[n]);
+      __m256i v_scale_hi = _mm256_loadu_si256((const __m256i*)&dequant_coef[n + 8]);
+      dequant_16_avx2(&q_coef[n], &coef[n], v_scale_lo, v_scale_hi, v_add, shift);
+    }
+  } else {
+    const __m256i v_scale = _mm256_set1_epi32(kvz_g_inv_quant_scales[qp_scaled % 6] << (qp_scaled / 6));
+    const __m256i v_add = _mm256_set1_epi32(1 << (shift - 1));
+
+    for (int32_t n = 0; n < width * height; n += 16) {
+      dequant_16_avx2(&q_coef[n], &coef[n], v_scale, v_scale, v_add, shift);
+    }
+  }
+}
+
+/**
+ * \brief transform skip
+ * \param block input data (residual)
+ * \param coeff output data (transform coefficients)
+ * \param block_size width of transform
+ */
+static void transformskip_avx2(int8_t bitdepth, int16_t *block, int16_t *coeff, int8_t block_size)
+{
+  const int32_t shift = MAX_TR_DYNAMIC_RANGE - bitdepth - (kvz_g_convert_to_bit[block_size] + 2);
+
+  for (int i = 0; i < block_size * block_size; i += 16) {
+    __m256i v_block = _mm256_loadu_si256((const __m256i*)&block[i]);
+    _mm256_storeu_si256((__m256i*)&coeff[i], _mm256_slli_epi16(v_block, shift));
+  }
+}
+
+/**
+ * \brief inverse transform skip
+ * \param block output data (residual)
+ * \param coeff input data (transform coefficients)
+ * \param block_size width of transform
+ */
+static void itransformskip_avx2(int8_t bitdepth, int16_t *block, int16_t *coeff, int8_t block_size)
+{
+  const int32_t shift = MAX_TR_DYNAMIC_RANGE - bitdepth - (kvz_g_convert_to_bit[block_size] + 2);
+  const __m256i v_one = _mm256_set1_epi16(1);
+
+  // (coeff + (1 << (shift - 1))) >> shift without overflowing 16 bits: the
+  // rounding adds one when the highest shifted out bit is set.
+  for (int i = 0; i < block_size * block_size; i += 16) {
+    __m256i v_coeff = _mm256_loadu_si256((const __m256i*)&coeff[i]);
+    __m256i v_round = _mm256_and_si256(_mm256_srai_epi16(v_coeff, shift - 1), v_one);
+    __m256i v_block = _mm256_add_epi16(_mm256_srai_epi16(v_coeff, shift), v_round);
+    _mm256_storeu_si256((__m256i*)&block[i], v_block);
+  }
+}
+
 #endif //COMPILE_INTEL_AVX2
 
 
@@ -214,6 +316,9 @@ int kvz_strategy_register_quant_avx2(void* opaque, uint8_t bitdepth)
 
 #if COMPILE_INTEL_AVX2
   success &= kvz_strategyselector_register(opaque, "quant", "avx2", 40, &kvz_quant_avx2);
+  success &= kvz_strategyselector_register(opaque, "dequant", "avx2", 40, &dequant_avx2);
+  success &= kvz_strategyselector_register(opaque, "transformskip", "avx2", 40, &transformskip_avx2);
+  success &= kvz_strategyselector_register(opaque, "itransformskip", "avx2", 40, &itransformskip_avx2);
 #endif //COMPILE_INTEL_AVX2
 
   return success;
@@ -568,6 +568,79 @@ static void partial_butterfly_inverse_32_generic(const int16_t *src, int16_t *ds
   }
 }
 
+/**
+ * \brief Inverse 32-point butterfly of lines with non-zero coefficients
+ * only in the first num_inputs positions.
+ *
+ * Only the first num_lines lines are transformed. With constant arguments
+ * the loops over the zero coefficients are removed.
+ */
+static INLINE void partial_butterfly_inverse_32_pruned_generic(const int16_t *src, int16_t *dst,
+  int32_t shift, const int num_lines, const int num_inputs)
+{
+  int32_t i, j, k;
+  int32_t e[16], o[16];
+  int32_t ee[8], eo[8];
+  int32_t eee[4], eeo[4];
+  int32_t eeee[2], eeeo[2];
+  int32_t add = 1 << (shift - 1);
+  const int32_t line = 32;
+
+  for (j = 0; j < num_lines; j++) {
+    for (k = 0; k < 16; k++) {
+      o[k] = 0;
+      for (i = 1; i < num_inputs; i += 2) {
+        o[k] += kvz_g_dct_32[i][k] * src[i * line];
+      }
+    }
+    for (k = 0; k < 8; k++) {
+      eo[k] = 0;
+      for (i = 2; i < num_inputs; i += 4) {
+        eo[k] += kvz_g_dct_32[i][k] * src[i * line];
+      }
+    }
+    for (k = 0; k < 4; k++) {
+      eeo[k] = 0;
+      for (i = 4; i < num_inputs; i += 8) {
+        eeo[k] += kvz_g_dct_32[i][k] * src[i * line];
+      }
+    }
+    eeeo[0] = 0;
+    eeeo[1] = 0;
+    eeee[0] = kvz_g_dct_32[0][0] * src[0];
+    eeee[1] = kvz_g_dct_32[0][1] * src[0];
+    if (num_inputs > 8) {
+      eeeo[0] = kvz_g_dct_32[8][0] * src[8 * line];
+      eeeo[1] = kvz_g_dct_32[8][1] * src[8 * line];
+    }
+    if (num_inputs > 16) {
+      eeeo[0] += kvz_g_dct_32[24][0] * src[24 * line];
+      eeeo[1] += kvz_g_dct_32[24][1] * src[24 * line];
+      eeee[0] += kvz_g_dct_32[16][0] * src[16 * line];
+      eeee[1] += kvz_g_dct_32[16][1] * src[16 * line];
+    }
+
+    eee[0] = eeee[0] + eeeo[0];
+    eee[3] = eeee[0] - eeeo[0];
+    eee[1] = eeee[1] + eeeo[1];
+    eee[2] = eeee[1] - eeeo[1];
+    for (k = 0; k < 4; k++) {
+      ee[k] = eee[k] + eeo[k];
+      ee[k + 4] = eee[3 - k] - eeo[3 - k];
+    }
+    for (k = 0; k < 8; k++) {
+      e[k] = ee[k] + eo[k];
+      e[k + 8] = ee[7 - k] - eo[7 - k];
+    }
+    for (k = 0; k<16; k++) {
+      dst[k] = (short)MAX(-32768, MIN(32767, (e[k] + o[k] + add) >> shift));
+      dst[k + 16] = (short)MAX(-32768, MIN(32767, (e[15 - k] - o[15 - k] + add) >> shift));
+    }
+    src++;
+    dst += 32;
+  }
+}
+
 #define DCT_NXN_GENERIC(n) \
 static void dct_ ## n ## x ## n ## _generic(int8_t bitdepth, const int16_t *input, int16_t *output) { \
 \
@@ -600,6 +673,23 @@ IDCT_NXN_GENERIC(8);
 IDCT_NXN_GENERIC(16);
 IDCT_NXN_GENERIC(32);
 
+// The first stage transforms the columns of the input into the rows of tmp,
+// so only the first n rows of tmp are non-zero and the second stage only
+// needs to read those.
+#define PARTIAL_IDCT_32X32_GENERIC(n) \
+static void partial_idct_32x32_ ## n ## _generic(int8_t bitdepth, const int16_t *input, int16_t *output) { \
+\
+  int16_t tmp[32 * n]; \
+  int32_t shift_1st = 7; \
+  int32_t shift_2nd = 12 - (bitdepth - 8); \
+\
+  partial_butterfly_inverse_32_pruned_generic(input, tmp, shift_1st, n, n); \
+  partial_butterfly_inverse_32_pruned_generic(tmp, output, shift_2nd, 32, n); \
+}
+
+PARTIAL_IDCT_32X32_GENERIC(8);
+PARTIAL_IDCT_32X32_GENERIC(16);
+
 static void fast_forward_dst_4x4_generic(int8_t bitdepth, const int16_t *input, int16_t *output)
 {
   int16_t tmp[4*4]; 
@@ -637,5 +727,8 @@ int kvz_strategy_register_dct_generic(void* opaque, uint8_t bitdepth)
   success &= kvz_strategyselector_register(opaque, "idct_8x8", "generic", 0, &idct_8x8_generic);
   success &= kvz_strategyselector_register(opaque, "idct_16x16", "generic", 0, &idct_16x16_generic);
   success &= kvz_strategyselector_register(opaque, "idct_32x32", "generic", 0, &idct_32x32_generic);
+
+  success &= kvz_strategyselector_register(opaque, "partial_idct_32x32_8", "generic", 0, &partial_idct_32x32_8_generic);
+  success &= kvz_strategyselector_register(opaque, "partial_idct_32x32_16", "generic", 0, &partial_idct_32x32_16_generic);
   return success;
 }
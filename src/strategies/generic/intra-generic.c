@@ -144,11 +144,167 @@ static void kvz_angular_pred_generic(
   }
 }
 
+
+/**
+ * \brief Generage planar prediction.
+ * \param log2_width    Log2 of width, range 2..5.
+ * \param in_ref_above  Pointer to -1 index of above reference, length=width*2+1.
+ * \param in_ref_left   Pointer to -1 index of left reference, length=width*2+1.
+ * \param dst           Buffer of size width*width.
+ */
+static void kvz_intra_pred_planar_generic(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const dst)
+{
+  assert(log2_width >= 2 && log2_width <= 5);
+
+  const int_fast8_t width = 1 << log2_width;
+  const kvz_pixel top_right = ref_top[width + 1];
+  const kvz_pixel bottom_left = ref_left[width + 1];
+
+#if 0
+  // Unoptimized version for reference.
+  for (int y = 0; y < width; ++y) {
+    for (int x = 0; x < width; ++x) {
+      int_fast16_t hor = (width - 1 - x) * ref_left[y + 1] + (x + 1) * top_right;
+      int_fast16_t ver = (width - 1 - y) * ref_top[x + 1] + (y + 1) * bottom_left;
+      dst[y * width + x] = (ver + hor + width) >> (log2_width + 1);
+    }
+  }
+#else
+  int_fast16_t top[32];
+  for (int i = 0; i < width; ++i) {
+    top[i] = ref_top[i + 1] << log2_width;
+  }
+
+  for (int y = 0; y < width; ++y) {
+    int_fast16_t hor = (ref_left[y + 1] << log2_width) + width;
+    for (int x = 0; x < width; ++x) {
+      hor += top_right - ref_left[y + 1];
+      top[x] += bottom_left - ref_top[x + 1];
+      dst[y * width + x] = (hor + top[x]) >> (log2_width + 1);
+    }
+  }
+#endif
+}
+
+
+/**
+* \brief Generage intra DC prediction.
+* \param log2_width    Log2 of width, range 2..5.
+* \param in_ref_above  Pointer to -1 index of above reference, length=width*2+1.
+* \param in_ref_left   Pointer to -1 index of left reference, length=width*2+1.
+* \param dst           Buffer of size width*width.
+*/
+static void kvz_intra_pred_dc_generic(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const out_block)
+{
+  int_fast8_t width = 1 << log2_width;
+
+  int_fast16_t sum = 0;
+  for (int_fast8_t i = 0; i < width; ++i) {
+    sum += ref_top[i + 1];
+    sum += ref_left[i + 1];
+  }
+
+  const kvz_pixel dc_val = (sum + width) >> (log2_width + 1);
+  const int_fast16_t block_size = 1 << (log2_width * 2);
+
+  for (int_fast16_t i = 0; i < block_size; ++i) {
+    out_block[i] = dc_val;
+  }
+}
+
+
+/**
+* \brief Generage intra DC prediction with post filtering applied.
+* \param log2_width    Log2 of width, range 2..5.
+* \param in_ref_above  Pointer to -1 index of above reference, length=width*2+1.
+* \param in_ref_left   Pointer to -1 index of left reference, length=width*2+1.
+* \param dst           Buffer of size width*width.
+*/
+static void kvz_intra_pred_filtered_dc_generic(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const out_block)
+{
+  assert(log2_width >= 2 && log2_width <= 5);
+
+  const int_fast8_t width = 1 << log2_width;
+
+  int_fast16_t sum = 0;
+  for (int_fast8_t i = 0; i < width; ++i) {
+    sum += ref_top[i + 1];
+    sum += ref_left[i + 1];
+  }
+
+  const kvz_pixel dc_val = (sum + width) >> (log2_width + 1);
+
+  // Filter top-left with ([1 2 1] / 4)
+  out_block[0] = (ref_left[1] + 2 * dc_val + ref_top[1] + 2) / 4;
+
+  // Filter rest of the boundary with ([1 3] / 4)
+  for (int_fast8_t x = 1; x < width; ++x) {
+    out_block[x] = (ref_top[x + 1] + 3 * dc_val + 2) / 4;
+  }
+  for (int_fast8_t y = 1; y < width; ++y) {
+    out_block[y * width] = (ref_left[y + 1] + 3 * dc_val + 2) / 4;
+    for (int_fast8_t x = 1; x < width; ++x) {
+      out_block[y * width + x] = dc_val;
+    }
+  }
+}
+
+
+/**
+ * \brief Filter the reference pixels with [1 2 1] / 4.
+ * \param log2_width     Log2 of width, range 2..5.
+ * \param ref_top        Pointer to -1 index of above reference, length=width*2+1.
+ * \param ref_left       Pointer to -1 index of left reference, length=width*2+1.
+ * \param filtered_top   Buffer of length width*2+1 for the filtered above reference.
+ * \param filtered_left  Buffer of length width*2+1 for the filtered left reference.
+ */
+static void kvz_intra_filter_ref_generic(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const filtered_top,
+  kvz_pixel *const filtered_left)
+{
+  const int_fast8_t ref_width = 2 * (1 << log2_width) + 1;
+
+  filtered_left[0] = (ref_left[1] + 2 * ref_left[0] + ref_top[1] + 2) / 4;
+  filtered_top[0] = filtered_left[0];
+
+  for (int_fast8_t y = 1; y < ref_width - 1; ++y) {
+    const kvz_pixel *p = &ref_left[y];
+    filtered_left[y] = (p[-1] + 2 * p[0] + p[1] + 2) / 4;
+  }
+  filtered_left[ref_width - 1] = ref_left[ref_width - 1];
+
+  for (int_fast8_t x = 1; x < ref_width - 1; ++x) {
+    const kvz_pixel *p = &ref_top[x];
+    filtered_top[x] = (p[-1] + 2 * p[0] + p[1] + 2) / 4;
+  }
+  filtered_top[ref_width - 1] = ref_top[ref_width - 1];
+}
+
+
 int kvz_strategy_register_intra_generic(void* opaque, uint8_t bitdepth)
 {
   bool success = true;
 
   success &= kvz_strategyselector_register(opaque, "angular_pred", "generic", 0, &kvz_angular_pred_generic);
+  success &= kvz_strategyselector_register(opaque, "intra_pred_planar", "generic", 0, &kvz_intra_pred_planar_generic);
+  success &= kvz_strategyselector_register(opaque, "intra_pred_dc", "generic", 0, &kvz_intra_pred_dc_generic);
+  success &= kvz_strategyselector_register(opaque, "intra_pred_filtered_dc", "generic", 0, &kvz_intra_pred_filtered_dc_generic);
+  success &= kvz_strategyselector_register(opaque, "intra_filter_ref", "generic", 0, &kvz_intra_filter_ref_generic);
 
   return success;
 }
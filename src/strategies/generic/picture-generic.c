@@ -100,6 +100,47 @@ static unsigned reg_sad_generic(const kvz_pixel * const data1, const kvz_pixel *
 }
 
 
+/**
+ * \brief Calculate SAD of one block against count blocks.
+ *
+ * Each pixel of the first block is loaded once for all the blocks.
+ */
+static INLINE void reg_sad_multi_generic(const kvz_pixel * const data1, const kvz_pixel * const * const data2,
+                                         const int count, const int width, const int height,
+                                         const unsigned stride1, const unsigned stride2,
+                                         unsigned * const sad_out)
+{
+  for (int i = 0; i < count; ++i) {
+    sad_out[i] = 0;
+  }
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const int a = data1[y * stride1 + x];
+      for (int i = 0; i < count; ++i) {
+        sad_out[i] += abs(a - data2[i][y * stride2 + x]);
+      }
+    }
+  }
+}
+
+static void reg_sad_x3_generic(const kvz_pixel * const data1, const kvz_pixel * const * const data2,
+                               const int width, const int height,
+                               const unsigned stride1, const unsigned stride2,
+                               unsigned * const sad_out)
+{
+  reg_sad_multi_generic(data1, data2, 3, width, height, stride1, stride2, sad_out);
+}
+
+static void reg_sad_x4_generic(const kvz_pixel * const data1, const kvz_pixel * const * const data2,
+                               const int width, const int height,
+                               const unsigned stride1, const unsigned stride2,
+                               unsigned * const sad_out)
+{
+  reg_sad_multi_generic(data1, data2, 4, width, height, stride1, stride2, sad_out);
+}
+
+
 /**
  * \brief  Calculate SATD between two 4x4 blocks inside bigger arrays.
  * From HM 13.0
@@ -312,6 +353,29 @@ SATD_NXN(16, kvz_pixel)
 SATD_NXN(32, kvz_pixel)
 SATD_NXN(64, kvz_pixel)
 
+// Function macro for defining functions which calculate the SATD of several
+// predictions against one block with the single block functions.
+#define SATD_NXN_MULTI(n) \
+static void satd_ ## n ## x ## n ## _multi_generic( \
+  const pred_buffer preds, const kvz_pixel *orig, \
+  unsigned num_modes, unsigned *costs_out) \
+{ \
+  for (unsigned i = 0; i < num_modes; ++i) { \
+    costs_out[i] = satd_ ## n ## x ## n ## _generic(preds[i], orig); \
+  } \
+}
+
+// Declare these functions to make sure the signature of the macro matches.
+static cost_pixel_nxn_multi_func satd_4x4_multi_generic;
+static cost_pixel_nxn_multi_func satd_8x8_multi_generic;
+static cost_pixel_nxn_multi_func satd_16x16_multi_generic;
+static cost_pixel_nxn_multi_func satd_32x32_multi_generic;
+
+SATD_NXN_MULTI(4)
+SATD_NXN_MULTI(8)
+SATD_NXN_MULTI(16)
+SATD_NXN_MULTI(32)
+
 // Function macro for defining SAD calculating functions
 // for fixed size blocks.
 #define SAD_NXN(n, pixel_type) \
@@ -348,6 +412,8 @@ int kvz_strategy_register_picture_generic(void* opaque)
   bool success = true;
 
   success &= kvz_strategyselector_register(opaque, "reg_sad", "generic", 0, &reg_sad_generic);
+  success &= kvz_strategyselector_register(opaque, "reg_sad_x3", "generic", 0, &reg_sad_x3_generic);
+  success &= kvz_strategyselector_register(opaque, "reg_sad_x4", "generic", 0, &reg_sad_x4_generic);
 
   success &= kvz_strategyselector_register(opaque, "sad_4x4", "generic", 0, &sad_4x4_generic);
   success &= kvz_strategyselector_register(opaque, "sad_8x8", "generic", 0, &sad_8x8_generic);
@@ -361,5 +427,10 @@ int kvz_strategy_register_picture_generic(void* opaque)
   success &= kvz_strategyselector_register(opaque, "satd_32x32", "generic", 0, &satd_32x32_generic);
   success &= kvz_strategyselector_register(opaque, "satd_64x64", "generic", 0, &satd_64x64_generic);
 
+  success &= kvz_strategyselector_register(opaque, "satd_4x4_multi", "generic", 0, &satd_4x4_multi_generic);
+  success &= kvz_strategyselector_register(opaque, "satd_8x8_multi", "generic", 0, &satd_8x8_multi_generic);
+  success &= kvz_strategyselector_register(opaque, "satd_16x16_multi", "generic", 0, &satd_16x16_multi_generic);
+  success &= kvz_strategyselector_register(opaque, "satd_32x32_multi", "generic", 0, &satd_32x32_multi_generic);
+
   return success;
 }
@@ -41,7 +41,7 @@ void kvz_quant_generic(const encoder_state_t * const state, coeff_t *coef, coeff
   const uint32_t log2_block_size = kvz_g_convert_to_bit[width] + 2;
   const uint32_t * const scan = kvz_g_sig_last_scan[scan_idx][log2_block_size - 1];
 
-  int32_t qp_scaled = kvz_get_scaled_qp(type, state->global->QP, (encoder->bitdepth - 8) * 6);
+  int32_t qp_scaled = kvz_get_scaled_qp(type, state->qp, (encoder->bitdepth - 8) * 6);
   const uint32_t log2_tr_size = kvz_g_convert_to_bit[width] + 2;
   const int32_t scalinglist_type = (block_type == CU_INTRA ? 0 : 3) + (int8_t)("\0\3\1\2"[type]);
   const int32_t *quant_coeff = encoder->scaling_list.quant_coeff[log2_tr_size - 2][scalinglist_type][qp_scaled % 6];
@@ -162,12 +162,130 @@ void kvz_quant_generic(const encoder_state_t * const state, coeff_t *coef, coeff
   }
 }
 
+/**
+ * \brief inverse quantize transformed and quantized coefficents
+ *
+ */
+static void dequant_generic(const encoder_state_t * const state, coeff_t *q_coef, coeff_t *coef, int32_t width, int32_t height,int8_t type, int8_t block_type)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  int32_t shift,add,coeff_q;
+  int32_t n;
+  int32_t transform_shift = 15 - encoder->bitdepth - (kvz_g_convert_to_bit[ width ] + 2);
+
+  int32_t qp_scaled = kvz_get_scaled_qp(type, state->qp, (encoder->bitdepth-8)*6);
+
+  shift = 20 - QUANT_SHIFT - transform_shift;
+
+  if (encoder->scaling_list.enable)
+  {
+    uint32_t log2_tr_size = kvz_g_convert_to_bit[ width ] + 2;
+    int32_t scalinglist_type = (block_type == CU_INTRA ? 0 : 3) + (int8_t)("\0\3\1\2"[type]);
+
+    const int32_t *dequant_coef = encoder->scaling_list.de_quant_coeff[log2_tr_size-2][scalinglist_type][qp_scaled%6];
+    shift += 4;
+
+    if (shift >qp_scaled / 6) {
+      add = 1 << (shift - qp_scaled/6 - 1);
+
+      for (n = 0; n < width * height; n++) {
+        coeff_q = ((q_coef[n] * dequant_coef[n]) + add ) >> (shift -  qp_scaled/6);
+        coef[n] = (coeff_t)CLIP(-32768,32767,coeff_q);
+      }
+    } else {
+      for (n = 0; n < width * height; n++) {
+        // Clip to avoid possible overflow in following shift left operation
+        coeff_q   = CLIP(-32768, 32767, q_coef[n] * dequant_coef[n]);
+        coef[n] = (coeff_t)CLIP(-32768, 32767, coeff_q << (qp_scaled/6 - shift));
+      }
+    }
+  } else {
+    int32_t scale = kvz_g_inv_quant_scales[qp_scaled%6] << (qp_scaled/6);
+    add = 1 << (shift-1);
+
+    for (n = 0; n < width*height; n++) {
+      coeff_q   = (q_coef[n] * scale + add) >> shift;
+      coef[n] = (coeff_t)CLIP(-32768, 32767, coeff_q);
+    }
+  }
+}
+
+/**
+ * \brief transform skip
+ * \param block input data (residual)
+ * \param coeff output data (transform coefficients)
+ * \param block_size width of transform
+ */
+static void transformskip_generic(int8_t bitdepth, int16_t *block, int16_t *coeff, int8_t block_size)
+{
+  uint32_t log2_tr_size =  kvz_g_convert_to_bit[block_size] + 2;
+  int32_t  shift = MAX_TR_DYNAMIC_RANGE - bitdepth - log2_tr_size;
+  int32_t  j,k;
+  for (j = 0; j < block_size; j++) {
+    for(k = 0; k < block_size; k ++) {
+      coeff[j * block_size + k] = block[j * block_size + k] << shift;
+    }
+  }
+}
+
+/**
+ * \brief inverse transform skip
+ * \param block output data (residual)
+ * \param coeff input data (transform coefficients)
+ * \param block_size width of transform
+ */
+static void itransformskip_generic(int8_t bitdepth, int16_t *block, int16_t *coeff, int8_t block_size)
+{
+  uint32_t log2_tr_size =  kvz_g_convert_to_bit[block_size] + 2;
+  int32_t  shift = MAX_TR_DYNAMIC_RANGE - bitdepth - log2_tr_size;
+  int32_t  j,k;
+  int32_t offset;
+  offset = (1 << (shift -1)); // For rounding
+  for ( j = 0; j < block_size; j++ ) {
+    for(k = 0; k < block_size; k ++) {
+      block[j * block_size + k] =  (coeff[j * block_size + k] + offset) >> shift;
+    }
+  }
+}
+
+/**
+ * \brief Find the non-zero coefficients of each 4x4 coefficient group.
+ *
+ * \param coeff      coefficients
+ * \param width      width of the transform block
+ * \param scan_mode  scan type (diag, hor, ver)
+ * \param masks      returns a mask for each coefficient group in raster
+ *                   order, with bit k set if the k:th coefficient of the
+ *                   group in scan order is non-zero
+ */
+static void coeff_group_masks_generic(const coeff_t *coeff, int32_t width, int8_t scan_mode, uint16_t *masks)
+{
+  const uint32_t *scan = kvz_g_sig_last_scan[scan_mode][1];
+  const int32_t num_blk_side = width >> 2;
+
+  for (int32_t cg_y = 0; cg_y < num_blk_side; cg_y++) {
+    for (int32_t cg_x = 0; cg_x < num_blk_side; cg_x++) {
+      const coeff_t *cg_coeff = &coeff[4 * (cg_y * width + cg_x)];
+      uint32_t mask = 0;
+      for (int k = 0; k < 16; k++) {
+        const uint32_t pos = scan[k];
+        mask |= (uint32_t)(cg_coeff[(pos >> 2) * width + (pos & 3)] != 0) << k;
+      }
+      masks[cg_y * num_blk_side + cg_x] = (uint16_t)mask;
+    }
+  }
+}
+
 
 int kvz_strategy_register_quant_generic(void* opaque, uint8_t bitdepth)
 {
   bool success = true;
 
   success &= kvz_strategyselector_register(opaque, "quant", "generic", 0, &kvz_quant_generic);
+  success &= kvz_strategyselector_register(opaque, "dequant", "generic", 0, &dequant_generic);
+  success &= kvz_strategyselector_register(opaque, "transformskip", "generic", 0, &transformskip_generic);
+  success &= kvz_strategyselector_register(opaque, "itransformskip", "generic", 0, &itransformskip_generic);
+  success &= kvz_strategyselector_register(opaque, "coeff_group_masks", "generic", 0, &coeff_group_masks_generic);
 
   return success;
 }
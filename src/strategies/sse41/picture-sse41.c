@@ -90,6 +90,71 @@ static unsigned reg_sad_sse41(const kvz_pixel * const data1, const kvz_pixel * c
   return sad;
 }
 
+
+/**
+ * \brief Calculate SAD of one block against count blocks.
+ *
+ * Each row of the first block is loaded once for all the blocks.
+ */
+static INLINE void reg_sad_multi_sse41(const kvz_pixel * const data1, const kvz_pixel * const * const data2,
+                                       const int count, const int width, const int height,
+                                       const unsigned stride1, const unsigned stride2,
+                                       unsigned * const sad_out)
+{
+  __m128i sums[4];
+  unsigned tails[4];
+  for (int i = 0; i < count; ++i) {
+    sums[i] = _mm_setzero_si128();
+    tails[i] = 0;
+  }
+
+  for (int y = 0; y < height; ++y) {
+    const kvz_pixel *row1 = &data1[y * stride1];
+    const unsigned offset2 = y * stride2;
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+      const __m128i a = _mm_loadu_si128((__m128i const*) &row1[x]);
+      for (int i = 0; i < count; ++i) {
+        const __m128i b = _mm_loadu_si128((__m128i const*) &data2[i][offset2 + x]);
+        sums[i] = _mm_add_epi64(sums[i], _mm_sad_epu8(a, b));
+      }
+    }
+    if (x + 8 <= width) {
+      const __m128i a = _mm_loadl_epi64((__m128i const*) &row1[x]);
+      for (int i = 0; i < count; ++i) {
+        const __m128i b = _mm_loadl_epi64((__m128i const*) &data2[i][offset2 + x]);
+        sums[i] = _mm_add_epi64(sums[i], _mm_sad_epu8(a, b));
+      }
+      x += 8;
+    }
+    for (; x < width; ++x) {
+      for (int i = 0; i < count; ++i) {
+        tails[i] += abs(row1[x] - data2[i][offset2 + x]);
+      }
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    sad_out[i] = _mm_cvtsi128_si32(sums[i]) + _mm_extract_epi32(sums[i], 2) + tails[i];
+  }
+}
+
+static void reg_sad_x3_sse41(const kvz_pixel * const data1, const kvz_pixel * const * const data2,
+                             const int width, const int height,
+                             const unsigned stride1, const unsigned stride2,
+                             unsigned * const sad_out)
+{
+  reg_sad_multi_sse41(data1, data2, 3, width, height, stride1, stride2, sad_out);
+}
+
+static void reg_sad_x4_sse41(const kvz_pixel * const data1, const kvz_pixel * const * const data2,
+                             const int width, const int height,
+                             const unsigned stride1, const unsigned stride2,
+                             unsigned * const sad_out)
+{
+  reg_sad_multi_sse41(data1, data2, 4, width, height, stride1, stride2, sad_out);
+}
+
 #endif //COMPILE_INTEL_SSE41
 
 
@@ -98,6 +163,8 @@ int kvz_strategy_register_picture_sse41(void* opaque, uint8_t bitdepth) {
 #if COMPILE_INTEL_SSE41
   if (bitdepth == 8){
     success &= kvz_strategyselector_register(opaque, "reg_sad", "sse41", 20, &reg_sad_sse41);
+    success &= kvz_strategyselector_register(opaque, "reg_sad_x3", "sse41", 20, &reg_sad_x3_sse41);
+    success &= kvz_strategyselector_register(opaque, "reg_sad_x4", "sse41", 20, &reg_sad_x4_sse41);
   }
 #endif
   return success;
@@ -0,0 +1,184 @@
+/*****************************************************************************
+* This file is part of Kvazaar HEVC encoder.
+*
+* Copyright (C) 2013-2015 Tampere University of Technology and others (see
+* COPYING file).
+*
+* Kvazaar is free software: you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the
+* Free Software Foundation; either version 2.1 of the License, or (at your
+* option) any later version.
+*
+* Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+* WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+* more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+****************************************************************************/
+
+/*
+* \file
+*/
+
+#include <stdlib.h>
+
+#include "quant-sse41.h"
+#include "../generic/quant-generic.h"
+#include "strategyselector.h"
+#include "encoder.h"
+#include "transform.h"
+
+#if COMPILE_INTEL_SSE41
+#include <immintrin.h>
+
+/**
+ * \brief Scale eight coefficients, round and clip them to 16 bits.
+ *
+ * Computes (q_coef * scale + add) >> shift for each coefficient when shift
+ * is positive and clip(q_coef * scale) << -shift otherwise.
+ */
+static INLINE void dequant_8_sse41(const coeff_t *q_coef, coeff_t *coef,
+                                   __m128i v_scale_lo, __m128i v_scale_hi,
+                                   __m128i v_add, int32_t shift)
+{
+  __m128i v_q = _mm_loadu_si128((const __m128i*)q_coef);
+  __m128i v_lo = _mm_mullo_epi32(_mm_cvtepi16_epi32(v_q), v_scale_lo);
+  __m128i v_hi = _mm_mullo_epi32(_mm_cvtepi16_epi32(_mm_srli_si128(v_q, 8)), v_scale_hi);
+
+  if (shift > 0) {
+    v_lo = _mm_srai_epi32(_mm_add_epi32(v_lo, v_add), shift);
+    v_hi = _mm_srai_epi32(_mm_add_epi32(v_hi, v_add), shift);
+  } else {
+    // Clip to avoid possible overflow in following shift left operation
+    const __m128i v_min = _mm_set1_epi32(-32768);
+    const __m128i v_max = _mm_set1_epi32(32767);
+    v_lo = _mm_slli_epi32(_mm_min_epi32(_mm_max_epi32(v_lo, v_min), v_max), -shift);
+    v_hi = _mm_slli_epi32(_mm_min_epi32(_mm_max_epi32(v_hi, v_min), v_max), -shift);
+  }
+
+  // Saturating pack clips to the range of coeff_t.
+  _mm_storeu_si128((__m128i*)coef, _mm_packs_epi32(v_lo, v_hi));
+}
+
+/**
+ * \brief inverse quantize transformed and quantized coefficents
+ *
+ */
+static void dequant_sse41(const encoder_state_t * const state, coeff_t *q_coef, coeff_t *coef, int32_t width, int32_t height, int8_t type, int8_t block_type)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const int32_t transform_shift = 15 - encoder->bitdepth - (kvz_g_convert_to_bit[width] + 2);
+  const int32_t qp_scaled = kvz_get_scaled_qp(type, state->qp, (encoder->bitdepth - 8) * 6);
+  int32_t shift = 20 - QUANT_SHIFT - transform_shift;
+
+  if (encoder->scaling_list.enable) {
+    const uint32_t log2_tr_size = kvz_g_convert_to_bit[width] + 2;
+    const int32_t scalinglist_type = (block_type == CU_INTRA ? 0 : 3) + (int8_t)("\0\3\1\2"[type]);
+    const int32_t *dequant_coef = encoder->scaling_list.de_quant_coeff[log2_tr_size - 2][scalinglist_type][qp_scaled % 6];
+
+    shift += 4 - qp_scaled / 6;
+    const __m128i v_add = _mm_set1_epi32(shift > 0 ? 1 << (shift - 1) : 0);
+
+    for (int32_t n = 0; n < width * height; n += 8) {
+      __m128i v_scale_lo = _mm_loadu_si128((const __m128i*)&dequant_coef[n]);
+      __m128i v_scale_hi = _mm_loadu_si128((const __m128i*)&dequant_coef[n + 4]);
+      dequant_8_sse41(&q_coef[n], &coef[n], v_scale_lo, v_scale_hi, v_add, shift);
+    }
+  } else {
+    const __m128i v_scale = _mm_set1_epi32(kvz_g_inv_quant_scales[qp_scaled % 6] << (qp_scaled / 6));
+    const __m128i v_add = _mm_set1_epi32(1 << (shift - 1));
+
+    for (int32_t n = 0; n < width * height; n += 8) {
+      dequant_8_sse41(&q_coef[n], &coef[n], v_scale, v_scale, v_add, shift);
+    }
+  }
+}
+
+/**
+ * \brief transform skip
+ * \param block input data (residual)
+ * \param coeff output data (transform coefficients)
+ * \param block_size width of transform
+ */
+static void transformskip_sse41(int8_t bitdepth, int16_t *block, int16_t *coeff, int8_t block_size)
+{
+  const int32_t shift = MAX_TR_DYNAMIC_RANGE - bitdepth - (kvz_g_convert_to_bit[block_size] + 2);
+
+  for (int i = 0; i < block_size * block_size; i += 8) {
+    __m128i v_block = _mm_loadu_si128((const __m128i*)&block[i]);
+    _mm_storeu_si128((__m128i*)&coeff[i], _mm_slli_epi16(v_block, shift));
+  }
+}
+
+/**
+ * \brief inverse transform skip
+ * \param block output data (residual)
+ * \param coeff input data (transform coefficients)
+ * \param block_size width of transform
+ */
+static void itransformskip_sse41(int8_t bitdepth, int16_t *block, int16_t *coeff, int8_t block_size)
+{
+  const int32_t shift = MAX_TR_DYNAMIC_RANGE - bitdepth - (kvz_g_convert_to_bit[block_size] + 2);
+  const __m128i v_one = _mm_set1_epi16(1);
+
+  // (coeff + (1 << (shift - 1))) >> shift without overflowing 16 bits: the
+  // rounding adds one when the highest shifted out bit is set.
+  for (int i = 0; i < block_size * block_size; i += 8) {
+    __m128i v_coeff = _mm_loadu_si128((const __m128i*)&coeff[i]);
+    __m128i v_round = _mm_and_si128(_mm_srai_epi16(v_coeff, shift - 1), v_one);
+    __m128i v_block = _mm_add_epi16(_mm_srai_epi16(v_coeff, shift), v_round);
+    _mm_storeu_si128((__m128i*)&block[i], v_block);
+  }
+}
+
+/**
+ * \brief Find the non-zero coefficients of each 4x4 coefficient group.
+ *
+ * The zero flags of a group are packed to bytes in raster order, permuted
+ * to scan order with a shuffle and collected with movemask.
+ */
+static void coeff_group_masks_sse41(const coeff_t *coeff, int32_t width, int8_t scan_mode, uint16_t *masks)
+{
+  // Raster positions of the coefficients of a 4x4 group in scan order.
+  static const int8_t scan_shuffle[3][16] = {
+    { 0, 4, 1, 8, 5, 2, 12, 9, 6, 3, 13, 10, 7, 14, 11, 15 }, // SCAN_DIAG
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }, // SCAN_HOR
+    { 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15 }, // SCAN_VER
+  };
+  const __m128i v_shuffle = _mm_loadu_si128((const __m128i*)scan_shuffle[scan_mode]);
+  const __m128i v_zero = _mm_setzero_si128();
+  const int32_t num_blk_side = width >> 2;
+
+  for (int32_t cg_y = 0; cg_y < num_blk_side; cg_y++) {
+    for (int32_t cg_x = 0; cg_x < num_blk_side; cg_x++) {
+      const coeff_t *cg_coeff = &coeff[4 * (cg_y * width + cg_x)];
+      __m128i v_rows01 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)&cg_coeff[0]),
+                                            _mm_loadl_epi64((const __m128i*)&cg_coeff[width]));
+      __m128i v_rows23 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)&cg_coeff[2 * width]),
+                                            _mm_loadl_epi64((const __m128i*)&cg_coeff[3 * width]));
+      __m128i v_is_zero = _mm_packs_epi16(_mm_cmpeq_epi16(v_rows01, v_zero),
+                                          _mm_cmpeq_epi16(v_rows23, v_zero));
+      v_is_zero = _mm_shuffle_epi8(v_is_zero, v_shuffle);
+      masks[cg_y * num_blk_side + cg_x] = (uint16_t)~_mm_movemask_epi8(v_is_zero);
+    }
+  }
+}
+
+#endif //COMPILE_INTEL_SSE41
+
+
+int kvz_strategy_register_quant_sse41(void* opaque, uint8_t bitdepth)
+{
+  bool success = true;
+
+#if COMPILE_INTEL_SSE41
+  success &= kvz_strategyselector_register(opaque, "dequant", "sse41", 20, &dequant_sse41);
+  success &= kvz_strategyselector_register(opaque, "transformskip", "sse41", 20, &transformskip_sse41);
+  success &= kvz_strategyselector_register(opaque, "itransformskip", "sse41", 20, &itransformskip_sse41);
+  success &= kvz_strategyselector_register(opaque, "coeff_group_masks", "sse41", 20, &coeff_group_masks_sse41);
+#endif //COMPILE_INTEL_SSE41
+
+  return success;
+}
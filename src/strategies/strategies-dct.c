@@ -36,6 +36,9 @@ dct_func * kvz_idct_8x8= 0;
 dct_func * kvz_idct_16x16 = 0;
 dct_func * kvz_idct_32x32 = 0;
 
+dct_func * kvz_partial_idct_32x32_8 = 0;
+dct_func * kvz_partial_idct_32x32_16 = 0;
+
 
 // Headers for platform optimizations.
 #include "generic/dct-generic.h"
@@ -40,6 +40,11 @@ extern dct_func * kvz_idct_8x8;
 extern dct_func * kvz_idct_16x16;
 extern dct_func * kvz_idct_32x32;
 
+// Inverse 32x32 transforms of blocks which only have non-zero coefficients
+// in the top-left 8x8 or 16x16 corner.
+extern dct_func * kvz_partial_idct_32x32_8;
+extern dct_func * kvz_partial_idct_32x32_16;
+
 
 int kvz_strategy_register_dct(void* opaque, uint8_t bitdepth);
 dct_func * kvz_get_dct_func(int8_t width, int32_t mode);
@@ -60,6 +65,9 @@ dct_func * kvz_get_idct_func(int8_t width, int32_t mode);
   {"idct_8x8", (void**)&kvz_idct_8x8}, \
   {"idct_16x16", (void**)&kvz_idct_16x16}, \
   {"idct_32x32", (void**)&kvz_idct_32x32}, \
+  \
+  {"partial_idct_32x32_8", (void**)&kvz_partial_idct_32x32_8}, \
+  {"partial_idct_32x32_16", (void**)&kvz_partial_idct_32x32_16}, \
 
 
 
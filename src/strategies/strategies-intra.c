@@ -23,6 +23,10 @@
 
 // Define function pointers.
 angular_pred_func *kvz_angular_pred;
+intra_pred_planar_func *kvz_intra_pred_planar;
+intra_pred_dc_func *kvz_intra_pred_dc;
+intra_pred_dc_func *kvz_intra_pred_filtered_dc;
+intra_filter_ref_func *kvz_intra_filter_ref;
 
 // Headers for platform optimizations.
 #include "generic/intra-generic.h"
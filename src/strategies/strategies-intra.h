@@ -29,14 +29,41 @@ typedef void (angular_pred_func)(
   const kvz_pixel *const in_ref_left,
   kvz_pixel *const dst);
 
+typedef void (intra_pred_planar_func)(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const dst);
+
+typedef void (intra_pred_dc_func)(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const out_block);
+
+typedef void (intra_filter_ref_func)(
+  const int_fast8_t log2_width,
+  const kvz_pixel *const ref_top,
+  const kvz_pixel *const ref_left,
+  kvz_pixel *const filtered_top,
+  kvz_pixel *const filtered_left);
+
 // Declare function pointers.
 extern angular_pred_func * kvz_angular_pred;
+extern intra_pred_planar_func * kvz_intra_pred_planar;
+extern intra_pred_dc_func * kvz_intra_pred_dc;
+extern intra_pred_dc_func * kvz_intra_pred_filtered_dc;
+extern intra_filter_ref_func * kvz_intra_filter_ref;
 
 int kvz_strategy_register_intra(void* opaque, uint8_t bitdepth);
 
 
 #define STRATEGIES_INTRA_EXPORTS \
   {"angular_pred", (void**) &kvz_angular_pred}, \
+  {"intra_pred_planar", (void**) &kvz_intra_pred_planar}, \
+  {"intra_pred_dc", (void**) &kvz_intra_pred_dc}, \
+  {"intra_pred_filtered_dc", (void**) &kvz_intra_pred_filtered_dc}, \
+  {"intra_filter_ref", (void**) &kvz_intra_filter_ref}, \
 
 
 
@@ -25,7 +25,6 @@
 ipol_func *kvz_filter_inter_quarterpel_luma;
 ipol_func *kvz_filter_inter_halfpel_chroma;
 ipol_func *kvz_filter_inter_octpel_chroma;
-epol_func *kvz_get_extended_block;
 
 // Headers for platform optimizations.
 #include "generic/ipol-generic.h"
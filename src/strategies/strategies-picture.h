@@ -27,10 +27,21 @@ typedef unsigned(reg_sad_func)(const kvz_pixel *const data1, const kvz_pixel *co
   const int width, const int height,
   const unsigned stride1, const unsigned stride2);
 typedef unsigned (cost_pixel_nxn_func)(const kvz_pixel *block1, const kvz_pixel *block2);
+// SAD of one block against several blocks with the same stride.
+typedef void (reg_sad_multi_func)(const kvz_pixel *const data1, const kvz_pixel *const *const data2,
+  const int width, const int height,
+  const unsigned stride1, const unsigned stride2, unsigned *const sad_out);
+// Buffers for predictions of blocks up to 32x32.
+typedef kvz_pixel (*pred_buffer)[32 * 32];
+// SATD of several predictions against the same block.
+typedef void (cost_pixel_nxn_multi_func)(const pred_buffer preds, const kvz_pixel *orig,
+  unsigned num_modes, unsigned *costs_out);
 
 
 // Declare function pointers.
 extern reg_sad_func * kvz_reg_sad;
+extern reg_sad_multi_func * kvz_reg_sad_x3;
+extern reg_sad_multi_func * kvz_reg_sad_x4;
 
 extern cost_pixel_nxn_func * kvz_sad_4x4;
 extern cost_pixel_nxn_func * kvz_sad_8x8;
@@ -44,14 +55,22 @@ extern cost_pixel_nxn_func * kvz_satd_16x16;
 extern cost_pixel_nxn_func * kvz_satd_32x32;
 extern cost_pixel_nxn_func * kvz_satd_64x64;
 
+extern cost_pixel_nxn_multi_func * kvz_satd_4x4_multi;
+extern cost_pixel_nxn_multi_func * kvz_satd_8x8_multi;
+extern cost_pixel_nxn_multi_func * kvz_satd_16x16_multi;
+extern cost_pixel_nxn_multi_func * kvz_satd_32x32_multi;
+
 
 int kvz_strategy_register_picture(void* opaque, uint8_t bitdepth);
 cost_pixel_nxn_func * kvz_pixels_get_satd_func(unsigned n);
 cost_pixel_nxn_func * kvz_pixels_get_sad_func(unsigned n);
+cost_pixel_nxn_multi_func * kvz_pixels_get_satd_multi_func(unsigned n);
 
 
 #define STRATEGIES_PICTURE_EXPORTS \
   {"reg_sad", (void**) &kvz_reg_sad}, \
+  {"reg_sad_x3", (void**) &kvz_reg_sad_x3}, \
+  {"reg_sad_x4", (void**) &kvz_reg_sad_x4}, \
   {"sad_4x4", (void**) &kvz_sad_4x4}, \
   {"sad_8x8", (void**) &kvz_sad_8x8}, \
   {"sad_16x16", (void**) &kvz_sad_16x16}, \
@@ -62,6 +81,10 @@ cost_pixel_nxn_func * kvz_pixels_get_sad_func(unsigned n);
   {"satd_16x16", (void**) &kvz_satd_16x16}, \
   {"satd_32x32", (void**) &kvz_satd_32x32}, \
   {"satd_64x64", (void**) &kvz_satd_64x64}, \
+  {"satd_4x4_multi", (void**) &kvz_satd_4x4_multi}, \
+  {"satd_8x8_multi", (void**) &kvz_satd_8x8_multi}, \
+  {"satd_16x16_multi", (void**) &kvz_satd_16x16_multi}, \
+  {"satd_32x32_multi", (void**) &kvz_satd_32x32_multi}, \
 
 
 
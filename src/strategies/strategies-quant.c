@@ -23,9 +23,14 @@
 
 // Define function pointers.
 quant_func *kvz_quant;
+dequant_func *kvz_dequant;
+transformskip_func *kvz_transformskip;
+transformskip_func *kvz_itransformskip;
+coeff_group_masks_func *kvz_coeff_group_masks;
 
 // Headers for platform optimizations.
 #include "generic/quant-generic.h"
+#include "sse41/quant-sse41.h"
 #include "avx2/quant-avx2.h"
 
 
@@ -34,6 +39,9 @@ int kvz_strategy_register_quant(void* opaque, uint8_t bitdepth) {
 
   success &= kvz_strategy_register_quant_generic(opaque, bitdepth);
 
+  if (kvz_g_hardware_flags.intel_flags.sse41) {
+    success &= kvz_strategy_register_quant_sse41(opaque, bitdepth);
+  }
   if (kvz_g_hardware_flags.intel_flags.avx2) {
     success &= kvz_strategy_register_quant_avx2(opaque, bitdepth);
   }
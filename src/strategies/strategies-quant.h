@@ -25,15 +25,27 @@
 // Declare function pointers.
 typedef unsigned (quant_func)(const encoder_state_t * const state, coeff_t *coef, coeff_t *q_coef, int32_t width,
   int32_t height, int8_t type, int8_t scan_idx, int8_t block_type);
+typedef void (dequant_func)(const encoder_state_t * const state, coeff_t *q_coef, coeff_t *coef, int32_t width,
+  int32_t height, int8_t type, int8_t block_type);
+typedef void (transformskip_func)(int8_t bitdepth, int16_t *block, int16_t *coeff, int8_t block_size);
+typedef void (coeff_group_masks_func)(const coeff_t *coeff, int32_t width, int8_t scan_mode, uint16_t *masks);
 
 // Declare function pointers.
 extern quant_func * kvz_quant;
+extern dequant_func * kvz_dequant;
+extern transformskip_func * kvz_transformskip;
+extern transformskip_func * kvz_itransformskip;
+extern coeff_group_masks_func * kvz_coeff_group_masks;
 
 int kvz_strategy_register_quant(void* opaque, uint8_t bitdepth);
 
 
 #define STRATEGIES_QUANT_EXPORTS \
   {"quant", (void**) &kvz_quant}, \
+  {"dequant", (void**) &kvz_dequant}, \
+  {"transformskip", (void**) &kvz_transformskip}, \
+  {"itransformskip", (void**) &kvz_itransformskip}, \
+  {"coeff_group_masks", (void**) &kvz_coeff_group_masks}, \
 
 
 
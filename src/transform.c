@@ -73,44 +73,6 @@ int32_t kvz_get_scaled_qp(int8_t type, int8_t qp, int8_t qp_offset)
   return qp_scaled;
 }
 
-/**
- * \brief NxN inverse transform (2D)
- * \param coeff input data (transform coefficients)
- * \param block output data (residual)
- * \param block_size input data (width of transform)
- */
-void kvz_transformskip(const encoder_control_t * const encoder, int16_t *block,int16_t *coeff, int8_t block_size)
-{
-  uint32_t log2_tr_size =  kvz_g_convert_to_bit[block_size] + 2;
-  int32_t  shift = MAX_TR_DYNAMIC_RANGE - encoder->bitdepth - log2_tr_size;
-  int32_t  j,k;
-  for (j = 0; j < block_size; j++) {
-    for(k = 0; k < block_size; k ++) {
-      coeff[j * block_size + k] = block[j * block_size + k] << shift;
-    }
-  }
-}
-
-/**
- * \brief inverse transform skip
- * \param coeff input data (transform coefficients)
- * \param block output data (residual)
- * \param block_size width of transform
- */
-void kvz_itransformskip(const encoder_control_t * const encoder, int16_t *block,int16_t *coeff, int8_t block_size)
-{
-  uint32_t log2_tr_size =  kvz_g_convert_to_bit[block_size] + 2;
-  int32_t  shift = MAX_TR_DYNAMIC_RANGE - encoder->bitdepth - log2_tr_size;
-  int32_t  j,k;
-  int32_t offset;
-  offset = (1 << (shift -1)); // For rounding
-  for ( j = 0; j < block_size; j++ ) {
-    for(k = 0; k < block_size; k ++) {
-      block[j * block_size + k] =  (coeff[j * block_size + k] + offset) >> shift;
-    }
-  }
-}
-
 /**
  * \brief forward transform (2D)
  * \param block input residual
@@ -130,51 +92,124 @@ void kvz_itransform2d(const encoder_control_t * const encoder, int16_t *block, i
 }
 
 /**
- * \brief inverse quantize transformed and quantized coefficents
+ * \brief Get the size of the top-left corner of a 32x32 block which contains
+ * all of its non-zero coefficients.
  *
+ * \param masks  coefficient group masks from kvz_coeff_group_masks
+ * \returns 8, 16 or 32
  */
-void kvz_dequant(const encoder_state_t * const state, coeff_t *q_coef, coeff_t *coef, int32_t width, int32_t height,int8_t type, int8_t block_type)
+static int coeff_extent_32x32(const uint16_t *masks)
 {
-  const encoder_control_t * const encoder = state->encoder_control;
-  int32_t shift,add,coeff_q;
-  int32_t n;
-  int32_t transform_shift = 15 - encoder->bitdepth - (kvz_g_convert_to_bit[ width ] + 2);
-
-  int32_t qp_scaled = kvz_get_scaled_qp(type, state->global->QP, (encoder->bitdepth-8)*6);
-
-  shift = 20 - QUANT_SHIFT - transform_shift;
+  // The 8x8 coefficient groups are in raster order.
+  int max_cg = 0;
+  for (int cg_y = 0; cg_y < 8; ++cg_y) {
+    for (int cg_x = 0; cg_x < 8; ++cg_x) {
+      if (masks[cg_y * 8 + cg_x]) max_cg = MAX(max_cg, MAX(cg_x, cg_y));
+    }
+  }
 
-  if (encoder->scaling_list.enable)
-  {
-    uint32_t log2_tr_size = kvz_g_convert_to_bit[ width ] + 2;
-    int32_t scalinglist_type = (block_type == CU_INTRA ? 0 : 3) + (int8_t)("\0\3\1\2"[type]);
+  if (max_cg >= 4) return 32;
+  if (max_cg >= 2) return 16;
+  return 8;
+}
 
-    const int32_t *dequant_coef = encoder->scaling_list.de_quant_coeff[log2_tr_size-2][scalinglist_type][qp_scaled%6];
-    shift += 4;
+/**
+ * \brief Inverse transform of a 32x32 block.
+ *
+ * Most 32x32 blocks only have low frequency coefficients, so the
+ * multiplications with the zeros in the rest of the block are skipped.
+ *
+ * \param masks  coefficient group masks of the quantized coefficients
+ */
+static void itransform2d_32x32(const encoder_control_t * const encoder, int16_t *block, int16_t *coeff,
+                               const uint16_t *masks)
+{
+  switch (coeff_extent_32x32(masks)) {
+    case 8:
+      kvz_partial_idct_32x32_8(encoder->bitdepth, coeff, block);
+      break;
+    case 16:
+      kvz_partial_idct_32x32_16(encoder->bitdepth, coeff, block);
+      break;
+    default:
+      kvz_itransform2d(encoder, block, coeff, 32, 0);
+  }
+}
 
-    if (shift >qp_scaled / 6) {
-      add = 1 << (shift - qp_scaled/6 - 1);
+/**
+ * \brief Check whether a residual is certain to quantize to all zeros.
+ *
+ * Bounds the magnitude of the transform coefficients with the SAD of the
+ * residual. No basis function has a coefficient larger than 90, so no
+ * coefficient can exceed 90 * 90 * SAD scaled by the transform shifts,
+ * plus the rounding of the two stages. The DCT basis functions other than
+ * DC sum to zero, so for them the SAD is taken around the mean, which
+ * makes the bound much tighter for residuals with a DC offset. If even the
+ * largest bound rounds to zero with the largest rounding offset used by
+ * kvz_quant and kvz_rdoq, the transform and quantization can be skipped
+ * without changing the result.
+ *
+ * \param residual    residual block
+ * \param width       transform width
+ * \param type        0 for luma, 2 for chroma
+ * \param use_trskip  whether transform skip is used
+ * \param use_dst     whether the 4x4 DST is used instead of the DCT
+ */
+static bool residual_quantizes_to_zero(const encoder_state_t *const state,
+                                       const int16_t *residual, int width,
+                                       int8_t type, int8_t block_type,
+                                       int use_trskip, int use_dst)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  const int num_pixels = width * width;
+  const int log2_tr_size = kvz_g_convert_to_bit[width] + 2;
+  const int32_t qp_scaled = kvz_get_scaled_qp(type, state->qp, (encoder->bitdepth - 8) * 6);
+  const int32_t scalinglist_type = (block_type == CU_INTRA ? 0 : 3) + (int8_t)("\0\3\1\2"[type]);
+  const int32_t *quant_coeff = encoder->scaling_list.quant_coeff[log2_tr_size - 2][scalinglist_type][qp_scaled % 6];
+  const int32_t transform_shift = MAX_TR_DYNAMIC_RANGE - encoder->bitdepth - log2_tr_size;
+  const int32_t q_bits = QUANT_SHIFT + qp_scaled / 6 + transform_shift;
+  const int64_t max_zero = INT64_C(1) << (q_bits - 1);
+
+  int32_t q = quant_coeff[0];
+  if (encoder->scaling_list.enable) {
+    for (int i = 1; i < num_pixels; ++i) {
+      q = MAX(q, quant_coeff[i]);
+    }
+  }
 
-      for (n = 0; n < width * height; n++) {
-        coeff_q = ((q_coef[n] * dequant_coef[n]) + add ) >> (shift -  qp_scaled/6);
-        coef[n] = (coeff_t)CLIP(-32768,32767,coeff_q);
-      }
-    } else {
-      for (n = 0; n < width * height; n++) {
-        // Clip to avoid possible overflow in following shift left operation
-        coeff_q   = CLIP(-32768, 32767, q_coef[n] * dequant_coef[n]);
-        coef[n] = (coeff_t)CLIP(-32768, 32767, coeff_q << (qp_scaled/6 - shift));
-      }
+  int64_t max_coeff;
+  if (use_trskip) {
+    int32_t max_abs = 0;
+    for (int i = 0; i < num_pixels; ++i) {
+      max_abs = MAX(max_abs, abs(residual[i]));
     }
+    max_coeff = (int64_t)max_abs << transform_shift;
+
   } else {
-    int32_t scale = kvz_g_inv_quant_scales[qp_scaled%6] << (qp_scaled/6);
-    add = 1 << (shift-1);
+    const int shift = 2 * log2_tr_size + 5 + (encoder->bitdepth - 8);
+    int32_t sum = 0;
+    int32_t sad = 0;
+    for (int i = 0; i < num_pixels; ++i) {
+      sum += residual[i];
+      sad += abs(residual[i]);
+    }
+
+    max_coeff = ((90 * 90 * (int64_t)sad) >> shift) + 2;
+    if (!use_dst && max_coeff * q >= max_zero) {
+      const int64_t max_dc = ((64 * 64 * (int64_t)abs(sum)) >> shift) + 2;
+      if (max_dc * q >= max_zero) return false;
 
-    for (n = 0; n < width*height; n++) {
-      coeff_q   = (q_coef[n] * scale + add) >> shift;
-      coef[n] = (coeff_t)CLIP(-32768, 32767, coeff_q);
+      const int32_t mean = (sum + (sum >= 0 ? num_pixels / 2 : -num_pixels / 2)) / num_pixels;
+      int32_t ac_sad = 0;
+      for (int i = 0; i < num_pixels; ++i) {
+        ac_sad += abs(residual[i] - mean);
+      }
+      const int64_t max_ac = ((90 * 90 * (int64_t)ac_sad) >> shift) + 2;
+      max_coeff = MAX(max_dc, max_ac);
     }
   }
+
+  return max_coeff * q < max_zero;
 }
 
 
@@ -204,6 +239,7 @@ int kvz_quantize_residual(encoder_state_t *const state,
   int16_t residual[TR_MAX_WIDTH * TR_MAX_WIDTH];
   coeff_t quant_coeff[TR_MAX_WIDTH * TR_MAX_WIDTH];
   coeff_t coeff[TR_MAX_WIDTH * TR_MAX_WIDTH];
+  uint16_t cg_masks[(TR_MAX_WIDTH / 4) * (TR_MAX_WIDTH / 4)];
 
   int has_coeffs = 0;
 
@@ -220,31 +256,45 @@ int kvz_quantize_residual(encoder_state_t *const state,
     }
   }
   
-  // Transform residual. (residual -> coeff)
-  if (use_trskip) {
-    kvz_transformskip(state->encoder_control, residual, coeff, width);
-  } else {
-    kvz_transform2d(state->encoder_control, residual, coeff, width, (color == COLOR_Y ? 0 : 65535));
-  }
+  if (residual_quantizes_to_zero(state, residual, width, (color == COLOR_Y ? 0 : 2),
+                                 cur_cu->type, use_trskip,
+                                 width == 4 && color == COLOR_Y)) {
+    FILL_ARRAY(quant_coeff, 0, width * width);
 
-  // Quantize coeffs. (coeff -> quant_coeff)
-  if (state->encoder_control->rdoq_enable) {
-    int8_t tr_depth = cur_cu->tr_depth - cur_cu->depth;
-    tr_depth += (cur_cu->part_size == SIZE_NxN ? 1 : 0);
-    kvz_rdoq(state, coeff, quant_coeff, width, width, (color == COLOR_Y ? 0 : 2),
-         scan_order, cur_cu->type, tr_depth);
   } else {
-    kvz_quant(state, coeff, quant_coeff, width, width, (color == COLOR_Y ? 0 : 2),
-          scan_order, cur_cu->type);
-  }
+    // Transform residual. (residual -> coeff)
+    if (use_trskip) {
+      kvz_transformskip(state->encoder_control->bitdepth, residual, coeff, width);
+    } else {
+      kvz_transform2d(state->encoder_control, residual, coeff, width, (color == COLOR_Y ? 0 : 65535));
+    }
 
-  // Check if there are any non-zero coefficients.
-  {
-    int i;
-    for (i = 0; i < width * width; ++i) {
-      if (quant_coeff[i] != 0) {
-        has_coeffs = 1;
-        break;
+    // Quantize coeffs. (coeff -> quant_coeff)
+    if (state->encoder_control->rdoq_enable) {
+      int8_t tr_depth = cur_cu->tr_depth - cur_cu->depth;
+      tr_depth += (cur_cu->part_size == SIZE_NxN ? 1 : 0);
+      kvz_rdoq(state, coeff, quant_coeff, width, width, (color == COLOR_Y ? 0 : 2),
+           scan_order, cur_cu->type, tr_depth);
+    } else {
+      kvz_quant(state, coeff, quant_coeff, width, width, (color == COLOR_Y ? 0 : 2),
+            scan_order, cur_cu->type);
+    }
+
+    // Check if there are any non-zero coefficients. The coefficient group
+    // masks of 32x32 blocks also give the extent of the coefficients for
+    // the inverse transform.
+    if (width == 32) {
+      kvz_coeff_group_masks(quant_coeff, width, scan_order, cg_masks);
+      for (int i = 0; i < 8 * 8; ++i) {
+        has_coeffs |= cg_masks[i] != 0;
+      }
+    } else {
+      int i;
+      for (i = 0; i < width * width; ++i) {
+        if (quant_coeff[i] != 0) {
+          has_coeffs = 1;
+          break;
+        }
       }
     }
   }
@@ -260,7 +310,9 @@ int kvz_quantize_residual(encoder_state_t *const state,
     // Get quantized residual. (quant_coeff -> coeff -> residual)
     kvz_dequant(state, quant_coeff, coeff, width, width, (color == COLOR_Y ? 0 : (color == COLOR_U ? 2 : 3)), cur_cu->type);
     if (use_trskip) {
-      kvz_itransformskip(state->encoder_control, residual, coeff, width);
+      kvz_itransformskip(state->encoder_control->bitdepth, residual, coeff, width);
+    } else if (width == 32) {
+      itransform2d_32x32(state->encoder_control, residual, coeff, cg_masks);
     } else {
       kvz_itransform2d(state->encoder_control, residual, coeff, width, (color == COLOR_Y ? 0 : 65535));
     }
@@ -321,7 +373,7 @@ int kvz_quantize_residual_trskip(
     int has_coeffs;
   } skip, noskip, *best;
 
-  const int bit_cost = (int)(state->global->cur_lambda_cost+0.5);
+  const int bit_cost = (int)(state->lambda+0.5);
   
   noskip.has_coeffs = kvz_quantize_residual(
       state, cur_cu, width, color, scan_order,
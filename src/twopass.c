@@ -0,0 +1,220 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "twopass.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "encoderstate.h"
+
+/*
+ * The statistics file starts with a header:
+ *   "KVZ2", version, width in LCUs, height in LCUs
+ * followed by a record for every picture in coding order:
+ *   frame number, POC, slice type, QP, bits, bits of each LCU in raster scan
+ *
+ * All numbers are 32-bit little endian, except slice type and QP which are
+ * single bytes.
+ */
+static const char STATS_MAGIC[4] = { 'K', 'V', 'Z', '2' };
+#define STATS_VERSION 1
+
+
+static void put_u32(FILE *file, uint32_t value)
+{
+  const uint8_t bytes[4] = {
+    value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24
+  };
+  fwrite(bytes, 1, 4, file);
+}
+
+static int get_u32(FILE *file, uint32_t *value)
+{
+  uint8_t bytes[4];
+  if (fread(bytes, 1, 4, file) != 4) return 0;
+  *value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+  return 1;
+}
+
+
+/**
+ * \brief Read the statistics of the first pass.
+ * \param stats   statistics to fill in
+ * \param file    statistics file
+ * \param encoder encoder control
+ * \return 1 on success, 0 on failure
+ */
+static int read_stats(twopass_stats_t *stats, FILE *file,
+                      const struct encoder_control_t *encoder)
+{
+  char magic[4];
+  uint32_t version, width_in_lcu, height_in_lcu;
+  if (fread(magic, 1, 4, file) != 4 || memcmp(magic, STATS_MAGIC, 4) ||
+      !get_u32(file, &version) || version != STATS_VERSION ||
+      !get_u32(file, &width_in_lcu) || !get_u32(file, &height_in_lcu))
+  {
+    fprintf(stderr, "Invalid statistics file header.\n");
+    return 0;
+  }
+  if (width_in_lcu != encoder->in.width_in_lcu ||
+      height_in_lcu != encoder->in.height_in_lcu)
+  {
+    fprintf(stderr, "The statistics file is for a different resolution.\n");
+    return 0;
+  }
+
+  stats->num_lcus = width_in_lcu * height_in_lcu;
+  const long record_size = 14 + 4 * stats->num_lcus;
+  const long header_end = ftell(file);
+  fseek(file, 0, SEEK_END);
+  const long num_frames = (ftell(file) - header_end) / record_size;
+  fseek(file, header_end, SEEK_SET);
+
+  if (num_frames <= 0) {
+    fprintf(stderr, "The statistics file contains no pictures.\n");
+    return 0;
+  }
+
+  stats->num_frames = num_frames;
+  stats->poc = MALLOC(int32_t, num_frames);
+  stats->frame_bits = MALLOC(uint32_t, num_frames);
+  stats->lcu_bits = MALLOC(uint32_t, num_frames * stats->num_lcus);
+  stats->remaining_bits = MALLOC(uint64_t, num_frames + 1);
+  if (!stats->poc || !stats->frame_bits || !stats->lcu_bits || !stats->remaining_bits) {
+    fprintf(stderr, "Failed to allocate the statistics.\n");
+    return 0;
+  }
+
+  for (int i = 0; i < num_frames; ++i) {
+    uint32_t frame, poc;
+    uint8_t type_and_qp[2];
+    if (!get_u32(file, &frame) || frame != i ||
+        !get_u32(file, &poc) ||
+        fread(type_and_qp, 1, 2, file) != 2 ||
+        !get_u32(file, &stats->frame_bits[i]))
+    {
+      fprintf(stderr, "Invalid statistics for picture %d.\n", i);
+      return 0;
+    }
+    stats->poc[i] = (int32_t)poc;
+    for (int lcu = 0; lcu < stats->num_lcus; ++lcu) {
+      if (!get_u32(file, &stats->lcu_bits[i * stats->num_lcus + lcu])) {
+        fprintf(stderr, "Invalid statistics for picture %d.\n", i);
+        return 0;
+      }
+    }
+  }
+
+  stats->remaining_bits[num_frames] = 0;
+  for (int i = num_frames - 1; i >= 0; --i) {
+    stats->remaining_bits[i] = stats->remaining_bits[i + 1] + stats->frame_bits[i];
+  }
+
+  return 1;
+}
+
+
+/**
+ * \brief Open the statistics file of two-pass encoding.
+ * \param encoder encoder control
+ * \return statistics or NULL on failure
+ *
+ * In the first pass the file is created and the header is written. In the
+ * second pass the whole file is read.
+ */
+twopass_stats_t * kvz_twopass_init(const struct encoder_control_t *encoder)
+{
+  const kvz_config * const cfg = encoder->cfg;
+
+  twopass_stats_t *stats = calloc(1, sizeof(twopass_stats_t));
+  if (!stats) {
+    fprintf(stderr, "Failed to allocate the statistics.\n");
+    return NULL;
+  }
+
+  if (cfg->pass == 1) {
+    stats->file = fopen(cfg->stats_file, "wb");
+    if (!stats->file) {
+      fprintf(stderr, "Could not open statistics file for writing: %s\n", cfg->stats_file);
+      goto init_failed;
+    }
+    fwrite(STATS_MAGIC, 1, 4, stats->file);
+    put_u32(stats->file, STATS_VERSION);
+    put_u32(stats->file, encoder->in.width_in_lcu);
+    put_u32(stats->file, encoder->in.height_in_lcu);
+  } else {
+    FILE *file = fopen(cfg->stats_file, "rb");
+    if (!file) {
+      fprintf(stderr, "Could not open statistics file for reading: %s\n", cfg->stats_file);
+      goto init_failed;
+    }
+    const int ok = read_stats(stats, file, encoder);
+    fclose(file);
+    if (!ok) goto init_failed;
+  }
+
+  return stats;
+
+init_failed:
+  kvz_twopass_free(stats);
+  return NULL;
+}
+
+/**
+ * \brief Close the statistics file and free the statistics.
+ */
+void kvz_twopass_free(twopass_stats_t *stats)
+{
+  if (!stats) return;
+
+  if (stats->file) {
+    fclose(stats->file);
+  }
+  FREE_POINTER(stats->poc);
+  FREE_POINTER(stats->frame_bits);
+  FREE_POINTER(stats->lcu_bits);
+  FREE_POINTER(stats->remaining_bits);
+  free(stats);
+}
+
+/**
+ * \brief Write the statistics of a picture in the first pass.
+ * \param state the main encoder state
+ * \param bits  number of bits in the picture
+ *
+ * Must be called in coding order.
+ */
+void kvz_twopass_write_frame(const encoder_state_t * const state, uint64_t bits)
+{
+  const encoder_control_t * const encoder = state->encoder_control;
+  FILE * const file = encoder->twopass->file;
+
+  put_u32(file, state->global->frame);
+  put_u32(file, (uint32_t)state->global->poc);
+  fputc(state->global->slicetype, file);
+  fputc(state->global->QP, file);
+  put_u32(file, (uint32_t)MIN(bits, UINT32_MAX));
+
+  const int num_lcus = encoder->in.width_in_lcu * encoder->in.height_in_lcu;
+  for (int i = 0; i < num_lcus; ++i) {
+    put_u32(file, state->global->lcu_bits[i]);
+  }
+}
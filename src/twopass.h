@@ -0,0 +1,65 @@
+#ifndef TWOPASS_H_
+#define TWOPASS_H_
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Kvazaar is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+/*
+ * \file
+ * \brief Statistics file of two-pass encoding.
+ */
+
+#include "global.h"
+
+#include <stdio.h>
+
+
+// Forward declare because including the header would lead  to a cyclic
+// dependency.
+struct encoder_control_t;
+struct encoder_state_t;
+
+
+/**
+ * \brief Statistics of the first pass.
+ *
+ * In the first pass only the file is used. In the second pass the
+ * statistics of every picture are read from the file in coding order.
+ */
+typedef struct twopass_stats_t {
+  FILE *file; //!< \brief Statistics file written by the first pass
+
+  int32_t num_frames; //!< \brief Number of pictures in the statistics
+  int32_t num_lcus;   //!< \brief Number of LCUs in a picture
+
+  int32_t *poc;          //!< \brief POC of each picture
+  uint32_t *frame_bits;  //!< \brief Bits of each picture
+  uint32_t *lcu_bits;    //!< \brief Bits of each LCU, num_lcus per picture
+
+  //! Sum of frame_bits from each picture to the end of the sequence.
+  uint64_t *remaining_bits;
+} twopass_stats_t;
+
+
+twopass_stats_t * kvz_twopass_init(const struct encoder_control_t *encoder);
+void kvz_twopass_free(twopass_stats_t *stats);
+
+void kvz_twopass_write_frame(const struct encoder_state_t *state, uint64_t bits);
+
+#endif // TWOPASS_H_
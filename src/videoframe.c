@@ -130,17 +130,19 @@ void kvz_videoframe_compute_psnr(const kvz_picture *const src,
   assert(src->width  == rec->width);
   assert(src->height == rec->height);
 
-  int32_t pixels = src->width * src->height;
-
   for (int32_t c = 0; c < NUM_COLORS; ++c) {
-    int32_t num_pixels = pixels;
-    if (c != COLOR_Y) {
-      num_pixels >>= 2;
-    }
+    const int32_t shift = c == COLOR_Y ? 0 : 1;
+    const int32_t width = src->width >> shift;
+    const int32_t height = src->height >> shift;
+    const int32_t num_pixels = width * height;
     psnr[c] = 0;
-    for (int32_t i = 0; i < num_pixels; ++i) {
-      const int32_t error = src->data[c][i] - rec->data[c][i];
-      psnr[c] += error * error;
+    for (int32_t y = 0; y < height; ++y) {
+      const kvz_pixel *src_row = &src->data[c][y * (src->stride >> shift)];
+      const kvz_pixel *rec_row = &rec->data[c][y * (rec->stride >> shift)];
+      for (int32_t x = 0; x < width; ++x) {
+        const int32_t error = src_row[x] - rec_row[x];
+        psnr[c] += error * error;
+      }
     }
 
     // Avoid division by zero
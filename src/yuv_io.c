@@ -189,16 +189,16 @@ int yuv_io_write(FILE* file,
                 const kvz_picture *img,
                 unsigned output_width, unsigned output_height)
 {
-  const int width = img->width;
+  const int stride = img->stride;
   for (int y = 0; y < output_height; ++y) {
-    fwrite(&img->y[y * width], sizeof(*img->y), output_width, file);
+    fwrite(&img->y[y * stride], sizeof(*img->y), output_width, file);
     // TODO: Check that fwrite succeeded.
   }
   for (int y = 0; y < output_height / 2; ++y) {
-    fwrite(&img->u[y * width / 2], sizeof(*img->u), output_width / 2, file);
+    fwrite(&img->u[y * stride / 2], sizeof(*img->u), output_width / 2, file);
   }
   for (int y = 0; y < output_height / 2; ++y) {
-    fwrite(&img->v[y * width / 2], sizeof(*img->v), output_width / 2, file);
+    fwrite(&img->v[y * stride / 2], sizeof(*img->v), output_width / 2, file);
   }
 
   return 1;
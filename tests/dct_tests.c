@@ -41,6 +41,7 @@ static int16_t * dct_actual_bufs[NUM_TESTS] = { 0 }; // pointers returned by mal
 
 static int16_t dct_result[NUM_SIZES][LCU_WIDTH*LCU_WIDTH] = { { 0 } };
 static int16_t idct_result[NUM_SIZES][LCU_WIDTH*LCU_WIDTH] = { { 0 } };
+static dct_func * idct_32x32_generic = NULL;
 
 static struct test_env_t {
   int log_width; // for selecting dim from bufs
@@ -125,6 +126,9 @@ static void setup_tests()
     {
       idct_generic = strat->fptr;
       idct_generic(KVZ_BIT_DEPTH, dct_bufs[block], idct_result[block]);
+      if (strcmp(strat->type, "idct_32x32") == 0) {
+        idct_32x32_generic = idct_generic;
+      }
       ++block;
     }
   }
@@ -175,6 +179,32 @@ TEST idct(void)
 }
 
 
+// Compare the partial inverse transforms against the full generic one on
+// a block with non-zero coefficients only in the top-left corner.
+TEST partial_idct(void)
+{
+  const int n = (strcmp(test_env.strategy->type, "partial_idct_32x32_8") == 0) ? 8 : 16;
+
+  int16_t coeffs[32 * 32] = { 0 };
+  for (int y = 0; y < n; ++y) {
+    for (int x = 0; x < n; ++x) {
+      coeffs[y * 32 + x] = dct_result[NUM_SIZES - 1][y * 32 + x];
+    }
+  }
+
+  int16_t expected[32 * 32];
+  int16_t test_result[32 * 32];
+  idct_32x32_generic(KVZ_BIT_DEPTH, coeffs, expected);
+  test_env.tested_func(KVZ_BIT_DEPTH, coeffs, test_result);
+
+  for (int i = 0; i < 32 * 32; ++i){
+    ASSERT_EQ(test_result[i], expected[i]);
+  }
+
+  PASS();
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 // TEST FIXTURES
 SUITE(dct_tests)
@@ -239,6 +269,10 @@ SUITE(dct_tests)
     {
       RUN_TEST(idct);
     }
+    else if (strncmp(strategy->type, "partial_idct_", 13) == 0)
+    {
+      RUN_TEST(partial_idct);
+    }
   }
 
   tear_down_tests();
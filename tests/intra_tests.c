@@ -0,0 +1,172 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * Kvazaar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "greatest/greatest.h"
+
+#include "test_strategies.h"
+
+#include "src/strategies/strategies-intra.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////
+// MACROS
+#define NUM_REFS 64
+#define NUM_SIZES 4
+#define LCU_MIN_LOG_W 2
+// Length of the references of a 32x32 block, with some padding for the
+// vector loads.
+#define REF_LENGTH (2 * 32 + 1 + 32)
+
+//////////////////////////////////////////////////////////////////////////
+// GLOBALS
+// Random references. The last pair is all white to test the largest
+// intermediate values.
+static kvz_pixel ref_tops[NUM_REFS][REF_LENGTH];
+static kvz_pixel ref_lefts[NUM_REFS][REF_LENGTH];
+
+static intra_pred_planar_func * planar_generic = NULL;
+static intra_pred_dc_func * dc_generic = NULL;
+static intra_pred_dc_func * filtered_dc_generic = NULL;
+static intra_filter_ref_func * filter_ref_generic = NULL;
+
+static struct test_env_t {
+  void * tested_func;
+  const strategy_t * strategy;
+} test_env;
+
+
+//////////////////////////////////////////////////////////////////////////
+// SETUP, TEARDOWN AND HELPER FUNCTIONS
+static void setup_tests()
+{
+  srand(0);
+  for (int r = 0; r < NUM_REFS - 1; ++r) {
+    for (int i = 0; i < REF_LENGTH; ++i) {
+      ref_tops[r][i] = rand() % 256;
+      ref_lefts[r][i] = rand() % 256;
+    }
+  }
+  memset(ref_tops[NUM_REFS - 1], 255, REF_LENGTH);
+  memset(ref_lefts[NUM_REFS - 1], 255, REF_LENGTH);
+
+  for (int s = 0; s < strategies.count; ++s) {
+    strategy_t *strat = &strategies.strategies[s];
+    if (strcmp(strat->strategy_name, "generic") != 0) continue;
+
+    if (strcmp(strat->type, "intra_pred_planar") == 0) {
+      planar_generic = strat->fptr;
+    } else if (strcmp(strat->type, "intra_pred_dc") == 0) {
+      dc_generic = strat->fptr;
+    } else if (strcmp(strat->type, "intra_pred_filtered_dc") == 0) {
+      filtered_dc_generic = strat->fptr;
+    } else if (strcmp(strat->type, "intra_filter_ref") == 0) {
+      filter_ref_generic = strat->fptr;
+    }
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// TESTS
+TEST intra_pred(void)
+{
+  // Planar, DC and filtered DC have the same signature.
+  intra_pred_dc_func *tested_func = test_env.tested_func;
+  intra_pred_dc_func *generic_func;
+  if (strcmp(test_env.strategy->type, "intra_pred_planar") == 0) {
+    generic_func = planar_generic;
+  } else if (strcmp(test_env.strategy->type, "intra_pred_dc") == 0) {
+    generic_func = dc_generic;
+  } else {
+    generic_func = filtered_dc_generic;
+  }
+
+  kvz_pixel expected[32 * 32];
+  kvz_pixel test_result[32 * 32];
+
+  for (int log_width = LCU_MIN_LOG_W; log_width < LCU_MIN_LOG_W + NUM_SIZES; ++log_width) {
+    const int width = 1 << log_width;
+    for (int r = 0; r < NUM_REFS; ++r) {
+      generic_func(log_width, ref_tops[r], ref_lefts[r], expected);
+      tested_func(log_width, ref_tops[r], ref_lefts[r], test_result);
+
+      for (int i = 0; i < width * width; ++i) {
+        ASSERT_EQ(test_result[i], expected[i]);
+      }
+    }
+  }
+
+  PASS();
+}
+
+TEST intra_filter_ref(void)
+{
+  intra_filter_ref_func *tested_func = test_env.tested_func;
+
+  kvz_pixel expected_top[REF_LENGTH];
+  kvz_pixel expected_left[REF_LENGTH];
+  kvz_pixel test_top[REF_LENGTH];
+  kvz_pixel test_left[REF_LENGTH];
+
+  for (int log_width = LCU_MIN_LOG_W; log_width < LCU_MIN_LOG_W + NUM_SIZES; ++log_width) {
+    const int ref_width = 2 * (1 << log_width) + 1;
+    for (int r = 0; r < NUM_REFS; ++r) {
+      filter_ref_generic(log_width, ref_tops[r], ref_lefts[r], expected_top, expected_left);
+      tested_func(log_width, ref_tops[r], ref_lefts[r], test_top, test_left);
+
+      for (int i = 0; i < ref_width; ++i) {
+        ASSERT_EQ(test_top[i], expected_top[i]);
+        ASSERT_EQ(test_left[i], expected_left[i]);
+      }
+    }
+  }
+
+  PASS();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// TEST FIXTURES
+SUITE(intra_tests)
+{
+  setup_tests();
+
+  // Loop through all strategies picking out the intra prediction ones and
+  // run them through the tests.
+  for (unsigned i = 0; i < strategies.count; ++i) {
+    const strategy_t * strategy = &strategies.strategies[i];
+
+    test_env.tested_func = strategy->fptr;
+    test_env.strategy = strategy;
+
+    // Call different tests depending on type of function.
+    // This allows for selecting a subset of tests with -t parameter.
+    if (strcmp(strategy->type, "intra_pred_planar") == 0 ||
+        strcmp(strategy->type, "intra_pred_dc") == 0 ||
+        strcmp(strategy->type, "intra_pred_filtered_dc") == 0)
+    {
+      RUN_TEST(intra_pred);
+    } else if (strcmp(strategy->type, "intra_filter_ref") == 0) {
+      RUN_TEST(intra_filter_ref);
+    }
+  }
+}
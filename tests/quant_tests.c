@@ -0,0 +1,247 @@
+/*****************************************************************************
+ * This file is part of Kvazaar HEVC encoder.
+ *
+ * Copyright (C) 2013-2015 Tampere University of Technology and others (see
+ * COPYING file).
+ *
+ * Kvazaar is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * Kvazaar is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Kvazaar.  If not, see <http://www.gnu.org/licenses/>.
+ ****************************************************************************/
+
+#include "greatest/greatest.h"
+
+#include "test_strategies.h"
+
+#include "src/encoderstate.h"
+#include "src/scalinglist.h"
+#include "src/strategies/strategies-quant.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////
+// MACROS
+#define NUM_SIZES 4
+#define LCU_MIN_LOG_W 2
+
+//////////////////////////////////////////////////////////////////////////
+// GLOBALS
+// Values in the range of a residual in the first buffer and values
+// covering the whole coefficient range in the second.
+static coeff_t coeff_bufs[2][LCU_WIDTH*LCU_WIDTH];
+
+// Encoders with flat quantization and with scaling lists.
+static encoder_control_t flat_encoder;
+static encoder_control_t scaled_encoder;
+
+static dequant_func * dequant_generic = NULL;
+static transformskip_func * transformskip_generic = NULL;
+static transformskip_func * itransformskip_generic = NULL;
+static coeff_group_masks_func * coeff_group_masks_generic = NULL;
+
+static struct test_env_t {
+  void * tested_func;
+  const strategy_t * strategy;
+} test_env;
+
+
+//////////////////////////////////////////////////////////////////////////
+// SETUP, TEARDOWN AND HELPER FUNCTIONS
+static void init_scaling_list(scaling_list_t *scaling_list)
+{
+  kvz_scalinglist_init(scaling_list);
+  scaling_list->enable = 1;
+
+  for (int size = 0; size < SCALING_LIST_SIZE_NUM; ++size) {
+    for (int list = 0; list < kvz_g_scaling_list_num[size]; ++list) {
+      // The coefficients are allocated in kvz_scalinglist_init.
+      int32_t *coeff = (int32_t*)scaling_list->scaling_list_coeff[size][list];
+      for (int i = 0; i < MIN(MAX_MATRIX_COEF_NUM, kvz_g_scaling_list_size[size]); ++i) {
+        coeff[i] = 4 + (i * 37 + list * 11 + size * 5) % 120;
+      }
+      scaling_list->scaling_list_dc[size][list] = 8 + list * 4;
+    }
+  }
+
+  kvz_scalinglist_process(scaling_list, KVZ_BIT_DEPTH);
+}
+
+static void setup_tests()
+{
+  srand(0);
+  for (int i = 0; i < LCU_WIDTH*LCU_WIDTH; ++i) {
+    coeff_bufs[0][i] = (rand() % 3 == 0) ? rand() % 511 - 255 : 0;
+    coeff_bufs[1][i] = rand() % 65536 - 32768;
+  }
+
+  flat_encoder.bitdepth = KVZ_BIT_DEPTH;
+  kvz_scalinglist_init(&flat_encoder.scaling_list);
+  kvz_scalinglist_process(&flat_encoder.scaling_list, KVZ_BIT_DEPTH);
+
+  scaled_encoder.bitdepth = KVZ_BIT_DEPTH;
+  init_scaling_list(&scaled_encoder.scaling_list);
+
+  for (int s = 0; s < strategies.count; ++s) {
+    strategy_t *strat = &strategies.strategies[s];
+    if (strcmp(strat->strategy_name, "generic") != 0) continue;
+
+    if (strcmp(strat->type, "dequant") == 0) {
+      dequant_generic = strat->fptr;
+    } else if (strcmp(strat->type, "transformskip") == 0) {
+      transformskip_generic = strat->fptr;
+    } else if (strcmp(strat->type, "itransformskip") == 0) {
+      itransformskip_generic = strat->fptr;
+    } else if (strcmp(strat->type, "coeff_group_masks") == 0) {
+      coeff_group_masks_generic = strat->fptr;
+    }
+  }
+}
+
+static void tear_down_tests()
+{
+  kvz_scalinglist_destroy(&flat_encoder.scaling_list);
+  kvz_scalinglist_destroy(&scaled_encoder.scaling_list);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// TESTS
+TEST dequant(void)
+{
+  dequant_func *tested_func = test_env.tested_func;
+  const encoder_control_t *encoders[2] = { &flat_encoder, &scaled_encoder };
+  // Luma, U and V as passed by kvz_quantize_residual. 32x32 blocks are only
+  // used for luma.
+  const int8_t types[3] = { 0, 2, 3 };
+  const int8_t block_types[2] = { CU_INTRA, CU_INTER };
+
+  coeff_t expected[LCU_WIDTH*LCU_WIDTH];
+  coeff_t test_result[LCU_WIDTH*LCU_WIDTH];
+
+  for (int e = 0; e < 2; ++e) {
+    encoder_state_t state;
+    FILL(state, 0);
+    state.encoder_control = encoders[e];
+
+    for (int log_width = LCU_MIN_LOG_W; log_width < LCU_MIN_LOG_W + NUM_SIZES; ++log_width) {
+      const int width = 1 << log_width;
+      for (int t = 0; t < (width == 32 ? 1 : 3); ++t) {
+        for (int b = 0; b < 2; ++b) {
+          // High QPs make the shift of the scaling list path negative.
+          for (int qp = 0; qp <= 51; ++qp) {
+            state.qp = qp;
+            for (int buf = 0; buf < 2; ++buf) {
+              dequant_generic(&state, coeff_bufs[buf], expected, width, width, types[t], block_types[b]);
+              tested_func(&state, coeff_bufs[buf], test_result, width, width, types[t], block_types[b]);
+
+              for (int i = 0; i < width * width; ++i) {
+                ASSERT_EQ(test_result[i], expected[i]);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  PASS();
+}
+
+TEST transformskip(void)
+{
+  transformskip_func *tested_func = test_env.tested_func;
+  const bool inverse = strcmp(test_env.strategy->type, "itransformskip") == 0;
+  transformskip_func *generic_func = inverse ? itransformskip_generic : transformskip_generic;
+
+  int16_t expected[LCU_WIDTH*LCU_WIDTH];
+  int16_t test_result[LCU_WIDTH*LCU_WIDTH];
+
+  for (int log_width = LCU_MIN_LOG_W; log_width < LCU_MIN_LOG_W + NUM_SIZES; ++log_width) {
+    const int width = 1 << log_width;
+    // Only the inverse gets coefficients that do not fit a residual.
+    for (int buf = 0; buf < (inverse ? 2 : 1); ++buf) {
+      // The inverse reads the coefficients from the last argument.
+      if (inverse) {
+        generic_func(KVZ_BIT_DEPTH, expected, coeff_bufs[buf], width);
+        tested_func(KVZ_BIT_DEPTH, test_result, coeff_bufs[buf], width);
+      } else {
+        generic_func(KVZ_BIT_DEPTH, coeff_bufs[buf], expected, width);
+        tested_func(KVZ_BIT_DEPTH, coeff_bufs[buf], test_result, width);
+      }
+
+      for (int i = 0; i < width * width; ++i) {
+        ASSERT_EQ(test_result[i], expected[i]);
+      }
+    }
+  }
+
+  PASS();
+}
+
+
+TEST coeff_group_masks(void)
+{
+  coeff_group_masks_func *tested_func = test_env.tested_func;
+
+  uint16_t expected[(LCU_WIDTH / 4) * (LCU_WIDTH / 4)];
+  uint16_t test_result[(LCU_WIDTH / 4) * (LCU_WIDTH / 4)];
+
+  // Diagonal, horizontal and vertical scans.
+  for (int8_t scan_mode = 0; scan_mode < 3; ++scan_mode) {
+    for (int log_width = LCU_MIN_LOG_W; log_width < LCU_MIN_LOG_W + NUM_SIZES; ++log_width) {
+      const int width = 1 << log_width;
+      const int num_groups = (width / 4) * (width / 4);
+      for (int buf = 0; buf < 2; ++buf) {
+        coeff_group_masks_generic(coeff_bufs[buf], width, scan_mode, expected);
+        tested_func(coeff_bufs[buf], width, scan_mode, test_result);
+
+        for (int i = 0; i < num_groups; ++i) {
+          ASSERT_EQ(test_result[i], expected[i]);
+        }
+      }
+    }
+  }
+
+  PASS();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// TEST FIXTURES
+SUITE(quant_tests)
+{
+  setup_tests();
+
+  // Loop through all strategies picking out the quantization ones and run
+  // them through the tests.
+  for (unsigned i = 0; i < strategies.count; ++i) {
+    const strategy_t * strategy = &strategies.strategies[i];
+
+    test_env.tested_func = strategy->fptr;
+    test_env.strategy = strategy;
+
+    // Call different tests depending on type of function.
+    // This allows for selecting a subset of tests with -t parameter.
+    if (strcmp(strategy->type, "dequant") == 0) {
+      RUN_TEST(dequant);
+    } else if (strcmp(strategy->type, "transformskip") == 0 ||
+               strcmp(strategy->type, "itransformskip") == 0)
+    {
+      RUN_TEST(transformskip);
+    } else if (strcmp(strategy->type, "coeff_group_masks") == 0) {
+      RUN_TEST(coeff_group_masks);
+    }
+  }
+
+  tear_down_tests();
+}
@@ -69,10 +69,13 @@ static void setup_tests()
     g_pic->y[i] = pic_data[i] + 48;
   }
 
-  g_ref = kvz_image_alloc(8, 8);
-  for (int i = 0; i < 64; ++i) {
-    g_ref->y[i] = ref_data[i] + 48;
+  g_ref = kvz_image_alloc_padded(8, 8, FRAME_PADDING_LUMA);
+  for (int y = 0; y < 8; ++y) {
+    for (int x = 0; x < 8; ++x) {
+      g_ref->y[y * g_ref->stride + x] = ref_data[y * 8 + x] + 48;
+    }
   }
+  kvz_image_extend_borders(g_ref, FRAME_PADDING_LUMA, 0, 8);
 }
 
 static void tear_down_tests()
@@ -225,6 +228,32 @@ TEST test_bottomright_out(void)
 }
 
 
+//////////////////////////////////////////////////////////////////////////
+// MULTIPLE POSITION TESTS
+static reg_sad_multi_func *g_reg_sad_multi = NULL;
+static int g_reg_sad_multi_count = 0;
+
+TEST test_multi(void)
+{
+  // Positions both inside and outside the frame.
+  static const int ref_x[4] = { -3, 0, 3, DIST };
+  static const int ref_y[4] = { -DIST, 3, 0, -3 };
+
+  const kvz_pixel *ref_blocks[4];
+  for (int i = 0; i < g_reg_sad_multi_count; ++i) {
+    ref_blocks[i] = &g_ref->y[ref_y[i] * g_ref->stride + ref_x[i]];
+  }
+
+  unsigned sads[4];
+  g_reg_sad_multi(g_pic->y, ref_blocks, 8, 8, g_pic->stride, g_ref->stride, sads);
+
+  for (int i = 0; i < g_reg_sad_multi_count; ++i) {
+    ASSERT_EQ(TEST_SAD(ref_x[i], ref_y[i]), sads[i]);
+  }
+  PASS();
+}
+
+
 struct sad_test_env_t {
   kvz_picture *g_pic;
   kvz_picture *g_ref;
@@ -273,6 +302,19 @@ SUITE(sad_tests)
     RUN_TEST(test_bottom_out);
     RUN_TEST(test_bottomright_out);
   }
+
+  for (unsigned i = 0; i < strategies.count; ++i) {
+    if (strcmp(strategies.strategies[i].type, "reg_sad_x3") == 0) {
+      g_reg_sad_multi_count = 3;
+    } else if (strcmp(strategies.strategies[i].type, "reg_sad_x4") == 0) {
+      g_reg_sad_multi_count = 4;
+    } else {
+      continue;
+    }
+    g_reg_sad_multi = strategies.strategies[i].fptr;
+
+    RUN_TEST(test_multi);
+  }
   
   tear_down_tests();
 }
@@ -159,6 +159,37 @@ TEST satd_test_gradient(void)
   PASS();
 }
 
+//////////////////////////////////////////////////////////////////////////
+// MULTIPLE PREDICTION TESTS
+static cost_pixel_nxn_multi_func *g_satd_multi = NULL;
+
+TEST satd_test_multi(void)
+{
+  const int satd_results[4] = {2040, 4080, 16320, 65280};
+
+  const int test = 0;
+  const int log_width = satd_test_env.log_width;
+  const unsigned size = 1 << (log_width * 2);
+
+  kvz_pixel * black = satd_bufs[test][log_width][0];
+  kvz_pixel * white = satd_bufs[test][log_width][1];
+
+  // An odd number of predictions to test the last one being unpaired.
+  kvz_pixel preds[3][32 * 32];
+  memcpy(preds[0], white, size * sizeof(kvz_pixel));
+  memcpy(preds[1], black, size * sizeof(kvz_pixel));
+  memcpy(preds[2], white, size * sizeof(kvz_pixel));
+
+  unsigned costs[3];
+  g_satd_multi(preds, black, 3, costs);
+
+  ASSERT_EQ(costs[0], satd_results[log_width - 2]);
+  ASSERT_EQ(costs[1], 0);
+  ASSERT_EQ(costs[2], satd_results[log_width - 2]);
+
+  PASS();
+}
+
 //////////////////////////////////////////////////////////////////////////
 // TEST FIXTURES
 SUITE(satd_tests)
@@ -197,5 +228,29 @@ SUITE(satd_tests)
     RUN_TEST(satd_test_gradient);
   }
 
+  for (unsigned i = 0; i < strategies.count; ++i) {
+    const char * type = strategies.strategies[i].type;
+
+    if (strcmp(type, "satd_4x4_multi") == 0) {
+      satd_test_env.log_width = 2;
+    }
+    else if (strcmp(type, "satd_8x8_multi") == 0) {
+      satd_test_env.log_width = 3;
+    }
+    else if (strcmp(type, "satd_16x16_multi") == 0) {
+      satd_test_env.log_width = 4;
+    }
+    else if (strcmp(type, "satd_32x32_multi") == 0) {
+      satd_test_env.log_width = 5;
+    }
+    else {
+      continue;
+    }
+
+    g_satd_multi = strategies.strategies[i].fptr;
+
+    RUN_TEST(satd_test_multi);
+  }
+
   satd_tear_down_tests();
 }
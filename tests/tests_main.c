@@ -28,6 +28,8 @@ extern SUITE(intra_sad_tests);
 extern SUITE(satd_tests);
 extern SUITE(speed_tests);
 extern SUITE(dct_tests);
+extern SUITE(quant_tests);
+extern SUITE(intra_tests);
 #endif //KVZ_BIT_DEPTH == 8
 
 int main(int argc, char **argv)
@@ -40,6 +42,8 @@ int main(int argc, char **argv)
   RUN_SUITE(intra_sad_tests);
   RUN_SUITE(satd_tests);
   RUN_SUITE(dct_tests);
+  RUN_SUITE(quant_tests);
+  RUN_SUITE(intra_tests);
 
   if (greatest_info.suite_filter &&
       greatest_name_match("speed", greatest_info.suite_filter))